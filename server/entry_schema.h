@@ -0,0 +1,113 @@
+#ifndef DCPROF_ENTRY_SCHEMA_H
+#define DCPROF_ENTRY_SCHEMA_H
+
+/* the layout of every XXX_entry, declared once. Each field is
+     X(entry type, name, kind, length, column, default, help)
+   where kind is one of
+     INT  : a PetscInt
+     IP   : a PetscInt holding the IP version. When parsing, tokens that are not a
+            number are the rest of a process name with spaces, and are appended
+            to the entry's comm field
+     REAL : a PetscReal
+     STR  : a char array of the given length
+     ADDR : a char array of the given length holding an IPv4 or IPv6 address; when
+            parsing, the entry's ip field must be on an earlier column
+   length is 1 for numbers, column is the position of the field in a line of the
+   tool's output (only used by generated parsers), and default and help are what
+   the field is registered in the entry's PetscBag with.
+
+   From these lists petsc_webserver.h declares the structs (in list order), and
+   petsc_webserver.c generates create_XXX_entry_bag(), the MPI datatype registered
+   by register_mpi_types() and, for the tools whose output is a fixed sequence of
+   columns (tcpaccept, tcpconnect, tcpconnlat and tcplife), XXX_entry_parse_line().
+   A new field or event type only needs a line or a list here. */
+
+#define TCPACCEPT_ENTRY_FIELDS(X,T)					\
+  X(T,pid,  INT, 1,              0,-1,        "Process ID that accepted the connection") \
+  X(T,ip,   IP,  1,              2,4,         "IP address version")	\
+  X(T,rport,INT, 1,              4,0,         "Remote port")		\
+  X(T,lport,INT, 1,              6,0,         "Local port")		\
+  X(T,laddr,ADDR,IP_ADDR_MAX_LEN,5,"0.0.0.0", "Local IP address")	\
+  X(T,raddr,ADDR,IP_ADDR_MAX_LEN,3,"0.0.0.0", "Remote IP address")	\
+  X(T,comm, STR, COMM_MAX_LEN,   1,"[unknown]","Process name")
+
+#define TCPCONNECT_ENTRY_FIELDS(X,T)					\
+  X(T,pid,  INT, 1,              0,-1,        "Process ID that requested the connection") \
+  X(T,ip,   IP,  1,              2,4,         "IP address version")	\
+  X(T,dport,INT, 1,              5,0,         "Destination port")	\
+  X(T,saddr,ADDR,IP_ADDR_MAX_LEN,3,"0.0.0.0", "Source IP address")	\
+  X(T,daddr,ADDR,IP_ADDR_MAX_LEN,4,"0.0.0.0", "Destination IP address") \
+  X(T,comm, STR, COMM_MAX_LEN,   1,"[unknown]","Process name")
+
+#define TCPCONNLAT_ENTRY_FIELDS(X,T)					\
+  X(T,pid,   INT, 1,              0,-1,        "Process ID that requested the connection") \
+  X(T,ip,    IP,  1,              2,4,         "IP address version")	\
+  X(T,dport, INT, 1,              5,0,         "Destination port")	\
+  X(T,lat_ms,REAL,1,              6,0.,        "Connection latency in milliseconds") \
+  X(T,saddr, ADDR,IP_ADDR_MAX_LEN,3,"0.0.0.0", "Source IP address")	\
+  X(T,daddr, ADDR,IP_ADDR_MAX_LEN,4,"0.0.0.0", "Destination IP address") \
+  X(T,comm,  STR, COMM_MAX_LEN,   1,"[unknown]","Process name")
+
+#define TCPLIFE_ENTRY_FIELDS(X,T)					\
+  X(T,pid,  INT, 1,              0,-1,        "Process ID that owned the connection") \
+  X(T,ip,   IP,  1,              2,4,         "IP address version")	\
+  X(T,lport,INT, 1,              4,0,         "Local port")		\
+  X(T,rport,INT, 1,              6,0,         "Remote port")		\
+  X(T,tx_kb,INT, 1,              7,0,         "Transmitted kB")		\
+  X(T,rx_kb,INT, 1,              8,0,         "Received kB")		\
+  X(T,ms,   REAL,1,              9,0.,        "Lifetime of the connection in milliseconds") \
+  X(T,laddr,ADDR,IP_ADDR_MAX_LEN,3,"0.0.0.0", "Local IP address")	\
+  X(T,raddr,ADDR,IP_ADDR_MAX_LEN,5,"0.0.0.0", "Remote IP address")	\
+  X(T,comm, STR, COMM_MAX_LEN,   1,"[unknown]","Process name")
+
+/* the remaining tools' output needs hand-written parsers, so their columns are -1 */
+#define TCPRETRANS_ENTRY_FIELDS(X,T)					\
+  X(T,pid,       INT,1,           -1,-1,         "Process ID that owned the connection") \
+  X(T,ip,        IP, 1,           -1,4,          "IP address version") \
+  X(T,tlp,       INT,1,           -1,0,          "1 for a tail loss probe (L>), 0 for a retransmit (R>)") \
+  X(T,laddr_port,STR,COMM_MAX_LEN,-1,"0.0.0.0:0","Local IP_address:tcp_port") \
+  X(T,raddr_port,STR,COMM_MAX_LEN,-1,"0.0.0.0:0","Remote IP_address:tcp_port") \
+  X(T,state,     STR,COMM_MAX_LEN,-1,"[unknown]","TCP session state")
+
+#define TCPSTATES_ENTRY_FIELDS(X,T)					\
+  X(T,pid,     INT, 1,              -1,-1,        "Process ID that owned the socket") \
+  X(T,ip,      IP,  1,              -1,4,         "IP address version") \
+  X(T,lport,   INT, 1,              -1,0,         "Local port")	\
+  X(T,rport,   INT, 1,              -1,0,         "Remote port")	\
+  X(T,oldstate,INT, 1,              -1,0,         "TCP state left, a number into TcpStates") \
+  X(T,newstate,INT, 1,              -1,0,         "TCP state entered, a number into TcpStates") \
+  X(T,ms,      REAL,1,              -1,0.,        "Milliseconds spent in the old state") \
+  X(T,laddr,   ADDR,IP_ADDR_MAX_LEN,-1,"0.0.0.0", "Local IP address") \
+  X(T,raddr,   ADDR,IP_ADDR_MAX_LEN,-1,"0.0.0.0", "Remote IP address") \
+  X(T,comm,    STR, COMM_MAX_LEN,   -1,"[unknown]","Process name")
+
+/* unit_us and section are parser state carried between the lines of a histogram */
+#define TCPRTT_ENTRY_FIELDS(X,T)					\
+  X(T,pid,    INT, 1,              -1,0,    "Process ID the samples are credited to; tcprtt does not see processes, so 0") \
+  X(T,bin,    INT, 1,              -1,0,    "The TCP_RTT_HIST_BINS log2 microsecond bucket of the row") \
+  X(T,count,  INT, 1,              -1,0,    "Number of RTT samples in the row") \
+  X(T,lo_us,  REAL,1,              -1,0.,   "Lower bound of the row in microseconds") \
+  X(T,hi_us,  REAL,1,              -1,0.,   "Upper bound of the row in microseconds") \
+  X(T,unit_us,REAL,1,              -1,1.,   "Microseconds per histogram unit, 1 for usecs and 1000 for msecs") \
+  X(T,section,STR, IP_ADDR_MAX_LEN,-1,"all","Address or port of a -b/-B/-d/-D histogram, all otherwise")
+
+#define TCPDROP_ENTRY_FIELDS(X,T)					\
+  X(T,pid,  INT, 1,              -1,-1,        "Process ID running when the packet was dropped") \
+  X(T,ip,   IP,  1,              -1,4,         "IP address version")	\
+  X(T,lport,INT, 1,              -1,0,         "Local port")		\
+  X(T,rport,INT, 1,              -1,0,         "Remote port")		\
+  X(T,laddr,ADDR,IP_ADDR_MAX_LEN,-1,"0.0.0.0", "Local IP address")	\
+  X(T,raddr,ADDR,IP_ADDR_MAX_LEN,-1,"0.0.0.0", "Remote IP address")	\
+  X(T,state,STR, TCP_STATE_LEN,  -1,"[unknown]","TCP session state")	\
+  X(T,flags,STR, TCP_FLAGS_LEN,  -1,"",        "TCP flags of the dropped packet")
+
+/* declares the struct T with the fields in the list FIELDS */
+#define ENTRY_DECLARE_INT(name,len)  PetscInt  name;
+#define ENTRY_DECLARE_IP(name,len)   PetscInt  name;
+#define ENTRY_DECLARE_REAL(name,len) PetscReal name;
+#define ENTRY_DECLARE_STR(name,len)  char      name[len];
+#define ENTRY_DECLARE_ADDR(name,len) char      name[len];
+#define ENTRY_FIELD_DECLARE(T,name,kind,len,col,def,help) ENTRY_DECLARE_##kind(name,len)
+#define ENTRY_STRUCT(T,FIELDS) typedef struct { FIELDS(ENTRY_FIELD_DECLARE,T) } T
+
+#endif
@@ -0,0 +1,493 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "event_filter.h"
+#include <ctype.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <arpa/inet.h>
+
+/* what the filter program looks at; built on the stack for every event */
+typedef struct {
+  PetscInt      pid,ip,lport,rport;  /* -1 if the tool does not report them */
+  const char    *comm,*raddr;        /* NULL if the tool does not report them */
+  const uint8_t *raddr_bin;          /* the binary remote address, once known */
+  uint8_t       addr[16];
+  PetscBool     addr_parsed;
+} event_filter_fields;
+
+typedef struct {
+  const char   *str;
+  size_t       pos;
+  event_filter *filter;
+} event_filter_parser;
+
+static PetscErrorCode event_filter_parse_or(event_filter_parser *);
+
+static PetscErrorCode event_filter_emit(event_filter_parser *p, EventFilterOp op, PetscInt lo, PetscInt hi, PetscInt arg, PetscInt *index)
+{
+  event_filter_insn *insn;
+  PetscFunctionBeginUser;
+  if (p->filter->ninsns == EVENT_FILTER_MAX_INSNS) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"Filter %s compiles to more than %D instructions\n",p->str,EVENT_FILTER_MAX_INSNS);
+  }
+  if (index) {
+    *index = p->filter->ninsns;
+  }
+  insn = &p->filter->insns[p->filter->ninsns++];
+  insn->op = op;
+  insn->lo = lo;
+  insn->hi = hi;
+  insn->arg = arg;
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode event_filter_new_arg(event_filter_parser *p, PetscInt *arg)
+{
+  PetscFunctionBeginUser;
+  if (p->filter->nargs == EVENT_FILTER_MAX_ARGS) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"Filter %s has more than %D comm and raddr predicates\n",p->str,EVENT_FILTER_MAX_ARGS);
+  }
+  *arg = p->filter->nargs++;
+  PetscFunctionReturn(0);
+}
+
+static void event_filter_skip_space(event_filter_parser *p)
+{
+  while (isspace((unsigned char)p->str[p->pos])) {
+    ++(p->pos);
+  }
+}
+
+static PetscBool event_filter_is_word_char(char c)
+{
+  return (PetscBool)(isalnum((unsigned char)c) || c == '_');
+}
+
+/* consumes the token in the second parameter if it comes next. Keywords must not
+   be followed by another word character, so e.g. "order" is not "or" */
+static PetscBool event_filter_accept(event_filter_parser *p, const char *tok)
+{
+  size_t len = strlen(tok);
+  event_filter_skip_space(p);
+  if (strncmp(p->str+p->pos,tok,len)) {
+    return PETSC_FALSE;
+  }
+  if (event_filter_is_word_char(tok[0]) && event_filter_is_word_char(p->str[p->pos+len])) {
+    return PETSC_FALSE;
+  }
+  p->pos += len;
+  return PETSC_TRUE;
+}
+
+/* parses N or N-M */
+static PetscErrorCode event_filter_parse_range(event_filter_parser *p, const char *value, PetscInt *lo, PetscInt *hi)
+{
+  char *end;
+  PetscFunctionBeginUser;
+  *lo = *hi = (PetscInt)strtol(value,&end,10);
+  if (end != value && *end == '-') {
+    value = end + 1;
+    *hi = (PetscInt)strtol(value,&end,10);
+  }
+  if (end == value || *end || *hi < *lo) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"%s is not a number or a range N-M in filter %s\n",value,p->str);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* the comm patterns the bcc tools' short names usually need, an exact name or a prefix,
+   are compiled to a compare; anything else goes to fnmatch() */
+static PetscErrorCode event_filter_compile_comm(event_filter_parser *p, const char *value)
+{
+  PetscErrorCode ierr;
+  PetscInt       arg;
+  size_t         len,wild;
+  PetscFunctionBeginUser;
+  len = strlen(value);
+  if (len >= EVENT_FILTER_PATTERN_LEN) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"comm pattern %s in filter %s is too long\n",value,p->str);
+  }
+  ierr = event_filter_new_arg(p,&arg);CHKERRQ(ierr);
+  ierr = PetscStrncpy(p->filter->patterns[arg],value,EVENT_FILTER_PATTERN_LEN);CHKERRQ(ierr);
+  wild = strcspn(value,"*?[\\");
+  if (wild == len) {
+    ierr = event_filter_emit(p,EVENT_FILTER_COMM_EQ,0,0,arg,NULL);CHKERRQ(ierr);
+  } else if (wild == len-1 && value[wild] == '*') {
+    ierr = event_filter_emit(p,EVENT_FILTER_COMM_PREFIX,(PetscInt)wild,0,arg,NULL);CHKERRQ(ierr);
+  } else {
+    ierr = event_filter_emit(p,EVENT_FILTER_COMM_GLOB,0,0,arg,NULL);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* parses ADDR or ADDR/N */
+static PetscErrorCode event_filter_compile_raddr(event_filter_parser *p, char *value)
+{
+  PetscErrorCode ierr;
+  PetscInt       arg,ip,bits;
+  char           *slash,*end;
+  PetscFunctionBeginUser;
+  ierr = event_filter_new_arg(p,&arg);CHKERRQ(ierr);
+  slash = strchr(value,'/');
+  if (slash) {
+    *slash = '\0';
+  }
+  if (inet_pton(AF_INET,value,p->filter->nets[arg]) == 1) {
+    ip = 4;
+  } else if (inet_pton(AF_INET6,value,p->filter->nets[arg]) == 1) {
+    ip = 6;
+  } else {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"%s is not an IPv4 or IPv6 address in filter %s\n",value,p->str);
+  }
+  bits = ip == 4 ? 32 : 128;
+  if (slash) {
+    bits = (PetscInt)strtol(slash+1,&end,10);
+    if (end == slash+1 || *end || bits < 0 || bits > (ip == 4 ? 32 : 128)) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Bad prefix length /%s in filter %s\n",slash+1,p->str);
+    }
+  }
+  ierr = event_filter_emit(p,EVENT_FILTER_RADDR,ip,bits,arg,NULL);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode event_filter_parse_predicate(event_filter_parser *p)
+{
+  PetscErrorCode ierr;
+  char           field[16],value[EVENT_FILTER_MAX_LEN];
+  size_t         start,len;
+  PetscInt       lo,hi;
+  PetscBool      negate;
+  PetscFunctionBeginUser;
+  event_filter_skip_space(p);
+  start = p->pos;
+  while (event_filter_is_word_char(p->str[p->pos])) {
+    ++(p->pos);
+  }
+  len = p->pos - start;
+  if (!len || len >= sizeof(field)) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Expected a field name at position %D of filter %s\n",(PetscInt)start,p->str);
+  }
+  ierr = PetscMemcpy(field,p->str+start,len);CHKERRQ(ierr);
+  field[len] = '\0';
+  event_filter_skip_space(p);
+  if (event_filter_accept(p,"!=")) {
+    negate = PETSC_TRUE;
+  } else if (event_filter_accept(p,"=")) {
+    negate = PETSC_FALSE;
+  } else {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Expected = or != after %s in filter %s\n",field,p->str);
+  }
+  event_filter_skip_space(p);
+  start = p->pos;
+  while (p->str[p->pos] && !isspace((unsigned char)p->str[p->pos]) && !strchr("()&|,",p->str[p->pos])) {
+    ++(p->pos);
+  }
+  len = p->pos - start;
+  if (!len) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Expected a value for %s in filter %s\n",field,p->str);
+  }
+  ierr = PetscMemcpy(value,p->str+start,len);CHKERRQ(ierr);
+  value[len] = '\0';
+
+  if (!strcmp(field,"comm")) {
+    ierr = event_filter_compile_comm(p,value);CHKERRQ(ierr);
+  } else if (!strcmp(field,"raddr")) {
+    ierr = event_filter_compile_raddr(p,value);CHKERRQ(ierr);
+  } else if (!strcmp(field,"ip")) {
+    if (strcmp(value,"4") && strcmp(value,"6")) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"ip must be 4 or 6, not %s, in filter %s\n",value,p->str);
+    }
+    lo = atoi(value);
+    ierr = event_filter_emit(p,EVENT_FILTER_IP,lo,lo,0,NULL);CHKERRQ(ierr);
+  } else {
+    ierr = event_filter_parse_range(p,value,&lo,&hi);CHKERRQ(ierr);
+    if (!strcmp(field,"pid")) {
+      ierr = event_filter_emit(p,EVENT_FILTER_PID,lo,hi,0,NULL);CHKERRQ(ierr);
+    } else if (!strcmp(field,"lport")) {
+      ierr = event_filter_emit(p,EVENT_FILTER_LPORT,lo,hi,0,NULL);CHKERRQ(ierr);
+    } else if (!strcmp(field,"rport")) {
+      ierr = event_filter_emit(p,EVENT_FILTER_RPORT,lo,hi,0,NULL);CHKERRQ(ierr);
+    } else if (!strcmp(field,"port")) {
+      ierr = event_filter_emit(p,EVENT_FILTER_PORT,lo,hi,0,NULL);CHKERRQ(ierr);
+    } else {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Unknown field %s in filter %s\n",field,p->str);
+    }
+  }
+  if (negate) {
+    ierr = event_filter_emit(p,EVENT_FILTER_NOT,0,0,0,NULL);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode event_filter_parse_unary(event_filter_parser *p)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  event_filter_skip_space(p);
+  if (p->str[p->pos] == '!' || event_filter_accept(p,"not")) {
+    if (p->str[p->pos] == '!') {
+      ++(p->pos);
+    }
+    ierr = event_filter_parse_unary(p);CHKERRQ(ierr);
+    ierr = event_filter_emit(p,EVENT_FILTER_NOT,0,0,0,NULL);CHKERRQ(ierr);
+  } else if (event_filter_accept(p,"(")) {
+    ierr = event_filter_parse_or(p);CHKERRQ(ierr);
+    if (!event_filter_accept(p,")")) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Expected ) at position %D of filter %s\n",(PetscInt)p->pos,p->str);
+    }
+  } else {
+    ierr = event_filter_parse_predicate(p);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* a && b compiles to: a; JUMP_IF_FALSE end; b; end: */
+static PetscErrorCode event_filter_parse_and(event_filter_parser *p)
+{
+  PetscErrorCode ierr;
+  PetscInt       jumps[EVENT_FILTER_MAX_INSNS],njumps=0,i;
+  PetscFunctionBeginUser;
+  ierr = event_filter_parse_unary(p);CHKERRQ(ierr);
+  while (event_filter_accept(p,"&&") || event_filter_accept(p,",") || event_filter_accept(p,"and")) {
+    ierr = event_filter_emit(p,EVENT_FILTER_JUMP_IF_FALSE,0,0,0,&jumps[njumps++]);CHKERRQ(ierr);
+    ierr = event_filter_parse_unary(p);CHKERRQ(ierr);
+  }
+  for (i=0; i<njumps; ++i) {
+    p->filter->insns[jumps[i]].arg = p->filter->ninsns;
+  }
+  PetscFunctionReturn(0);
+}
+
+/* a || b compiles to: a; JUMP_IF_TRUE end; b; end: */
+static PetscErrorCode event_filter_parse_or(event_filter_parser *p)
+{
+  PetscErrorCode ierr;
+  PetscInt       jumps[EVENT_FILTER_MAX_INSNS],njumps=0,i;
+  PetscFunctionBeginUser;
+  ierr = event_filter_parse_and(p);CHKERRQ(ierr);
+  while (event_filter_accept(p,"||") || event_filter_accept(p,"or")) {
+    ierr = event_filter_emit(p,EVENT_FILTER_JUMP_IF_TRUE,0,0,0,&jumps[njumps++]);CHKERRQ(ierr);
+    ierr = event_filter_parse_and(p);CHKERRQ(ierr);
+  }
+  for (i=0; i<njumps; ++i) {
+    p->filter->insns[jumps[i]].arg = p->filter->ninsns;
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_filter_compile(const char *str, event_filter *filter)
+{
+  PetscErrorCode      ierr;
+  event_filter_parser p;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(filter,sizeof(event_filter));CHKERRQ(ierr);
+  if (strlen(str) >= EVENT_FILTER_MAX_LEN) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"Filters may be at most %D characters long\n",EVENT_FILTER_MAX_LEN-1);
+  }
+  ierr = PetscStrncpy(filter->text,str,EVENT_FILTER_MAX_LEN);CHKERRQ(ierr);
+  p.str = filter->text;
+  p.pos = 0;
+  p.filter = filter;
+  event_filter_skip_space(&p);
+  if (!p.str[p.pos]) {
+    PetscFunctionReturn(0);
+  }
+  ierr = event_filter_parse_or(&p);CHKERRQ(ierr);
+  event_filter_skip_space(&p);
+  if (p.str[p.pos]) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Unexpected %s at the end of filter %s\n",p.str+p.pos,p.str);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* the text address is only converted if a raddr predicate is reached */
+static const uint8_t *event_filter_fields_raddr(event_filter_fields *f)
+{
+  if (!f->raddr_bin && f->raddr && !f->addr_parsed) {
+    f->addr_parsed = PETSC_TRUE;
+    if (inet_pton(f->ip == 6 ? AF_INET6 : AF_INET,f->raddr,f->addr) == 1) {
+      f->raddr_bin = f->addr;
+    }
+  }
+  return f->raddr_bin;
+}
+
+static PetscBool event_filter_in_net(const uint8_t *addr, const uint8_t *net, PetscInt bits)
+{
+  PetscInt nbytes = bits/8,rem = bits%8;
+  if (memcmp(addr,net,nbytes)) {
+    return PETSC_FALSE;
+  }
+  return (PetscBool)(!rem || !((addr[nbytes] ^ net[nbytes]) & (0xff << (8-rem)) & 0xff));
+}
+
+static PetscBool event_filter_run(event_filter *filter, event_filter_fields *f)
+{
+  const event_filter_insn *insn;
+  const uint8_t           *addr;
+  PetscInt                pc = 0;
+  PetscBool               acc = PETSC_TRUE;
+
+  ++(filter->nevents);
+  while (pc < filter->ninsns) {
+    insn = &filter->insns[pc++];
+    switch (insn->op) {
+    case EVENT_FILTER_PID:
+      acc = (PetscBool)(f->pid >= insn->lo && f->pid <= insn->hi);
+      break;
+    case EVENT_FILTER_LPORT:
+      acc = (PetscBool)(f->lport >= insn->lo && f->lport <= insn->hi);
+      break;
+    case EVENT_FILTER_RPORT:
+      acc = (PetscBool)(f->rport >= insn->lo && f->rport <= insn->hi);
+      break;
+    case EVENT_FILTER_PORT:
+      acc = (PetscBool)((f->lport >= insn->lo && f->lport <= insn->hi) || (f->rport >= insn->lo && f->rport <= insn->hi));
+      break;
+    case EVENT_FILTER_IP:
+      acc = (PetscBool)(f->ip == insn->lo);
+      break;
+    case EVENT_FILTER_COMM_EQ:
+      acc = (PetscBool)(f->comm && !strcmp(f->comm,filter->patterns[insn->arg]));
+      break;
+    case EVENT_FILTER_COMM_PREFIX:
+      acc = (PetscBool)(f->comm && !strncmp(f->comm,filter->patterns[insn->arg],insn->lo));
+      break;
+    case EVENT_FILTER_COMM_GLOB:
+      acc = (PetscBool)(f->comm && !fnmatch(filter->patterns[insn->arg],f->comm,0));
+      break;
+    case EVENT_FILTER_RADDR:
+      addr = f->ip == insn->lo ? event_filter_fields_raddr(f) : NULL;
+      acc = (PetscBool)(addr && event_filter_in_net(addr,filter->nets[insn->arg],insn->hi));
+      break;
+    case EVENT_FILTER_NOT:
+      acc = (PetscBool)!acc;
+      break;
+    case EVENT_FILTER_JUMP_IF_FALSE:
+      if (!acc) {
+	pc = insn->arg;
+      }
+      break;
+    case EVENT_FILTER_JUMP_IF_TRUE:
+      if (acc) {
+	pc = insn->arg;
+      }
+      break;
+    }
+  }
+  if (!acc) {
+    ++(filter->nrejected);
+  }
+  return acc;
+}
+
+static void event_filter_fields_init(event_filter_fields *f, PetscInt pid, PetscInt ip, PetscInt lport, PetscInt rport,
+				     const char *comm, const char *raddr)
+{
+  f->pid = pid;
+  f->ip = ip;
+  f->lport = lport;
+  f->rport = rport;
+  f->comm = comm;
+  f->raddr = raddr;
+  f->raddr_bin = NULL;
+  f->addr_parsed = PETSC_FALSE;
+}
+
+PetscBool event_filter_match_accept(event_filter *filter, tcpaccept_entry *entry)
+{
+  event_filter_fields f;
+  if (!filter->ninsns) {
+    return PETSC_TRUE;
+  }
+  event_filter_fields_init(&f,entry->pid,entry->ip,entry->lport,entry->rport,entry->comm,entry->raddr);
+  return event_filter_run(filter,&f);
+}
+
+PetscBool event_filter_match_connect(event_filter *filter, tcpconnect_entry *entry)
+{
+  event_filter_fields f;
+  if (!filter->ninsns) {
+    return PETSC_TRUE;
+  }
+  event_filter_fields_init(&f,entry->pid,entry->ip,-1,entry->dport,entry->comm,entry->daddr);
+  return event_filter_run(filter,&f);
+}
+
+PetscBool event_filter_match_connlat(event_filter *filter, tcpconnlat_entry *entry)
+{
+  event_filter_fields f;
+  if (!filter->ninsns) {
+    return PETSC_TRUE;
+  }
+  event_filter_fields_init(&f,entry->pid,entry->ip,-1,entry->dport,entry->comm,entry->daddr);
+  return event_filter_run(filter,&f);
+}
+
+PetscBool event_filter_match_life(event_filter *filter, tcplife_entry *entry)
+{
+  event_filter_fields f;
+  if (!filter->ninsns) {
+    return PETSC_TRUE;
+  }
+  event_filter_fields_init(&f,entry->pid,entry->ip,entry->lport,entry->rport,entry->comm,entry->raddr);
+  return event_filter_run(filter,&f);
+}
+
+/* tcpretrans reports ADDR:PORT pairs */
+PetscBool event_filter_match_retrans(event_filter *filter, tcpretrans_entry *entry)
+{
+  event_filter_fields f;
+  char                raddr[IP_ADDR_MAX_LEN];
+  const char          *lcolon,*rcolon;
+  size_t              len;
+  if (!filter->ninsns) {
+    return PETSC_TRUE;
+  }
+  lcolon = strrchr(entry->laddr_port,':');
+  rcolon = strrchr(entry->raddr_port,':');
+  raddr[0] = '\0';
+  if (rcolon) {
+    len = PetscMin((size_t)(rcolon - entry->raddr_port),sizeof(raddr)-1);
+    memcpy(raddr,entry->raddr_port,len);
+    raddr[len] = '\0';
+  }
+  event_filter_fields_init(&f,entry->pid,entry->ip,lcolon ? atoi(lcolon+1) : -1,rcolon ? atoi(rcolon+1) : -1,
+			   NULL,rcolon ? raddr : NULL);
+  return event_filter_run(filter,&f);
+}
+
+PetscBool event_filter_match_states(event_filter *filter, tcpstates_entry *entry)
+{
+  event_filter_fields f;
+  if (!filter->ninsns) {
+    return PETSC_TRUE;
+  }
+  event_filter_fields_init(&f,entry->pid,entry->ip,entry->lport,entry->rport,entry->comm,entry->raddr);
+  return event_filter_run(filter,&f);
+}
+
+PetscBool event_filter_match_drop(event_filter *filter, tcpdrop_entry *entry)
+{
+  event_filter_fields f;
+  if (!filter->ninsns) {
+    return PETSC_TRUE;
+  }
+  event_filter_fields_init(&f,entry->pid,entry->ip,entry->lport,entry->rport,NULL,entry->raddr);
+  return event_filter_run(filter,&f);
+}
+
+/* records carry the binary address, so raddr predicates need no conversion. A
+   connect record's lport is 0, which tcpconnect and tcpconnlat do not report,
+   so it is -1 here as it is for their text entries */
+PetscBool event_filter_match_record(event_filter *filter, const event_record *rec)
+{
+  event_filter_fields f;
+  PetscInt            lport;
+  if (!filter->ninsns) {
+    return PETSC_TRUE;
+  }
+  lport = rec->type == TCPCONNECT || rec->type == TCPCONNLAT ? -1 : (PetscInt)rec->lport;
+  event_filter_fields_init(&f,rec->pid,rec->ip,lport,rec->rport,rec->comm[0] ? rec->comm : NULL,NULL);
+  f.raddr_bin = rec->raddr;
+  return event_filter_run(filter,&f);
+}
@@ -0,0 +1,69 @@
+#ifndef DCPROF_EVENT_FILTER_H
+#define DCPROF_EVENT_FILTER_H
+#include "petsc_webserver.h"
+#include "event_source.h"
+#include <stdint.h>
+
+/* a filter on the events the driver ingests, given with --filter. The expression
+   is compiled once into a short program for a one-register machine, with the
+   && and || operators compiled to jumps so evaluation stops as soon as the
+   result is known. handle_line() and handle_record() run the program on every
+   parsed event before it touches process_statistics, and drop the event if the
+   result is false.
+
+   An expression is made of the predicates
+     comm=GLOB        process name, with the wildcards of fnmatch(3)
+     pid=N[-M]        PID or range of PIDs
+     lport=N[-M]      local port or range of ports
+     rport=N[-M]      remote port or range of ports
+     port=N[-M]       either port
+     raddr=ADDR[/N]   remote address in a network, IPv4 or IPv6
+     ip=4|6           IP version
+   any of which may be negated by writing != instead of =, combined with
+   ! (or not), && (or and, or a comma), || (or or) and parentheses, e.g.
+     comm=mpi* && !(rport=22 || raddr=10.0.0.0/8)
+   A predicate on a field the tool does not report (e.g. comm for tcpretrans
+   and tcpdrop, lport for tcpconnect) is false. */
+
+typedef enum {
+  EVENT_FILTER_PID,EVENT_FILTER_LPORT,EVENT_FILTER_RPORT,EVENT_FILTER_PORT,EVENT_FILTER_IP,
+  EVENT_FILTER_COMM_EQ,EVENT_FILTER_COMM_PREFIX,EVENT_FILTER_COMM_GLOB,EVENT_FILTER_RADDR,
+  EVENT_FILTER_NOT,EVENT_FILTER_JUMP_IF_FALSE,EVENT_FILTER_JUMP_IF_TRUE
+} EventFilterOp;
+
+#define EVENT_FILTER_MAX_INSNS   64
+#define EVENT_FILTER_MAX_ARGS    16
+#define EVENT_FILTER_PATTERN_LEN 64
+#define EVENT_FILTER_MAX_LEN     512
+
+typedef struct {
+  EventFilterOp op;
+  PetscInt      lo,hi; /* ranges; RADDR: the IP version and the prefix length; COMM_PREFIX: the prefix length */
+  PetscInt      arg;   /* COMM_XXX and RADDR: index of the pattern or network; JUMP_XXX: the target */
+} event_filter_insn;
+
+typedef struct {
+  PetscInt          ninsns,nargs;
+  event_filter_insn insns[EVENT_FILTER_MAX_INSNS];
+  char              patterns[EVENT_FILTER_MAX_ARGS][EVENT_FILTER_PATTERN_LEN];
+  uint8_t           nets[EVENT_FILTER_MAX_ARGS][16];
+  PetscInt          nevents,nrejected; /* events the filter was run on, and those it dropped */
+  char              text[EVENT_FILTER_MAX_LEN];
+} event_filter;
+
+/* compiles the expression in the first parameter into the filter in the second. An
+   empty expression gives a filter that accepts everything */
+extern PetscErrorCode event_filter_compile(const char *, event_filter *);
+
+/* return whether the event in the second parameter passes the filter in the first.
+   An empty filter returns PETSC_TRUE without looking at the event */
+extern PetscBool event_filter_match_accept(event_filter *, tcpaccept_entry *);
+extern PetscBool event_filter_match_connect(event_filter *, tcpconnect_entry *);
+extern PetscBool event_filter_match_connlat(event_filter *, tcpconnlat_entry *);
+extern PetscBool event_filter_match_life(event_filter *, tcplife_entry *);
+extern PetscBool event_filter_match_retrans(event_filter *, tcpretrans_entry *);
+extern PetscBool event_filter_match_states(event_filter *, tcpstates_entry *);
+extern PetscBool event_filter_match_drop(event_filter *, tcpdrop_entry *);
+extern PetscBool event_filter_match_record(event_filter *, const event_record *);
+
+#endif
@@ -0,0 +1,308 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "event_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define EVENT_LOG_FIELD(f,kind) {#f,offsetof(event_log_record,f),sizeof(((event_log_record*)0)->f),kind,0}
+
+static const event_log_field EventLogSchema[EVENT_LOG_NFIELDS] = {
+  EVENT_LOG_FIELD(ts_ns,EVENT_LOG_UINT),
+  EVENT_LOG_FIELD(pid,EVENT_LOG_UINT),
+  EVENT_LOG_FIELD(name_id,EVENT_LOG_NAME_ID),
+  EVENT_LOG_FIELD(type,EVENT_LOG_UINT),
+  EVENT_LOG_FIELD(ip,EVENT_LOG_UINT),
+  EVENT_LOG_FIELD(lport,EVENT_LOG_UINT),
+  EVENT_LOG_FIELD(rport,EVENT_LOG_UINT),
+  EVENT_LOG_FIELD(state,EVENT_LOG_UINT),
+  {"laddr",offsetof(event_log_record,u.addr.laddr),16,EVENT_LOG_ADDR,0},
+  {"raddr",offsetof(event_log_record,u.addr.raddr),16,EVENT_LOG_ADDR,0},
+  EVENT_LOG_FIELD(tx_kb,EVENT_LOG_UINT),
+  EVENT_LOG_FIELD(rx_kb,EVENT_LOG_UINT),
+  EVENT_LOG_FIELD(duration_us,EVENT_LOG_UINT)
+};
+
+static void event_log_header_init(event_log_header *header)
+{
+  memset(header,0,sizeof(event_log_header));
+  memcpy(header->magic,EVENT_LOG_MAGIC,sizeof(header->magic));
+  header->version = EVENT_LOG_VERSION;
+  header->header_size = sizeof(event_log_header);
+  header->record_size = sizeof(event_log_record);
+  header->nfields = EVENT_LOG_NFIELDS;
+  memcpy(header->fields,EventLogSchema,sizeof(EventLogSchema));
+}
+
+/* FNV-1a, folded to a non-negative PetscInt */
+static PetscInt event_log_name_hash(const char *name)
+{
+  uint32_t h = 2166136261u;
+  size_t   i;
+  for (i=0; i<EVENT_LOG_NAME_LEN && name[i]; ++i) {
+    h ^= (unsigned char)name[i];
+    h *= 16777619u;
+  }
+  return (PetscInt)(h & 0x7fffffff);
+}
+
+PetscErrorCode event_log_writer_open(event_log_writer *writer, const char *filename)
+{
+  PetscErrorCode   ierr;
+  event_log_header header;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(writer,sizeof(event_log_writer));CHKERRQ(ierr);
+  writer->fd = fopen(filename,"wb");
+  if (!writer->fd) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open event log %s: %s\n",filename,strerror(errno));
+  }
+  event_log_header_init(&header);
+  if (fwrite(&header,sizeof(header),1,writer->fd) != 1) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write event log header: %s\n",strerror(errno));
+  }
+  ierr = PetscHMapICreate(&writer->name_ids);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_log_writer_close(event_log_writer *writer)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (writer->fd) {
+    fclose(writer->fd);
+  }
+  writer->fd = NULL;
+  ierr = PetscHMapIDestroy(&writer->name_ids);CHKERRQ(ierr);
+  ierr = PetscFree(writer->names);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* the id of the name in the second parameter, writing its definition if it is new */
+static PetscErrorCode event_log_name_id(event_log_writer *writer, const char *name, uint32_t *id)
+{
+  PetscErrorCode   ierr;
+  event_log_record rec;
+  PetscInt         key,i;
+  char             padded[EVENT_LOG_NAME_LEN];
+  PetscFunctionBeginUser;
+  memset(padded,0,EVENT_LOG_NAME_LEN);
+  strncpy(padded,name,EVENT_LOG_NAME_LEN - 1);
+  /* names whose hashes collide take the next free keys, so a name is only new
+     once the probe reaches a key that is not taken */
+  for (key=event_log_name_hash(padded);; key=(key + 1) & 0x7fffffff) {
+    ierr = PetscHMapIGet(writer->name_ids,key,&i);CHKERRQ(ierr);
+    if (i < 0) {
+      break;
+    }
+    if (!memcmp(writer->names[i],padded,EVENT_LOG_NAME_LEN)) {
+      *id = (uint32_t)i;
+      PetscFunctionReturn(0);
+    }
+  }
+  if (writer->nnames == writer->names_capacity) {
+    writer->names_capacity = writer->names_capacity ? 2 * writer->names_capacity : 64;
+    ierr = PetscRealloc(writer->names_capacity * sizeof(*writer->names),&writer->names);CHKERRQ(ierr);
+  }
+  i = writer->nnames++;
+  memcpy(writer->names[i],padded,EVENT_LOG_NAME_LEN);
+  ierr = PetscHMapISet(writer->name_ids,key,i);CHKERRQ(ierr);
+  memset(&rec,0,sizeof(rec));
+  rec.type = EVENT_LOG_NAME;
+  rec.name_id = (uint32_t)i;
+  memcpy(rec.u.name,padded,EVENT_LOG_NAME_LEN);
+  if (fwrite(&rec,sizeof(rec),1,writer->fd) != 1) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write event log record: %s\n",strerror(errno));
+  }
+  *id = (uint32_t)i;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_log_write(event_log_writer *writer, const event_record *event)
+{
+  PetscErrorCode   ierr;
+  event_log_record rec;
+  char             comm[EVENT_RECORD_COMM_LEN+1];
+  PetscFunctionBeginUser;
+  memcpy(comm,event->comm,EVENT_RECORD_COMM_LEN);
+  comm[EVENT_RECORD_COMM_LEN] = '\0';
+  memset(&rec,0,sizeof(rec));
+  ierr = event_log_name_id(writer,comm,&rec.name_id);CHKERRQ(ierr);
+  rec.ts_ns = event->ts_ns;
+  rec.pid = event->pid;
+  rec.type = (uint8_t)event->type;
+  rec.ip = (uint8_t)event->ip;
+  rec.lport = event->lport;
+  rec.rport = event->rport;
+  rec.state = event->state;
+  memcpy(rec.u.addr.laddr,event->laddr,16);
+  memcpy(rec.u.addr.raddr,event->raddr,16);
+  rec.tx_kb = (uint32_t)(event->tx_bytes / 1024);
+  rec.rx_kb = (uint32_t)(event->rx_bytes / 1024);
+  rec.duration_us = (uint32_t)(event->duration_ns / 1000);
+  if (fwrite(&rec,sizeof(rec),1,writer->fd) != 1) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write event log record: %s\n",strerror(errno));
+  }
+  ++(writer->nrecords);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_log_reader_open(event_log_reader *reader, const char *filename)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(reader,sizeof(event_log_reader));CHKERRQ(ierr);
+  reader->fd = open(filename,O_RDONLY | O_CLOEXEC);
+  if (reader->fd < 0) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open event log %s: %s\n",filename,strerror(errno));
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_log_reader_close(event_log_reader *reader)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (reader->map) {
+    munmap(reader->map,reader->maplen);
+  }
+  reader->map = NULL;
+  if (reader->fd >= 0) {
+    close(reader->fd);
+  }
+  reader->fd = -1;
+  ierr = PetscFree(reader->names);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode event_log_check_header(const event_log_header *header)
+{
+  event_log_header expected;
+  PetscInt         f;
+  PetscFunctionBeginUser;
+  event_log_header_init(&expected);
+  if (memcmp(header->magic,expected.magic,sizeof(expected.magic))) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Not an event log\n");
+  }
+  if (header->version != EVENT_LOG_VERSION) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Event log has version %d, expected %d\n",(int)header->version,EVENT_LOG_VERSION);
+  }
+  if (header->header_size != expected.header_size || header->record_size != expected.record_size
+      || header->nfields != expected.nfields) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Event log header or record size does not match this build\n");
+  }
+  for (f=0; f<EVENT_LOG_NFIELDS; ++f) {
+    if (strncmp(header->fields[f].name,expected.fields[f].name,sizeof(expected.fields[f].name))
+	|| header->fields[f].offset != expected.fields[f].offset || header->fields[f].size != expected.fields[f].size) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Event log schema does not match this build at field %s\n",expected.fields[f].name);
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+/* (re)maps the whole file if it has grown */
+static PetscErrorCode event_log_remap(event_log_reader *reader)
+{
+  struct stat st;
+  PetscFunctionBeginUser;
+  if (fstat(reader->fd,&st)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not stat event log: %s\n",strerror(errno));
+  }
+  if ((size_t)st.st_size <= reader->maplen || (size_t)st.st_size < sizeof(event_log_header)) {
+    PetscFunctionReturn(0);
+  }
+  if (reader->map) {
+    munmap(reader->map,reader->maplen);
+  }
+  reader->map = (unsigned char*)mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,reader->fd,0);
+  if (reader->map == MAP_FAILED) {
+    reader->map = NULL;
+    reader->maplen = 0;
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_MEM,"Could not map event log: %s\n",strerror(errno));
+  }
+  reader->maplen = (size_t)st.st_size;
+  posix_madvise(reader->map,reader->maplen,POSIX_MADV_SEQUENTIAL);
+  PetscFunctionReturn(0);
+}
+
+/* a writer defines the names in the order of their ids, so a definition either
+   redefines a name or is the next one */
+static PetscErrorCode event_log_define_name(event_log_reader *reader, const event_log_record *rec)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (rec->name_id > (uint32_t)reader->nnames) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Event log defines name id %D when only %D names are defined\n",(PetscInt)rec->name_id,reader->nnames);
+  }
+  while ((PetscInt)rec->name_id >= reader->names_capacity) {
+    reader->names_capacity = reader->names_capacity ? 2 * reader->names_capacity : 64;
+    ierr = PetscRealloc(reader->names_capacity * sizeof(*reader->names),&reader->names);CHKERRQ(ierr);
+  }
+  memcpy(reader->names[rec->name_id],rec->u.name,EVENT_LOG_NAME_LEN);
+  reader->names[rec->name_id][EVENT_LOG_NAME_LEN-1] = '\0';
+  reader->nnames = PetscMax(reader->nnames,(PetscInt)rec->name_id + 1);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_log_read(event_log_reader *reader, event_record_handler handler, void *ctx, PetscInt *nread)
+{
+  PetscErrorCode         ierr;
+  const event_log_record *rec,*end;
+  event_record           event;
+  PetscInt               n = 0;
+  size_t                 nrec;
+  PetscFunctionBeginUser;
+  ierr = event_log_remap(reader);CHKERRQ(ierr);
+  if (!reader->map) {
+    if (nread) {
+      *nread = 0;
+    }
+    PetscFunctionReturn(0);
+  }
+  if (!reader->offset) {
+    ierr = event_log_check_header((const event_log_header*)reader->map);CHKERRQ(ierr);
+    reader->offset = sizeof(event_log_header);
+  }
+  rec = (const event_log_record*)(reader->map + reader->offset);
+  /* a partially written record is left for the next read */
+  nrec = (reader->maplen - reader->offset) / sizeof(event_log_record);
+  reader->behind = PETSC_FALSE;
+  if (reader->max_bytes && nrec > PetscMax(reader->max_bytes / sizeof(event_log_record),1)) {
+    nrec = PetscMax(reader->max_bytes / sizeof(event_log_record),1);
+    reader->behind = PETSC_TRUE;
+  }
+  end = rec + nrec;
+  for (; rec<end; ++rec) {
+    if (rec->type == EVENT_LOG_NAME) {
+      ierr = event_log_define_name(reader,rec);CHKERRQ(ierr);
+      continue;
+    }
+    memset(&event,0,sizeof(event));
+    event.ts_ns = rec->ts_ns;
+    event.type = rec->type;
+    event.pid = rec->pid;
+    event.ip = rec->ip;
+    event.lport = rec->lport;
+    event.rport = rec->rport;
+    event.state = rec->state;
+    memcpy(event.laddr,rec->u.addr.laddr,16);
+    memcpy(event.raddr,rec->u.addr.raddr,16);
+    event.tx_bytes = (uint64_t)rec->tx_kb * 1024;
+    event.rx_bytes = (uint64_t)rec->rx_kb * 1024;
+    event.duration_ns = (uint64_t)rec->duration_us * 1000;
+    if ((PetscInt)rec->name_id < reader->nnames) {
+      strncpy(event.comm,reader->names[rec->name_id],EVENT_RECORD_COMM_LEN);
+    }
+    ierr = handler(&event,ctx);CHKERRQ(ierr);
+    ++n;
+  }
+  reader->offset = (size_t)((const unsigned char*)end - reader->map);
+  reader->nrecords += n;
+  if (nread) {
+    *nread = n;
+  }
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,97 @@
+#ifndef DCPROF_EVENT_LOG_H
+#define DCPROF_EVENT_LOG_H
+#include "event_source.h"
+#include <petsc/private/hashmapi.h>
+
+/* a compact, versioned binary log of TCP events, meant to replace the bcc text logs
+   on disk. The file is
+
+     event_log_header : magic, version, record size and a schema that names every
+                        field of the record with its offset, size and kind, so other
+                        tools can read the log without this header file
+     event_log_record : fixed-size 72-byte records, appended
+
+   Addresses are stored in binary and process names as ids. A name is defined by an
+   EVENT_LOG_NAME record (the name in place of the addresses) before the first record
+   that uses its id, so the log can be read, and appended to, as a stream.
+
+   The driver reads a log with --event_source LOG: the file is mmap()ed, the mapping
+   is grown as the file grows, and records are applied to process_statistics
+   straight from the mapping. event_log_convert turns bcc text logs into this format. */
+
+#define EVENT_LOG_MAGIC    "DCPLOG1"
+#define EVENT_LOG_VERSION  1
+#define EVENT_LOG_NAME     255 /* record type of a name definition */
+#define EVENT_LOG_NAME_LEN 32
+
+typedef enum {EVENT_LOG_UINT,EVENT_LOG_ADDR,EVENT_LOG_NAME_ID,EVENT_LOG_BYTES} EventLogFieldKind;
+
+typedef struct {
+  uint64_t ts_ns;
+  uint32_t pid,name_id;
+  uint8_t  type,ip;         /* type is an InputType or EVENT_LOG_NAME */
+  uint16_t lport,rport;
+  uint16_t state;
+  union {
+    struct {
+      uint8_t laddr[16],raddr[16];
+    } addr;
+    char name[EVENT_LOG_NAME_LEN]; /* EVENT_LOG_NAME */
+  } u;
+  uint32_t tx_kb,rx_kb;
+  uint32_t duration_us;     /* connlat latency or tcplife lifetime */
+  uint32_t reserved;
+} event_log_record;
+
+typedef struct {
+  char     name[16];
+  uint16_t offset,size,kind,reserved;
+} event_log_field;
+
+#define EVENT_LOG_NFIELDS 13
+
+typedef struct {
+  char            magic[8];
+  uint32_t        version,header_size,record_size,nfields;
+  event_log_field fields[EVENT_LOG_NFIELDS];
+} event_log_header;
+
+typedef struct {
+  FILE       *fd;
+  PetscHMapI name_ids;   /* hash of a name -> its id */
+  char       (*names)[EVENT_LOG_NAME_LEN];
+  PetscInt   nnames,names_capacity;
+  PetscInt   nrecords;
+} event_log_writer;
+
+typedef struct {
+  int            fd;
+  unsigned char  *map;
+  size_t         maplen,offset;
+  char           (*names)[EVENT_LOG_NAME_LEN];
+  PetscInt       nnames,names_capacity;
+  PetscInt       nrecords;
+  size_t         max_bytes; /* of records read per call at most, 0 for no limit */
+  PetscBool      behind;    /* whether the last call stopped at max_bytes */
+} event_log_reader;
+
+/* creates (or truncates) the log named by the second parameter and writes its header */
+extern PetscErrorCode event_log_writer_open(event_log_writer *, const char *);
+
+extern PetscErrorCode event_log_writer_close(event_log_writer *);
+
+/* appends the event in the second parameter, defining its name first if it is new */
+extern PetscErrorCode event_log_write(event_log_writer *, const event_record *);
+
+/* opens the log named by the second parameter. The header is checked on the first read,
+   so the writer does not have to have written it yet */
+extern PetscErrorCode event_log_reader_open(event_log_reader *, const char *);
+
+extern PetscErrorCode event_log_reader_close(event_log_reader *);
+
+/* calls the handler in the second parameter, with the context in the third, on every
+   event appended since the last call, or on the first max_bytes of them. The number of
+   events is stored in the last parameter. */
+extern PetscErrorCode event_log_read(event_log_reader *, event_record_handler, void *, PetscInt *);
+
+#endif
@@ -0,0 +1,177 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "event_source.h"
+#include "event_log.h"
+#include <petsctime.h>
+#include <stdio.h>
+
+static const char help[] = "Converts a text log of one of the bcc tools (tcpaccept, tcpconnect, tcpconnlat,\n"
+  "tcplife, tcpretrans) into a binary event log that petsc_webserver_driver reads with\n"
+  "--event_source LOG --event_source_path <log>.\n"
+  "Options:\n"
+  "-file [filename] : (required) the text log\n"
+  "-type [ACCEPT,CONNECT,CONNLAT,LIFE,RETRANS] : (required) which tool wrote it\n"
+  "-o [filename] : (required) the event log to write\n"
+  "--benchmark [n] : (optional) afterwards, load both files into process statistics n times (default 5)\n"
+  "       and print the throughput of the text and the binary path\n";
+
+static PetscErrorCode add_record(const event_record *rec, void *ctx)
+{
+  return process_statistics_add_event((process_statistics*)ctx,rec);
+}
+
+/* parses the line in the second parameter; the event is stored in rec if the parse succeeded
+   and, if pstats is not NULL, added to it like the driver would */
+static PetscErrorCode parse_line(InputType type, char *line, process_statistics *pstats, event_record *rec, PetscBool *parsed,
+				 tcpaccept_entry *accept_entry, tcpconnect_entry *connect_entry,
+				 tcpconnlat_entry *connlat_entry, tcplife_entry *life_entry,
+				 tcpretrans_entry *retrans_entry)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  *parsed = PETSC_FALSE;
+  switch (type) {
+    case TCPACCEPT:
+      if (tcpaccept_entry_parse_line(accept_entry,line)) break;
+      if (pstats) {
+	ierr = process_statistics_add_accept(pstats,accept_entry);CHKERRQ(ierr);
+      }
+      if (rec) {
+	ierr = event_record_from_accept(rec,accept_entry);CHKERRQ(ierr);
+      }
+      *parsed = PETSC_TRUE;
+      break;
+    case TCPCONNECT:
+      if (tcpconnect_entry_parse_line(connect_entry,line)) break;
+      if (pstats) {
+	ierr = process_statistics_add_connect(pstats,connect_entry);CHKERRQ(ierr);
+      }
+      if (rec) {
+	ierr = event_record_from_connect(rec,connect_entry);CHKERRQ(ierr);
+      }
+      *parsed = PETSC_TRUE;
+      break;
+    case TCPCONNLAT:
+      if (tcpconnlat_entry_parse_line(connlat_entry,line)) break;
+      if (pstats) {
+	ierr = process_statistics_add_connlat(pstats,connlat_entry);CHKERRQ(ierr);
+      }
+      if (rec) {
+	ierr = event_record_from_connlat(rec,connlat_entry);CHKERRQ(ierr);
+      }
+      *parsed = PETSC_TRUE;
+      break;
+    case TCPLIFE:
+      if (tcplife_entry_parse_line(life_entry,line)) break;
+      if (pstats) {
+	ierr = process_statistics_add_life(pstats,life_entry);CHKERRQ(ierr);
+      }
+      if (rec) {
+	ierr = event_record_from_life(rec,life_entry);CHKERRQ(ierr);
+      }
+      *parsed = PETSC_TRUE;
+      break;
+    case TCPRETRANS:
+      if (tcpretrans_entry_parse_line(retrans_entry,line)) break;
+      if (pstats) {
+	ierr = process_statistics_add_retrans(pstats,retrans_entry);CHKERRQ(ierr);
+      }
+      if (rec) {
+	ierr = event_record_from_retrans(rec,retrans_entry);CHKERRQ(ierr);
+      }
+      *parsed = PETSC_TRUE;
+      break;
+    default:
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SUP,"Event logs do not support %s input",InputTypes[type]);
+  }
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode     ierr;
+  char               filename[PETSC_MAX_PATH_LEN],output_filename[PETSC_MAX_PATH_LEN];
+  char               *line=NULL;
+  size_t             linesize=0;
+  PetscBool          has_file,has_type,has_output,has_benchmark,parsed;
+  PetscInt           nrepeat,r,nlines,nevents,nread;
+  InputType          type;
+  FILE               *fd;
+  event_log_writer   writer;
+  event_log_reader   reader;
+  event_record       rec;
+  process_statistics pstats;
+  PetscLogDouble     t0,t1,text_time,log_time;
+  long               text_bytes,log_bytes;
+  tcpaccept_entry    accept_entry;
+  tcpconnect_entry   connect_entry;
+  tcpconnlat_entry   connlat_entry;
+  tcplife_entry      life_entry;
+  tcpretrans_entry   retrans_entry;
+  ierr = PetscInitialize(&argc,&argv,NULL,help);if (ierr) return ierr;
+  ierr = PetscOptionsGetString(NULL,NULL,"-file",filename,PETSC_MAX_PATH_LEN,&has_file);CHKERRQ(ierr);
+  ierr = PetscOptionsGetEnum(NULL,NULL,"-type",InputTypes,(PetscEnum*)&type,&has_type);CHKERRQ(ierr);
+  ierr = PetscOptionsGetString(NULL,NULL,"-o",output_filename,PETSC_MAX_PATH_LEN,&has_output);CHKERRQ(ierr);
+  if (!(has_file && has_type && has_output)) {
+    SETERRQ(PETSC_COMM_WORLD,1,"Must provide -file, -type and -o");
+  }
+  nrepeat = 5;
+  ierr = PetscOptionsGetInt(NULL,NULL,"--benchmark",&nrepeat,&has_benchmark);CHKERRQ(ierr);
+  if (!has_benchmark) {
+    ierr = PetscOptionsHasName(NULL,NULL,"--benchmark",&has_benchmark);CHKERRQ(ierr);
+  }
+
+  fd = fopen(filename,"r");
+  if (!fd) {
+    SETERRQ1(PETSC_COMM_WORLD,PETSC_ERR_FILE_OPEN,"Could not open %s\n",filename);
+  }
+  ierr = event_log_writer_open(&writer,output_filename);CHKERRQ(ierr);
+  nlines = nevents = 0;
+  while (getline(&line,&linesize,fd) != -1) {
+    ++nlines;
+    ierr = parse_line(type,line,NULL,&rec,&parsed,&accept_entry,&connect_entry,
+		      &connlat_entry,&life_entry,&retrans_entry);CHKERRQ(ierr);
+    if (parsed) {
+      ierr = event_log_write(&writer,&rec);CHKERRQ(ierr);
+      ++nevents;
+    }
+  }
+  text_bytes = ftell(fd);
+  fclose(fd);
+  log_bytes = ftell(writer.fd);
+  PetscPrintf(PETSC_COMM_WORLD,"Converted %D of %D lines of %s (%ld bytes) to %D records and %D names in %s (%ld bytes)\n",
+	      nevents,nlines,filename,text_bytes,nevents,writer.nnames,output_filename,log_bytes);
+  ierr = event_log_writer_close(&writer);CHKERRQ(ierr);
+
+  if (has_benchmark && nevents) {
+    text_time = log_time = 0.0;
+    for (r=0; r<nrepeat; ++r) {
+      ierr = process_statistics_init(&pstats);CHKERRQ(ierr);
+      ierr = PetscTime(&t0);CHKERRQ(ierr);
+      fd = fopen(filename,"r");
+      while (getline(&line,&linesize,fd) != -1) {
+	ierr = parse_line(type,line,&pstats,NULL,&parsed,&accept_entry,&connect_entry,
+			  &connlat_entry,&life_entry,&retrans_entry);CHKERRQ(ierr);
+      }
+      fclose(fd);
+      ierr = PetscTime(&t1);CHKERRQ(ierr);
+      text_time += t1 - t0;
+      ierr = process_statistics_destroy(&pstats);CHKERRQ(ierr);
+
+      ierr = process_statistics_init(&pstats);CHKERRQ(ierr);
+      ierr = PetscTime(&t0);CHKERRQ(ierr);
+      ierr = event_log_reader_open(&reader,output_filename);CHKERRQ(ierr);
+      ierr = event_log_read(&reader,add_record,&pstats,&nread);CHKERRQ(ierr);
+      ierr = event_log_reader_close(&reader);CHKERRQ(ierr);
+      ierr = PetscTime(&t1);CHKERRQ(ierr);
+      log_time += t1 - t0;
+      ierr = process_statistics_destroy(&pstats);CHKERRQ(ierr);
+    }
+    PetscPrintf(PETSC_COMM_WORLD,"text: %g events/s (%g MB/s)\n",nevents*nrepeat/text_time,text_bytes*nrepeat/text_time*1.0e-6);
+    PetscPrintf(PETSC_COMM_WORLD,"log:  %g events/s (%g MB/s), %gx the text path\n",nevents*nrepeat/log_time,
+		log_bytes*nrepeat/log_time*1.0e-6,text_time/log_time);
+  }
+  free(line);
+  PetscFinalize();
+  return 0;
+}
@@ -0,0 +1,467 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "event_source.h"
+#include "event_log.h"
+#include "process_tree.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <petsctime.h>
+#if defined(DCPROF_HAVE_LIBBPF)
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#endif
+
+/* records read from a replay file per pread() */
+#define EVENT_SOURCE_BATCH 4096
+
+#if defined(DCPROF_HAVE_LIBBPF)
+static int event_source_ringbuf_sample(void *ctx, void *data, size_t size)
+{
+  event_source *src = (event_source*)ctx;
+  if (size < sizeof(event_record)) {
+    /* not one of ours */
+    return 0;
+  }
+  src->error = src->handler((const event_record*)data,src->ctx);
+  if (src->error) {
+    return -1;
+  }
+  ++(src->nrecords);
+  return 0;
+}
+#endif
+
+PetscErrorCode event_source_open(event_source *src, EventSourceType type, const char *path)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(src,sizeof(event_source));CHKERRQ(ierr);
+  src->type = type;
+  src->fd = -1;
+  if (type == EVENT_SOURCE_RINGBUF) {
+#if defined(DCPROF_HAVE_LIBBPF)
+    src->fd = bpf_obj_get(path);
+    if (src->fd < 0) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open the BPF ring buffer pinned at %s: %s\n",path,strerror(errno));
+    }
+    src->ring = ring_buffer__new(src->fd,event_source_ringbuf_sample,src,NULL);
+    if (!src->ring) {
+      close(src->fd);
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_LIB,"Could not create a ring buffer for the map pinned at %s: %s\n",path,strerror(errno));
+    }
+#else
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SUP,"Cannot open the ring buffer at %s: built without libbpf (define DCPROF_HAVE_LIBBPF and link -lbpf)\n",path);
+#endif
+  } else if (type == EVENT_SOURCE_LOG) {
+    ierr = PetscNew((event_log_reader**)&src->log);CHKERRQ(ierr);
+    ierr = event_log_reader_open((event_log_reader*)src->log,path);CHKERRQ(ierr);
+  } else {
+    src->fd = open(path,O_RDONLY | O_CLOEXEC);
+    if (src->fd < 0) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open event record file %s: %s\n",path,strerror(errno));
+    }
+    src->batch_capacity = EVENT_SOURCE_BATCH;
+    ierr = PetscMalloc1(src->batch_capacity,&src->batch);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_source_close(event_source *src)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+#if defined(DCPROF_HAVE_LIBBPF)
+  if (src->ring) {
+    ring_buffer__free((struct ring_buffer*)src->ring);
+  }
+#endif
+  src->ring = NULL;
+  if (src->log) {
+    ierr = event_log_reader_close((event_log_reader*)src->log);CHKERRQ(ierr);
+    ierr = PetscFree(src->log);CHKERRQ(ierr);
+  }
+  if (src->fd >= 0) {
+    close(src->fd);
+  }
+  src->fd = -1;
+  ierr = PetscFree(src->batch);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* the header is checked on the first poll rather than at open, so the driver can
+   be started before the recording has written anything */
+static PetscErrorCode event_source_replay_header(event_source *src, PetscBool *ready)
+{
+  event_record_file_header header;
+  ssize_t                  len;
+  PetscFunctionBeginUser;
+  *ready = PETSC_FALSE;
+  len = pread(src->fd,&header,sizeof(header),0);
+  if (len < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not read event record file header: %s\n",strerror(errno));
+  }
+  if ((size_t)len < sizeof(header)) {
+    PetscFunctionReturn(0);
+  }
+  if (memcmp(header.magic,EVENT_RECORD_MAGIC,sizeof(header.magic))) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Not an event record file\n");
+  }
+  if (header.version != EVENT_RECORD_VERSION || header.record_size != sizeof(event_record)) {
+    SETERRQ4(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Event record file has version %d and %d byte records, expected version %d and %d byte records\n",
+	     (int)header.version,(int)header.record_size,EVENT_RECORD_VERSION,(int)sizeof(event_record));
+  }
+  src->offset = sizeof(header);
+  *ready = PETSC_TRUE;
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode event_source_poll_replay(event_source *src)
+{
+  PetscErrorCode ierr;
+  PetscBool      ready;
+  ssize_t        len;
+  size_t         i,nrec,want,left = SIZE_MAX;
+  PetscFunctionBeginUser;
+  src->behind = PETSC_FALSE;
+  if (!src->offset) {
+    ierr = event_source_replay_header(src,&ready);CHKERRQ(ierr);
+    if (!ready) {
+      PetscFunctionReturn(0);
+    }
+  }
+  if (src->max_bytes) {
+    left = PetscMax(src->max_bytes / sizeof(event_record),1);
+  }
+  do {
+    want = PetscMin(src->batch_capacity,left);
+    if (!want) {
+      src->behind = PETSC_TRUE;
+      break;
+    }
+    len = pread(src->fd,src->batch,want * sizeof(event_record),src->offset);
+    if (len < 0) {
+      if (errno == EINTR) {
+	/* so that the loop tries the same read again */
+	nrec = want;
+	continue;
+      }
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not read event record file: %s\n",strerror(errno));
+    }
+    /* a partially written record is left for the next poll */
+    nrec = (size_t)len / sizeof(event_record);
+    for (i=0; i<nrec; ++i) {
+      ierr = src->handler(&src->batch[i],src->ctx);CHKERRQ(ierr);
+    }
+    src->offset += (off_t)(nrec * sizeof(event_record));
+    src->nrecords += (PetscInt)nrec;
+    left -= nrec;
+  } while (nrec == want);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_source_poll(event_source *src, event_record_handler handler, void *ctx, PetscInt *nread)
+{
+  PetscErrorCode ierr;
+  PetscInt       before = src->nrecords,nread_log;
+  PetscFunctionBeginUser;
+  src->handler = handler;
+  src->ctx = ctx;
+  src->error = 0;
+  if (src->type == EVENT_SOURCE_RINGBUF) {
+#if defined(DCPROF_HAVE_LIBBPF)
+    if (ring_buffer__consume((struct ring_buffer*)src->ring) < 0) {
+      CHKERRQ(src->error);
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_LIB,"Could not consume the BPF ring buffer: %s\n",strerror(errno));
+    }
+#endif
+  } else if (src->type == EVENT_SOURCE_LOG) {
+    ((event_log_reader*)src->log)->max_bytes = src->max_bytes;
+    ierr = event_log_read((event_log_reader*)src->log,handler,ctx,&nread_log);CHKERRQ(ierr);
+    src->nrecords += nread_log;
+    src->behind = ((event_log_reader*)src->log)->behind;
+  } else {
+    ierr = event_source_poll_replay(src);CHKERRQ(ierr);
+  }
+  if (nread) {
+    *nread = src->nrecords - before;
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_source_progress(event_source *src, int64_t *consumed, int64_t *total)
+{
+  struct stat st;
+  int         fd = src->fd;
+  PetscFunctionBeginUser;
+  *consumed = *total = 0;
+  if (src->type == EVENT_SOURCE_RINGBUF) {
+    PetscFunctionReturn(0);
+  }
+  if (src->type == EVENT_SOURCE_LOG) {
+    fd = ((event_log_reader*)src->log)->fd;
+    *consumed = (int64_t)((event_log_reader*)src->log)->offset;
+  } else {
+    *consumed = (int64_t)src->offset;
+  }
+  if (fstat(fd,&st)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not stat the event source: %s\n",strerror(errno));
+  }
+  *total = (int64_t)st.st_size;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode process_statistics_add_event(process_statistics *pstats, const event_record *rec)
+{
+  PetscErrorCode ierr;
+  process_data   pdata;
+  event_record   ancestor;
+  PetscInt       node;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapDataGet(pstats->ht,(PetscInt)rec->pid,&pdata);CHKERRQ(ierr);
+  switch (rec->type) {
+  case TCPACCEPT:
+    ++pdata.naccept;
+    break;
+  case TCPCONNECT:
+    ++pdata.nconnect;
+    break;
+  case TCPCONNLAT:
+    ++pdata.nconnlat;
+    pdata.latms += (PetscReal)rec->duration_ns * 1.0e-6;
+    break;
+  case TCPLIFE:
+    ++pdata.nlife;
+    pdata.tx_kb += (long long)(rec->tx_bytes / 1024);
+    pdata.rx_kb += (long long)(rec->rx_bytes / 1024);
+    pdata.lifems += (PetscReal)rec->duration_ns * 1.0e-6;
+    break;
+  case TCPRETRANS:
+    ++pdata.nretrans;
+    break;
+  default:
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"Unknown event record type %d\n",(int)rec->type);
+  }
+  if (rec->ip == 4) {
+    ++pdata.nipv4;
+  } else if (rec->ip == 6) {
+    ++pdata.nipv6;
+  }
+  if (rec->comm[0]) {
+    /* comm is not NUL-terminated when it is exactly TASK_COMM_LEN long */
+    memcpy(pdata.comm,rec->comm,EVENT_RECORD_COMM_LEN);
+    pdata.comm[EVENT_RECORD_COMM_LEN] = '\0';
+  } else if (!pdata.comm[0]) {
+    PetscStrncpy(pdata.comm,"[unknown]",sizeof("[unknown]"));
+  }
+  ierr = PetscHMapDataSet(pstats->ht,(PetscInt)rec->pid,pdata);CHKERRQ(ierr);
+  if (pstats->tree) {
+    /* credit the record to the PID's ancestors too, see process_tree.h */
+    ierr = process_tree_find(pstats->tree,(PetscInt)rec->pid,&node);CHKERRQ(ierr);
+    ancestor = *rec;
+    for (; node >= 0; node = pstats->tree->nodes[node].parent) {
+      ancestor.pid = (uint32_t)pstats->tree->nodes[node].pid;
+      ierr = process_statistics_add_event(&pstats->tree->rollup,&ancestor);CHKERRQ(ierr);
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+static void event_record_addr_to_string(const event_record *rec, const uint8_t *addr, char *str)
+{
+  if (!inet_ntop(rec->ip == 6 ? AF_INET6 : AF_INET,addr,str,IP_ADDR_MAX_LEN)) {
+    str[0] = '\0';
+  }
+}
+
+static void event_record_comm(const event_record *rec, char *comm)
+{
+  memcpy(comm,rec->comm,EVENT_RECORD_COMM_LEN);
+  comm[EVENT_RECORD_COMM_LEN] = '\0';
+}
+
+PetscErrorCode event_store_add_record(event_store *store, const event_record *rec, PetscLogDouble now)
+{
+  PetscErrorCode   ierr;
+  union {
+    tcpaccept_entry  accept;
+    tcpconnect_entry connect;
+    tcpconnlat_entry connlat;
+    tcplife_entry    life;
+  } entry;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(&entry,sizeof(entry));CHKERRQ(ierr);
+  if (rec->ts_ns) {
+    now = (PetscLogDouble)rec->ts_ns * 1.0e-9;
+  }
+  switch (rec->type) {
+  case TCPACCEPT:
+    entry.accept.pid = rec->pid;
+    entry.accept.ip = rec->ip;
+    entry.accept.lport = rec->lport;
+    entry.accept.rport = rec->rport;
+    event_record_addr_to_string(rec,rec->laddr,entry.accept.laddr);
+    event_record_addr_to_string(rec,rec->raddr,entry.accept.raddr);
+    event_record_comm(rec,entry.accept.comm);
+    ierr = event_store_add_accept(store,&entry.accept,now);CHKERRQ(ierr);
+    break;
+  case TCPCONNECT:
+    entry.connect.pid = rec->pid;
+    entry.connect.ip = rec->ip;
+    entry.connect.dport = rec->rport;
+    event_record_addr_to_string(rec,rec->laddr,entry.connect.saddr);
+    event_record_addr_to_string(rec,rec->raddr,entry.connect.daddr);
+    event_record_comm(rec,entry.connect.comm);
+    ierr = event_store_add_connect(store,&entry.connect,now);CHKERRQ(ierr);
+    break;
+  case TCPCONNLAT:
+    entry.connlat.pid = rec->pid;
+    entry.connlat.ip = rec->ip;
+    entry.connlat.dport = rec->rport;
+    entry.connlat.lat_ms = (PetscReal)rec->duration_ns * 1.0e-6;
+    event_record_addr_to_string(rec,rec->laddr,entry.connlat.saddr);
+    event_record_addr_to_string(rec,rec->raddr,entry.connlat.daddr);
+    event_record_comm(rec,entry.connlat.comm);
+    ierr = event_store_add_connlat(store,&entry.connlat,now);CHKERRQ(ierr);
+    break;
+  case TCPLIFE:
+    entry.life.pid = rec->pid;
+    entry.life.ip = rec->ip;
+    entry.life.lport = rec->lport;
+    entry.life.rport = rec->rport;
+    entry.life.tx_kb = (PetscInt)(rec->tx_bytes / 1024);
+    entry.life.rx_kb = (PetscInt)(rec->rx_bytes / 1024);
+    entry.life.ms = (PetscReal)rec->duration_ns * 1.0e-6;
+    event_record_addr_to_string(rec,rec->laddr,entry.life.laddr);
+    event_record_addr_to_string(rec,rec->raddr,entry.life.raddr);
+    event_record_comm(rec,entry.life.comm);
+    ierr = event_store_add_life(store,&entry.life,now);CHKERRQ(ierr);
+    break;
+  default:
+    /* the event store keeps no retransmits */
+    break;
+  }
+  PetscFunctionReturn(0);
+}
+
+static void event_record_init(event_record *rec, InputType type, PetscInt pid, PetscInt ip, const char *comm)
+{
+  PetscLogDouble now;
+  memset(rec,0,sizeof(event_record));
+  PetscTime(&now);
+  rec->ts_ns = (uint64_t)(now * 1.0e9);
+  rec->type = (uint32_t)type;
+  rec->pid = (uint32_t)pid;
+  rec->ip = (uint16_t)ip;
+  if (comm) {
+    strncpy(rec->comm,comm,EVENT_RECORD_COMM_LEN);
+  }
+}
+
+static void event_record_string_to_addr(const event_record *rec, const char *str, uint8_t *addr)
+{
+  if (inet_pton(rec->ip == 6 ? AF_INET6 : AF_INET,str,addr) != 1) {
+    memset(addr,0,16);
+  }
+}
+
+PetscErrorCode event_record_from_accept(event_record *rec, tcpaccept_entry *entry)
+{
+  PetscFunctionBeginUser;
+  event_record_init(rec,TCPACCEPT,entry->pid,entry->ip,entry->comm);
+  rec->lport = (uint16_t)entry->lport;
+  rec->rport = (uint16_t)entry->rport;
+  event_record_string_to_addr(rec,entry->laddr,rec->laddr);
+  event_record_string_to_addr(rec,entry->raddr,rec->raddr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_record_from_connect(event_record *rec, tcpconnect_entry *entry)
+{
+  PetscFunctionBeginUser;
+  event_record_init(rec,TCPCONNECT,entry->pid,entry->ip,entry->comm);
+  rec->rport = (uint16_t)entry->dport;
+  event_record_string_to_addr(rec,entry->saddr,rec->laddr);
+  event_record_string_to_addr(rec,entry->daddr,rec->raddr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_record_from_connlat(event_record *rec, tcpconnlat_entry *entry)
+{
+  PetscFunctionBeginUser;
+  event_record_init(rec,TCPCONNLAT,entry->pid,entry->ip,entry->comm);
+  rec->rport = (uint16_t)entry->dport;
+  rec->duration_ns = (uint64_t)(entry->lat_ms * 1.0e6);
+  event_record_string_to_addr(rec,entry->saddr,rec->laddr);
+  event_record_string_to_addr(rec,entry->daddr,rec->raddr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_record_from_life(event_record *rec, tcplife_entry *entry)
+{
+  PetscFunctionBeginUser;
+  event_record_init(rec,TCPLIFE,entry->pid,entry->ip,entry->comm);
+  rec->lport = (uint16_t)entry->lport;
+  rec->rport = (uint16_t)entry->rport;
+  rec->tx_bytes = (uint64_t)entry->tx_kb * 1024;
+  rec->rx_bytes = (uint64_t)entry->rx_kb * 1024;
+  rec->duration_ns = (uint64_t)(entry->ms * 1.0e6);
+  event_record_string_to_addr(rec,entry->laddr,rec->laddr);
+  event_record_string_to_addr(rec,entry->raddr,rec->raddr);
+  PetscFunctionReturn(0);
+}
+
+/* "addr:port", where an IPv6 address has colons of its own */
+static void event_record_split_addr_port(const event_record *rec, const char *str, uint8_t *addr, uint16_t *port)
+{
+  char       buf[IP_ADDR_MAX_LEN];
+  const char *colon = strrchr(str,':');
+  size_t     len = colon ? (size_t)(colon - str) : strlen(str);
+  if (len >= IP_ADDR_MAX_LEN) {
+    len = IP_ADDR_MAX_LEN - 1;
+  }
+  memcpy(buf,str,len);
+  buf[len] = '\0';
+  event_record_string_to_addr(rec,buf,addr);
+  *port = colon ? (uint16_t)atoi(colon + 1) : 0;
+}
+
+PetscErrorCode event_record_from_retrans(event_record *rec, tcpretrans_entry *entry)
+{
+  PetscFunctionBeginUser;
+  event_record_init(rec,TCPRETRANS,entry->pid,entry->ip,NULL);
+  event_record_split_addr_port(rec,entry->laddr_port,rec->laddr,&rec->lport);
+  event_record_split_addr_port(rec,entry->raddr_port,rec->raddr,&rec->rport);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_record_file_open(const char *filename, FILE **fd)
+{
+  event_record_file_header header;
+  PetscFunctionBeginUser;
+  *fd = fopen(filename,"wb");
+  if (!*fd) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open event record file %s: %s\n",filename,strerror(errno));
+  }
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,EVENT_RECORD_MAGIC,sizeof(header.magic));
+  header.version = EVENT_RECORD_VERSION;
+  header.record_size = sizeof(event_record);
+  if (fwrite(&header,sizeof(header),1,*fd) != 1) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write event record file header: %s\n",strerror(errno));
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_record_write(FILE *fd, const event_record *rec)
+{
+  PetscFunctionBeginUser;
+  if (fwrite(rec,sizeof(event_record),1,fd) != 1) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write event record: %s\n",strerror(errno));
+  }
+  PetscFunctionReturn(0);
+}
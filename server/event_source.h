@@ -0,0 +1,103 @@
+#ifndef DCPROF_EVENT_SOURCE_H
+#define DCPROF_EVENT_SOURCE_H
+#include "petsc_webserver.h"
+#include "event_store.h"
+#include <stdint.h>
+#include <sys/types.h>
+
+/* binary sources of TCP events. Instead of running the bcc tools, formatting
+   their events as text and parsing the text back with strtok, an event source
+   hands the driver fixed-layout event_records that are applied to
+   process_statistics without any parsing.
+
+   RINGBUF : records are consumed from a BPF ring buffer map pinned in bpffs (by
+             default EVENT_SOURCE_DEFAULT_PIN). The BPF program that fills it must
+             submit exactly this struct. Needs libbpf (build with -DDCPROF_HAVE_LIBBPF
+             and link -lbpf) and the privileges to open the pinned map.
+   REPLAY  : records are read from a file written by event_record_write() (e.g. with
+             the driver's --event_record option), so everything downstream can be
+             tested and benchmarked without privileges. The file is followed as it
+             grows, like the text logs.
+   LOG     : records are read from a compact event log (see event_log.h) through
+             mmap(); the log is followed as it grows. */
+
+typedef enum {EVENT_SOURCE_RINGBUF,EVENT_SOURCE_REPLAY,EVENT_SOURCE_LOG} EventSourceType;
+static const char *EventSourceTypes[] = {"RINGBUF","REPLAY","LOG","EventSourceType","EVENT_SOURCE_",0};
+
+#define EVENT_SOURCE_DEFAULT_PIN "/sys/fs/bpf/dcprof_events"
+#define EVENT_RECORD_MAGIC       "DCPEVT1"
+#define EVENT_RECORD_VERSION     1
+#define EVENT_RECORD_COMM_LEN    16 /* TASK_COMM_LEN */
+
+/* one event; type is an InputType. 96 bytes, no implicit padding */
+typedef struct {
+  uint64_t ts_ns;           /* when it happened, in nanoseconds since the epoch; 0 if unknown */
+  uint32_t type,pid;
+  uint16_t ip;              /* 4 or 6 */
+  uint16_t lport,rport;     /* host byte order; lport is 0 for TCPCONNECT and TCPCONNLAT */
+  uint16_t state;           /* TCPRETRANS: the TCP state number */
+  uint8_t  laddr[16],raddr[16]; /* network byte order; IPv4 uses the first 4 bytes */
+  uint64_t tx_bytes,rx_bytes;   /* TCPLIFE */
+  uint64_t duration_ns;         /* TCPCONNLAT: the latency; TCPLIFE: the lifetime */
+  char     comm[EVENT_RECORD_COMM_LEN];
+} event_record;
+
+/* the replay file starts with this header */
+typedef struct {
+  char     magic[8];
+  uint32_t version,record_size;
+} event_record_file_header;
+
+typedef PetscErrorCode (*event_record_handler)(const event_record *, void *);
+
+typedef struct {
+  EventSourceType      type;
+  int                  fd;
+  off_t                offset;   /* REPLAY: bytes of the file consumed so far */
+  void                 *ring;    /* RINGBUF: the libbpf struct ring_buffer */
+  void                 *log;     /* LOG: the event_log_reader */
+  event_record_handler handler;
+  void                 *ctx;
+  PetscErrorCode       error;    /* RINGBUF: error raised inside the libbpf callback */
+  PetscInt             nrecords;
+  event_record         *batch;
+  size_t               batch_capacity;
+  size_t               max_bytes; /* REPLAY and LOG: of the file read per poll at most, 0 for no limit */
+  PetscBool            behind;    /* REPLAY and LOG: whether the last poll stopped at max_bytes */
+} event_source;
+
+/* opens the event source of the type in the second parameter at the path in the
+   third (the pinned map for RINGBUF, the file for REPLAY and LOG) */
+extern PetscErrorCode event_source_open(event_source *, EventSourceType, const char *);
+
+extern PetscErrorCode event_source_close(event_source *);
+
+/* calls the handler in the second parameter, with the context in the third, on every
+   record available now, without blocking. The number of records handled is stored in
+   the last parameter. */
+extern PetscErrorCode event_source_poll(event_source *, event_record_handler, void *, PetscInt *);
+
+/* stores how many bytes of its file a REPLAY or LOG source has read in the second
+   parameter, and the size of the file in the third; both are 0 for RINGBUF */
+extern PetscErrorCode event_source_progress(event_source *, int64_t *, int64_t *);
+
+/* the no-parse equivalent of the process_statistics_add_XXX() functions */
+extern PetscErrorCode process_statistics_add_event(process_statistics *, const event_record *);
+
+/* stores the record in the event store, with its own time, or with the ingestion time
+   in the third parameter if its ts_ns is 0 */
+extern PetscErrorCode event_store_add_record(event_store *, const event_record *, PetscLogDouble);
+
+/* convert parsed text entries to records, so text logs can be recorded for replay */
+extern PetscErrorCode event_record_from_accept(event_record *, tcpaccept_entry *);
+extern PetscErrorCode event_record_from_connect(event_record *, tcpconnect_entry *);
+extern PetscErrorCode event_record_from_connlat(event_record *, tcpconnlat_entry *);
+extern PetscErrorCode event_record_from_life(event_record *, tcplife_entry *);
+extern PetscErrorCode event_record_from_retrans(event_record *, tcpretrans_entry *);
+
+/* creates (or truncates) the replay file named by the first parameter and writes its header */
+extern PetscErrorCode event_record_file_open(const char *, FILE **);
+
+extern PetscErrorCode event_record_write(FILE *, const event_record *);
+
+#endif
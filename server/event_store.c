@@ -0,0 +1,817 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "event_store.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <math.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+static const char *unknown_string = "[unknown]";
+
+static size_t fnv1a(const char *str)
+{
+  size_t h = 14695981039346656037ULL;
+  for (; *str; ++str) {
+    h ^= (unsigned char)(*str);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+PetscErrorCode string_table_create(string_table *tab, PetscInt max_strings)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  if (max_strings < 1) {
+    SETERRQ1(PETSC_COMM_WORLD,PETSC_ERR_ARG_OUTOFRANGE,"A string table must hold at least one string, not %D",max_strings);
+  }
+  tab->max_strings = max_strings;
+  tab->nstrings = 0;
+  /* keep the load factor at or below 1/2 */
+  tab->nslots = 16;
+  while (tab->nslots < 2*max_strings) {
+    tab->nslots *= 2;
+  }
+  tab->pool_capacity = 1024;
+  tab->pool_len = 0;
+  ierr = PetscMalloc1(tab->pool_capacity,&tab->pool);CHKERRQ(ierr);
+  ierr = PetscMalloc1(max_strings,&tab->offsets);CHKERRQ(ierr);
+  ierr = PetscMalloc1(tab->nslots,&tab->slots);CHKERRQ(ierr);
+  for (i=0; i<tab->nslots; ++i) {
+    tab->slots[i] = -1;
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode string_table_destroy(string_table *tab)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscFree(tab->pool);CHKERRQ(ierr);
+  ierr = PetscFree(tab->offsets);CHKERRQ(ierr);
+  ierr = PetscFree(tab->slots);CHKERRQ(ierr);
+  tab->nstrings = tab->nslots = 0;
+  tab->pool_len = tab->pool_capacity = 0;
+  PetscFunctionReturn(0);
+}
+
+/* returns the slot holding str, or the empty slot where it would be inserted */
+static PetscInt string_table_slot(string_table *tab, const char *str)
+{
+  size_t   mask = (size_t)tab->nslots - 1;
+  size_t   i = fnv1a(str) & mask;
+  while (tab->slots[i] != -1) {
+    if (strcmp(tab->pool + tab->offsets[tab->slots[i]],str) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return (PetscInt)i;
+}
+
+PetscErrorCode string_table_find(string_table *tab, const char *str, PetscInt *id)
+{
+  PetscFunctionBeginUser;
+  *id = tab->slots[string_table_slot(tab,str)];
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode string_table_intern(string_table *tab, const char *str, PetscInt *id)
+{
+  PetscErrorCode ierr;
+  PetscInt       slot;
+  size_t         len;
+  PetscFunctionBeginUser;
+  slot = string_table_slot(tab,str);
+  if (tab->slots[slot] != -1) {
+    *id = tab->slots[slot];
+    PetscFunctionReturn(0);
+  }
+  if (tab->nstrings == tab->max_strings) {
+    *id = -1;
+    PetscFunctionReturn(0);
+  }
+  ierr = PetscStrlen(str,&len);CHKERRQ(ierr);
+  if (tab->pool_len + len + 1 > tab->pool_capacity) {
+    while (tab->pool_len + len + 1 > tab->pool_capacity) {
+      tab->pool_capacity *= 2;
+    }
+    ierr = PetscRealloc(tab->pool_capacity,&tab->pool);CHKERRQ(ierr);
+  }
+  ierr = PetscMemcpy(tab->pool + tab->pool_len,str,len+1);CHKERRQ(ierr);
+  tab->offsets[tab->nstrings] = tab->pool_len;
+  tab->pool_len += len + 1;
+  tab->slots[slot] = tab->nstrings;
+  *id = tab->nstrings++;
+  PetscFunctionReturn(0);
+}
+
+const char *string_table_get(string_table *tab, PetscInt id)
+{
+  if (id < 0 || id >= tab->nstrings) {
+    return unknown_string;
+  }
+  return tab->pool + tab->offsets[id];
+}
+
+PetscErrorCode event_store_create(event_store *store, size_t capacity)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (capacity < 1) {
+    SETERRQ(PETSC_COMM_WORLD,PETSC_ERR_ARG_OUTOFRANGE,"Event store capacity must be positive");
+  }
+  store->capacity = capacity;
+  store->count = 0;
+  store->next = 0;
+  ierr = PetscMalloc1(capacity,&store->type);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->pid);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->name_id);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->laddr_id);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->raddr_id);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->lport);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->rport);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->ip);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->tx_kb);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->rx_kb);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->latency_ms);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->duration_ms);CHKERRQ(ierr);
+  ierr = PetscMalloc1(capacity,&store->timestamp);CHKERRQ(ierr);
+  /* names and addresses are far fewer than events; the tables only stop growing
+     so that a stream of unique addresses can't exhaust memory */
+  ierr = string_table_create(&store->names,65536);CHKERRQ(ierr);
+  ierr = string_table_create(&store->addrs,1<<20);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_store_destroy(event_store *store)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscFree(store->type);CHKERRQ(ierr);
+  ierr = PetscFree(store->pid);CHKERRQ(ierr);
+  ierr = PetscFree(store->name_id);CHKERRQ(ierr);
+  ierr = PetscFree(store->laddr_id);CHKERRQ(ierr);
+  ierr = PetscFree(store->raddr_id);CHKERRQ(ierr);
+  ierr = PetscFree(store->lport);CHKERRQ(ierr);
+  ierr = PetscFree(store->rport);CHKERRQ(ierr);
+  ierr = PetscFree(store->ip);CHKERRQ(ierr);
+  ierr = PetscFree(store->tx_kb);CHKERRQ(ierr);
+  ierr = PetscFree(store->rx_kb);CHKERRQ(ierr);
+  ierr = PetscFree(store->latency_ms);CHKERRQ(ierr);
+  ierr = PetscFree(store->duration_ms);CHKERRQ(ierr);
+  ierr = PetscFree(store->timestamp);CHKERRQ(ierr);
+  ierr = string_table_destroy(&store->names);CHKERRQ(ierr);
+  ierr = string_table_destroy(&store->addrs);CHKERRQ(ierr);
+  store->capacity = store->count = store->next = 0;
+  PetscFunctionReturn(0);
+}
+
+/* claims the next row of the store, overwriting the oldest event if full */
+static size_t event_store_next_row(event_store *store)
+{
+  size_t row = store->next;
+  store->next = (store->next + 1) % store->capacity;
+  if (store->count < store->capacity) {
+    ++(store->count);
+  }
+  return row;
+}
+
+static PetscErrorCode event_store_add(event_store *store, InputType type, PetscInt pid, PetscInt ip,
+				      const char *comm, const char *laddr, const char *raddr,
+				      PetscInt lport, PetscInt rport, PetscInt tx_kb, PetscInt rx_kb,
+				      PetscReal latency_ms, PetscReal duration_ms, PetscLogDouble now)
+{
+  PetscErrorCode ierr;
+  PetscInt       name_id,laddr_id,raddr_id;
+  size_t         row;
+  PetscFunctionBeginUser;
+  ierr = string_table_intern(&store->names,comm,&name_id);CHKERRQ(ierr);
+  ierr = string_table_intern(&store->addrs,laddr,&laddr_id);CHKERRQ(ierr);
+  ierr = string_table_intern(&store->addrs,raddr,&raddr_id);CHKERRQ(ierr);
+  row = event_store_next_row(store);
+  store->type[row] = (int32_t)type;
+  store->pid[row] = pid;
+  store->name_id[row] = name_id;
+  store->laddr_id[row] = laddr_id;
+  store->raddr_id[row] = raddr_id;
+  store->lport[row] = lport;
+  store->rport[row] = rport;
+  store->ip[row] = ip;
+  store->tx_kb[row] = tx_kb;
+  store->rx_kb[row] = rx_kb;
+  store->latency_ms[row] = latency_ms;
+  store->duration_ms[row] = duration_ms;
+  store->timestamp[row] = now;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_store_add_accept(event_store *store, tcpaccept_entry *entry, PetscLogDouble now)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = event_store_add(store,TCPACCEPT,entry->pid,entry->ip,entry->comm,entry->laddr,entry->raddr,
+			 entry->lport,entry->rport,0,0,0.0,0.0,now);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_store_add_connect(event_store *store, tcpconnect_entry *entry, PetscLogDouble now)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = event_store_add(store,TCPCONNECT,entry->pid,entry->ip,entry->comm,entry->saddr,entry->daddr,
+			 -1,entry->dport,0,0,0.0,0.0,now);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_store_add_connlat(event_store *store, tcpconnlat_entry *entry, PetscLogDouble now)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = event_store_add(store,TCPCONNLAT,entry->pid,entry->ip,entry->comm,entry->saddr,entry->daddr,
+			 -1,entry->dport,0,0,entry->lat_ms,0.0,now);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_store_add_life(event_store *store, tcplife_entry *entry, PetscLogDouble now)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = event_store_add(store,TCPLIFE,entry->pid,entry->ip,entry->comm,entry->laddr,entry->raddr,
+			 entry->lport,entry->rport,entry->tx_kb,entry->rx_kb,0.0,entry->ms,now);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* re-interns the strings the first count rows of the id columns in the third and
+   fourth parameter (which may be NULL) still use into a new table, and remaps the
+   ids, so that those only forgotten rows used are released */
+static PetscErrorCode string_table_compact(string_table *tab, size_t count, int32_t *ids, int32_t *ids2)
+{
+  PetscErrorCode ierr;
+  string_table   fresh;
+  size_t         row;
+  PetscInt       id;
+  PetscFunctionBeginUser;
+  ierr = string_table_create(&fresh,tab->max_strings);CHKERRQ(ierr);
+  for (row=0; row<count; ++row) {
+    if (ids[row] >= 0) {
+      ierr = string_table_intern(&fresh,string_table_get(tab,ids[row]),&id);CHKERRQ(ierr);
+      ids[row] = (int32_t)id;
+    }
+    if (ids2 && ids2[row] >= 0) {
+      ierr = string_table_intern(&fresh,string_table_get(tab,ids2[row]),&id);CHKERRQ(ierr);
+      ids2[row] = (int32_t)id;
+    }
+  }
+  ierr = string_table_destroy(tab);CHKERRQ(ierr);
+  *tab = fresh;
+  PetscFunctionReturn(0);
+}
+
+/* moves the rows in the second parameter, of the number in the third, of the column
+   in the first, whose elements are of the size in the fourth, to the front of it in
+   that order. tmp has room for as many elements. */
+static void event_column_gather(void *col, const size_t *rows, size_t n, size_t size, void *tmp)
+{
+  size_t k;
+  for (k=0; k<n; ++k) {
+    memcpy((char*)tmp + k*size,(char*)col + rows[k]*size,size);
+  }
+  memcpy(col,tmp,n*size);
+}
+
+PetscErrorCode event_store_forget(event_store *store, PetscInt npid, const PetscInt *pids)
+{
+  PetscErrorCode ierr;
+  PetscInt       *sorted,loc;
+  size_t         *rows,first,row,k,nkept=0;
+  PetscReal      *tmp;
+  PetscFunctionBeginUser;
+  if (!npid || !store->count) {
+    PetscFunctionReturn(0);
+  }
+  ierr = PetscMalloc1(npid,&sorted);CHKERRQ(ierr);
+  ierr = PetscMemcpy(sorted,pids,npid*sizeof(PetscInt));CHKERRQ(ierr);
+  ierr = PetscSortInt(npid,sorted);CHKERRQ(ierr);
+  ierr = PetscMalloc1(store->count,&rows);CHKERRQ(ierr);
+  /* the rows that are kept, oldest first */
+  first = store->count < store->capacity ? 0 : store->next;
+  for (k=0; k<store->count; ++k) {
+    row = (first + k) % store->capacity;
+    ierr = PetscFindInt(store->pid[row],npid,sorted,&loc);CHKERRQ(ierr);
+    if (loc < 0) {
+      rows[nkept++] = row;
+    }
+  }
+  if (nkept < store->count) {
+    if (nkept) {
+      /* room for an element of the widest column */
+      ierr = PetscMalloc1(nkept,&tmp);CHKERRQ(ierr);
+      event_column_gather(store->type,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->pid,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->name_id,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->laddr_id,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->raddr_id,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->lport,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->rport,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->ip,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->tx_kb,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->rx_kb,rows,nkept,sizeof(int32_t),tmp);
+      event_column_gather(store->latency_ms,rows,nkept,sizeof(PetscReal),tmp);
+      event_column_gather(store->duration_ms,rows,nkept,sizeof(PetscReal),tmp);
+      event_column_gather(store->timestamp,rows,nkept,sizeof(PetscReal),tmp);
+      ierr = PetscFree(tmp);CHKERRQ(ierr);
+    }
+    /* the rows are in order again, and the store is no longer full */
+    store->count = nkept;
+    store->next = nkept;
+    ierr = string_table_compact(&store->names,store->count,store->name_id,NULL);CHKERRQ(ierr);
+    ierr = string_table_compact(&store->addrs,store->count,store->laddr_id,store->raddr_id);CHKERRQ(ierr);
+  }
+  ierr = PetscFree(rows);CHKERRQ(ierr);
+  ierr = PetscFree(sorted);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* selection bitmaps hold one bit per row; bit (i % 64) of word (i / 64) is row i */
+#define SEL_WORDS(n) (((n) + 63) / 64)
+
+/* keeps only the rows with lo <= col[i] <= hi set in sel (or, if negate, only those outside
+   that range). Every integer comparison is reduced to this form. */
+static void scan_int_range(const int32_t *col, size_t n, int32_t lo, int32_t hi, PetscBool negate, uint64_t *sel)
+{
+  size_t   w,i,nfull = n / 64;
+  uint64_t flip = negate ? ~(uint64_t)0 : 0;
+  for (w=0; w<nfull; ++w) {
+    const int32_t *c = col + 64*w;
+    uint64_t      m = 0;
+    if (!sel[w]) continue;
+#if defined(__AVX2__)
+    {
+      const __m256i vlo = _mm256_set1_epi32(lo),vhi = _mm256_set1_epi32(hi);
+      for (i=0; i<64; i+=8) {
+	__m256i x = _mm256_loadu_si256((const __m256i*)(c+i));
+	/* out of range iff lo > x or x > hi */
+	__m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(vlo,x),_mm256_cmpgt_epi32(x,vhi));
+	m |= (uint64_t)(~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xff) << i;
+      }
+    }
+#else
+    for (i=0; i<64; ++i) {
+      m |= (uint64_t)((c[i] >= lo) & (c[i] <= hi)) << i;
+    }
+#endif
+    sel[w] &= m ^ flip;
+  }
+  if (n % 64) {
+    uint64_t m = 0;
+    for (i=64*nfull; i<n; ++i) {
+      m |= (uint64_t)(((col[i] >= lo) & (col[i] <= hi)) ^ (negate ? 1 : 0)) << (i % 64);
+    }
+    sel[nfull] &= m;
+  }
+}
+
+static void scan_int(const int32_t *col, size_t n, event_cmp op, PetscReal value, uint64_t *sel)
+{
+  /* round the bound so that e.g. rport < 1023.5 behaves like rport <= 1023. The
+     bounds stay reals until they are clamped to the column's range, so a value
+     past either end of it selects all of the rows or none of them. */
+  PetscReal lo = (PetscReal)INT32_MIN,hi = (PetscReal)INT32_MAX;
+  PetscBool negate = (PetscBool)(op == EVENT_CMP_NE);
+  if (value != value) {
+    /* nothing compares with NaN, except as not equal */
+    lo = 1; hi = 0;
+  } else {
+    switch (op) {
+    case EVENT_CMP_EQ:
+    case EVENT_CMP_NE:
+      if (value != floor(value)) {
+	/* an integer column can never equal a fractional value */
+	lo = 1; hi = 0;
+      } else {
+	lo = hi = value;
+      }
+      break;
+    case EVENT_CMP_LT: hi = ceil(value) - 1; break;
+    case EVENT_CMP_LE: hi = floor(value); break;
+    case EVENT_CMP_GT: lo = floor(value) + 1; break;
+    case EVENT_CMP_GE: lo = ceil(value); break;
+    }
+    lo = PetscMax(lo,(PetscReal)INT32_MIN);
+    hi = PetscMin(hi,(PetscReal)INT32_MAX);
+  }
+  if (lo > hi || (lo == (PetscReal)INT32_MIN && hi == (PetscReal)INT32_MAX)) {
+    /* none of the rows are in the range, or all of them */
+    if ((lo > hi) != negate) {
+      memset(sel,0,SEL_WORDS(n)*sizeof(uint64_t));
+    }
+    return;
+  }
+  scan_int_range(col,n,(int32_t)lo,(int32_t)hi,negate,sel);
+}
+
+#if defined(__AVX2__)
+#define SCAN_REAL_AVX2(CMP) do {					\
+    const __m256d vv = _mm256_set1_pd(value);				\
+    for (i=0; i<64; i+=4) {						\
+      __m256d x = _mm256_loadu_pd(c+i);				\
+      m |= (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(x,vv,CMP)) << i; \
+    }									\
+  } while (0)
+#endif
+
+#define SCAN_REAL_SCALAR(EXPR,start,end) do {		\
+    for (i=start; i<end; ++i) {				\
+      const PetscReal x = col[i];			\
+      m |= (uint64_t)(EXPR) << (i % 64);		\
+    }							\
+  } while (0)
+
+static void scan_real(const PetscReal *col, size_t n, event_cmp op, PetscReal value, uint64_t *sel)
+{
+  size_t   w,i,nfull = n / 64;
+  for (w=0; w<nfull; ++w) {
+    uint64_t m = 0;
+    if (!sel[w]) continue;
+#if defined(__AVX2__)
+    const PetscReal *c = col + 64*w;
+    switch (op) {
+    case EVENT_CMP_EQ: SCAN_REAL_AVX2(_CMP_EQ_OQ); break;
+    case EVENT_CMP_NE: SCAN_REAL_AVX2(_CMP_NEQ_UQ); break;
+    case EVENT_CMP_LT: SCAN_REAL_AVX2(_CMP_LT_OQ); break;
+    case EVENT_CMP_LE: SCAN_REAL_AVX2(_CMP_LE_OQ); break;
+    case EVENT_CMP_GT: SCAN_REAL_AVX2(_CMP_GT_OQ); break;
+    case EVENT_CMP_GE: SCAN_REAL_AVX2(_CMP_GE_OQ); break;
+    }
+#else
+    switch (op) {
+    case EVENT_CMP_EQ: SCAN_REAL_SCALAR(x == value,64*w,64*w+64); break;
+    case EVENT_CMP_NE: SCAN_REAL_SCALAR(x != value,64*w,64*w+64); break;
+    case EVENT_CMP_LT: SCAN_REAL_SCALAR(x < value,64*w,64*w+64); break;
+    case EVENT_CMP_LE: SCAN_REAL_SCALAR(x <= value,64*w,64*w+64); break;
+    case EVENT_CMP_GT: SCAN_REAL_SCALAR(x > value,64*w,64*w+64); break;
+    case EVENT_CMP_GE: SCAN_REAL_SCALAR(x >= value,64*w,64*w+64); break;
+    }
+#endif
+    sel[w] &= m;
+  }
+  if (n % 64) {
+    uint64_t m = 0;
+    switch (op) {
+    case EVENT_CMP_EQ: SCAN_REAL_SCALAR(x == value,64*nfull,n); break;
+    case EVENT_CMP_NE: SCAN_REAL_SCALAR(x != value,64*nfull,n); break;
+    case EVENT_CMP_LT: SCAN_REAL_SCALAR(x < value,64*nfull,n); break;
+    case EVENT_CMP_LE: SCAN_REAL_SCALAR(x <= value,64*nfull,n); break;
+    case EVENT_CMP_GT: SCAN_REAL_SCALAR(x > value,64*nfull,n); break;
+    case EVENT_CMP_GE: SCAN_REAL_SCALAR(x >= value,64*nfull,n); break;
+    }
+    sel[nfull] &= m;
+  }
+}
+
+static int32_t *event_store_int_column(event_store *store, event_column col)
+{
+  switch (col) {
+  case EVENT_COL_TYPE:  return store->type;
+  case EVENT_COL_PID:   return store->pid;
+  case EVENT_COL_NAME:  return store->name_id;
+  case EVENT_COL_LADDR: return store->laddr_id;
+  case EVENT_COL_RADDR: return store->raddr_id;
+  case EVENT_COL_LPORT: return store->lport;
+  case EVENT_COL_RPORT: return store->rport;
+  case EVENT_COL_IP:    return store->ip;
+  case EVENT_COL_TX_KB: return store->tx_kb;
+  case EVENT_COL_RX_KB: return store->rx_kb;
+  default:              return NULL;
+  }
+}
+
+static PetscReal *event_store_real_column(event_store *store, event_column col)
+{
+  switch (col) {
+  case EVENT_COL_LATENCY:  return store->latency_ms;
+  case EVENT_COL_DURATION: return store->duration_ms;
+  case EVENT_COL_TIME:     return store->timestamp;
+  default:                 return NULL;
+  }
+}
+
+/* string-valued predicates are resolved to ids once, so the scan itself is an integer compare */
+static PetscErrorCode event_predicate_resolve(event_store *store, event_predicate *pred, PetscReal *value)
+{
+  PetscErrorCode ierr;
+  PetscInt       id = -1;
+  PetscBool      match;
+  PetscFunctionBeginUser;
+  switch (pred->col) {
+  case EVENT_COL_NAME:
+    ierr = string_table_find(&store->names,pred->str,&id);CHKERRQ(ierr);
+    break;
+  case EVENT_COL_LADDR:
+  case EVENT_COL_RADDR:
+    ierr = string_table_find(&store->addrs,pred->str,&id);CHKERRQ(ierr);
+    break;
+  case EVENT_COL_TYPE:
+    for (id=0; id<TCPRETRANS+1; ++id) {
+      ierr = PetscStrcasecmp(InputTypes[id],pred->str,&match);CHKERRQ(ierr);
+      if (match) break;
+    }
+    if (id == TCPRETRANS+1) {
+      id = -1;
+    }
+    break;
+  default:
+    *value = pred->value;
+    PetscFunctionReturn(0);
+  }
+  /* ids are never negative, so an unknown string matches nothing under EQ and
+     everything under NE */
+  *value = (PetscReal)(id < 0 ? -1 : id);
+  PetscFunctionReturn(0);
+}
+
+/* the key of row i of the group-by column, written as a string */
+static void event_store_group_key(event_store *store, event_column col, size_t i, char *key)
+{
+  switch (col) {
+  case EVENT_COL_NAME:
+    PetscStrncpy(key,string_table_get(&store->names,store->name_id[i]),EVENT_GROUP_KEY_LEN);
+    break;
+  case EVENT_COL_LADDR:
+    PetscStrncpy(key,string_table_get(&store->addrs,store->laddr_id[i]),EVENT_GROUP_KEY_LEN);
+    break;
+  case EVENT_COL_RADDR:
+    PetscStrncpy(key,string_table_get(&store->addrs,store->raddr_id[i]),EVENT_GROUP_KEY_LEN);
+    break;
+  case EVENT_COL_TYPE:
+    PetscStrncpy(key,InputTypes[store->type[i]],EVENT_GROUP_KEY_LEN);
+    break;
+  case EVENT_COL_NONE:
+    PetscStrncpy(key,"all",EVENT_GROUP_KEY_LEN);
+    break;
+  default:
+    sprintf(key,"%d",(int)event_store_int_column(store,col)[i]);
+    break;
+  }
+}
+
+PetscErrorCode event_store_query(event_store *store, event_query *query, PetscInt rank,
+				 PetscLogDouble now, event_group_row **rowsptr, PetscInt *nrowsptr)
+{
+  PetscErrorCode  ierr;
+  size_t          n = store->count,nwords = SEL_WORDS(store->count),w,i;
+  uint64_t        *sel,bits;
+  PetscInt        p,group,ngroup=0,row_capacity=16;
+  PetscReal       value;
+  int32_t         *icol,*gcol=NULL;
+  PetscReal       *rcol;
+  event_group_row *rows,*r;
+  PetscHMapI      groups;
+  PetscFunctionBeginUser;
+  ierr = PetscMalloc1(nwords+1,&sel);CHKERRQ(ierr);
+  for (w=0; w<nwords; ++w) {
+    sel[w] = ~(uint64_t)0;
+  }
+  /* rows past the count are never selected, even by a query with no predicates */
+  if (n % 64) {
+    sel[nwords-1] = ((uint64_t)1 << (n % 64)) - 1;
+  }
+  if (query->since > 0.0) {
+    scan_real(store->timestamp,n,EVENT_CMP_GE,now - query->since,sel);
+  }
+  for (p=0; p<query->npred; ++p) {
+    ierr = event_predicate_resolve(store,&query->pred[p],&value);CHKERRQ(ierr);
+    if ((icol = event_store_int_column(store,query->pred[p].col))) {
+      scan_int(icol,n,query->pred[p].op,value,sel);
+    } else if ((rcol = event_store_real_column(store,query->pred[p].col))) {
+      scan_real(rcol,n,query->pred[p].op,value,sel);
+    }
+  }
+
+  /* hash group-by over the surviving rows */
+  ierr = PetscHMapICreate(&groups);CHKERRQ(ierr);
+  ierr = PetscMalloc1(row_capacity,&rows);CHKERRQ(ierr);
+  if (query->group_by != EVENT_COL_NONE) {
+    gcol = event_store_int_column(store,query->group_by);
+  }
+  for (w=0; w<nwords; ++w) {
+    for (bits=sel[w]; bits; bits &= bits - 1) {
+      i = 64*w + (size_t)__builtin_ctzll(bits);
+      ierr = PetscHMapIGet(groups,gcol ? gcol[i] : 0,&group);CHKERRQ(ierr);
+      if (group < 0) {
+	if (ngroup == row_capacity) {
+	  row_capacity *= 2;
+	  ierr = PetscRealloc(row_capacity*sizeof(event_group_row),&rows);CHKERRQ(ierr);
+	}
+	group = ngroup++;
+	ierr = PetscHMapISet(groups,gcol ? gcol[i] : 0,group);CHKERRQ(ierr);
+	r = &rows[group];
+	ierr = PetscMemzero(r,sizeof(event_group_row));CHKERRQ(ierr);
+	r->rank = rank;
+	event_store_group_key(store,gcol ? query->group_by : EVENT_COL_NONE,i,r->key);
+      }
+      r = &rows[group];
+      ++(r->count);
+      r->tx_kb += store->tx_kb[i];
+      r->rx_kb += store->rx_kb[i];
+      r->sum_latency += store->latency_ms[i];
+      r->max_latency = PetscMax(r->max_latency,store->latency_ms[i]);
+      r->sum_duration += store->duration_ms[i];
+    }
+  }
+  ierr = PetscHMapIDestroy(&groups);CHKERRQ(ierr);
+  ierr = PetscFree(sel);CHKERRQ(ierr);
+  *rowsptr = rows;
+  *nrowsptr = ngroup;
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode event_column_parse(const char *str, event_column *col)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscBool      match;
+  PetscFunctionBeginUser;
+  for (i=0; EventColumns[i]; ++i) {
+    ierr = PetscStrcasecmp(EventColumns[i],str,&match);CHKERRQ(ierr);
+    if (match) {
+      *col = (event_column)i;
+      PetscFunctionReturn(0);
+    }
+  }
+  SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Unknown event column %s\n",str);
+}
+
+/* the number in the first parameter, which must be all of it, in the second */
+static PetscErrorCode event_query_parse_number(const char *str, PetscReal *value)
+{
+  char *end;
+  PetscFunctionBeginUser;
+  *value = (PetscReal)strtod(str,&end);
+  if (end == str || *end) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Query value %s is not a number\n",str);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_query_parse(const char *str, event_query *query)
+{
+  PetscErrorCode  ierr;
+  char            buf[EVENT_QUERY_MAX_LEN],*term,*save,*op,*value;
+  event_column    col;
+  event_predicate *pred;
+  size_t          oplen;
+  PetscBool       match;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(query,sizeof(event_query));CHKERRQ(ierr);
+  query->group_by = EVENT_COL_NONE;
+  ierr = PetscStrncpy(query->text,str,EVENT_QUERY_MAX_LEN);CHKERRQ(ierr);
+  query->text[strcspn(query->text,"\n")] = '\0';
+  ierr = PetscStrncpy(buf,str,EVENT_QUERY_MAX_LEN);CHKERRQ(ierr);
+  for (term=strtok_r(buf,", \n",&save); term; term=strtok_r(NULL,", \n",&save)) {
+    op = strpbrk(term,"=!<>");
+    if (!op || op == term) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Query term %s is not of the form COLUMN OP VALUE\n",term);
+    }
+    oplen = (op[1] == '=') ? 2 : 1;
+    value = op + oplen;
+    if (op[0] == '=') {
+      *op = '\0';
+      ierr = PetscStrcmp(term,"since",&match);CHKERRQ(ierr);
+      if (match) {
+	ierr = event_query_parse_number(value,&query->since);CHKERRQ(ierr);
+	continue;
+      }
+      ierr = PetscStrcmp(term,"group",&match);CHKERRQ(ierr);
+      if (match) {
+	ierr = event_column_parse(value,&query->group_by);CHKERRQ(ierr);
+	/* groups are keyed by the integer columns */
+	if (query->group_by == EVENT_COL_LATENCY || query->group_by == EVENT_COL_DURATION || query->group_by == EVENT_COL_TIME) {
+	  SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Cannot group by column %s\n",value);
+	}
+	continue;
+      }
+      *op = '=';
+    }
+    if (query->npred == EVENT_QUERY_MAX_PREDICATES) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"A query may have at most %D predicates\n",EVENT_QUERY_MAX_PREDICATES);
+    }
+    pred = &query->pred[query->npred];
+    switch (op[0]) {
+    case '=': pred->op = EVENT_CMP_EQ; break;
+    case '!':
+      if (op[1] != '=') {
+	SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Unknown operator in query term %s\n",term);
+      }
+      pred->op = EVENT_CMP_NE;
+      break;
+    case '<': pred->op = oplen == 2 ? EVENT_CMP_LE : EVENT_CMP_LT; break;
+    case '>': pred->op = oplen == 2 ? EVENT_CMP_GE : EVENT_CMP_GT; break;
+    }
+    *op = '\0';
+    ierr = event_column_parse(term,&col);CHKERRQ(ierr);
+    pred->col = col;
+    if (col == EVENT_COL_NAME || col == EVENT_COL_LADDR || col == EVENT_COL_RADDR || col == EVENT_COL_TYPE) {
+      if (pred->op != EVENT_CMP_EQ && pred->op != EVENT_CMP_NE) {
+	SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Column %s only supports = and !=\n",term);
+      }
+      ierr = PetscStrncpy(pred->str,value,sizeof(pred->str));CHKERRQ(ierr);
+    } else if (col == EVENT_COL_NONE) {
+      SETERRQ(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Cannot filter on column none\n");
+    } else {
+      ierr = event_query_parse_number(value,&pred->value);CHKERRQ(ierr);
+    }
+    ++(query->npred);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_query_read_file(const char *filename, event_query *queries, PetscInt max_queries, PetscInt *nqueries)
+{
+  PetscErrorCode ierr;
+  PetscInt       rank,n=0;
+  FILE           *fd;
+  char           *line=NULL;
+  size_t         linesize=0;
+  PetscFunctionBeginUser;
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  if (!rank && (fd = fopen(filename,"r"))) {
+    while (getline(&line,&linesize,fd) != -1) {
+      if (line[0] == '\n' || line[0] == '#') continue;
+      if (n == max_queries) {
+	PetscFPrintf(PETSC_COMM_SELF,stderr,"Ignoring query past the first %D: %s",max_queries,line);
+	continue;
+      }
+      ierr = event_query_parse(line,&queries[n]);
+      if (ierr) {
+	PetscFPrintf(PETSC_COMM_SELF,stderr,"Ignoring malformed query %s",line);
+	continue;
+      }
+      ++n;
+    }
+    free(line);
+    fclose(fd);
+  }
+  MPI_Bcast(&n,1,MPI_INT,0,PETSC_COMM_WORLD);
+  MPI_Bcast(queries,n*sizeof(event_query),MPI_BYTE,0,PETSC_COMM_WORLD);
+  *nqueries = n;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_group_row_view(FILE *fd, event_group_row *row)
+{
+  PetscFunctionBeginUser;
+  PetscFPrintf(PETSC_COMM_SELF,fd,"rank = %D, key = %s, count = %ld, tx_kb = %ld, rx_kb = %ld, avg_latency = %g, max_latency = %g, avg_duration = %g\n",
+	       row->rank,row->key,row->count,row->tx_kb,row->rx_kb,
+	       row->count ? row->sum_latency / row->count : 0.0,row->max_latency,
+	       row->count ? row->sum_duration / row->count : 0.0);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode event_store_gather_queries(event_store *store, event_query *queries, PetscInt nqueries, FILE *fd)
+{
+  PetscErrorCode  ierr;
+  PetscInt        rank,size,q,i,nrows,total,*counts=NULL,*displs=NULL;
+  event_group_row *rows,*all=NULL;
+  PetscLogDouble  now;
+  PetscFunctionBeginUser;
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  MPI_Comm_size(PETSC_COMM_WORLD,&size);
+  ierr = PetscTime(&now);CHKERRQ(ierr);
+  if (!rank) {
+    ierr = PetscMalloc2(size,&counts,size,&displs);CHKERRQ(ierr);
+  }
+  for (q=0; q<nqueries; ++q) {
+    ierr = event_store_query(store,&queries[q],rank,now,&rows,&nrows);CHKERRQ(ierr);
+    MPI_Gather(&nrows,1,MPI_INT,counts,1,MPI_INT,0,PETSC_COMM_WORLD);
+    total = 0;
+    if (!rank) {
+      for (i=0; i<size; ++i) {
+	displs[i] = total;
+	total += counts[i];
+      }
+      ierr = PetscMalloc1(total+1,&all);CHKERRQ(ierr);
+    }
+    MPI_Gatherv(rows,nrows,MPI_DTYPES[DTYPE_GROUP_ROW],all,counts,displs,
+		MPI_DTYPES[DTYPE_GROUP_ROW],0,PETSC_COMM_WORLD);
+    if (!rank && fd) {
+      PetscFPrintf(PETSC_COMM_SELF,fd,"Query result for %s (%D groups):\n",queries[q].text,total);
+      for (i=0; i<total; ++i) {
+	ierr = event_group_row_view(fd,&all[i]);CHKERRQ(ierr);
+      }
+    }
+    ierr = PetscFree(rows);CHKERRQ(ierr);
+    if (!rank) {
+      ierr = PetscFree(all);CHKERRQ(ierr);
+    }
+  }
+  if (!rank) {
+    ierr = PetscFree2(counts,displs);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,142 @@
+#ifndef DCPROF_EVENT_STORE_H
+#define DCPROF_EVENT_STORE_H
+#include "petsc_webserver.h"
+#include <stdint.h>
+#include <petsc/private/hashmapi.h>
+
+/* a bounded, columnar (struct-of-arrays) store of the most recent TCP events
+   seen on this rank. Where process_statistics only keeps running totals per PID,
+   the event store keeps the individual events so that ad-hoc questions such as
+   "connections to port 5432 with latency > 10 ms in the last minute, grouped by
+   process name" can be answered. Strings (process names, IP addresses) are
+   interned into dense integer ids so that every column is a flat numeric array
+   that can be scanned with SIMD compares. */
+
+/* interns strings into dense ids 0,1,2,... */
+typedef struct {
+  char     *pool;   /* all interned strings, NUL-separated */
+  size_t   pool_len,pool_capacity;
+  size_t   *offsets; /* offsets[id] is the start of string id in pool */
+  PetscInt *slots;   /* open-addressing hash table of ids, -1 for empty */
+  PetscInt nstrings,nslots,max_strings;
+} string_table;
+
+extern PetscErrorCode string_table_create(string_table *, PetscInt);
+
+extern PetscErrorCode string_table_destroy(string_table *);
+
+/* looks up the string in the second parameter, inserting it if it is not present, and
+   stores its id in the third parameter. If the table already holds its maximum number
+   of strings, the id is set to -1 */
+extern PetscErrorCode string_table_intern(string_table *, const char *, PetscInt *);
+
+/* like string_table_intern(), but never inserts; the id is -1 if the string is absent */
+extern PetscErrorCode string_table_find(string_table *, const char *, PetscInt *);
+
+/* returns the string with the given id, or "[unknown]" if the id is out of range */
+extern const char *string_table_get(string_table *, PetscInt);
+
+typedef struct {
+  size_t    capacity; /* maximum number of events kept */
+  size_t    count;    /* number of valid rows; valid rows are always [0,count) */
+  size_t    next;     /* row the next event is written to (oldest row once full) */
+  int32_t   *type,*pid,*name_id,*laddr_id,*raddr_id,*lport,*rport,*ip;
+  int32_t   *tx_kb,*rx_kb;
+  PetscReal *latency_ms,*duration_ms,*timestamp;
+  string_table names,addrs;
+} event_store;
+
+/* creates an event store that keeps the most recent N events, where N is the second
+   parameter. Once full, the oldest events are overwritten. */
+extern PetscErrorCode event_store_create(event_store *, size_t);
+
+extern PetscErrorCode event_store_destroy(event_store *);
+
+/* the last parameter of each of these is the time of the event (in seconds since the
+   epoch, like PetscTime()): its own where the tool printed one, or else the time it
+   was read, which for a backlog is later than the event */
+extern PetscErrorCode event_store_add_accept(event_store *, tcpaccept_entry *, PetscLogDouble);
+
+extern PetscErrorCode event_store_add_connect(event_store *, tcpconnect_entry *, PetscLogDouble);
+
+extern PetscErrorCode event_store_add_connlat(event_store *, tcpconnlat_entry *, PetscLogDouble);
+
+extern PetscErrorCode event_store_add_life(event_store *, tcplife_entry *, PetscLogDouble);
+
+/* drops the events of every PID in the array in the third parameter (of the length in
+   the second), e.g. those pid_reaper_evict() evicts, and the names and addresses only
+   they used */
+extern PetscErrorCode event_store_forget(event_store *, PetscInt, const PetscInt *);
+
+typedef enum {
+  EVENT_COL_TYPE,EVENT_COL_PID,EVENT_COL_NAME,EVENT_COL_LADDR,EVENT_COL_RADDR,
+  EVENT_COL_LPORT,EVENT_COL_RPORT,EVENT_COL_IP,EVENT_COL_TX_KB,EVENT_COL_RX_KB,
+  EVENT_COL_LATENCY,EVENT_COL_DURATION,EVENT_COL_TIME,EVENT_COL_NONE
+} event_column;
+static const char *EventColumns[] = {"type","pid","name","laddr","raddr","lport","rport",
+				     "ip","tx_kb","rx_kb","latency","duration","time","none",0};
+
+typedef enum {EVENT_CMP_EQ,EVENT_CMP_NE,EVENT_CMP_LT,EVENT_CMP_LE,EVENT_CMP_GT,EVENT_CMP_GE} event_cmp;
+
+#define EVENT_QUERY_MAX_PREDICATES 8
+#define EVENT_QUERY_MAX_LEN        256
+
+typedef struct {
+  event_column col;
+  event_cmp    op;
+  PetscReal    value;            /* for numeric columns */
+  char         str[IP_ADDR_MAX_LEN+1]; /* for name/laddr/raddr/type columns (EQ/NE only) */
+} event_predicate;
+
+typedef struct {
+  PetscInt        npred;
+  event_predicate pred[EVENT_QUERY_MAX_PREDICATES];
+  PetscReal       since;         /* only consider events at most this many seconds old (by the time
+				    column); <= 0 for all */
+  event_column    group_by;      /* EVENT_COL_NONE to aggregate everything into one row */
+  char            text[EVENT_QUERY_MAX_LEN];
+} event_query;
+
+/* parses a query of the form
+   term[,term...]
+   where each term is either a predicate COLUMN OP VALUE, with OP one of
+   =, !=, <, <=, >, >=, e.g. rport=5432 or latency>10, or one of the
+   directives since=SECONDS and group=COLUMN. Column names are those in
+   EventColumns; latency, duration and time cannot be grouped by. The first parameter is the string, the result is written to
+   the second parameter */
+extern PetscErrorCode event_query_parse(const char *, event_query *);
+
+/* of the key of a group: room for an IPv6 address, and for a process name as
+   the kernel keeps it (longer ones are cut short) */
+#define EVENT_GROUP_KEY_LEN 64
+
+/* one row of a grouped query result */
+typedef struct {
+  PetscInt  rank;
+  long      count,tx_kb,rx_kb;
+  PetscReal sum_latency,max_latency,sum_duration;
+  char      key[EVENT_GROUP_KEY_LEN];
+} event_group_row;
+
+/* runs the query in the second parameter against the store in the first, and stores
+   a newly allocated array of result rows (one per group) in the fourth parameter and
+   its length in the fifth. The third parameter is the MPI rank written to each row,
+   and now is the current time as returned by PetscTime(). Free the rows with PetscFree(). */
+extern PetscErrorCode event_store_query(event_store *, event_query *, PetscInt, PetscLogDouble,
+					event_group_row **, PetscInt *);
+
+/* runs each query in the second parameter (of length given by the third) on every rank,
+   gathers the grouped results to root, and writes them to the file pointed to by the
+   fourth parameter (only significant on root). Collective on PETSC_COMM_WORLD */
+extern PetscErrorCode event_store_gather_queries(event_store *, event_query *, PetscInt, FILE *);
+
+/* reads at most the number of queries given by the third parameter from the file named by
+   the first parameter on root, and broadcasts them to all ranks. The number read is stored
+   in the fourth parameter. A missing file means there are no queries. Collective on
+   PETSC_COMM_WORLD */
+extern PetscErrorCode event_query_read_file(const char *, event_query *, PetscInt, PetscInt *);
+
+/* write one grouped query result row to the file in the first parameter */
+extern PetscErrorCode event_group_row_view(FILE *, event_group_row *);
+
+#endif
@@ -0,0 +1,198 @@
+"""Reader for the per-rank time-series files written by history_store.c.
+
+The file is a sequence of HISTORY_BLOCK_SIZE blocks. Block 0 is the file header;
+every other block holds the Gorilla-compressed samples of one PID. Only the
+64-byte block headers are read to find the blocks that overlap a query, and only
+those blocks are decoded.
+
+Rollups at coarser resolutions live next to it in <filename>.r<seconds>, as
+fixed-size history_rollup records appended as their buckets close.
+"""
+import mmap
+import os
+import struct
+
+FILE_HEADER = struct.Struct('<8sIIIi')
+BLOCK_HEADER = struct.Struct('<IiiIqq32s')
+BLOCK_MAGIC = 0x4b4c4248
+METRICS = ['tx_kb', 'rx_kb', 'n_event', 'avg_latency', 'avg_lifetime']
+RESOLUTIONS = [60000, 600000, 3600000]
+HIST_METRICS = ['avg_latency', 'avg_lifetime']
+HIST_BINS = 12
+# history_rollup: t_start, pid, nsamples, nvalid[5], reserved, min[5], max[5], sum[5], hist[2][12]
+ROLLUP = struct.Struct('<qii5ii5d5d5d24I')
+# upper bounds (ms) of the histogram bins; the last bin is unbounded
+HIST_BOUNDS = [0.25 * 2**i for i in range(HIST_BINS - 1)] + [float('inf')]
+
+
+class BitReader:
+    def __init__(self, buf, offset):
+        self.buf = buf
+        self.pos = offset * 8
+
+    def read(self, nbits):
+        value = 0
+        buf, pos = self.buf, self.pos
+        for _ in range(nbits):
+            value = (value << 1) | ((buf[pos >> 3] >> (7 - (pos & 7))) & 1)
+            pos += 1
+        self.pos = pos
+        return value
+
+
+def _signed32(x):
+    return x - (1 << 32) if x & (1 << 31) else x
+
+
+def _to_double(bits):
+    return struct.unpack('<d', struct.pack('<Q', bits))[0]
+
+
+def decode_block(buf, offset, t0, t1):
+    magic, pid, nsamples, nbits, t_first, t_last, comm = BLOCK_HEADER.unpack_from(buf, offset)
+    reader = BitReader(buf, offset + BLOCK_HEADER.size)
+    samples = []
+    t, delta = t_first, 0
+    values = [0] * len(METRICS)
+    lead = [-1] * len(METRICS)
+    trail = [-1] * len(METRICS)
+    for k in range(nsamples):
+        if k == 0:
+            values = [reader.read(64) for _ in METRICS]
+        else:
+            if not reader.read(1):
+                dod = 0
+            elif not reader.read(1):
+                dod = reader.read(7) - 63
+            elif not reader.read(1):
+                dod = reader.read(9) - 255
+            elif not reader.read(1):
+                dod = reader.read(12) - 2047
+            else:
+                dod = _signed32(reader.read(32))
+            delta += dod
+            t += delta
+            for j in range(len(METRICS)):
+                if not reader.read(1):
+                    continue
+                if reader.read(1):
+                    lead[j] = reader.read(5)
+                    sigbits = reader.read(6) or 64
+                    trail[j] = 64 - lead[j] - sigbits
+                sigbits = 64 - lead[j] - trail[j]
+                values[j] ^= reader.read(sigbits) << trail[j]
+        if t0 <= t <= t1:
+            sample = {'t': t}
+            sample.update(zip(METRICS, map(_to_double, values)))
+            samples.append(sample)
+    return samples
+
+
+def read_history(filename, pid, t0, t1):
+    """Returns the samples of pid with t0 <= t <= t1 (milliseconds since the epoch)."""
+    if not os.path.exists(filename):
+        return []
+    with open(filename, 'rb') as f:
+        size = os.fstat(f.fileno()).st_size
+        if size < FILE_HEADER.size:
+            return []
+        buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        try:
+            magic, version, block_size, nmetrics, rank = FILE_HEADER.unpack_from(buf, 0)
+            if not magic.startswith(b'DCPHIST') or nmetrics != len(METRICS):
+                raise ValueError(f"{filename} is not a history file this reader understands")
+            samples = []
+            for offset in range(block_size, size - block_size + 1, block_size):
+                magic, bpid, nsamples, nbits, t_first, t_last, comm = BLOCK_HEADER.unpack_from(buf, offset)
+                if magic != BLOCK_MAGIC or bpid != pid or nsamples == 0 or t_last < t0 or t_first > t1:
+                    continue
+                samples.extend(decode_block(buf, offset, t0, t1))
+        finally:
+            buf.close()
+    samples.sort(key=lambda s: s['t'])
+    return samples
+
+
+def _unpack_rollup(buf, offset):
+    fields = ROLLUP.unpack_from(buf, offset)
+    n = len(METRICS)
+    t_start, pid, nsamples = fields[0:3]
+    nvalid = fields[3:3 + n]
+    mins = fields[4 + n:4 + 2 * n]
+    maxs = fields[4 + 2 * n:4 + 3 * n]
+    sums = fields[4 + 3 * n:4 + 4 * n]
+    hist = fields[4 + 4 * n:]
+    return {'t': t_start, 'pid': pid, 'nsamples': nsamples,
+            'metrics': {m: {'count': nvalid[j], 'min': mins[j], 'max': maxs[j], 'sum': sums[j]}
+                        for j, m in enumerate(METRICS)},
+            'hist': {m: list(hist[k * HIST_BINS:(k + 1) * HIST_BINS]) for k, m in enumerate(HIST_METRICS)}}
+
+
+def _merge_rollup(dst, src):
+    dst['nsamples'] += src['nsamples']
+    for m in METRICS:
+        d, s = dst['metrics'][m], src['metrics'][m]
+        d['count'] += s['count']
+        d['min'] = min(d['min'], s['min'])
+        d['max'] = max(d['max'], s['max'])
+        d['sum'] += s['sum']
+    for m in HIST_METRICS:
+        dst['hist'][m] = [a + b for a, b in zip(dst['hist'][m], src['hist'][m])]
+
+
+def _finish_rollup(r):
+    for m in METRICS:
+        stats = r['metrics'][m]
+        stats['avg'] = stats['sum'] / stats['count'] if stats['count'] else None
+        if not stats['count']:
+            stats['min'] = stats['max'] = None
+    return r
+
+
+def read_rollups(filename, pid, t0, t1, step):
+    """Returns (resolution, buckets) for pid between t0 and t1 (ms since the epoch), from
+    the coarsest resolution no coarser than step (ms). If step is finer than every rollup,
+    each raw sample is returned as a bucket of one sample and the resolution is 0."""
+    usable = [r for r in RESOLUTIONS if r <= step]
+    if not usable:
+        buckets = []
+        for sample in read_history(filename, pid, t0, t1):
+            metrics = {}
+            for m in METRICS:
+                v = sample[m]
+                valid = v == v
+                metrics[m] = {'count': int(valid), 'min': v if valid else None, 'max': v if valid else None,
+                              'sum': v if valid else 0.0, 'avg': v if valid else None}
+            buckets.append({'t': sample['t'], 'pid': pid, 'nsamples': 1, 'metrics': metrics})
+        return 0, buckets
+    res = usable[-1]
+    rollup_filename = f"{filename}.r{res // 1000}"
+    if not os.path.exists(rollup_filename) or os.path.getsize(rollup_filename) < ROLLUP.size:
+        return res, []
+    buckets = {}
+    with open(rollup_filename, 'rb') as f:
+        buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        try:
+            nrecords = len(buf) // ROLLUP.size
+            # records are sorted by t_start to within one resolution; skip ahead with slack
+            lo, hi = 0, nrecords
+            while lo < hi:
+                mid = (lo + hi) // 2
+                if struct.unpack_from('<q', buf, mid * ROLLUP.size)[0] + 2 * res <= t0:
+                    lo = mid + 1
+                else:
+                    hi = mid
+            for i in range(lo, nrecords):
+                t_start, rpid = struct.unpack_from('<qi', buf, i * ROLLUP.size)
+                if t_start > t1 + res:
+                    break
+                if rpid != pid or t_start + res <= t0 or t_start > t1:
+                    continue
+                r = _unpack_rollup(buf, i * ROLLUP.size)
+                if t_start in buckets:
+                    _merge_rollup(buckets[t_start], r)
+                else:
+                    buckets[t_start] = r
+        finally:
+            buf.close()
+    return res, [_finish_rollup(buckets[t]) for t in sorted(buckets)]
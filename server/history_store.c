@@ -0,0 +1,650 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "history_store.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <math.h>
+
+/* the most bits one sample can take: a 4 bit delta-of-delta prefix with 32 bits
+   of payload, and for every metric a 2 bit control prefix, 5 + 6 bits of window
+   and all 64 bits of the value */
+#define HISTORY_MAX_SAMPLE_BITS (36 + HISTORY_NMETRICS*77)
+
+int64_t history_now_ms()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return (int64_t)tv.tv_sec*1000 + tv.tv_usec/1000;
+}
+
+typedef union {
+  PetscReal d;
+  uint64_t  u;
+} real_bits;
+
+/* bits are written most significant bit first */
+static void bits_write(unsigned char *payload, uint32_t *pos, uint64_t value, int nbits)
+{
+  int i;
+  for (i=nbits-1; i>=0; --i) {
+    if ((value >> i) & 1) {
+      payload[*pos >> 3] |= (unsigned char)(0x80 >> (*pos & 7));
+    }
+    ++(*pos);
+  }
+}
+
+static uint64_t bits_read(const unsigned char *payload, uint32_t *pos, int nbits)
+{
+  uint64_t value = 0;
+  int      i;
+  for (i=0; i<nbits; ++i) {
+    value = (value << 1) | ((payload[*pos >> 3] >> (7 - (*pos & 7))) & 1);
+    ++(*pos);
+  }
+  return value;
+}
+
+static inline history_block_header *block_header(unsigned char *data)
+{
+  return (history_block_header*)data;
+}
+
+static inline unsigned char *block_payload(unsigned char *data)
+{
+  return data + sizeof(history_block_header);
+}
+
+static void encode_timestamp(history_open_block *blk, uint32_t *pos, int64_t t)
+{
+  unsigned char *payload = block_payload(blk->data);
+  int64_t       delta = t - blk->prev_t,dod = delta - blk->prev_delta;
+  if (dod == 0) {
+    bits_write(payload,pos,0,1);
+  } else if (dod >= -63 && dod <= 64) {
+    bits_write(payload,pos,0x2,2);
+    bits_write(payload,pos,(uint64_t)(dod + 63),7);
+  } else if (dod >= -255 && dod <= 256) {
+    bits_write(payload,pos,0x6,3);
+    bits_write(payload,pos,(uint64_t)(dod + 255),9);
+  } else if (dod >= -2047 && dod <= 2048) {
+    bits_write(payload,pos,0xe,4);
+    bits_write(payload,pos,(uint64_t)(dod + 2047),12);
+  } else {
+    bits_write(payload,pos,0xf,4);
+    bits_write(payload,pos,(uint64_t)(uint32_t)(int32_t)dod,32);
+  }
+  blk->prev_delta = delta;
+  blk->prev_t = t;
+}
+
+static void encode_value(history_open_block *blk, uint32_t *pos, PetscInt j, PetscReal v)
+{
+  unsigned char *payload = block_payload(blk->data);
+  real_bits     rb;
+  uint64_t      x;
+  int           lead,trail,sigbits;
+  rb.d = v;
+  x = rb.u ^ blk->prev_v[j];
+  blk->prev_v[j] = rb.u;
+  if (!x) {
+    bits_write(payload,pos,0,1);
+    return;
+  }
+  lead = __builtin_clzll(x);
+  trail = __builtin_ctzll(x);
+  if (lead > 31) {
+    lead = 31; /* the leading zero count is stored in 5 bits */
+  }
+  if (blk->prev_lead[j] >= 0 && lead >= blk->prev_lead[j] && trail >= blk->prev_trail[j]) {
+    /* the meaningful bits fit in the previous window */
+    sigbits = 64 - blk->prev_lead[j] - blk->prev_trail[j];
+    bits_write(payload,pos,0x2,2);
+    bits_write(payload,pos,x >> blk->prev_trail[j],sigbits);
+  } else {
+    sigbits = 64 - lead - trail;
+    bits_write(payload,pos,0x3,2);
+    bits_write(payload,pos,(uint64_t)lead,5);
+    bits_write(payload,pos,(uint64_t)(sigbits & 63),6); /* 64 is stored as 0 */
+    bits_write(payload,pos,x >> trail,sigbits);
+    blk->prev_lead[j] = lead;
+    blk->prev_trail[j] = trail;
+  }
+}
+
+/* decodes all samples of a block into samples (which must have room for
+   header->nsamples entries), keeping those with t0 <= t <= t1. The number
+   kept is returned. */
+static PetscInt decode_block(const unsigned char *data, int64_t t0, int64_t t1, history_sample *samples)
+{
+  const history_block_header *hdr = (const history_block_header*)data;
+  const unsigned char        *payload = data + sizeof(history_block_header);
+  uint32_t                   pos = 0;
+  int64_t                    t = hdr->t_first,delta = 0,dod;
+  uint64_t                   v[HISTORY_NMETRICS],x;
+  int                        lead[HISTORY_NMETRICS],trail[HISTORY_NMETRICS],sigbits;
+  PetscInt                   k,j,nkept = 0;
+  real_bits                  rb;
+
+  for (k=0; k<hdr->nsamples; ++k) {
+    if (k == 0) {
+      for (j=0; j<HISTORY_NMETRICS; ++j) {
+	v[j] = bits_read(payload,&pos,64);
+	lead[j] = trail[j] = -1;
+      }
+    } else {
+      if (!bits_read(payload,&pos,1)) {
+	dod = 0;
+      } else if (!bits_read(payload,&pos,1)) {
+	dod = (int64_t)bits_read(payload,&pos,7) - 63;
+      } else if (!bits_read(payload,&pos,1)) {
+	dod = (int64_t)bits_read(payload,&pos,9) - 255;
+      } else if (!bits_read(payload,&pos,1)) {
+	dod = (int64_t)bits_read(payload,&pos,12) - 2047;
+      } else {
+	dod = (int64_t)(int32_t)(uint32_t)bits_read(payload,&pos,32);
+      }
+      delta += dod;
+      t += delta;
+      for (j=0; j<HISTORY_NMETRICS; ++j) {
+	if (!bits_read(payload,&pos,1)) {
+	  continue;
+	}
+	if (!bits_read(payload,&pos,1)) {
+	  sigbits = 64 - lead[j] - trail[j];
+	  x = bits_read(payload,&pos,sigbits) << trail[j];
+	} else {
+	  lead[j] = (int)bits_read(payload,&pos,5);
+	  sigbits = (int)bits_read(payload,&pos,6);
+	  if (!sigbits) {
+	    sigbits = 64;
+	  }
+	  trail[j] = 64 - lead[j] - sigbits;
+	  x = bits_read(payload,&pos,sigbits) << trail[j];
+	}
+	v[j] ^= x;
+      }
+    }
+    if (t >= t0 && t <= t1) {
+      samples[nkept].t = t;
+      for (j=0; j<HISTORY_NMETRICS; ++j) {
+	rb.u = v[j];
+	samples[nkept].v[j] = rb.d;
+      }
+      ++nkept;
+    }
+  }
+  return nkept;
+}
+
+static PetscErrorCode history_index_push(history_store *hist, int32_t pid, int64_t t_first,
+					 int64_t t_last, int64_t slot, PetscInt open, PetscInt *pos)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (hist->nindex == hist->index_capacity) {
+    hist->index_capacity = hist->index_capacity ? 2*hist->index_capacity : 256;
+    ierr = PetscRealloc(hist->index_capacity*sizeof(history_index_entry),&hist->index);CHKERRQ(ierr);
+  }
+  hist->index[hist->nindex].pid = pid;
+  hist->index[hist->nindex].t_first = t_first;
+  hist->index[hist->nindex].t_last = t_last;
+  hist->index[hist->nindex].slot = slot;
+  hist->index[hist->nindex].open = open;
+  if (pos) {
+    *pos = hist->nindex;
+  }
+  ++(hist->nindex);
+  PetscFunctionReturn(0);
+}
+
+static int history_hist_bin(PetscReal v)
+{
+  int       b;
+  PetscReal bound = 0.25;
+  for (b=0; b<HISTORY_HIST_BINS-1; ++b, bound *= 2) {
+    if (v < bound) {
+      return b;
+    }
+  }
+  return HISTORY_HIST_BINS-1;
+}
+
+static void history_rollup_reset(history_rollup *r, PetscInt pid, int64_t t_start)
+{
+  PetscInt j;
+  PetscMemzero(r,sizeof(history_rollup));
+  r->pid = pid;
+  r->t_start = t_start;
+  for (j=0; j<HISTORY_NMETRICS; ++j) {
+    r->min[j] = PETSC_INFINITY;
+    r->max[j] = -PETSC_INFINITY;
+  }
+}
+
+static void history_rollup_add(history_rollup *r, const PetscReal *v)
+{
+  PetscInt j;
+  ++(r->nsamples);
+  for (j=0; j<HISTORY_NMETRICS; ++j) {
+    if (v[j] != v[j]) {
+      continue; /* NaN, e.g. an average with no events behind it */
+    }
+    ++(r->nvalid[j]);
+    r->min[j] = PetscMin(r->min[j],v[j]);
+    r->max[j] = PetscMax(r->max[j],v[j]);
+    r->sum[j] += v[j];
+  }
+  /* avg_latency and avg_lifetime are the last two metrics */
+  for (j=0; j<HISTORY_NHIST; ++j) {
+    if (v[HISTORY_NMETRICS-HISTORY_NHIST+j] == v[HISTORY_NMETRICS-HISTORY_NHIST+j]) {
+      ++(r->hist[j][history_hist_bin(v[HISTORY_NMETRICS-HISTORY_NHIST+j])]);
+    }
+  }
+}
+
+static void history_rollup_merge(history_rollup *dst, const history_rollup *src)
+{
+  PetscInt j,b;
+  dst->nsamples += src->nsamples;
+  for (j=0; j<HISTORY_NMETRICS; ++j) {
+    dst->nvalid[j] += src->nvalid[j];
+    dst->min[j] = PetscMin(dst->min[j],src->min[j]);
+    dst->max[j] = PetscMax(dst->max[j],src->max[j]);
+    dst->sum[j] += src->sum[j];
+  }
+  for (j=0; j<HISTORY_NHIST; ++j) {
+    for (b=0; b<HISTORY_HIST_BINS; ++b) {
+      dst->hist[j][b] += src->hist[j][b];
+    }
+  }
+}
+
+/* appends the open bucket at the given level to its file and folds it into the
+   bucket of the next coarser level, closing that one first if it has moved on */
+static PetscErrorCode history_rollup_close(history_store *hist, history_rollup_state *state, PetscInt level)
+{
+  PetscErrorCode ierr;
+  int64_t        next_start;
+  PetscFunctionBeginUser;
+  if (!state->open[level]) {
+    PetscFunctionReturn(0);
+  }
+  if (write(hist->rollup_fd[level],&state->bucket[level],sizeof(history_rollup)) != sizeof(history_rollup)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not append a rollup for history file %s\n",hist->filename);
+  }
+  state->open[level] = PETSC_FALSE;
+  if (level + 1 == HISTORY_NLEVELS) {
+    PetscFunctionReturn(0);
+  }
+  next_start = state->bucket[level].t_start - state->bucket[level].t_start % HistoryResolutions[level+1];
+  if (state->open[level+1] && state->bucket[level+1].t_start != next_start) {
+    ierr = history_rollup_close(hist,state,level+1);CHKERRQ(ierr);
+  }
+  if (!state->open[level+1]) {
+    history_rollup_reset(&state->bucket[level+1],state->bucket[level].pid,next_start);
+    state->open[level+1] = PETSC_TRUE;
+  }
+  history_rollup_merge(&state->bucket[level+1],&state->bucket[level]);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode history_rollup_add_sample(history_store *hist, PetscInt pid, int64_t t, const PetscReal *v)
+{
+  PetscErrorCode       ierr;
+  PetscInt             i;
+  history_rollup_state *state;
+  int64_t              start = t - t % HistoryResolutions[0];
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(hist->pid_to_rollup,pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    if (hist->nrollups == hist->rollup_capacity) {
+      hist->rollup_capacity = hist->rollup_capacity ? 2*hist->rollup_capacity : 64;
+      ierr = PetscRealloc(hist->rollup_capacity*sizeof(history_rollup_state),&hist->rollups);CHKERRQ(ierr);
+    }
+    i = hist->nrollups++;
+    ierr = PetscMemzero(&hist->rollups[i],sizeof(history_rollup_state));CHKERRQ(ierr);
+    ierr = PetscHMapISet(hist->pid_to_rollup,pid,i);CHKERRQ(ierr);
+  }
+  state = &hist->rollups[i];
+  if (state->open[0] && state->bucket[0].t_start != start) {
+    ierr = history_rollup_close(hist,state,0);CHKERRQ(ierr);
+  }
+  if (!state->open[0]) {
+    history_rollup_reset(&state->bucket[0],pid,start);
+    state->open[0] = PETSC_TRUE;
+  }
+  history_rollup_add(&state->bucket[0],v);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode history_store_open(history_store *hist, const char *filename, PetscInt rank)
+{
+  PetscErrorCode       ierr;
+  history_file_header  fhdr;
+  history_block_header bhdr;
+  struct stat          st;
+  int64_t              slot;
+  PetscInt             level;
+  char                 rollup_filename[PETSC_MAX_PATH_LEN];
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(hist,sizeof(history_store));CHKERRQ(ierr);
+  ierr = PetscStrncpy(hist->filename,filename,PETSC_MAX_PATH_LEN);CHKERRQ(ierr);
+  ierr = PetscHMapICreate(&hist->pid_to_open);CHKERRQ(ierr);
+  ierr = PetscHMapICreate(&hist->pid_to_rollup);CHKERRQ(ierr);
+  for (level=0; level<HISTORY_NLEVELS; ++level) {
+    sprintf(rollup_filename,"%s.r%d",filename,(int)(HistoryResolutions[level]/1000));
+    hist->rollup_fd[level] = open(rollup_filename,O_RDWR | O_CREAT | O_APPEND,0644);
+    if (hist->rollup_fd[level] < 0) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open rollup file %s\n",rollup_filename);
+    }
+  }
+  hist->fd = open(filename,O_RDWR | O_CREAT,0644);
+  if (hist->fd < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open history file %s\n",filename);
+  }
+  if (fstat(hist->fd,&st)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not stat history file %s\n",filename);
+  }
+  if (st.st_size < HISTORY_BLOCK_SIZE) {
+    unsigned char block[HISTORY_BLOCK_SIZE];
+    ierr = PetscMemzero(block,HISTORY_BLOCK_SIZE);CHKERRQ(ierr);
+    ierr = PetscMemzero(&fhdr,sizeof(fhdr));CHKERRQ(ierr);
+    ierr = PetscStrncpy(fhdr.magic,HISTORY_FILE_MAGIC,sizeof(fhdr.magic));CHKERRQ(ierr);
+    fhdr.version = HISTORY_VERSION;
+    fhdr.block_size = HISTORY_BLOCK_SIZE;
+    fhdr.nmetrics = HISTORY_NMETRICS;
+    fhdr.rank = rank;
+    ierr = PetscMemcpy(block,&fhdr,sizeof(fhdr));CHKERRQ(ierr);
+    if (pwrite(hist->fd,block,HISTORY_BLOCK_SIZE,0) != HISTORY_BLOCK_SIZE) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write the header of history file %s\n",filename);
+    }
+    hist->nslots = 1;
+    PetscFunctionReturn(0);
+  }
+  if (pread(hist->fd,&fhdr,sizeof(fhdr),0) != sizeof(fhdr) || strncmp(fhdr.magic,HISTORY_FILE_MAGIC,sizeof(fhdr.magic))) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"%s is not a history file\n",filename);
+  }
+  if (fhdr.version != HISTORY_VERSION || fhdr.block_size != HISTORY_BLOCK_SIZE || fhdr.nmetrics != HISTORY_NMETRICS) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"History file %s was written with an incompatible layout\n",filename);
+  }
+  /* index the existing blocks; blocks left open by a previous run are treated as sealed */
+  hist->nslots = st.st_size / HISTORY_BLOCK_SIZE;
+  for (slot=1; slot<hist->nslots; ++slot) {
+    if (pread(hist->fd,&bhdr,sizeof(bhdr),slot*HISTORY_BLOCK_SIZE) != sizeof(bhdr)) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not read block %D of history file %s\n",(PetscInt)slot,filename);
+    }
+    if (bhdr.magic != HISTORY_BLOCK_MAGIC || bhdr.nsamples == 0) {
+      continue;
+    }
+    ierr = history_index_push(hist,bhdr.pid,bhdr.t_first,bhdr.t_last,slot,-1,NULL);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode history_block_write(history_store *hist, history_open_block *blk)
+{
+  PetscFunctionBeginUser;
+  if (pwrite(hist->fd,blk->data,HISTORY_BLOCK_SIZE,blk->slot*HISTORY_BLOCK_SIZE) != HISTORY_BLOCK_SIZE) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write to history file %s\n",hist->filename);
+  }
+  blk->dirty = PETSC_FALSE;
+  PetscFunctionReturn(0);
+}
+
+/* drops the rollup state at the given position, whose buckets must all be closed */
+static PetscErrorCode history_rollup_remove(history_store *hist, PetscInt i)
+{
+  PetscErrorCode ierr;
+  PetscInt       last;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIDel(hist->pid_to_rollup,hist->rollups[i].bucket[0].pid);CHKERRQ(ierr);
+  /* keep the rollup states dense by moving the last one into the hole */
+  last = hist->nrollups - 1;
+  if (i != last) {
+    hist->rollups[i] = hist->rollups[last];
+    ierr = PetscHMapISet(hist->pid_to_rollup,hist->rollups[i].bucket[0].pid,i);CHKERRQ(ierr);
+  }
+  --(hist->nrollups);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode history_store_sync(history_store *hist, int64_t now)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,level;
+  PetscBool      open;
+  PetscFunctionBeginUser;
+  for (i=0; i<hist->nopen; ++i) {
+    if (hist->open[i].dirty) {
+      ierr = history_block_write(hist,&hist->open[i]);CHKERRQ(ierr);
+    }
+  }
+  /* close buckets whose time is up even if their PID has gone quiet; closing a level
+     may open the next one, which is checked next. A PID with no bucket left open
+     is dropped until its next sample, so only the recent ones are gone through. */
+  for (i=0; i<hist->nrollups;) {
+    open = PETSC_FALSE;
+    for (level=0; level<HISTORY_NLEVELS; ++level) {
+      if (hist->rollups[i].open[level] && hist->rollups[i].bucket[level].t_start + HistoryResolutions[level] <= now) {
+	ierr = history_rollup_close(hist,&hist->rollups[i],level);CHKERRQ(ierr);
+      }
+      open = (PetscBool)(open || hist->rollups[i].open[level]);
+    }
+    if (open) {
+      ++i;
+    } else {
+      ierr = history_rollup_remove(hist,i);CHKERRQ(ierr);
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode history_store_seal(history_store *hist, PetscInt pid)
+{
+  PetscErrorCode     ierr;
+  PetscInt           i,last;
+  history_open_block *blk;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(hist->pid_to_open,pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    PetscFunctionReturn(0);
+  }
+  blk = &hist->open[i];
+  if (blk->dirty) {
+    ierr = history_block_write(hist,blk);CHKERRQ(ierr);
+  }
+  hist->index[blk->index].open = -1;
+  ierr = PetscFree(blk->data);CHKERRQ(ierr);
+  ierr = PetscHMapIDel(hist->pid_to_open,pid);CHKERRQ(ierr);
+  /* keep the open blocks dense by moving the last one into the hole */
+  last = hist->nopen - 1;
+  if (i != last) {
+    hist->open[i] = hist->open[last];
+    hist->index[hist->open[i].index].open = i;
+    ierr = PetscHMapISet(hist->pid_to_open,block_header(hist->open[i].data)->pid,i);CHKERRQ(ierr);
+  }
+  --(hist->nopen);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode history_store_forget(history_store *hist, PetscInt pid)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,level;
+  PetscFunctionBeginUser;
+  ierr = history_store_seal(hist,pid);CHKERRQ(ierr);
+  ierr = PetscHMapIGet(hist->pid_to_rollup,pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    PetscFunctionReturn(0);
+  }
+  /* the partial buckets are written, as history_store_close() does */
+  for (level=0; level<HISTORY_NLEVELS; ++level) {
+    ierr = history_rollup_close(hist,&hist->rollups[i],level);CHKERRQ(ierr);
+  }
+  ierr = history_rollup_remove(hist,i);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode history_block_start(history_store *hist, PetscInt pid, const char *comm, int64_t t, PetscInt *pos)
+{
+  PetscErrorCode       ierr;
+  history_open_block   *blk;
+  history_block_header *hdr;
+  PetscInt             j;
+  PetscFunctionBeginUser;
+  if (hist->nopen == hist->open_capacity) {
+    hist->open_capacity = hist->open_capacity ? 2*hist->open_capacity : 64;
+    ierr = PetscRealloc(hist->open_capacity*sizeof(history_open_block),&hist->open);CHKERRQ(ierr);
+  }
+  blk = &hist->open[hist->nopen];
+  ierr = PetscMemzero(blk,sizeof(history_open_block));CHKERRQ(ierr);
+  ierr = PetscCalloc1(HISTORY_BLOCK_SIZE,&blk->data);CHKERRQ(ierr);
+  hdr = block_header(blk->data);
+  hdr->magic = HISTORY_BLOCK_MAGIC;
+  hdr->pid = pid;
+  hdr->t_first = hdr->t_last = t;
+  ierr = PetscStrncpy(hdr->comm,comm,HISTORY_COMM_LEN);CHKERRQ(ierr);
+  for (j=0; j<HISTORY_NMETRICS; ++j) {
+    blk->prev_lead[j] = blk->prev_trail[j] = -1;
+  }
+  blk->slot = hist->nslots++;
+  ierr = history_index_push(hist,pid,t,t,blk->slot,hist->nopen,&blk->index);CHKERRQ(ierr);
+  ierr = PetscHMapISet(hist->pid_to_open,pid,hist->nopen);CHKERRQ(ierr);
+  *pos = hist->nopen++;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode history_store_append(history_store *hist, process_data_summary *psumm, int64_t t)
+{
+  PetscErrorCode       ierr;
+  PetscInt             i,j;
+  history_open_block   *blk;
+  history_block_header *hdr;
+  PetscReal            v[HISTORY_NMETRICS];
+  uint32_t             pos;
+  real_bits            rb;
+  PetscFunctionBeginUser;
+  v[0] = (PetscReal)psumm->tx_kb;
+  v[1] = (PetscReal)psumm->rx_kb;
+  v[2] = (PetscReal)psumm->n_event;
+  v[3] = psumm->avg_latency;
+  v[4] = psumm->avg_lifetime;
+
+  ierr = PetscHMapIGet(hist->pid_to_open,psumm->pid,&i);CHKERRQ(ierr);
+  if (i >= 0) {
+    hdr = block_header(hist->open[i].data);
+    if (t < hdr->t_last) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"History samples for PID %D must be appended in time order\n",psumm->pid);
+    }
+    if (hdr->nbits + HISTORY_MAX_SAMPLE_BITS > HISTORY_PAYLOAD_BITS || t - hdr->t_last > INT32_MAX) {
+      ierr = history_store_seal(hist,psumm->pid);CHKERRQ(ierr);
+      i = -1;
+    }
+  }
+  if (i < 0) {
+    ierr = history_block_start(hist,psumm->pid,psumm->comm,t,&i);CHKERRQ(ierr);
+  }
+  blk = &hist->open[i];
+  hdr = block_header(blk->data);
+  pos = hdr->nbits;
+  if (hdr->nsamples == 0) {
+    /* the first timestamp lives in the header and the first values are stored verbatim */
+    blk->prev_t = t;
+    blk->prev_delta = 0;
+    for (j=0; j<HISTORY_NMETRICS; ++j) {
+      rb.d = v[j];
+      blk->prev_v[j] = rb.u;
+      bits_write(block_payload(blk->data),&pos,rb.u,64);
+    }
+  } else {
+    encode_timestamp(blk,&pos,t);
+    for (j=0; j<HISTORY_NMETRICS; ++j) {
+      encode_value(blk,&pos,j,v[j]);
+    }
+  }
+  hdr->nbits = pos;
+  hdr->t_last = t;
+  ++(hdr->nsamples);
+  hist->index[blk->index].t_last = t;
+  blk->dirty = PETSC_TRUE;
+  ierr = history_rollup_add_sample(hist,psumm->pid,t,v);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode history_store_query(history_store *hist, PetscInt pid, int64_t t0, int64_t t1,
+				   history_sample **samplesptr, PetscInt *nsamplesptr)
+{
+  PetscErrorCode      ierr;
+  PetscInt            i,n=0,capacity=0;
+  history_index_entry *e;
+  history_sample      *samples=NULL;
+  unsigned char       *map=NULL;
+  const unsigned char *data;
+  size_t              maplen = 0;
+  PetscFunctionBeginUser;
+  for (i=0; i<hist->nindex; ++i) {
+    e = &hist->index[i];
+    if (e->pid != pid || e->t_last < t0 || e->t_first > t1) {
+      continue;
+    }
+    if (e->open >= 0) {
+      data = hist->open[e->open].data;
+    } else {
+      if (!map) {
+	/* sealed blocks are read straight from a mapping of the file */
+	maplen = (size_t)hist->nslots*HISTORY_BLOCK_SIZE;
+	map = (unsigned char*)mmap(NULL,maplen,PROT_READ,MAP_SHARED,hist->fd,0);
+	if (map == MAP_FAILED) {
+	  SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not mmap history file %s\n",hist->filename);
+	}
+      }
+      data = map + e->slot*HISTORY_BLOCK_SIZE;
+    }
+    if (n + ((const history_block_header*)data)->nsamples > capacity) {
+      capacity = PetscMax(2*capacity,n + ((const history_block_header*)data)->nsamples);
+      ierr = PetscRealloc(capacity*sizeof(history_sample),&samples);CHKERRQ(ierr);
+    }
+    n += decode_block(data,t0,t1,samples + n);
+  }
+  if (map) {
+    munmap(map,maplen);
+  }
+  *samplesptr = samples;
+  *nsamplesptr = n;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode history_store_close(history_store *hist)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,level;
+  PetscFunctionBeginUser;
+  ierr = history_store_sync(hist,history_now_ms());CHKERRQ(ierr);
+  /* write the partial buckets too; if the store is reopened before they end, the
+     bucket is written again and history_reader.read_rollups() merges the two records */
+  for (i=0; i<hist->nrollups; ++i) {
+    for (level=0; level<HISTORY_NLEVELS; ++level) {
+      ierr = history_rollup_close(hist,&hist->rollups[i],level);CHKERRQ(ierr);
+    }
+  }
+  for (level=0; level<HISTORY_NLEVELS; ++level) {
+    close(hist->rollup_fd[level]);
+  }
+  ierr = PetscFree(hist->rollups);CHKERRQ(ierr);
+  ierr = PetscHMapIDestroy(&hist->pid_to_rollup);CHKERRQ(ierr);
+  for (i=0; i<hist->nopen; ++i) {
+    ierr = PetscFree(hist->open[i].data);CHKERRQ(ierr);
+  }
+  ierr = PetscFree(hist->open);CHKERRQ(ierr);
+  ierr = PetscFree(hist->index);CHKERRQ(ierr);
+  ierr = PetscHMapIDestroy(&hist->pid_to_open);CHKERRQ(ierr);
+  close(hist->fd);
+  hist->fd = -1;
+  hist->nopen = hist->nindex = 0;
+  PetscFunctionReturn(0);
+}
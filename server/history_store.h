@@ -0,0 +1,149 @@
+#ifndef DCPROF_HISTORY_STORE_H
+#define DCPROF_HISTORY_STORE_H
+#include "petsc_webserver.h"
+#include <stdint.h>
+#include <petsc/private/hashmapi.h>
+
+/* an append-only, on-disk time series of per-process summaries. Every polling
+   interval, one sample per PID is appended holding the HISTORY_NMETRICS fields
+   of process_data_summary listed in HistoryMetrics. Samples are compressed as in
+   Facebook's Gorilla TSDB: timestamps are stored as delta-of-deltas and values
+   as the XOR with the previous value of the same metric, in fixed-size blocks
+   that each hold the samples of one PID for a contiguous time range. Blocks are
+   block_size-aligned so the file can be mmap()ed and a range query only decodes
+   the blocks whose time range overlaps the query.
+
+   File layout:
+   block 0          : history_file_header (rest of the block is zero)
+   block 1, 2, ...  : history_block_header followed by the compressed samples
+
+   Next to the raw samples the store keeps rollups at each of the coarser
+   resolutions in HistoryResolutions, one file of fixed-size history_rollup
+   records per resolution (<filename>.r<seconds>). Rollups are computed
+   incrementally: raw samples are accumulated into the open bucket of the finest
+   resolution, and when a bucket closes its record is appended to that
+   resolution's file and merged into the open bucket of the next coarser one. */
+
+#define HISTORY_NMETRICS    5
+#define HISTORY_BLOCK_SIZE  4096
+#define HISTORY_COMM_LEN    32
+#define HISTORY_VERSION     1
+#define HISTORY_FILE_MAGIC  "DCPHIST"
+#define HISTORY_BLOCK_MAGIC 0x4b4c4248u /* "HBLK" */
+
+static const char *HistoryMetrics[] = {"tx_kb","rx_kb","n_event","avg_latency","avg_lifetime",0};
+
+typedef struct {
+  char     magic[8];
+  uint32_t version,block_size,nmetrics;
+  int32_t  rank;
+} history_file_header;
+
+typedef struct {
+  uint32_t magic;
+  int32_t  pid;
+  int32_t  nsamples;
+  uint32_t nbits;         /* number of bits of the payload in use */
+  int64_t  t_first,t_last; /* milliseconds since the epoch */
+  char     comm[HISTORY_COMM_LEN];
+} history_block_header;
+
+#define HISTORY_PAYLOAD_BITS (8*(HISTORY_BLOCK_SIZE - sizeof(history_block_header)))
+
+typedef struct {
+  int64_t   t;
+  PetscReal v[HISTORY_NMETRICS];
+} history_sample;
+
+#define HISTORY_NLEVELS    3
+static const int64_t HistoryResolutions[HISTORY_NLEVELS] = {60000,600000,3600000}; /* ms */
+
+/* histograms are kept of avg_latency and avg_lifetime. Bin i < HISTORY_HIST_BINS-1
+   counts values below 2^(i-2) ms (and at or above the previous bin's bound); the
+   last bin counts everything larger. */
+#define HISTORY_NHIST      2
+#define HISTORY_HIST_BINS  12
+
+typedef struct {
+  int64_t   t_start;  /* ms since the epoch, a multiple of the resolution */
+  int32_t   pid,nsamples;
+  int32_t   nvalid[HISTORY_NMETRICS]; /* samples of each metric that were not NaN */
+  int32_t   reserved;
+  PetscReal min[HISTORY_NMETRICS],max[HISTORY_NMETRICS],sum[HISTORY_NMETRICS];
+  uint32_t  hist[HISTORY_NHIST][HISTORY_HIST_BINS];
+} history_rollup;
+
+/* the open buckets of one PID at every resolution */
+typedef struct {
+  history_rollup bucket[HISTORY_NLEVELS];
+  PetscBool      open[HISTORY_NLEVELS];
+} history_rollup_state;
+
+/* Gorilla encoder state of a block that is still being appended to */
+typedef struct {
+  unsigned char *data;  /* HISTORY_BLOCK_SIZE bytes: header, then payload */
+  int64_t       slot;   /* block number in the file */
+  PetscInt      index;  /* position in history_store.index */
+  int64_t       prev_t,prev_delta;
+  uint64_t      prev_v[HISTORY_NMETRICS];
+  int           prev_lead[HISTORY_NMETRICS],prev_trail[HISTORY_NMETRICS];
+  PetscBool     dirty;
+} history_open_block;
+
+typedef struct {
+  int32_t pid;
+  int64_t t_first,t_last,slot;
+  PetscInt open;        /* index into history_store.open, or -1 once sealed */
+} history_index_entry;
+
+typedef struct {
+  int                 fd;
+  char                filename[PETSC_MAX_PATH_LEN];
+  int64_t             nslots;  /* blocks in the file, including the file header */
+  history_open_block  *open;
+  PetscInt            nopen,open_capacity;
+  history_index_entry *index;
+  PetscInt            nindex,index_capacity;
+  PetscHMapI          pid_to_open;
+  int                 rollup_fd[HISTORY_NLEVELS];
+  history_rollup_state *rollups;
+  PetscInt            nrollups,rollup_capacity;
+  PetscHMapI          pid_to_rollup;
+} history_store;
+
+/* opens (creating if necessary) the history file named by the second parameter for
+   the MPI rank in the third parameter. Blocks already in the file are indexed, and
+   new samples are appended in new blocks. */
+extern PetscErrorCode history_store_open(history_store *, const char *, PetscInt);
+
+/* writes any unsynced blocks and closes the file */
+extern PetscErrorCode history_store_close(history_store *);
+
+/* appends one sample of the summary in the second parameter, taken at the time (ms since
+   the epoch) in the third parameter. Samples for one PID must be appended in time order. */
+extern PetscErrorCode history_store_append(history_store *, process_data_summary *, int64_t);
+
+/* writes the blocks that changed since the last call to the file, and closes every rollup
+   bucket that ends at or before the time (ms since the epoch) in the second parameter.
+   Call once per poll. */
+extern PetscErrorCode history_store_sync(history_store *, int64_t);
+
+/* finishes the open block of the given PID, if any, so its memory can be released. The
+   next sample for that PID starts a new block. */
+extern PetscErrorCode history_store_seal(history_store *, PetscInt);
+
+/* seals the block of the given PID, as history_store_seal() does, and writes and releases
+   its open rollup buckets; for a PID that is gone. A later sample of that PID starts over. */
+extern PetscErrorCode history_store_forget(history_store *, PetscInt);
+
+/* decodes all samples for the PID in the second parameter with t0 <= t <= t1 (third and
+   fourth parameters). Only blocks overlapping [t0,t1] are decoded. A newly allocated array
+   of samples is stored in the fifth parameter (free with PetscFree()) and its length in the
+   sixth. */
+extern PetscErrorCode history_store_query(history_store *, PetscInt, int64_t, int64_t,
+					  history_sample **, PetscInt *);
+
+/* the current time in milliseconds since the epoch */
+extern int64_t history_now_ms();
+
+#endif
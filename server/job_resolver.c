@@ -0,0 +1,242 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "job_resolver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+PetscErrorCode job_resolver_create(job_resolver *res)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(res,sizeof(job_resolver));CHKERRQ(ierr);
+  ierr = PetscHMapICreate(&res->pid_to_job);CHKERRQ(ierr);
+  res->buflen = 4096;
+  ierr = PetscMalloc1(res->buflen,&res->buf);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode job_resolver_destroy(job_resolver *res)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscFree(res->jobs);CHKERRQ(ierr);
+  ierr = PetscFree(res->buf);CHKERRQ(ierr);
+  ierr = PetscHMapIDestroy(&res->pid_to_job);CHKERRQ(ierr);
+  res->njobs = res->capacity = 0;
+  res->buflen = 0;
+  PetscFunctionReturn(0);
+}
+
+/* reads all of /proc/<pid>/<file> (up to JOB_ENVIRON_MAX_LEN bytes) into res->buf,
+   growing it as needed, and stores the length in len. The buffer is NUL-terminated.
+   err is 0 on success and the errno of the failure otherwise. */
+static PetscErrorCode job_read(job_resolver *res, PetscInt pid, const char *file, size_t *len, int *err)
+{
+  PetscErrorCode ierr;
+  char           path[64];
+  ssize_t        n;
+  int            fd;
+  PetscFunctionBeginUser;
+  snprintf(path,sizeof(path),"/proc/%d/%s",(int)pid,file);
+  *len = 0;
+  *err = 0;
+  fd = open(path,O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *err = errno;
+    PetscFunctionReturn(0);
+  }
+  while (1) {
+    if (*len + 1 >= res->buflen) {
+      if (res->buflen >= JOB_ENVIRON_MAX_LEN) {
+	break;
+      }
+      res->buflen *= 2;
+      ierr = PetscRealloc(res->buflen,&res->buf);CHKERRQ(ierr);
+    }
+    n = read(fd,res->buf + *len,res->buflen - *len - 1);
+    if (n < 0) {
+      *err = errno;
+      break;
+    }
+    if (!n) {
+      break;
+    }
+    *len += n;
+  }
+  res->buf[*len] = '\0';
+  close(fd);
+  PetscFunctionReturn(0);
+}
+
+/* starttime is field 22 of /proc/<pid>/stat; the command name (field 2) is in
+   parentheses and may itself contain spaces and parentheses */
+static PetscBool job_parse_start_time(const char *buf, unsigned long long *start_time)
+{
+  const char *p = strrchr(buf,')');
+  int        field;
+  if (!p) {
+    return PETSC_FALSE;
+  }
+  for (field=2; field<22 && p; ++field) {
+    p = strchr(p + 1,' ');
+  }
+  if (!p) {
+    return PETSC_FALSE;
+  }
+  *start_time = strtoull(p + 1,NULL,10);
+  return PETSC_TRUE;
+}
+
+/* the index in names of the variable the NUL-separated KEY=VALUE pair is for, or -1 */
+static PetscInt job_var_index(const char **names, const char *pair, const char **value)
+{
+  PetscInt i;
+  size_t   len;
+  for (i=0; names[i]; ++i) {
+    len = strlen(names[i]);
+    if (!strncmp(pair,names[i],len) && pair[len] == '=') {
+      *value = pair + len + 1;
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void job_scan_environ(const char *buf, size_t len, job_info *job)
+{
+  const char *pair,*value;
+  PetscInt   i,best_rank = -1,best_id = -1;
+  for (pair=buf; pair<buf+len; pair+=strlen(pair)+1) {
+    if ((i = job_var_index(JobRankVars,pair,&value)) >= 0 && (best_rank < 0 || i < best_rank)) {
+      best_rank = i;
+      job->app_rank = atoi(value);
+    } else if ((i = job_var_index(JobIdVars,pair,&value)) >= 0 && (best_id < 0 || i < best_id)) {
+      best_id = i;
+      PetscStrncpy(job->job_id,value,JOB_ID_LEN);
+    }
+  }
+}
+
+/* Slurm puts the tasks of a job under .../job_<id>/step_<n>/..., Torque under
+   /torque/<id> and PBS Pro under /pbspro.service/jobid/<id> */
+static void job_scan_cgroup(const char *buf, job_info *job)
+{
+  static const char *markers[] = {"/job_","/torque/","/jobid/",0};
+  const char        *p;
+  size_t            len;
+  PetscInt          i;
+  for (i=0; markers[i]; ++i) {
+    if ((p = strstr(buf,markers[i]))) {
+      p += strlen(markers[i]);
+      len = strcspn(p,"/\n");
+      if (len && len < JOB_ID_LEN) {
+	memcpy(job->job_id,p,len);
+	job->job_id[len] = '\0';
+	return;
+      }
+    }
+  }
+}
+
+static PetscErrorCode job_resolver_get(job_resolver *res, PetscInt pid, job_info **job, PetscBool *isnew)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(res->pid_to_job,pid,&i);CHKERRQ(ierr);
+  *isnew = (PetscBool)(i < 0);
+  if (i < 0) {
+    if (res->njobs == res->capacity) {
+      res->capacity = res->capacity ? 2*res->capacity : 64;
+      ierr = PetscRealloc(res->capacity*sizeof(job_info),&res->jobs);CHKERRQ(ierr);
+    }
+    i = res->njobs++;
+    ierr = PetscMemzero(&res->jobs[i],sizeof(job_info));CHKERRQ(ierr);
+    res->jobs[i].pid = pid;
+    res->jobs[i].app_rank = -1;
+    ierr = PetscHMapISet(res->pid_to_job,pid,i);CHKERRQ(ierr);
+  }
+  *job = &res->jobs[i];
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode job_resolver_poll(job_resolver *res, PetscInt npid, PetscInt *pids)
+{
+  PetscErrorCode     ierr;
+  PetscInt           i;
+  job_info           *job;
+  unsigned long long start_time;
+  size_t             len;
+  int                err;
+  PetscBool          isnew;
+  PetscFunctionBeginUser;
+  for (i=0; i<npid; ++i) {
+    if (pids[i] <= 0) {
+      continue;
+    }
+    ierr = job_read(res,pids[i],"stat",&len,&err);CHKERRQ(ierr);
+    if (err || !job_parse_start_time(res->buf,&start_time)) {
+      /* gone; whatever was resolved while it ran stays */
+      continue;
+    }
+    ierr = job_resolver_get(res,pids[i],&job,&isnew);CHKERRQ(ierr);
+    if (!isnew) {
+      if (job->start_time == start_time) {
+	continue;
+      }
+      ++(res->nreused);
+    }
+    job->start_time = start_time;
+    job->app_rank = -1;
+    job->job_id[0] = '\0';
+    ierr = job_read(res,pids[i],"environ",&len,&err);CHKERRQ(ierr);
+    if (!err) {
+      job_scan_environ(res->buf,len,job);
+    }
+    if (!job->job_id[0]) {
+      ierr = job_read(res,pids[i],"cgroup",&len,&err);CHKERRQ(ierr);
+      if (!err) {
+	job_scan_cgroup(res->buf,job);
+      }
+    }
+    ++(res->nresolved);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode job_resolver_summarize(job_resolver *res, process_data_summary *psumm)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(res->pid_to_job,psumm->pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    PetscFunctionReturn(0);
+  }
+  psumm->app_rank = res->jobs[i].app_rank;
+  ierr = PetscStrncpy(psumm->job_id,res->jobs[i].job_id,JOB_ID_LEN);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode job_resolver_forget(job_resolver *res, PetscInt pid)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,last;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(res->pid_to_job,pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    PetscFunctionReturn(0);
+  }
+  ierr = PetscHMapIDel(res->pid_to_job,pid);CHKERRQ(ierr);
+  /* keep the jobs dense by moving the last one into the hole */
+  last = res->njobs - 1;
+  if (i != last) {
+    res->jobs[i] = res->jobs[last];
+    ierr = PetscHMapISet(res->pid_to_job,res->jobs[i].pid,i);CHKERRQ(ierr);
+  }
+  --(res->njobs);
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,57 @@
+#ifndef DCPROF_JOB_RESOLVER_H
+#define DCPROF_JOB_RESOLVER_H
+#include "petsc_webserver.h"
+#include <petsc/private/hashmapi.h>
+
+/* attributes the PIDs seen in the TCP data to the MPI job and application rank they
+   belong to, so a summary can say "rank 3 of SLURM job 1234" rather than only "PID
+   4242 on profiler rank 0". The first time a PID is seen its /proc/<pid>/environ is
+   scanned for the variables the launchers set (JobRankVars, JobIdVars; earlier
+   names win), and if no job id is found there, /proc/<pid>/cgroup is searched for a
+   Slurm or Torque/PBS job cgroup. environ is only readable for our own processes
+   (or as root); cgroup is readable by everyone.
+
+   The result is cached per PID together with the process's start time (field 22 of
+   /proc/<pid>/stat). Every poll re-reads the start time only, and a PID whose start
+   time changed has been reused by another process and is resolved again. */
+
+#define JOB_ENVIRON_MAX_LEN (1<<20) /* bytes of /proc/<pid>/environ scanned at most */
+
+static const char *JobRankVars[] = {"OMPI_COMM_WORLD_RANK","PMIX_RANK","PMI_RANK","MV2_COMM_WORLD_RANK",
+				    "PALS_RANKID","SLURM_PROCID",0};
+static const char *JobIdVars[] = {"SLURM_JOB_ID","PBS_JOBID","LSB_JOBID","COBALT_JOBID","FLUX_JOB_ID",
+				  "PMIX_NAMESPACE","OMPI_MCA_ess_base_jobid",0};
+
+typedef struct {
+  PetscInt           pid;
+  unsigned long long start_time; /* in clock ticks since boot */
+  PetscInt           app_rank;   /* -1 if the process is not a rank of a job */
+  char               job_id[JOB_ID_LEN]; /* empty if the process is not part of a job */
+} job_info;
+
+typedef struct {
+  job_info   *jobs;
+  PetscInt   njobs,capacity;
+  PetscHMapI pid_to_job;
+  PetscInt   nresolved,nreused; /* PIDs resolved, and PIDs found to have been reused */
+  char       *buf;
+  size_t     buflen;
+} job_resolver;
+
+extern PetscErrorCode job_resolver_create(job_resolver *);
+
+extern PetscErrorCode job_resolver_destroy(job_resolver *);
+
+/* resolves every PID in the array in the third parameter (of the length in the second
+   parameter) that has not been resolved yet, or that has been reused since */
+extern PetscErrorCode job_resolver_poll(job_resolver *, PetscInt, PetscInt *);
+
+/* copies the job id and application rank of the summary's PID into the summary.
+   Summaries of PIDs that were never resolved are left as they are. */
+extern PetscErrorCode job_resolver_summarize(job_resolver *, process_data_summary *);
+
+/* drops what was resolved of the PID in the second parameter; if the PID shows up
+   again, it is resolved again */
+extern PetscErrorCode job_resolver_forget(job_resolver *, PetscInt);
+
+#endif
@@ -0,0 +1,101 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "node_share.h"
+
+PetscErrorCode node_share_create(node_share *ns, MPI_Comm comm, PetscInt capacity)
+{
+  PetscErrorCode ierr;
+  PetscMPIInt    rank;
+  MPI_Aint       size;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(ns,sizeof(node_share));CHKERRQ(ierr);
+  if (capacity < 1) {
+    SETERRQ1(comm,PETSC_ERR_ARG_OUTOFRANGE,"Node share capacity must be positive, not %D",capacity);
+  }
+  ns->capacity = capacity;
+  MPI_Comm_rank(comm,&rank);
+  ierr = MPI_Comm_split_type(comm,MPI_COMM_TYPE_SHARED,rank,MPI_INFO_NULL,&ns->node_comm);CHKERRQ(ierr);
+  MPI_Comm_rank(ns->node_comm,&ns->node_rank);
+  MPI_Comm_size(ns->node_comm,&ns->node_size);
+  /* the leader only reads the others' segments, so its own is empty */
+  size = node_share_is_leader(ns) ? 0 : sizeof(node_share_segment) + capacity * sizeof(node_share_entry);
+  ierr = MPI_Win_allocate_shared(size,1,MPI_INFO_NULL,ns->node_comm,&ns->segment,&ns->win);CHKERRQ(ierr);
+  /* one passive epoch for the window's lifetime; consistency comes from
+     MPI_Win_sync() and barriers in node_share_merge() */
+  ierr = MPI_Win_lock_all(MPI_MODE_NOCHECK,ns->win);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode node_share_destroy(node_share *ns)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = MPI_Win_unlock_all(ns->win);CHKERRQ(ierr);
+  ierr = MPI_Win_free(&ns->win);CHKERRQ(ierr);
+  ierr = MPI_Comm_free(&ns->node_comm);CHKERRQ(ierr);
+  ns->segment = NULL;
+  PetscFunctionReturn(0);
+}
+
+PetscBool node_share_claim(node_share *ns, PetscBool has_file)
+{
+  PetscInt owner;
+  if (!has_file) {
+    return PETSC_FALSE;
+  }
+  owner = ns->nclaimed++ % ns->node_size;
+  return (PetscBool)(owner == ns->node_rank);
+}
+
+PetscErrorCode node_share_merge(node_share *ns, process_statistics *pstats)
+{
+  PetscErrorCode     ierr;
+  PetscInt           n=0,sent=0,remaining,max_remaining,i;
+  PetscInt           *pids=NULL;
+  process_data       *pdata=NULL;
+  PetscMPIInt        r,disp_unit;
+  MPI_Aint           size;
+  node_share_segment *seg;
+  PetscFunctionBeginUser;
+  if (ns->node_size == 1) {
+    PetscFunctionReturn(0);
+  }
+  if (!node_share_is_leader(ns)) {
+    ierr = process_statistics_num_entries(pstats,&n);CHKERRQ(ierr);
+    ierr = PetscMalloc2(n,&pids,n,&pdata);CHKERRQ(ierr);
+    ierr = process_statistics_get_all(pstats,pdata,pids);CHKERRQ(ierr);
+  }
+  while (1) {
+    remaining = n - sent;
+    ierr = MPI_Allreduce(&remaining,&max_remaining,1,MPIU_INT,MPI_MAX,ns->node_comm);CHKERRQ(ierr);
+    if (!max_remaining) {
+      break;
+    }
+    if (!node_share_is_leader(ns)) {
+      ns->segment->count = PetscMin(remaining,ns->capacity);
+      for (i=0; i<ns->segment->count; ++i) {
+	ns->segment->entries[i].pid = pids[sent + i];
+	ns->segment->entries[i].pdata = pdata[sent + i];
+      }
+      sent += ns->segment->count;
+    }
+    MPI_Win_sync(ns->win);
+    MPI_Barrier(ns->node_comm);
+    MPI_Win_sync(ns->win);
+    if (node_share_is_leader(ns)) {
+      for (r=1; r<ns->node_size; ++r) {
+	ierr = MPI_Win_shared_query(ns->win,r,&size,&disp_unit,&seg);CHKERRQ(ierr);
+	for (i=0; i<seg->count; ++i) {
+	  ierr = process_statistics_add_pdata(pstats,seg->entries[i].pid,&seg->entries[i].pdata);CHKERRQ(ierr);
+	}
+	ns->nmerged += seg->count;
+      }
+    }
+    /* the workers may not refill their segments until the leader is done */
+    MPI_Barrier(ns->node_comm);
+  }
+  if (!node_share_is_leader(ns)) {
+    ierr = PetscFree2(pids,pdata);CHKERRQ(ierr);
+    ierr = process_statistics_clear(pstats);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,61 @@
+#ifndef DCPROF_NODE_SHARE_H
+#define DCPROF_NODE_SHARE_H
+#include "petsc_webserver.h"
+#include <stdint.h>
+
+/* lets several driver ranks on one node split its ingestion. The ranks that share
+   a node are found with MPI_Comm_split_type(MPI_COMM_TYPE_SHARED); the input files
+   are dealt out among them round-robin with node_share_claim(), and rank 0 of the
+   node (the leader) keeps the node's process_statistics. Every poll, the other
+   ranks (workers) move what they ingested since the previous poll into their
+   segment of an MPI_Win_allocate_shared() window, from which the leader merges it
+   into its table, and clear their own. Only the leader has anything to summarize,
+   so only it sends summaries in the gather to rank 0.
+
+   Segments hold capacity entries; a worker with more PIDs than that hands them
+   over in several rounds. Sources that cannot be split (sock_diag, --event_source,
+   the node counters) are only read by the leader. */
+
+typedef struct {
+  PetscInt     pid;
+  process_data pdata;
+} node_share_entry;
+
+typedef struct {
+  int64_t          count;     /* entries in use in this round */
+  int64_t          reserved;
+  node_share_entry entries[]; /* capacity of them */
+} node_share_segment;
+
+typedef struct {
+  MPI_Comm           node_comm;
+  PetscMPIInt        node_rank,node_size;
+  MPI_Win            win;
+  node_share_segment *segment;   /* this rank's */
+  PetscInt           capacity;
+  PetscInt           nclaimed;   /* input files dealt out so far */
+  PetscInt           nmerged;    /* entries the leader merged, in total */
+} node_share;
+
+/* splits the communicator in the second parameter by node, and allocates the
+   shared window with segments of the number of entries in the third parameter.
+   Collective. */
+extern PetscErrorCode node_share_create(node_share *, MPI_Comm, PetscInt);
+
+/* frees the window and the node communicator. Collective. */
+extern PetscErrorCode node_share_destroy(node_share *);
+
+/* deals out the next input file: returns whether this rank is to read it. Call
+   with the same sequence of has-file flags on every rank of the node; files that
+   are not given (a PETSC_FALSE second parameter) are skipped and never claimed */
+extern PetscBool node_share_claim(node_share *, PetscBool);
+
+/* whether this rank is its node's leader */
+#define node_share_is_leader(ns) ((ns)->node_rank == 0)
+
+/* moves the data the workers ingested into the leader's process_statistics (the
+   second parameter on every rank) and clears the workers'. Collective over the
+   node. */
+extern PetscErrorCode node_share_merge(node_share *, process_statistics *);
+
+#endif
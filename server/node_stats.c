@@ -0,0 +1,286 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "node_stats.h"
+#include "summary_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* where each counter of /proc/net/snmp and /proc/net/netstat is found. Both files
+   hold pairs of lines per section: a header line of field names and a line of
+   values, each starting with the section name. */
+typedef struct {
+  const char   *section,*name;
+  node_counter counter;
+} node_keyed_field;
+
+static const node_keyed_field NodeSnmpFields[] = {
+  {"Tcp:","ActiveOpens",NODE_TCP_ACTIVE_OPENS},
+  {"Tcp:","PassiveOpens",NODE_TCP_PASSIVE_OPENS},
+  {"Tcp:","AttemptFails",NODE_TCP_ATTEMPT_FAILS},
+  {"Tcp:","EstabResets",NODE_TCP_ESTAB_RESETS},
+  {"Tcp:","CurrEstab",NODE_TCP_CURR_ESTAB},
+  {"Tcp:","InSegs",NODE_TCP_IN_SEGS},
+  {"Tcp:","OutSegs",NODE_TCP_OUT_SEGS},
+  {"Tcp:","RetransSegs",NODE_TCP_RETRANS_SEGS},
+  {"Tcp:","InErrs",NODE_TCP_IN_ERRS},
+  {"Tcp:","OutRsts",NODE_TCP_OUT_RSTS},
+  {"Udp:","InErrors",NODE_UDP_IN_ERRORS},
+  {"Udp:","RcvbufErrors",NODE_UDP_RCVBUF_ERRORS}
+};
+
+static const node_keyed_field NodeNetstatFields[] = {
+  {"TcpExt:","ListenOverflows",NODE_LISTEN_OVERFLOWS},
+  {"TcpExt:","ListenDrops",NODE_LISTEN_DROPS},
+  {"TcpExt:","TCPTimeouts",NODE_TCP_TIMEOUTS},
+  {"TcpExt:","TCPSynRetrans",NODE_TCP_SYN_RETRANS},
+  {"TcpExt:","TCPBacklogDrop",NODE_TCP_BACKLOG_DROP}
+};
+
+#define NUM_SNMP_FIELDS    (sizeof(NodeSnmpFields)/sizeof(NodeSnmpFields[0]))
+#define NUM_NETSTAT_FIELDS (sizeof(NodeNetstatFields)/sizeof(NodeNetstatFields[0]))
+
+/* reads the whole file into sampler->buf (NUL-terminated); seq_file reads may
+   return less than asked for, so keep reading until EOF or the buffer is full */
+static int node_read(node_sampler *sampler, int fd)
+{
+  ssize_t len;
+  size_t  total = 0;
+  do {
+    len = pread(fd,sampler->buf + total,NODE_READ_BUF_LEN - 1 - total,(off_t)total);
+    if (len < 0) {
+      sampler->buf[0] = '\0';
+      return errno;
+    }
+    total += (size_t)len;
+  } while (len > 0 && total < NODE_READ_BUF_LEN - 1);
+  sampler->buf[total] = '\0';
+  return 0;
+}
+
+static const char *skip_line(const char *p)
+{
+  p = strchr(p,'\n');
+  return p ? p + 1 : NULL;
+}
+
+/* "  eth0: rx_bytes rx_packets rx_errs rx_drop fifo frame compressed multicast
+            tx_bytes tx_packets tx_errs tx_drop fifo colls carrier compressed" */
+static void node_parse_dev(const char *buf, long *cur)
+{
+  const char *p = skip_line(buf),*name;
+  char       *end;
+  long       v[16];
+  int        i;
+  PetscInt   c;
+  for (c=NODE_RX_BYTES; c<=NODE_TX_DROP; ++c) {
+    cur[c] = 0;
+  }
+  if (p) {
+    p = skip_line(p); /* two header lines */
+  }
+  while (p && *p) {
+    while (*p == ' ') {
+      ++p;
+    }
+    name = p;
+    p = strchr(p,':');
+    if (!p) {
+      break;
+    }
+    ++p;
+    for (i=0; i<16; ++i) {
+      v[i] = strtol(p,&end,10);
+      p = end;
+    }
+    if (strncmp(name,"lo:",3)) {
+      cur[NODE_RX_BYTES] += v[0];
+      cur[NODE_RX_PACKETS] += v[1];
+      cur[NODE_RX_ERRS] += v[2];
+      cur[NODE_RX_DROP] += v[3];
+      cur[NODE_TX_BYTES] += v[8];
+      cur[NODE_TX_PACKETS] += v[9];
+      cur[NODE_TX_ERRS] += v[10];
+      cur[NODE_TX_DROP] += v[11];
+    }
+    p = skip_line(p);
+  }
+}
+
+static PetscBool starts_with(const char *line, const char *prefix)
+{
+  return (PetscBool)(strncmp(line,prefix,strlen(prefix)) == 0);
+}
+
+/* walks the header/value line pairs of /proc/net/snmp or /proc/net/netstat */
+static void node_parse_keyed(const char *buf, const node_keyed_field *fields, size_t nfields, long *cur)
+{
+  const char *line = buf,*header = NULL,*h,*v,*name;
+  char       *end;
+  size_t     f,len;
+  long       value;
+  while (line && *line) {
+    if (header && strncmp(line,header,(size_t)(strchr(header,':') - header + 1)) == 0) {
+      /* the value line of the section whose header we just passed */
+      h = strchr(header,':') + 1;
+      v = strchr(line,':') + 1;
+      while (*h && *h != '\n') {
+	while (*h == ' ') {
+	  ++h;
+	}
+	name = h;
+	while (*h && *h != ' ' && *h != '\n') {
+	  ++h;
+	}
+	len = (size_t)(h - name);
+	value = strtol(v,&end,10);
+	v = end;
+	for (f=0; f<nfields; ++f) {
+	  if (starts_with(header,fields[f].section) && strlen(fields[f].name) == len
+	      && strncmp(fields[f].name,name,len) == 0) {
+	    cur[fields[f].counter] = value;
+	  }
+	}
+      }
+      header = NULL;
+    } else {
+      header = line;
+    }
+    line = skip_line(line);
+  }
+}
+
+PetscErrorCode node_sampler_sample(node_sampler *sampler)
+{
+  PetscErrorCode ierr;
+  PetscLogDouble now;
+  PetscReal      dt,rate;
+  PetscInt       c;
+  PetscFunctionBeginUser;
+  ierr = PetscTime(&now);CHKERRQ(ierr);
+  if (sampler->dev_fd >= 0 && !node_read(sampler,sampler->dev_fd)) {
+    node_parse_dev(sampler->buf,sampler->cur);
+  }
+  if (sampler->snmp_fd >= 0 && !node_read(sampler,sampler->snmp_fd)) {
+    node_parse_keyed(sampler->buf,NodeSnmpFields,NUM_SNMP_FIELDS,sampler->cur);
+  }
+  if (sampler->netstat_fd >= 0 && !node_read(sampler,sampler->netstat_fd)) {
+    node_parse_keyed(sampler->buf,NodeNetstatFields,NUM_NETSTAT_FIELDS,sampler->cur);
+  }
+  if (!sampler->nsamples) {
+    sampler->t_first = now;
+    ierr = PetscArraycpy(sampler->first,sampler->cur,NUM_NODE_COUNTERS);CHKERRQ(ierr);
+  } else {
+    dt = (PetscReal)(now - sampler->t_prev);
+    if (dt > 0.0) {
+      for (c=0; c<NUM_NODE_COUNTERS; ++c) {
+	rate = (PetscReal)(sampler->cur[c] - sampler->prev[c]) / dt;
+	sampler->peak_rate[c] = PetscMax(sampler->peak_rate[c],rate);
+      }
+    }
+  }
+  ierr = PetscArraycpy(sampler->prev,sampler->cur,NUM_NODE_COUNTERS);CHKERRQ(ierr);
+  sampler->t_prev = now;
+  ++(sampler->nsamples);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode node_sampler_create(node_sampler *sampler)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(sampler,sizeof(node_sampler));CHKERRQ(ierr);
+  sampler->dev_fd = open("/proc/net/dev",O_RDONLY | O_CLOEXEC);
+  sampler->snmp_fd = open("/proc/net/snmp",O_RDONLY | O_CLOEXEC);
+  sampler->netstat_fd = open("/proc/net/netstat",O_RDONLY | O_CLOEXEC);
+  if (sampler->dev_fd < 0 && sampler->snmp_fd < 0 && sampler->netstat_fd < 0) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open any of /proc/net/dev, /proc/net/snmp and /proc/net/netstat\n");
+  }
+  if (gethostname(sampler->host,NODE_HOST_LEN)) {
+    ierr = PetscStrncpy(sampler->host,"[unknown]",NODE_HOST_LEN);CHKERRQ(ierr);
+  }
+  sampler->host[NODE_HOST_LEN-1] = '\0';
+  ierr = node_sampler_sample(sampler);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode node_sampler_destroy(node_sampler *sampler)
+{
+  PetscFunctionBeginUser;
+  if (sampler->dev_fd >= 0) {
+    close(sampler->dev_fd);
+  }
+  if (sampler->snmp_fd >= 0) {
+    close(sampler->snmp_fd);
+  }
+  if (sampler->netstat_fd >= 0) {
+    close(sampler->netstat_fd);
+  }
+  sampler->dev_fd = sampler->snmp_fd = sampler->netstat_fd = -1;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode node_sampler_summarize(node_sampler *sampler, PetscInt rank, node_summary *nsumm)
+{
+  PetscErrorCode ierr;
+  PetscInt       c;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(nsumm,sizeof(node_summary));CHKERRQ(ierr);
+  nsumm->rank = rank;
+  nsumm->interval = (PetscReal)(sampler->t_prev - sampler->t_first);
+  ierr = PetscStrncpy(nsumm->host,sampler->host,NODE_HOST_LEN);CHKERRQ(ierr);
+  for (c=0; c<NUM_NODE_COUNTERS; ++c) {
+    nsumm->total[c] = sampler->prev[c];
+    if (nsumm->interval > 0.0) {
+      nsumm->rate[c] = (PetscReal)(sampler->prev[c] - sampler->first[c]) / nsumm->interval;
+    }
+    nsumm->peak_rate[c] = sampler->peak_rate[c];
+    sampler->peak_rate[c] = 0.0;
+  }
+  /* the next interval starts at the last sample */
+  ierr = PetscArraycpy(sampler->first,sampler->prev,NUM_NODE_COUNTERS);CHKERRQ(ierr);
+  sampler->t_first = sampler->t_prev;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode node_summary_view(FILE *fd, node_summary *nsumm)
+{
+  PetscInt c;
+  PetscFunctionBeginUser;
+  PetscFPrintf(PETSC_COMM_SELF,fd,"Node summary of rank %D on host %s over %g seconds:\n",nsumm->rank,nsumm->host,nsumm->interval);
+  for (c=0; c<NUM_NODE_COUNTERS; ++c) {
+    PetscFPrintf(PETSC_COMM_SELF,fd,"%-17s = %ld (%g/s, peak %g/s)\n",NodeCounters[c],nsumm->total[c],nsumm->rate[c],nsumm->peak_rate[c]);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode node_summary_gather(node_summary *nsumm, FILE *fd, summary_snapshot *snap)
+{
+  PetscErrorCode ierr;
+  PetscInt       rank,size,i;
+  node_summary   *all=NULL;
+  PetscFunctionBeginUser;
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  MPI_Comm_size(PETSC_COMM_WORLD,&size);
+  if (!rank) {
+    ierr = PetscMalloc1(size,&all);CHKERRQ(ierr);
+  }
+  MPI_Gather(nsumm,1,MPI_DTYPES[DTYPE_NODE],all,1,MPI_DTYPES[DTYPE_NODE],0,PETSC_COMM_WORLD);
+  if (!rank) {
+    for (i=0; i<size; ++i) {
+      if (all[i].rank < 0) {
+	continue;
+      }
+      if (fd) {
+	ierr = node_summary_view(fd,&all[i]);CHKERRQ(ierr);
+      }
+      if (snap) {
+	ierr = summary_snapshot_add_node(snap,&all[i]);CHKERRQ(ierr);
+      }
+    }
+    ierr = PetscFree(all);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,84 @@
+#ifndef DCPROF_NODE_STATS_H
+#define DCPROF_NODE_STATS_H
+#include "petsc_webserver.h"
+#include <petsctime.h>
+
+/* node-wide NIC and TCP stack counters. The per-process eBPF events do not see
+   kernel-wide symptoms such as interface drops, retransmitted segments or
+   listen queue overflows, so each rank also samples /proc/net/dev, /proc/net/snmp
+   and /proc/net/netstat. The three files are kept open and re-read with pread()
+   into a fixed buffer and parsed in place, so a sample allocates nothing and can
+   be taken several times per polling interval. */
+
+#define NODE_HOST_LEN      64
+#define NODE_READ_BUF_LEN  65536
+
+typedef enum {
+  /* /proc/net/dev, summed over every interface but lo */
+  NODE_RX_BYTES,NODE_RX_PACKETS,NODE_RX_ERRS,NODE_RX_DROP,
+  NODE_TX_BYTES,NODE_TX_PACKETS,NODE_TX_ERRS,NODE_TX_DROP,
+  /* /proc/net/snmp */
+  NODE_TCP_ACTIVE_OPENS,NODE_TCP_PASSIVE_OPENS,NODE_TCP_ATTEMPT_FAILS,NODE_TCP_ESTAB_RESETS,
+  NODE_TCP_CURR_ESTAB,NODE_TCP_IN_SEGS,NODE_TCP_OUT_SEGS,NODE_TCP_RETRANS_SEGS,
+  NODE_TCP_IN_ERRS,NODE_TCP_OUT_RSTS,NODE_UDP_IN_ERRORS,NODE_UDP_RCVBUF_ERRORS,
+  /* /proc/net/netstat */
+  NODE_LISTEN_OVERFLOWS,NODE_LISTEN_DROPS,NODE_TCP_TIMEOUTS,NODE_TCP_SYN_RETRANS,
+  NODE_TCP_BACKLOG_DROP,
+  NUM_NODE_COUNTERS
+} node_counter;
+
+static const char *NodeCounters[] = {"rx_bytes","rx_packets","rx_errs","rx_drop",
+				     "tx_bytes","tx_packets","tx_errs","tx_drop",
+				     "active_opens","passive_opens","attempt_fails","estab_resets",
+				     "curr_estab","in_segs","out_segs","retrans_segs",
+				     "in_errs","out_rsts","udp_in_errors","udp_rcvbuf_errors",
+				     "listen_overflows","listen_drops","tcp_timeouts","tcp_syn_retrans",
+				     "tcp_backlog_drop",0};
+
+/* one record per rank, gathered to root next to the process summaries. Rates are
+   per second; for curr_estab, which is a gauge, the rate is its rate of change. */
+typedef struct {
+  PetscInt  rank;
+  PetscReal interval;                       /* seconds covered by rate */
+  long      total[NUM_NODE_COUNTERS];       /* value at the last sample */
+  PetscReal rate[NUM_NODE_COUNTERS];        /* average over the interval */
+  PetscReal peak_rate[NUM_NODE_COUNTERS];   /* highest rate between two consecutive samples */
+  char      host[NODE_HOST_LEN];
+} node_summary;
+
+typedef struct {
+  int            dev_fd,snmp_fd,netstat_fd;
+  PetscInt       nsamples;        /* samples taken in the current interval */
+  PetscLogDouble t_first,t_prev;  /* time of the interval's first sample, and of the last one */
+  long           first[NUM_NODE_COUNTERS],prev[NUM_NODE_COUNTERS],cur[NUM_NODE_COUNTERS];
+  PetscReal      peak_rate[NUM_NODE_COUNTERS];
+  char           host[NODE_HOST_LEN];
+  char           buf[NODE_READ_BUF_LEN];
+} node_sampler;
+
+/* opens the /proc/net files and takes the first sample */
+extern PetscErrorCode node_sampler_create(node_sampler *);
+
+extern PetscErrorCode node_sampler_destroy(node_sampler *);
+
+/* reads all counters and updates the peak rates. Cheap enough to call several times a second. */
+extern PetscErrorCode node_sampler_sample(node_sampler *);
+
+/* stores the counters and rates since the previous call (or since creation) in the
+   node_summary in the third parameter, for the MPI rank in the second parameter, and
+   starts a new interval */
+extern PetscErrorCode node_sampler_summarize(node_sampler *, PetscInt, node_summary *);
+
+/* write the node summary pointed to by the second parameter to the file pointed to by the first */
+extern PetscErrorCode node_summary_view(FILE *, node_summary *);
+
+struct summary_snapshot_s;
+
+/* gathers every rank's node summary in the first parameter to root, where they are
+   written to the file in the second parameter and added to the snapshot in the
+   third, either of which may be NULL (both are ignored on other ranks).
+   Collective; ranks that do not sample their node pass a summary with rank -1,
+   which is skipped. */
+extern PetscErrorCode node_summary_gather(node_summary *, FILE *, struct summary_snapshot_s *);
+
+#endif
@@ -1,2 +1,2076 @@
-#include "mongoose.h"
-#include "petsc_webserver.h"
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_mongoose.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stddef.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <time.h>
+
+/* what the server thread builds responses in; grown with realloc() */
+typedef struct {
+  char   *data;
+  size_t len,capacity;
+  int    failed;
+} http_buffer;
+
+static void http_buffer_printf(http_buffer *b, const char *fmt, ...)
+{
+  va_list ap;
+  int     n;
+  char    *data;
+  size_t  capacity;
+  if (b->failed) {
+    return;
+  }
+  while (1) {
+    va_start(ap,fmt);
+    n = vsnprintf(b->data ? b->data + b->len : NULL,b->data ? b->capacity - b->len : 0,fmt,ap);
+    va_end(ap);
+    if (n < 0) {
+      b->failed = 1;
+      return;
+    }
+    if (b->data && b->len + n < b->capacity) {
+      b->len += n;
+      return;
+    }
+    capacity = b->capacity ? b->capacity : 4096;
+    while (capacity <= b->len + n) {
+      capacity *= 2;
+    }
+    data = (char*)realloc(b->data,capacity);
+    if (!data) {
+      b->failed = 1;
+      return;
+    }
+    b->data = data;
+    b->capacity = capacity;
+  }
+}
+
+/* grows the buffer by the number of bytes in the second parameter and returns
+   them, or NULL if it cannot */
+static void *http_buffer_extend(http_buffer *b, size_t n)
+{
+  char   *data;
+  size_t capacity;
+  if (b->failed) {
+    return NULL;
+  }
+  if (b->len + n >= b->capacity) {
+    capacity = b->capacity ? b->capacity : 4096;
+    while (capacity <= b->len + n) {
+      capacity *= 2;
+    }
+    data = (char*)realloc(b->data,capacity);
+    if (!data) {
+      b->failed = 1;
+      return NULL;
+    }
+    b->data = data;
+    b->capacity = capacity;
+  }
+  b->len += n;
+  return b->data + b->len - n;
+}
+
+static void http_buffer_append(http_buffer *b, const void *data, size_t n)
+{
+  void *dst = http_buffer_extend(b,n);
+  if (dst && n) {
+    memcpy(dst,data,n);
+  }
+}
+
+/* appends the string in the second parameter, escaped for a JSON string */
+static void http_buffer_escape(http_buffer *b, const char *s)
+{
+  const char *c;
+  for (c=s; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      http_buffer_printf(b,"\\%c",*c);
+    } else if ((unsigned char)*c < 0x20) {
+      http_buffer_printf(b,"\\u%04x",(unsigned char)*c);
+    } else {
+      http_buffer_printf(b,"%c",*c);
+    }
+  }
+}
+
+static void http_buffer_string(http_buffer *b, const char *s)
+{
+  http_buffer_printf(b,"\"");
+  http_buffer_escape(b,s);
+  http_buffer_printf(b,"\"");
+}
+
+static void http_buffer_real(http_buffer *b, const char *key, PetscReal x)
+{
+  if (isfinite((double)x)) {
+    http_buffer_printf(b,"\"%s\": %.10g, ",key,(double)x);
+  } else {
+    http_buffer_printf(b,"\"%s\": null, ",key);
+  }
+}
+
+/* the fields of summary_view(), under the same names */
+static void http_buffer_summary(http_buffer *b, process_data_summary *psum)
+{
+  http_buffer_printf(b,"{\"rank\": %ld, \"pid\": %ld, \"name\": ",(long)psum->rank,(long)psum->pid);
+  http_buffer_string(b,psum->comm);
+  http_buffer_printf(b,", \"tx_kb\": %ld, \"rx_kb\": %ld, \"n_event\": %ld, ",psum->tx_kb,psum->rx_kb,psum->n_event);
+  http_buffer_real(b,"avg_latency",psum->avg_latency);
+  http_buffer_real(b,"avg_lifetime",psum->avg_lifetime);
+  http_buffer_real(b,"fraction_ipv6",psum->fraction_ipv6);
+  http_buffer_printf(b,"\"nretrans\": %ld, \"ndrop\": %ld, ",psum->nretrans,psum->ndrop);
+  http_buffer_real(b,"avg_rtt",psum->avg_rtt);
+  http_buffer_real(b,"p99_rtt",psum->p99_rtt);
+  http_buffer_real(b,"avg_handshake",psum->avg_handshake);
+  http_buffer_real(b,"avg_established",psum->avg_established);
+  http_buffer_real(b,"cpu_seconds",psum->cpu_seconds);
+  http_buffer_printf(b,"\"rss_kb\": %ld, \"read_bytes\": %ld, \"write_bytes\": %ld, \"ctx_switches\": %ld, ",
+		     psum->rss_kb,psum->read_bytes,psum->write_bytes,psum->ctx_switches);
+  http_buffer_real(b,"bytes_per_cpu_second",psum->bytes_per_cpu_second);
+  http_buffer_printf(b,"\"job_id\": ");
+  http_buffer_string(b,psum->job_id);
+  http_buffer_printf(b,", \"app_rank\": %ld}",(long)psum->app_rank);
+}
+
+/* decodes %XX escapes (and '+') in place */
+static void http_url_decode(char *s)
+{
+  char *out=s;
+  int  hi,lo;
+  for (; *s; ++s) {
+    if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2])) {
+      hi = isdigit((unsigned char)s[1]) ? s[1] - '0' : tolower((unsigned char)s[1]) - 'a' + 10;
+      lo = isdigit((unsigned char)s[2]) ? s[2] - '0' : tolower((unsigned char)s[2]) - 'a' + 10;
+      *out++ = (char)(16*hi + lo);
+      s += 2;
+    } else if (*s == '+') {
+      *out++ = ' ';
+    } else {
+      *out++ = *s;
+    }
+  }
+  *out = '\0';
+}
+
+static PetscBool http_is_number(const char *s, size_t len)
+{
+  size_t i;
+  if (!len) {
+    return PETSC_FALSE;
+  }
+  for (i=0; i<len; ++i) {
+    if (!isdigit((unsigned char)s[i])) {
+      return PETSC_FALSE;
+    }
+  }
+  return PETSC_TRUE;
+}
+
+/* parses the {rank}/{pid} of /api/get, the digits from the first parameter to
+   the slash in the second and after it, into the third. Returns PETSC_FALSE if
+   either does not fit a PetscInt, which no summary has. */
+static PetscBool http_parse_key(const char *arg, const char *slash, process_data_summary *key)
+{
+  long long rank,pid;
+  char      *end;
+  errno = 0;
+  rank = strtoll(arg,&end,10);
+  if (errno || end != slash || rank < 0 || rank > PETSC_MAX_INT) {
+    return PETSC_FALSE;
+  }
+  pid = strtoll(slash + 1,&end,10);
+  if (errno || *end || pid < 0 || pid > PETSC_MAX_INT) {
+    return PETSC_FALSE;
+  }
+  key->rank = (PetscInt)rank;
+  key->pid = (PetscInt)pid;
+  return PETSC_TRUE;
+}
+
+static int http_summary_cmp(const void *a, const void *b)
+{
+  const process_data_summary *x = (const process_data_summary*)a,*y = (const process_data_summary*)b;
+  if (x->rank != y->rank) {
+    return x->rank < y->rank ? -1 : 1;
+  }
+  return x->pid < y->pid ? -1 : (x->pid > y->pid);
+}
+
+/* NaN (no samples) is the same as NaN */
+static PetscBool http_real_differs(PetscReal x, PetscReal y)
+{
+  return (PetscBool)!(x == y || (x != x && y != y));
+}
+
+/* whether a watcher would see any difference between two summaries of the same
+   process */
+static PetscBool http_summary_changed(process_data_summary *x, process_data_summary *y)
+{
+  return (PetscBool)(x->tx_kb != y->tx_kb || x->rx_kb != y->rx_kb || x->n_event != y->n_event
+		     || x->nretrans != y->nretrans || x->ndrop != y->ndrop || x->rss_kb != y->rss_kb
+		     || x->read_bytes != y->read_bytes || x->write_bytes != y->write_bytes
+		     || x->ctx_switches != y->ctx_switches || x->app_rank != y->app_rank
+		     || http_real_differs(x->avg_latency,y->avg_latency) || http_real_differs(x->avg_lifetime,y->avg_lifetime)
+		     || http_real_differs(x->fraction_ipv6,y->fraction_ipv6) || http_real_differs(x->avg_rtt,y->avg_rtt)
+		     || http_real_differs(x->p99_rtt,y->p99_rtt) || http_real_differs(x->avg_handshake,y->avg_handshake)
+		     || http_real_differs(x->avg_established,y->avg_established)
+		     || http_real_differs(x->cpu_seconds,y->cpu_seconds)
+		     || http_real_differs(x->bytes_per_cpu_second,y->bytes_per_cpu_second)
+		     || strcmp(x->comm,y->comm) || strcmp(x->job_id,y->job_id));
+}
+
+#define HTTP_REMOVED -1
+#define HTTP_CHANGED -2
+
+typedef struct {
+  PetscReal value;
+  PetscInt  index;
+} http_sort_entry;
+
+static const char *HttpSortKeys[] = {"tx_kb","rx_kb","n_event","avg_latency",0};
+
+static PetscReal http_sort_value(process_data_summary *psum, HttpSortKey key)
+{
+  switch (key) {
+  case HTTP_SORT_TX_KB:       return (PetscReal)psum->tx_kb;
+  case HTTP_SORT_RX_KB:       return (PetscReal)psum->rx_kb;
+  case HTTP_SORT_N_EVENT:     return (PetscReal)psum->n_event;
+  case HTTP_SORT_AVG_LATENCY: return psum->avg_latency;
+  default:                    return 0.0;
+  }
+}
+
+/* larger values first, NaN last, and (rank,pid) order among equals */
+static int http_sort_entry_cmp(const void *a, const void *b)
+{
+  const http_sort_entry *x = (const http_sort_entry*)a,*y = (const http_sort_entry*)b;
+  int                   xnan = x->value != x->value,ynan = y->value != y->value;
+  if (xnan != ynan) {
+    return xnan ? 1 : -1;
+  }
+  if (!xnan && x->value != y->value) {
+    return x->value > y->value ? -1 : 1;
+  }
+  return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/* matches the pending summaries with the ones being served, both sorted by
+   (rank,pid), in one merge: the second parameter gets the new index of each
+   served summary, or HTTP_REMOVED or HTTP_CHANGED, and the third the indices of
+   the pending ones that are new or have changed. Returns how many of those there
+   are. */
+static PetscInt http_server_match(http_server *srv, PetscInt *remap, http_sort_entry *fresh)
+{
+  PetscInt i=0,j=0,nfresh=0;
+  int      cmp;
+  while (i < srv->nsummaries || j < srv->npending) {
+    if (i == srv->nsummaries) {
+      cmp = 1;
+    } else if (j == srv->npending) {
+      cmp = -1;
+    } else {
+      cmp = http_summary_cmp(&srv->summaries[i],&srv->pending[j]);
+    }
+    if (cmp < 0) {
+      remap[i++] = HTTP_REMOVED;
+    } else if (cmp > 0) {
+      fresh[nfresh++].index = j++;
+    } else if (http_summary_changed(&srv->summaries[i],&srv->pending[j])) {
+      remap[i++] = HTTP_CHANGED;
+      fresh[nfresh++].index = j++;
+    } else {
+      remap[i++] = j++;
+    }
+  }
+  return nfresh;
+}
+
+/* the delta from the summaries being served to the pending ones, as matched by
+   http_server_match() */
+static void http_buffer_delta(http_buffer *b, http_server *srv, const PetscInt *remap, const http_sort_entry *fresh, PetscInt nfresh)
+{
+  PetscInt i,n=0;
+  http_buffer_printf(b,"{\"epoch\": %llu, \"full\": false, \"changed\": [",(unsigned long long)srv->epoch + 1);
+  for (i=0; i<nfresh; ++i) {
+    http_buffer_printf(b,i ? ", " : "");
+    http_buffer_summary(b,&srv->pending[fresh[i].index]);
+  }
+  http_buffer_printf(b,"], \"removed\": [");
+  for (i=0; i<srv->nsummaries; ++i) {
+    if (remap[i] == HTTP_REMOVED) {
+      http_buffer_printf(b,"%s[%ld, %ld]",n++ ? ", " : "",(long)srv->summaries[i].rank,(long)srv->summaries[i].pid);
+    }
+  }
+  http_buffer_printf(b,"]}");
+}
+
+/* orders the pending summaries by the key in the second parameter, from their
+   order in the summaries being served: the ones that have not changed keep their
+   relative order, so only the fresh ones (as matched by http_server_match()) are
+   sorted, and then merged in */
+static void http_server_order(http_server *srv, HttpSortKey key, const PetscInt *remap, http_sort_entry *fresh, PetscInt nfresh)
+{
+  http_order      *old = &srv->order[key],*order = &srv->pending_order[key];
+  http_sort_entry kept;
+  PetscInt        i,j=0,n=0;
+  for (i=0; i<nfresh; ++i) {
+    fresh[i].value = http_sort_value(&srv->pending[fresh[i].index],key);
+  }
+  qsort(fresh,nfresh,sizeof(http_sort_entry),http_sort_entry_cmp);
+  order->nvalued = 0;
+  for (i=0; i<srv->nsummaries; ++i) {
+    kept.index = remap[old->index[i]];
+    if (kept.index < 0) {
+      continue;
+    }
+    kept.value = http_sort_value(&srv->pending[kept.index],key);
+    for (; j<nfresh && http_sort_entry_cmp(&fresh[j],&kept) < 0; ++j) {
+      order->nvalued += fresh[j].value == fresh[j].value;
+      order->index[n++] = fresh[j].index;
+    }
+    order->nvalued += kept.value == kept.value;
+    order->index[n++] = kept.index;
+  }
+  for (; j<nfresh; ++j) {
+    order->nvalued += fresh[j].value == fresh[j].value;
+    order->index[n++] = fresh[j].index;
+  }
+}
+
+/* whether the ring still has every epoch after the one in the second parameter,
+   with its JSON if json */
+static PetscBool http_server_covers(http_server *srv, uint64_t since, PetscBool json)
+{
+  http_delta *d;
+  uint64_t   e;
+  if (since > srv->epoch || srv->epoch - since > HTTP_DELTA_HISTORY) {
+    return PETSC_FALSE;
+  }
+  for (e=since+1; e<=srv->epoch; ++e) {
+    d = &srv->deltas[e % HTTP_DELTA_HISTORY];
+    if (d->epoch != e || (json && !d->json)) {
+      return PETSC_FALSE;
+    }
+  }
+  return PETSC_TRUE;
+}
+
+/* appends the events that take a watcher from the epoch in the third parameter
+   to the current one, and moves it there: the deltas in between if they are all
+   still kept, or else one full snapshot. As SSE events if sse, or else as JSON
+   objects separated by commas. Called under lock; returns the number of events. */
+static int http_buffer_events(http_server *srv, http_buffer *b, uint64_t *since, PetscBool sse)
+{
+  http_delta *d;
+  uint64_t   e;
+  PetscInt   i;
+  PetscBool  full;
+  int        n=0;
+  if (srv->epoch == srv->epoch0 || *since == srv->epoch) {
+    return 0;
+  }
+  full = (PetscBool)!http_server_covers(srv,*since,PETSC_TRUE);
+  if (full) {
+    if (sse) {
+      http_buffer_printf(b,"id: %llu\nevent: snapshot\ndata: ",(unsigned long long)srv->epoch);
+    }
+    http_buffer_printf(b,"{\"epoch\": %llu, \"full\": true, \"changed\": [",(unsigned long long)srv->epoch);
+    for (i=0; i<srv->nsummaries; ++i) {
+      http_buffer_printf(b,i ? ", " : "");
+      http_buffer_summary(b,&srv->summaries[i]);
+    }
+    http_buffer_printf(b,"], \"removed\": []}%s",sse ? "\n\n" : "");
+    n = 1;
+  } else {
+    for (e=*since+1; e<=srv->epoch; ++e,++n) {
+      d = &srv->deltas[e % HTTP_DELTA_HISTORY];
+      if (sse) {
+	http_buffer_printf(b,"id: %llu\nevent: delta\ndata: %.*s\n\n",(unsigned long long)e,(int)d->len,d->json);
+      } else {
+	http_buffer_printf(b,"%s%.*s",n ? ", " : "",(int)d->len,d->json);
+      }
+    }
+  }
+  *since = srv->epoch;
+  return n;
+}
+
+#define HTTP_PAD8(n) (((n) + 7) & ~(size_t)7)
+
+/* pads the buffer with zeros to a multiple of 8 bytes */
+static void http_buffer_pad8(http_buffer *b)
+{
+  size_t n = HTTP_PAD8(b->len) - b->len;
+  void   *dst = http_buffer_extend(b,n);
+  if (dst) {
+    memset(dst,0,n);
+  }
+}
+
+/* the names in an export, and an open addressing hash of them */
+typedef struct {
+  http_buffer names;
+  uint32_t    n;
+  size_t      *offsets;         /* of each name in names */
+  uint32_t    *slots;           /* 1 + the index of a name, or 0 */
+  size_t      mask;
+} http_dictionary;
+
+/* FNV-1a */
+uint64_t http_name_hash(const char *name)
+{
+  uint64_t   h=1469598103934665603ULL;
+  const char *c;
+  for (c=name; *c; ++c) {
+    h = (h ^ (unsigned char)*c) * 1099511628211ULL;
+  }
+  return h;
+}
+
+static uint32_t http_dictionary_intern(http_dictionary *dict, const char *name)
+{
+  size_t i;
+  if (dict->names.failed) {
+    return 0;
+  }
+  for (i=http_name_hash(name) & dict->mask; dict->slots[i]; i=(i + 1) & dict->mask) {
+    if (strcmp(dict->names.data + dict->offsets[dict->slots[i] - 1],name) == 0) {
+      return dict->slots[i] - 1;
+    }
+  }
+  dict->slots[i] = dict->n + 1;
+  dict->offsets[dict->n] = dict->names.len;
+  http_buffer_append(&dict->names,name,strlen(name) + 1);
+  return dict->n++;
+}
+
+/* appends an nrows long column of the type in the first parameter, of the
+   expression in the second for each row psum */
+#define HTTP_EXPORT_COLUMN(type,expr) do {					\
+    type *col = (type*)http_buffer_extend(b,HTTP_PAD8(nrows * sizeof(type))); \
+    if (col) {								\
+      memset(col,0,HTTP_PAD8(nrows * sizeof(type)));			\
+      for (k=0; k<nrows; ++k) {						\
+	psum = &srv->summaries[rows[k]];				\
+	col[k] = (type)(expr);						\
+      }									\
+    }									\
+  } while (0)
+
+/* appends the export (see petsc_mongoose.h) of all the summaries if full, or
+   else of those that changed after the epoch in the third parameter, with the
+   processes removed since. Called under lock. */
+static void http_buffer_export(http_server *srv, http_buffer *b, uint64_t since, PetscBool full)
+{
+  http_export_header   hdr;
+  http_dictionary      dict;
+  process_data_summary *psum;
+  http_delta           *d;
+  PetscInt             *rows,nrows=0,k,j;
+  uint32_t             *names;
+  int32_t              *removed;
+  size_t               nslots=16,nremoved=0,n;
+  uint64_t             e;
+  memset(&dict,0,sizeof(dict));
+  rows = (PetscInt*)malloc((srv->nsummaries + 1) * sizeof(PetscInt));
+  names = (uint32_t*)malloc(2 * (srv->nsummaries + 1) * sizeof(uint32_t));
+  for (k=0; rows && k<srv->nsummaries; ++k) {
+    if (full || srv->changed[k] > since) {
+      rows[nrows++] = k;
+    }
+  }
+  while (nslots < 4 * (size_t)nrows) {
+    nslots *= 2;
+  }
+  dict.mask = nslots - 1;
+  dict.slots = (uint32_t*)calloc(nslots,sizeof(uint32_t));
+  dict.offsets = (size_t*)malloc((2 * nrows + 1) * sizeof(size_t));
+  if (!rows || !names || !dict.slots || !dict.offsets) {
+    b->failed = 1;
+    goto cleanup;
+  }
+  for (k=0; k<nrows; ++k) {
+    names[2*k] = http_dictionary_intern(&dict,srv->summaries[rows[k]].comm);
+    names[2*k+1] = http_dictionary_intern(&dict,srv->summaries[rows[k]].job_id);
+  }
+  for (e=since+1; !full && e<=srv->epoch; ++e) {
+    nremoved += srv->deltas[e % HTTP_DELTA_HISTORY].nremoved;
+  }
+
+  memset(&hdr,0,sizeof(hdr));
+  memcpy(hdr.magic,HTTP_EXPORT_MAGIC,sizeof(HTTP_EXPORT_MAGIC));
+  hdr.version = HTTP_EXPORT_VERSION;
+  hdr.full = full ? 1 : 0;
+  hdr.epoch = srv->epoch;
+  hdr.since = full ? 0 : since;
+  hdr.nrows = (uint32_t)nrows;
+  hdr.nremoved = (uint32_t)nremoved;
+  hdr.nnames = dict.n;
+  hdr.names_len = (uint32_t)dict.names.len;
+  http_buffer_append(b,&hdr,sizeof(hdr));
+  http_buffer_append(b,dict.names.data,dict.names.len);
+  http_buffer_pad8(b);
+  HTTP_EXPORT_COLUMN(int32_t,psum->rank);
+  HTTP_EXPORT_COLUMN(int32_t,psum->pid);
+  HTTP_EXPORT_COLUMN(int32_t,psum->app_rank);
+  HTTP_EXPORT_COLUMN(uint32_t,names[2*k]);
+  HTTP_EXPORT_COLUMN(uint32_t,names[2*k+1]);
+  HTTP_EXPORT_COLUMN(int64_t,psum->tx_kb);
+  HTTP_EXPORT_COLUMN(int64_t,psum->rx_kb);
+  HTTP_EXPORT_COLUMN(int64_t,psum->n_event);
+  HTTP_EXPORT_COLUMN(int64_t,psum->nretrans);
+  HTTP_EXPORT_COLUMN(int64_t,psum->ndrop);
+  HTTP_EXPORT_COLUMN(int64_t,psum->rss_kb);
+  HTTP_EXPORT_COLUMN(int64_t,psum->read_bytes);
+  HTTP_EXPORT_COLUMN(int64_t,psum->write_bytes);
+  HTTP_EXPORT_COLUMN(int64_t,psum->ctx_switches);
+  HTTP_EXPORT_COLUMN(double,psum->avg_latency);
+  HTTP_EXPORT_COLUMN(double,psum->avg_lifetime);
+  HTTP_EXPORT_COLUMN(double,psum->fraction_ipv6);
+  HTTP_EXPORT_COLUMN(double,psum->avg_rtt);
+  HTTP_EXPORT_COLUMN(double,psum->p99_rtt);
+  HTTP_EXPORT_COLUMN(double,psum->avg_handshake);
+  HTTP_EXPORT_COLUMN(double,psum->avg_established);
+  HTTP_EXPORT_COLUMN(double,psum->cpu_seconds);
+  HTTP_EXPORT_COLUMN(double,psum->bytes_per_cpu_second);
+  /* the rank column of the removed processes, then the pid column */
+  for (j=0; j<2; ++j) {
+    removed = (int32_t*)http_buffer_extend(b,HTTP_PAD8(nremoved * sizeof(int32_t)));
+    if (!removed) {
+      break;
+    }
+    memset(removed,0,HTTP_PAD8(nremoved * sizeof(int32_t)));
+    for (e=since+1,n=0; !full && e<=srv->epoch; ++e) {
+      d = &srv->deltas[e % HTTP_DELTA_HISTORY];
+      for (k=0; k<d->nremoved; ++k) {
+	removed[n++] = d->removed[2*k+j];
+      }
+    }
+  }
+
+ cleanup:
+  free(rows);
+  free(names);
+  free(dict.slots);
+  free(dict.offsets);
+  free(dict.names.data);
+}
+
+static int64_t http_now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* the value of the parameter named by the second parameter in a query string,
+   or NULL */
+static const char *http_query_param(const char *query, const char *name)
+{
+  size_t len = strlen(name);
+  while (query) {
+    if (strncmp(query,name,len) == 0 && query[len] == '=') {
+      return query + len + 1;
+    }
+    query = strchr(query,'&');
+    query = query ? query + 1 : NULL;
+  }
+  return NULL;
+}
+
+/* copies the value of a query parameter, URL decoded, to the third parameter, of
+   the length in the fourth. Returns PETSC_FALSE if there is no such parameter. */
+static PetscBool http_query_copy(const char *query, const char *name, char *value, size_t len)
+{
+  const char *v = http_query_param(query,name);
+  size_t     n;
+  if (!v) {
+    return PETSC_FALSE;
+  }
+  n = strcspn(v,"&");
+  n = n < len - 1 ? n : len - 1;
+  memcpy(value,v,n);
+  value[n] = '\0';
+  http_url_decode(value);
+  return PETSC_TRUE;
+}
+
+/* parses an integer query parameter into the third parameter, if there is one.
+   Returns PETSC_FALSE if it is not an integer. */
+static PetscBool http_query_long(const char *query, const char *name, long *value)
+{
+  const char *v = http_query_param(query,name);
+  char       *end;
+  if (!v) {
+    return PETSC_TRUE;
+  }
+  *value = strtol(v,&end,10);
+  return (PetscBool)(end != v && (*end == '\0' || *end == '&'));
+}
+
+/* answers /api/export, from the full export of the epoch if it has been encoded
+   already */
+static void http_export(http_server *srv, http_buffer *body, const char *query)
+{
+  const char *since = http_query_param(query,"since");
+  uint64_t   epoch = since && isdigit((unsigned char)*since) ? strtoull(since,NULL,10) : UINT64_MAX;
+  PetscBool  full;
+  pthread_mutex_lock(&srv->lock);
+  full = (PetscBool)!http_server_covers(srv,epoch,PETSC_FALSE);
+  if (full && srv->export && srv->export_epoch == srv->epoch) {
+    http_buffer_append(body,srv->export,srv->export_len);
+  } else {
+    http_buffer_export(srv,body,epoch,full);
+    if (full && !body->failed) {
+      free(srv->export);
+      srv->export = (char*)malloc(body->len);
+      if (srv->export) {
+	memcpy(srv->export,body->data,body->len);
+	srv->export_len = body->len;
+	srv->export_epoch = srv->epoch;
+      }
+    }
+  }
+  pthread_mutex_unlock(&srv->lock);
+}
+
+/* the index of the first summary at or after (rank,pid) */
+static PetscInt http_lower_bound(http_server *srv, long rank, long pid)
+{
+  PetscInt lo=0,hi=srv->nsummaries,mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (srv->summaries[mid].rank < rank || (srv->summaries[mid].rank == rank && srv->summaries[mid].pid < pid)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* writes the JSON body of /api/select for the query string in the third parameter
+   (see petsc_mongoose.h) to the second parameter and returns the HTTP status */
+static int http_select(http_server *srv, http_buffer *body, const char *query)
+{
+  char                 name[256],sort[32],dir[8];
+  long                 rank=-1,pid_min=LONG_MIN,pid_max=LONG_MAX,offset=0,limit=LONG_MAX,top=-1,nmatch=0,nsent=0;
+  PetscBool            has_name,desc=PETSC_TRUE;
+  http_order           *order=NULL;
+  process_data_summary *psum;
+  PetscInt             i,lo,hi,idx;
+  int                  key=-1;
+  if (!http_query_long(query,"rank",&rank) || !http_query_long(query,"pid_min",&pid_min)
+      || !http_query_long(query,"pid_max",&pid_max) || !http_query_long(query,"offset",&offset)
+      || !http_query_long(query,"limit",&limit) || !http_query_long(query,"top",&top)
+      || offset < 0 || limit < 0 || (http_query_param(query,"top") && top < 0)) {
+    http_buffer_printf(body,"{\"error\": \"rank, pid_min, pid_max, offset, limit and top must be integers, and offset, limit and top not negative\"}");
+    return 400;
+  }
+  has_name = http_query_copy(query,"name",name,sizeof(name));
+  if (http_query_copy(query,"sort",sort,sizeof(sort))) {
+    for (key=0; HttpSortKeys[key] && strcmp(HttpSortKeys[key],sort); ++key);
+    if (!HttpSortKeys[key]) {
+      http_buffer_printf(body,"{\"error\": \"Unknown sort key ");
+      http_buffer_escape(body,sort);
+      http_buffer_printf(body,"; use tx_kb, rx_kb, n_event or avg_latency\"}");
+      return 400;
+    }
+  }
+  if (http_query_copy(query,"order",dir,sizeof(dir))) {
+    if (strcmp(dir,"asc") && strcmp(dir,"desc")) {
+      http_buffer_printf(body,"{\"error\": \"order must be asc or desc\"}");
+      return 400;
+    }
+    desc = (PetscBool)(strcmp(dir,"desc") == 0);
+  }
+  if (top >= 0) {
+    limit = top;
+    key = key < 0 ? HTTP_SORT_TX_KB : key;
+  }
+
+  pthread_mutex_lock(&srv->lock);
+  if (key >= 0) {
+    order = &srv->order[key];
+    lo = 0;
+    hi = srv->nsummaries;
+  } else if (rank >= 0) {
+    /* in (rank,pid) order, the PIDs of a rank are one range */
+    lo = http_lower_bound(srv,rank,pid_min);
+    hi = pid_max == LONG_MAX ? http_lower_bound(srv,rank + 1,LONG_MIN) : http_lower_bound(srv,rank,pid_max + 1);
+  } else {
+    lo = 0;
+    hi = srv->nsummaries;
+  }
+  http_buffer_printf(body,"{\"response\": [");
+  for (i=lo; i<hi && nsent<limit; ++i) {
+    if (!order) {
+      idx = i;
+    } else if (desc) {
+      idx = order->index[i];
+    } else {
+      /* smallest value first, but those with none still last */
+      idx = order->index[i < order->nvalued ? order->nvalued - 1 - i : i];
+    }
+    psum = &srv->summaries[idx];
+    if ((rank >= 0 && psum->rank != rank) || psum->pid < pid_min || psum->pid > pid_max
+	|| (has_name && strcmp(psum->comm,name))) {
+      continue;
+    }
+    if (nmatch++ < offset) {
+      continue;
+    }
+    http_buffer_printf(body,nsent++ ? ", " : "");
+    http_buffer_summary(body,psum);
+  }
+  http_buffer_printf(body,"]}");
+  pthread_mutex_unlock(&srv->lock);
+  return 200;
+}
+
+#define HTTP_METRICS_BUCKETS 13   /* 0.25 ms to 512 ms, doubling, and +Inf */
+
+/* a /metrics scrape in progress: the processes it labels, copied out of the
+   poll it started in, and the histograms of all of that poll's processes */
+struct http_metrics_s {
+  process_data_summary *rows;
+  PetscInt             nrows,nprocesses;
+  uint64_t             epoch;
+  PetscInt             nranks;
+  PetscInt             *ranks;
+  long                 *counts;  /* nranks x HTTP_METRICS_NHIST x HTTP_METRICS_BUCKETS, not cumulative */
+  double               *sums;    /* nranks x HTTP_METRICS_NHIST */
+  int                  family;   /* the next one to write, and its next row */
+  PetscInt             row;
+};
+
+typedef struct {
+  const char *name,*type,*help;
+  size_t     offset;
+  PetscBool  real;
+} http_metric;
+
+/* the families labelled per process, by field of process_data_summary */
+static const http_metric HttpMetrics[] = {
+  {"dcprof_tx_kilobytes_total","counter","Kilobytes sent over TCP",offsetof(process_data_summary,tx_kb),PETSC_FALSE},
+  {"dcprof_rx_kilobytes_total","counter","Kilobytes received over TCP",offsetof(process_data_summary,rx_kb),PETSC_FALSE},
+  {"dcprof_tcp_events_total","counter","TCP events seen",offsetof(process_data_summary,n_event),PETSC_FALSE},
+  {"dcprof_tcp_retransmits_total","counter","TCP segments retransmitted",offsetof(process_data_summary,nretrans),PETSC_FALSE},
+  {"dcprof_tcp_drops_total","counter","TCP packets dropped by the kernel",offsetof(process_data_summary,ndrop),PETSC_FALSE},
+  {"dcprof_cpu_seconds_total","counter","CPU time used",offsetof(process_data_summary,cpu_seconds),PETSC_TRUE},
+  {"dcprof_read_bytes_total","counter","Bytes read from storage",offsetof(process_data_summary,read_bytes),PETSC_FALSE},
+  {"dcprof_written_bytes_total","counter","Bytes written to storage",offsetof(process_data_summary,write_bytes),PETSC_FALSE},
+  {"dcprof_context_switches_total","counter","Context switches",offsetof(process_data_summary,ctx_switches),PETSC_FALSE},
+  {"dcprof_resident_kilobytes","gauge","Resident set size",offsetof(process_data_summary,rss_kb),PETSC_FALSE},
+  {"dcprof_connection_latency_milliseconds","gauge","Average latency of the connections opened",offsetof(process_data_summary,avg_latency),PETSC_TRUE},
+  {"dcprof_connection_lifetime_milliseconds","gauge","Average lifetime of the connections closed",offsetof(process_data_summary,avg_lifetime),PETSC_TRUE},
+  {"dcprof_ipv6_ratio","gauge","Fraction of the connections over IPv6",offsetof(process_data_summary,fraction_ipv6),PETSC_TRUE},
+  {"dcprof_rtt_milliseconds","gauge","Average round trip time",offsetof(process_data_summary,avg_rtt),PETSC_TRUE},
+  {"dcprof_rtt_p99_milliseconds","gauge","99th percentile of the round trip time",offsetof(process_data_summary,p99_rtt),PETSC_TRUE},
+  {"dcprof_handshake_milliseconds","gauge","Average time connections spent in the handshake",offsetof(process_data_summary,avg_handshake),PETSC_TRUE},
+  {"dcprof_established_milliseconds","gauge","Average time connections spent established",offsetof(process_data_summary,avg_established),PETSC_TRUE},
+};
+#define HTTP_METRICS_NFAMILY ((int)(sizeof(HttpMetrics)/sizeof(HttpMetrics[0])))
+
+/* and the histograms per rank, of the processes with a value */
+static const http_metric HttpMetricsHist[] = {
+  {"dcprof_process_connection_latency_milliseconds","histogram","Processes by the average latency of their connections",
+   offsetof(process_data_summary,avg_latency),PETSC_TRUE},
+  {"dcprof_process_rtt_milliseconds","histogram","Processes by their average round trip time",
+   offsetof(process_data_summary,avg_rtt),PETSC_TRUE},
+};
+#define HTTP_METRICS_NHIST ((int)(sizeof(HttpMetricsHist)/sizeof(HttpMetricsHist[0])))
+
+static double http_metric_value(const http_metric *m, process_data_summary *psum)
+{
+  const char *field = (const char*)psum + m->offset;
+  return m->real ? (double)*(const PetscReal*)field : (double)*(const long*)field;
+}
+
+static void http_metrics_destroy(http_metrics *m)
+{
+  if (m) {
+    free(m->rows);
+    free(m->ranks);
+    free(m->counts);
+    free(m->sums);
+    free(m);
+  }
+}
+
+/* copies what a scrape of the poll being served exports. Called under lock;
+   returns NULL if it cannot. */
+static http_metrics *http_metrics_create(http_server *srv)
+{
+  http_metrics         *m;
+  process_data_summary *psum;
+  const http_metric    *h;
+  PetscInt             i,r=-1;
+  double               x,le;
+  int                  k,b;
+  m = (http_metrics*)calloc(1,sizeof(http_metrics));
+  if (!m) {
+    return NULL;
+  }
+  m->nprocesses = srv->nsummaries;
+  m->nrows = srv->nsummaries < srv->max_series ? srv->nsummaries : srv->max_series;
+  m->epoch = srv->epoch - srv->epoch0;
+  for (i=0; i<srv->nsummaries; ++i) {
+    m->nranks += !i || srv->summaries[i].rank != srv->summaries[i-1].rank;
+  }
+  m->rows = (process_data_summary*)malloc((m->nrows ? m->nrows : 1) * sizeof(process_data_summary));
+  m->ranks = (PetscInt*)malloc((m->nranks ? m->nranks : 1) * sizeof(PetscInt));
+  m->counts = (long*)calloc(m->nranks ? m->nranks * HTTP_METRICS_NHIST * HTTP_METRICS_BUCKETS : 1,sizeof(long));
+  m->sums = (double*)calloc(m->nranks ? m->nranks * HTTP_METRICS_NHIST : 1,sizeof(double));
+  if (!m->rows || !m->ranks || !m->counts || !m->sums) {
+    http_metrics_destroy(m);
+    return NULL;
+  }
+  if (m->nrows == srv->nsummaries) {
+    if (m->nrows) {
+      memcpy(m->rows,srv->summaries,m->nrows * sizeof(process_data_summary));
+    }
+  } else {
+    /* the ones with the most tx_kb */
+    for (i=0; i<m->nrows; ++i) {
+      m->rows[i] = srv->summaries[srv->order[HTTP_SORT_TX_KB].index[i]];
+    }
+  }
+  for (i=0; i<srv->nsummaries; ++i) {
+    psum = &srv->summaries[i];
+    if (!i || psum->rank != srv->summaries[i-1].rank) {
+      m->ranks[++r] = psum->rank;
+    }
+    for (k=0; k<HTTP_METRICS_NHIST; ++k) {
+      h = &HttpMetricsHist[k];
+      x = http_metric_value(h,psum);
+      /* none: NaN, or 0 for an RTT with no samples */
+      if (!(x > 0.0) || !isfinite(x)) {
+	continue;
+      }
+      for (b=0,le=0.25; b<HTTP_METRICS_BUCKETS-1 && x > le; ++b,le*=2);
+      ++m->counts[(r * HTTP_METRICS_NHIST + k) * HTTP_METRICS_BUCKETS + b];
+      m->sums[r * HTTP_METRICS_NHIST + k] += x;
+    }
+  }
+  return m;
+}
+
+/* appends the integer in the second parameter in decimal */
+static void http_buffer_long(http_buffer *b, long x)
+{
+  char          digits[24];
+  unsigned long u = x < 0 ? -(unsigned long)x : (unsigned long)x;
+  int           n = sizeof(digits);
+  do {
+    digits[--n] = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  if (x < 0) {
+    digits[--n] = '-';
+  }
+  http_buffer_append(b,digits + n,sizeof(digits) - n);
+}
+
+#define HTTP_APPEND_LITERAL(b,s) http_buffer_append(b,s,sizeof(s) - 1)
+
+/* appends the sample of the family in the second parameter for the process,
+   with its comm escaped as the exposition format wants. Samples are most of a
+   scrape, so this appends rather than formats whatever it can. */
+static void http_buffer_sample(http_buffer *b, const http_metric *f, process_data_summary *psum)
+{
+  const char *c,*field = (const char*)psum + f->offset;
+  http_buffer_append(b,f->name,strlen(f->name));
+  HTTP_APPEND_LITERAL(b,"{rank=\"");
+  http_buffer_long(b,(long)psum->rank);
+  HTTP_APPEND_LITERAL(b,"\",pid=\"");
+  http_buffer_long(b,(long)psum->pid);
+  HTTP_APPEND_LITERAL(b,"\",comm=\"");
+  for (c=psum->comm; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      http_buffer_printf(b,"\\%c",*c);
+    } else if (*c == '\n') {
+      HTTP_APPEND_LITERAL(b,"\\n");
+    } else {
+      http_buffer_append(b,c,1);
+    }
+  }
+  HTTP_APPEND_LITERAL(b,"\"} ");
+  if (f->real) {
+    http_buffer_printf(b,"%.10g\n",(double)*(const PetscReal*)field);
+  } else {
+    http_buffer_long(b,*(const long*)field);
+    HTTP_APPEND_LITERAL(b,"\n");
+  }
+}
+
+/* writes the scrape on from where it was until the buffer holds at least the
+   number of bytes in the third parameter. Returns 1 once all of it is written. */
+static int http_metrics_write(http_metrics *m, http_buffer *b, size_t limit)
+{
+  const http_metric *f;
+  PetscInt          r;
+  double            x,le;
+  long              n;
+  int               k,j;
+  while (b->len < limit && !b->failed) {
+    if (m->family == 0) {
+      http_buffer_printf(b,"# HELP dcprof_processes Processes summarized in the last poll\n"
+			 "# TYPE dcprof_processes gauge\ndcprof_processes %ld\n",(long)m->nprocesses);
+      http_buffer_printf(b,"# HELP dcprof_processes_unlabelled Processes left out of the per-process series\n"
+			 "# TYPE dcprof_processes_unlabelled gauge\ndcprof_processes_unlabelled %ld\n",
+			 (long)(m->nprocesses - m->nrows));
+      http_buffer_printf(b,"# HELP dcprof_epoch Polls published\n# TYPE dcprof_epoch counter\ndcprof_epoch %llu\n",
+			 (unsigned long long)m->epoch);
+    } else if (m->family <= HTTP_METRICS_NFAMILY) {
+      f = &HttpMetrics[m->family - 1];
+      if (!m->row) {
+	http_buffer_printf(b,"# HELP %s %s\n# TYPE %s %s\n",f->name,f->help,f->name,f->type);
+      }
+      for (; m->row < m->nrows && b->len < limit; ++m->row) {
+	x = http_metric_value(f,&m->rows[m->row]);
+	if (isfinite(x)) {
+	  http_buffer_sample(b,f,&m->rows[m->row]);
+	}
+      }
+      if (m->row < m->nrows) {
+	break;
+      }
+    } else if (m->family <= HTTP_METRICS_NFAMILY + HTTP_METRICS_NHIST) {
+      k = m->family - HTTP_METRICS_NFAMILY - 1;
+      f = &HttpMetricsHist[k];
+      if (!m->row) {
+	http_buffer_printf(b,"# HELP %s %s\n# TYPE %s %s\n",f->name,f->help,f->name,f->type);
+      }
+      for (; m->row < m->nranks && b->len < limit; ++m->row) {
+	r = m->row;
+	for (n=0,j=0,le=0.25; j<HTTP_METRICS_BUCKETS; ++j,le*=2) {
+	  n += m->counts[(r * HTTP_METRICS_NHIST + k) * HTTP_METRICS_BUCKETS + j];
+	  if (j < HTTP_METRICS_BUCKETS - 1) {
+	    http_buffer_printf(b,"%s_bucket{rank=\"%ld\",le=\"%g\"} %ld\n",f->name,(long)m->ranks[r],le,n);
+	  } else {
+	    http_buffer_printf(b,"%s_bucket{rank=\"%ld\",le=\"+Inf\"} %ld\n",f->name,(long)m->ranks[r],n);
+	  }
+	}
+	http_buffer_printf(b,"%s_sum{rank=\"%ld\"} %.10g\n%s_count{rank=\"%ld\"} %ld\n",f->name,(long)m->ranks[r],
+			   m->sums[r * HTTP_METRICS_NHIST + k],f->name,(long)m->ranks[r],n);
+      }
+      if (m->row < m->nranks) {
+	break;
+      }
+    } else {
+      return 1;
+    }
+    ++m->family;
+    m->row = 0;
+  }
+  return 0;
+}
+
+/* writes the JSON body for the path in the third parameter to the second
+   parameter and returns the HTTP status */
+static int http_route(http_server *srv, http_buffer *body, char *path)
+{
+  const char           *prefix="/api/get/";
+  char                 *arg,*slash;
+  process_data_summary key,*found;
+  PetscInt             i,nfound=0;
+  int                  status=200;
+  if (strncmp(path,prefix,strlen(prefix))) {
+    http_url_decode(path);
+    http_buffer_printf(body,"{\"error\": \"No endpoint ");
+    http_buffer_escape(body,path);
+    http_buffer_printf(body,"\"}");
+    return 404;
+  }
+  arg = path + strlen(prefix);
+  slash = strchr(arg,'/');
+  pthread_mutex_lock(&srv->lock);
+  if (strcmp(arg,"all") == 0) {
+    http_buffer_printf(body,"{\"response\": [");
+    for (i=0; i<srv->nsummaries; ++i) {
+      http_buffer_printf(body,i ? ", " : "");
+      http_buffer_summary(body,&srv->summaries[i]);
+    }
+    http_buffer_printf(body,"]}");
+  } else if (slash && http_is_number(arg,slash - arg) && http_is_number(slash + 1,strlen(slash + 1))) {
+    found = NULL;
+    if (http_parse_key(arg,slash,&key)) {
+      found = (process_data_summary*)bsearch(&key,srv->summaries,srv->nsummaries,sizeof(process_data_summary),http_summary_cmp);
+    }
+    if (found) {
+      http_buffer_printf(body,"{\"response\": ");
+      http_buffer_summary(body,found);
+      http_buffer_printf(body,"}");
+    } else {
+      http_buffer_printf(body,"{\"error\": \"Key %.*s/%s not found in dictionary entries!\"}",(int)(slash - arg),arg,slash + 1);
+      status = 404;
+    }
+  } else if (!slash) {
+    http_url_decode(arg);
+    http_buffer_printf(body,"{\"response\": [");
+    for (i=0; i<srv->nsummaries; ++i) {
+      if (strcmp(srv->summaries[i].comm,arg) == 0) {
+	http_buffer_printf(body,nfound++ ? ", " : "");
+	http_buffer_summary(body,&srv->summaries[i]);
+      }
+    }
+    if (nfound) {
+      http_buffer_printf(body,"]}");
+    } else {
+      body->len = 0;
+      http_buffer_printf(body,"{\"error\": \"Key ");
+      http_buffer_escape(body,arg);
+      http_buffer_printf(body," not found in dictionary entries_by_name!\"}");
+      status = 404;
+    }
+  } else {
+    http_buffer_printf(body,"{\"error\": \"Malformed request path\"}");
+    status = 404;
+  }
+  pthread_mutex_unlock(&srv->lock);
+  return status;
+}
+
+/* whether the server has the summaries of the rank in the second parameter in
+   this poll; if not, asks the driver for them. Called under lock. */
+static PetscBool http_fanout_ready(http_server *srv, PetscInt r)
+{
+  if (srv->ranks[r].state == HTTP_RANK_NONE) {
+    srv->ranks[r].state = HTTP_RANK_WANTED;
+    srv->wanted[srv->nwanted++] = r;
+    pthread_cond_signal(&srv->wanted_cond);
+  }
+  return (PetscBool)(srv->ranks[r].state == HTTP_RANK_READY);
+}
+
+static int http_hash_cmp(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a,y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+/* whether the index has the name hashed in the third parameter on the rank */
+static PetscBool http_fanout_has(http_server *srv, PetscInt r, uint64_t h)
+{
+  return (PetscBool)!!bsearch(&h,srv->names + srv->name_offsets[r],srv->name_offsets[r+1] - srv->name_offsets[r],
+			      sizeof(uint64_t),http_hash_cmp);
+}
+
+/* http_route() for --fanout: writes the JSON body for the /api/get path in the
+   third parameter from the ranks it is about and returns the HTTP status, or 0
+   if the server is still waiting for some of them. Called under lock. */
+static int http_fanout_route(http_server *srv, http_buffer *body, char *path)
+{
+  char                 *arg = path + strlen("/api/get/"),*slash = strchr(arg,'/');
+  process_data_summary key,*found;
+  http_rank            *rk;
+  PetscInt             r,i,nwait=0,nfound=0;
+  uint64_t             h=0;
+  PetscBool            all = (PetscBool)(strcmp(arg,"all") == 0);
+  if (slash && http_is_number(arg,slash - arg) && http_is_number(slash + 1,strlen(slash + 1))) {
+    found = NULL;
+    /* only ranks the index has are asked for; any other is not found */
+    if (http_parse_key(arg,slash,&key) && key.rank >= 0 && key.rank < srv->nranks) {
+      if (!http_fanout_ready(srv,key.rank)) {
+	return 0;
+      }
+      rk = &srv->ranks[key.rank];
+      found = (process_data_summary*)bsearch(&key,rk->summaries,rk->nsummaries,sizeof(process_data_summary),http_summary_cmp);
+    }
+    if (!found) {
+      http_buffer_printf(body,"{\"error\": \"Key %.*s/%s not found in dictionary entries!\"}",(int)(slash - arg),arg,slash + 1);
+      return 404;
+    }
+    http_buffer_printf(body,"{\"response\": ");
+    http_buffer_summary(body,found);
+    http_buffer_printf(body,"}");
+    return 200;
+  } else if (slash) {
+    http_buffer_printf(body,"{\"error\": \"Malformed request path\"}");
+    return 404;
+  }
+  if (!all) {
+    http_url_decode(arg);
+    h = http_name_hash(arg);
+  }
+  /* ask for every rank involved before waiting for any */
+  for (r=0; r<srv->nranks; ++r) {
+    if ((all ? srv->name_offsets[r+1] > srv->name_offsets[r] : http_fanout_has(srv,r,h)) && !http_fanout_ready(srv,r)) {
+      ++nwait;
+    }
+  }
+  if (nwait) {
+    return 0;
+  }
+  http_buffer_printf(body,"{\"response\": [");
+  for (r=0; r<srv->nranks; ++r) {
+    rk = &srv->ranks[r];
+    if (rk->state != HTTP_RANK_READY) {
+      continue;
+    }
+    for (i=0; i<rk->nsummaries; ++i) {
+      if (all || strcmp(rk->summaries[i].comm,arg) == 0) {
+	http_buffer_printf(body,nfound++ ? ", " : "");
+	http_buffer_summary(body,&rk->summaries[i]);
+      }
+    }
+  }
+  http_buffer_printf(body,"]}");
+  if (!all && !nfound) {
+    body->len = 0;
+    http_buffer_printf(body,"{\"error\": \"Key ");
+    http_buffer_escape(body,arg);
+    http_buffer_printf(body," not found in dictionary entries_by_name!\"}");
+    return 404;
+  }
+  return 200;
+}
+
+static const char *http_reason(int status)
+{
+  switch (status) {
+  case 200: return "OK";
+  case 400: return "Bad Request";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 431: return "Request Header Fields Too Large";
+  case 504: return "Gateway Timeout";
+  default:  return "Internal Server Error";
+  }
+}
+
+/* queues the bytes in the second parameter after what the connection has not
+   sent yet. Returns -1 if it cannot. */
+static int http_connection_queue(http_connection *c, const char *data, size_t len)
+{
+  char   *response;
+  size_t capacity;
+  if (!len) {
+    return 0;
+  }
+  if (c->nsent) {
+    memmove(c->response,c->response + c->nsent,c->response_len - c->nsent);
+    c->response_len -= c->nsent;
+    c->nsent = 0;
+  }
+  if (c->response_len + len > c->response_capacity) {
+    capacity = c->response_capacity ? c->response_capacity : 4096;
+    while (capacity < c->response_len + len) {
+      capacity *= 2;
+    }
+    response = (char*)realloc(c->response,capacity);
+    if (!response) {
+      return -1;
+    }
+    c->response = response;
+    c->response_capacity = capacity;
+  }
+  memcpy(c->response + c->response_len,data,len);
+  c->response_len += len;
+  return 0;
+}
+
+/* writes the headers that say how far ingestion is, once the driver has said
+   so, to the second parameter. Called under lock. */
+static void http_progress_headers(http_server *srv, char *headers, size_t len)
+{
+  headers[0] = '\0';
+  if (srv->nprogress) {
+    snprintf(headers,len,"X-Ingest-Progress: %lld/%lld\r\nX-Ingest-Backfilling: %lld\r\n",
+	     (long long)srv->ingest.consumed,(long long)srv->ingest.total,(long long)srv->ingest.backfilling);
+  }
+}
+
+/* writes the JSON body of /api/progress to the second parameter */
+static void http_progress_body(http_server *srv, http_buffer *body)
+{
+  PetscInt r;
+  pthread_mutex_lock(&srv->lock);
+  http_buffer_printf(body,"{\"response\": {\"consumed\": %lld, \"total\": %lld, \"backfilling\": %lld, \"ranks\": [",
+		     (long long)srv->ingest.consumed,(long long)srv->ingest.total,(long long)srv->ingest.backfilling);
+  for (r=0; r<srv->nprogress; ++r) {
+    http_buffer_printf(body,"%s{\"rank\": %ld, \"consumed\": %lld, \"total\": %lld, \"backfilling\": %s}",r ? ", " : "",
+		       (long)r,(long long)srv->progress[r].consumed,(long long)srv->progress[r].total,
+		       srv->progress[r].backfilling ? "true" : "false");
+  }
+  http_buffer_printf(body,"]}}");
+  pthread_mutex_unlock(&srv->lock);
+}
+
+/* queues a response with the body in the fourth parameter, which it frees, and
+   the header lines in the last, if any. Returns -1 if the connection is to be
+   closed. */
+static int http_connection_reply(http_connection *c, int status, const char *content_type, http_buffer *body, PetscBool head,
+				 const char *headers)
+{
+  http_buffer resp;
+  int         err;
+  memset(&resp,0,sizeof(resp));
+  http_buffer_printf(&resp,"HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: %s\r\n%s%s\r\n",
+		     status,http_reason(status),content_type,(unsigned long)body->len,c->keep_alive ? "keep-alive" : "close",
+		     status == 405 ? "Allow: GET, HEAD\r\n" : "",headers ? headers : "");
+  if (!head && body->len) {
+    http_buffer_append(&resp,body->data,body->len);
+  }
+  free(body->data);
+  if (body->failed || resp.failed) {
+    free(resp.data);
+    return -1;
+  }
+  if (!c->response_len) {
+    /* nothing queued: hand the buffer over rather than copy it */
+    free(c->response);
+    c->response = resp.data;
+    c->response_len = resp.len;
+    c->response_capacity = resp.capacity;
+    c->nsent = 0;
+    return 0;
+  }
+  err = http_connection_queue(c,resp.data,resp.len);
+  free(resp.data);
+  return err;
+}
+
+/* answers a parked long poll with the events since the epoch it asked for, which
+   may be none. Called under lock; returns -1 if the connection is to be closed. */
+static int http_connection_answer(http_server *srv, http_connection *c, PetscBool head)
+{
+  http_buffer body;
+  char        headers[HTTP_PROGRESS_HEADERS_LEN];
+  memset(&body,0,sizeof(body));
+  http_progress_headers(srv,headers,sizeof(headers));
+  http_buffer_printf(&body,"{\"response\": [");
+  http_buffer_events(srv,&body,&c->since,PETSC_FALSE);
+  http_buffer_printf(&body,"]}");
+  c->mode = HTTP_CONN_REQUEST;
+  return http_connection_reply(c,200,"application/json",&body,head,headers);
+}
+
+/* turns the connection into a watcher of the epochs after the one in the query
+   (or the Last-Event-ID header): an SSE stream, or a long poll that is answered
+   by the loop. Returns -1 if the connection is to be closed. */
+static int http_connection_watch(http_server *srv, http_connection *c, PetscBool stream, const char *query,
+				 const char *last_event_id, PetscBool head)
+{
+  const char *since,*timeout;
+  long       ms=HTTP_LONGPOLL_MS;
+  int        err=0;
+  char       headers[256],progress[HTTP_PROGRESS_HEADERS_LEN];
+  since = http_query_param(query,"since");
+  if (!since) {
+    since = last_event_id;
+  }
+  /* with no epoch, or one the server has not reached, a watcher starts from a
+     full snapshot */
+  c->since = since && isdigit((unsigned char)*since) ? strtoull(since,NULL,10) : UINT64_MAX;
+  if (stream) {
+    c->mode = HTTP_CONN_STREAM;
+    c->keep_alive = PETSC_FALSE;
+    c->deadline_ms = http_now_ms() + HTTP_KEEPALIVE_MS;
+    pthread_mutex_lock(&srv->lock);
+    http_progress_headers(srv,progress,sizeof(progress));
+    pthread_mutex_unlock(&srv->lock);
+    snprintf(headers,sizeof(headers),"HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+	     "Connection: close\r\n%s\r\n",progress);
+    err = http_connection_queue(c,headers,strlen(headers));
+    if (head) {
+      c->mode = HTTP_CONN_REQUEST;
+    }
+    return err;
+  }
+  timeout = http_query_param(query,"timeout");
+  if (timeout && isdigit((unsigned char)*timeout)) {
+    ms = 1000 * strtol(timeout,NULL,10);
+    ms = ms < 0 || ms > HTTP_LONGPOLL_MAX_MS ? HTTP_LONGPOLL_MAX_MS : ms;
+  }
+  pthread_mutex_lock(&srv->lock);
+  if (head || !ms || (srv->epoch != srv->epoch0 && c->since != srv->epoch)) {
+    err = http_connection_answer(srv,c,head);
+  } else {
+    c->mode = HTTP_CONN_LONGPOLL;
+    c->deadline_ms = http_now_ms() + ms;
+  }
+  pthread_mutex_unlock(&srv->lock);
+  return err;
+}
+
+/* starts a /metrics scrape of the poll being served on the connection. Returns
+   -1 if the connection is to be closed. */
+static int http_connection_scrape(http_server *srv, http_connection *c, PetscBool head)
+{
+  char headers[256],progress[HTTP_PROGRESS_HEADERS_LEN];
+  pthread_mutex_lock(&srv->lock);
+  http_progress_headers(srv,progress,sizeof(progress));
+  if (!head) {
+    c->metrics = http_metrics_create(srv);
+  }
+  pthread_mutex_unlock(&srv->lock);
+  if (!head) {
+    if (!c->metrics) {
+      return -1;
+    }
+    c->mode = HTTP_CONN_METRICS;
+  }
+  snprintf(headers,sizeof(headers),"HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+	   "Transfer-Encoding: chunked\r\nConnection: %s\r\n%s\r\n",c->keep_alive ? "keep-alive" : "close",progress);
+  return http_connection_queue(c,headers,strlen(headers));
+}
+
+/* writes the next chunk of the connection's scrape in place of the last one,
+   which has been sent, and the last (empty) chunk once the scrape is done.
+   Returns -1 if the connection is to be closed. */
+static int http_connection_metrics(http_connection *c)
+{
+  http_buffer b;
+  char        size[11];
+  int         done;
+  b.data = c->response;
+  b.len = 0;
+  b.capacity = c->response_capacity;
+  b.failed = 0;
+  /* room for the size, which leading zeros make fixed width */
+  http_buffer_extend(&b,10);
+  done = http_metrics_write(c->metrics,&b,HTTP_METRICS_CHUNK);
+  if (b.len > 10) {
+    /* a chunk is about HTTP_METRICS_CHUNK bytes, so its size has at most 8 digits */
+    snprintf(size,sizeof(size),"%08x\r\n",(unsigned int)(b.len - 10));
+    memcpy(b.data,size,10);
+    http_buffer_append(&b,"\r\n",2);
+  } else {
+    b.len = 0;
+  }
+  if (done) {
+    http_buffer_append(&b,"0\r\n\r\n",5);
+    http_metrics_destroy(c->metrics);
+    c->metrics = NULL;
+    c->mode = HTTP_CONN_REQUEST;
+  }
+  c->response = b.data;
+  c->response_capacity = b.capacity;
+  c->response_len = b.failed ? 0 : b.len;
+  c->nsent = 0;
+  return b.failed ? -1 : 0;
+}
+
+/* answers the /api/get request the connection waits with once the server has
+   the ranks it is about, or with 504 once it has waited HTTP_FANOUT_MS. Called
+   under lock; returns -1 if the connection is to be closed. */
+static int http_connection_fanout(http_server *srv, http_connection *c, int64_t now)
+{
+  char        path[HTTP_MAX_REQUEST_LEN],headers[HTTP_PROGRESS_HEADERS_LEN];
+  http_buffer body;
+  int         status;
+  memset(&body,0,sizeof(body));
+  /* routing decodes the path in place */
+  strcpy(path,c->path);
+  status = http_fanout_route(srv,&body,path);
+  if (!status) {
+    if (now < c->deadline_ms) {
+      free(body.data);
+      return 0;
+    }
+    body.len = 0;
+    http_buffer_printf(&body,"{\"error\": \"Timed out waiting for the ranks\"}");
+    status = 504;
+  }
+  c->mode = HTTP_CONN_REQUEST;
+  free(c->path);
+  c->path = NULL;
+  http_progress_headers(srv,headers,sizeof(headers));
+  return http_connection_reply(c,status,"application/json",&body,c->head,headers);
+}
+
+/* whether /api/get is answered from the ranks */
+static PetscBool http_server_fanout(http_server *srv)
+{
+  PetscBool fanout;
+  pthread_mutex_lock(&srv->lock);
+  fanout = srv->fanout;
+  pthread_mutex_unlock(&srv->lock);
+  return fanout;
+}
+
+/* if a whole request has been read, builds its response. Returns -1 if the
+   connection is to be closed. */
+static int http_connection_respond(http_server *srv, http_connection *c)
+{
+  char        *end,*method,*path,*version,*header,*next,*query,*last_event_id=NULL;
+  char        headers[HTTP_PROGRESS_HEADERS_LEN];
+  const char  *content_type="application/json";
+  size_t      request_len;
+  int         status,err;
+  PetscBool   head;
+  http_buffer body;
+  request_len = c->nread;
+  c->request[c->nread] = '\0';
+  end = strstr(c->request,"\r\n\r\n");
+  if (!end) {
+    if (c->nread == HTTP_MAX_REQUEST_LEN - 1) {
+      c->keep_alive = PETSC_FALSE;
+      status = 431;
+      goto error;
+    }
+    return 0;
+  }
+  *end = '\0';
+  request_len = end + 4 - c->request;
+  ++srv->nrequests;
+
+  /* request line */
+  method = c->request;
+  path = strchr(method,' ');
+  version = path ? strchr(path + 1,' ') : NULL;
+  next = strstr(method,"\r\n");
+  if (!path || !version || (next && version > next)) {
+    c->keep_alive = PETSC_FALSE;
+    status = 400;
+    goto error;
+  }
+  *path++ = '\0';
+  *version++ = '\0';
+  if (next) {
+    *next = '\0';
+  }
+  c->keep_alive = (PetscBool)(strcmp(version,"HTTP/1.1") == 0);
+  for (header=next ? next + 2 : NULL; header; header=next) {
+    next = strstr(header,"\r\n");
+    if (next) {
+      *next = '\0';
+      next += 2;
+    }
+    if (strncasecmp(header,"Connection:",11) == 0) {
+      for (header+=11; *header == ' '; ++header);
+      if (strcasecmp(header,"close") == 0) {
+	c->keep_alive = PETSC_FALSE;
+      } else if (strcasecmp(header,"keep-alive") == 0) {
+	c->keep_alive = PETSC_TRUE;
+      }
+    } else if (strncasecmp(header,"Last-Event-ID:",14) == 0) {
+      for (last_event_id=header+14; *last_event_id == ' '; ++last_event_id);
+    }
+  }
+  head = (PetscBool)(strcmp(method,"HEAD") == 0);
+  if (strcmp(method,"GET") && !head) {
+    status = 405;
+    goto error;
+  }
+  query = strchr(path,'?');
+  if (query) {
+    *query++ = '\0';
+  }
+
+  if (strcmp(path,"/api/stream") == 0 || strcmp(path,"/api/deltas") == 0) {
+    err = http_connection_watch(srv,c,(PetscBool)(strcmp(path,"/api/stream") == 0),query,last_event_id,head);
+  } else if (strcmp(path,"/metrics") == 0) {
+    err = http_connection_scrape(srv,c,head);
+  } else if (strncmp(path,"/api/get/",9) == 0 && http_server_fanout(srv)) {
+    c->path = strdup(path);
+    if (!c->path) {
+      err = -1;
+    } else {
+      c->head = head;
+      c->mode = HTTP_CONN_FANOUT;
+      c->deadline_ms = http_now_ms() + HTTP_FANOUT_MS;
+      pthread_mutex_lock(&srv->lock);
+      err = http_connection_fanout(srv,c,http_now_ms());
+      pthread_mutex_unlock(&srv->lock);
+    }
+  } else {
+    memset(&body,0,sizeof(body));
+    status = 200;
+    if (strcmp(path,"/api/export") == 0) {
+      http_export(srv,&body,query);
+      content_type = "application/octet-stream";
+    } else if (strcmp(path,"/api/progress") == 0) {
+      http_progress_body(srv,&body);
+    } else {
+      status = strcmp(path,"/api/select") == 0 ? http_select(srv,&body,query) : http_route(srv,&body,path);
+    }
+    pthread_mutex_lock(&srv->lock);
+    http_progress_headers(srv,headers,sizeof(headers));
+    pthread_mutex_unlock(&srv->lock);
+    err = http_connection_reply(c,status,content_type,&body,head,headers);
+  }
+  goto consume;
+
+ error:
+  memset(&body,0,sizeof(body));
+  http_buffer_printf(&body,"{\"error\": \"%s\"}",http_reason(status));
+  err = http_connection_reply(c,status,"application/json",&body,PETSC_FALSE,NULL);
+
+ consume:
+  /* keep anything pipelined after this request for the next one */
+  memmove(c->request,c->request + request_len,c->nread - request_len);
+  c->nread -= request_len;
+  return err;
+}
+
+/* reads or writes what the connection is ready for. Returns -1 if it is to be
+   closed. */
+static int http_connection_service(http_server *srv, http_connection *c, short revents)
+{
+  ssize_t n;
+  if (revents & (POLLERR | POLLNVAL)) {
+    return -1;
+  }
+  if (c->mode == HTTP_CONN_METRICS && c->nsent == c->response_len && (revents & POLLOUT)
+      && http_connection_metrics(c) < 0) {
+    return -1;
+  }
+  if (c->nsent < c->response_len) {
+    if (!(revents & (POLLOUT | POLLHUP))) {
+      return 0;
+    }
+    n = send(c->fd,c->response + c->nsent,c->response_len - c->nsent,MSG_NOSIGNAL);
+    if (n < 0) {
+      return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+    c->nsent += n;
+    if (c->nsent < c->response_len) {
+      return 0;
+    }
+    c->nsent = c->response_len = 0;
+    c->snapshot_len = 0;
+    if (c->mode == HTTP_CONN_STREAM || c->mode == HTTP_CONN_METRICS) {
+      /* keep the buffer for the next epoch, or chunk */
+      return 0;
+    }
+    free(c->response);
+    c->response = NULL;
+    c->response_capacity = 0;
+    if (!c->keep_alive) {
+      return -1;
+    }
+    return http_connection_respond(srv,c);
+  }
+  if (!(revents & (POLLIN | POLLHUP))) {
+    return 0;
+  }
+  if (c->mode == HTTP_CONN_STREAM) {
+    /* a stream has nothing more to ask: only look for the client closing it */
+    n = recv(c->fd,c->request,HTTP_MAX_REQUEST_LEN - 1,0);
+  } else {
+    n = recv(c->fd,c->request + c->nread,HTTP_MAX_REQUEST_LEN - 1 - c->nread,0);
+  }
+  if (n == 0) {
+    return -1;
+  } else if (n < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+  }
+  if (c->mode == HTTP_CONN_STREAM) {
+    return 0;
+  }
+  c->nread += n;
+  if (c->mode != HTTP_CONN_REQUEST) {
+    /* pipelined behind a poll, scrape or fan-out; answered once it is */
+    return 0;
+  }
+  return http_connection_respond(srv,c);
+}
+
+static void http_connection_close(http_server *srv, PetscInt i)
+{
+  close(srv->conns[i].fd);
+  free(srv->conns[i].response);
+  http_metrics_destroy(srv->conns[i].metrics);
+  free(srv->conns[i].path);
+  srv->conns[i] = srv->conns[--srv->nconns];
+}
+
+/* sends the watchers the epochs they do not have yet, answers the long polls
+   that have some or have timed out, and keeps idle streams alive. Returns the
+   time until the next deadline, in ms, or -1 if there is none. */
+static int http_server_watchers(http_server *srv)
+{
+  http_connection *c;
+  http_buffer     events;
+  PetscInt        i;
+  int64_t         now=http_now_ms(),next=-1,left;
+  int             err;
+  PetscBool       full;
+  pthread_mutex_lock(&srv->lock);
+  for (i=srv->nconns-1; i>=0; --i) {
+    c = &srv->conns[i];
+    err = 0;
+    if (c->mode == HTTP_CONN_STREAM && c->since != srv->epoch) {
+      memset(&events,0,sizeof(events));
+      full = (PetscBool)(srv->epoch != srv->epoch0 && !http_server_covers(srv,c->since,PETSC_TRUE));
+      if (http_buffer_events(srv,&events,&c->since,PETSC_TRUE)) {
+	c->deadline_ms = now + HTTP_KEEPALIVE_MS;
+      }
+      err = events.failed || (events.len && http_connection_queue(c,events.data,events.len));
+      /* a snapshot is as big as the table, however fast the watcher reads */
+      if (full && !err) {
+	c->snapshot_len = events.len;
+      }
+      free(events.data);
+    }
+    if (c->mode == HTTP_CONN_STREAM && now >= c->deadline_ms) {
+      err = err || http_connection_queue(c,": keepalive\n\n",13);
+      c->deadline_ms = now + HTTP_KEEPALIVE_MS;
+    }
+    if (c->mode == HTTP_CONN_LONGPOLL && ((srv->epoch != srv->epoch0 && c->since != srv->epoch) || now >= c->deadline_ms)) {
+      err = http_connection_answer(srv,c,PETSC_FALSE);
+    }
+    if (c->mode == HTTP_CONN_FANOUT) {
+      err = http_connection_fanout(srv,c,now);
+    }
+    /* a watcher that has fallen this far behind is not reading */
+    if (err || (c->mode == HTTP_CONN_STREAM && c->response_len - c->nsent > HTTP_MAX_BACKLOG + c->snapshot_len)) {
+      http_connection_close(srv,i);
+      continue;
+    }
+    if (c->mode == HTTP_CONN_STREAM || c->mode == HTTP_CONN_LONGPOLL || c->mode == HTTP_CONN_FANOUT) {
+      left = c->deadline_ms - now;
+      next = next < 0 || left < next ? left : next;
+    }
+  }
+  pthread_mutex_unlock(&srv->lock);
+  return (int)next;
+}
+
+static void *http_server_loop(void *arg)
+{
+  http_server     *srv = (http_server*)arg;
+  struct pollfd   fds[HTTP_MAX_CONNECTIONS + 2];
+  http_connection *c;
+  PetscInt        i,nconns;
+  int             fd,one=1,timeout=-1;
+  char            wake[64];
+  ssize_t         n;
+  while (1) {
+    fds[0].fd = srv->wake_fd[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = srv->listen_fd;
+    fds[1].events = srv->nconns < HTTP_MAX_CONNECTIONS ? POLLIN : 0;
+    for (i=0; i<srv->nconns; ++i) {
+      c = &srv->conns[i];
+      fds[i+2].fd = c->fd;
+      if (c->nsent < c->response_len || c->mode == HTTP_CONN_METRICS) {
+	fds[i+2].events = POLLOUT;
+      } else {
+	fds[i+2].events = (c->mode == HTTP_CONN_LONGPOLL || c->mode == HTTP_CONN_FANOUT) && c->nread == HTTP_MAX_REQUEST_LEN - 1
+	  ? 0 : POLLIN;
+      }
+      fds[i+2].revents = 0;
+    }
+    nconns = srv->nconns;
+    if (poll(fds,nconns + 2,timeout) < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      perror("http_server poll()");
+      break;
+    }
+    if (fds[0].revents) {
+      /* 'p' after a publish, 'q' to stop */
+      n = read(srv->wake_fd[0],wake,sizeof(wake));
+      if (n <= 0 || memchr(wake,'q',n)) {
+	break;
+      }
+    }
+    /* backwards, so that closing a connection only moves one already serviced */
+    for (i=nconns-1; i>=0; --i) {
+      if (fds[i+2].revents && http_connection_service(srv,&srv->conns[i],fds[i+2].revents) < 0) {
+	http_connection_close(srv,i);
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      while (srv->nconns < HTTP_MAX_CONNECTIONS) {
+	fd = accept(srv->listen_fd,NULL,NULL);
+	if (fd < 0) {
+	  break;
+	}
+	fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) | O_NONBLOCK);
+	setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+	c = &srv->conns[srv->nconns++];
+	c->fd = fd;
+	c->nread = 0;
+	c->response = NULL;
+	c->response_len = c->response_capacity = c->nsent = 0;
+	c->keep_alive = PETSC_FALSE;
+	c->mode = HTTP_CONN_REQUEST;
+	c->since = 0;
+	c->snapshot_len = 0;
+	c->deadline_ms = 0;
+	c->metrics = NULL;
+	c->path = NULL;
+      }
+    }
+    timeout = http_server_watchers(srv);
+  }
+  while (srv->nconns) {
+    http_connection_close(srv,srv->nconns - 1);
+  }
+  return NULL;
+}
+
+/* makes the server thread look at what has changed; never waits for it */
+static PetscErrorCode http_server_wake(http_server *srv)
+{
+  char c='p';
+  PetscFunctionBeginUser;
+  if (write(srv->wake_fd[1],&c,1) != 1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not wake the HTTP server thread: %s",strerror(errno));
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode http_server_start(http_server *srv, const char *host, PetscInt port, PetscInt max_series)
+{
+  PetscErrorCode  ierr;
+  struct addrinfo hints,*addrs,*a;
+  char            service[8];
+  int             one=1,err;
+  struct timespec ts;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(srv,sizeof(http_server));CHKERRQ(ierr);
+  if (port < 1 || port > 65535) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"HTTP port must be between 1 and 65535, not %D",port);
+  }
+  srv->port = port;
+  srv->max_series = max_series < 0 ? 0 : max_series;
+  /* an instance that published more than once a ms could reach the epochs of
+     the next one; the driver polls far less often than that */
+  clock_gettime(CLOCK_REALTIME,&ts);
+  srv->epoch = srv->epoch0 = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+  /* without a host, every IPv4 interface as before; a host may resolve to
+     several addresses, of which the first one that can be bound is used */
+  ierr = PetscMemzero(&hints,sizeof(hints));CHKERRQ(ierr);
+  hints.ai_family = host ? AF_UNSPEC : AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  snprintf(service,sizeof(service),"%d",(int)port);
+  if ((err = getaddrinfo(host,service,&hints,&addrs))) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Could not resolve the HTTP host %s: %s",host,gai_strerror(err));
+  }
+  srv->listen_fd = -1;
+  for (a=addrs; a; a=a->ai_next) {
+    srv->listen_fd = socket(a->ai_family,a->ai_socktype,a->ai_protocol);
+    if (srv->listen_fd < 0) {
+      continue;
+    }
+    setsockopt(srv->listen_fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+    if (!bind(srv->listen_fd,a->ai_addr,a->ai_addrlen) && !listen(srv->listen_fd,128)) {
+      break;
+    }
+    err = errno;
+    close(srv->listen_fd);
+    srv->listen_fd = -1;
+    errno = err;
+  }
+  freeaddrinfo(addrs);
+  if (srv->listen_fd < 0) {
+    SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not listen on %s port %D: %s",host ? host : "all interfaces",port,strerror(errno));
+  }
+  fcntl(srv->listen_fd,F_SETFL,fcntl(srv->listen_fd,F_GETFL) | O_NONBLOCK);
+  if (pipe(srv->wake_fd)) {
+    close(srv->listen_fd);
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not create the HTTP server's pipe: %s",strerror(errno));
+  }
+  /* a publish never waits for the server thread; if the pipe is full, it has a
+     wakeup coming anyway */
+  fcntl(srv->wake_fd[1],F_SETFL,fcntl(srv->wake_fd[1],F_GETFL) | O_NONBLOCK);
+  srv->conns = (http_connection*)malloc(HTTP_MAX_CONNECTIONS * sizeof(http_connection));
+  if (!srv->conns) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_MEM,"Could not allocate the HTTP connections");
+  }
+  pthread_mutex_init(&srv->lock,NULL);
+  pthread_cond_init(&srv->wanted_cond,NULL);
+  if ((errno = pthread_create(&srv->thread,NULL,http_server_loop,srv))) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not start the HTTP server thread: %s",strerror(errno));
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode http_server_stop(http_server *srv)
+{
+  PetscErrorCode ierr;
+  char           c='q';
+  int            i;
+  PetscFunctionBeginUser;
+  fcntl(srv->wake_fd[1],F_SETFL,fcntl(srv->wake_fd[1],F_GETFL) & ~O_NONBLOCK);
+  if (write(srv->wake_fd[1],&c,1) != 1) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not wake the HTTP server thread: %s",strerror(errno));
+  }
+  pthread_join(srv->thread,NULL);
+  pthread_mutex_destroy(&srv->lock);
+  pthread_cond_destroy(&srv->wanted_cond);
+  close(srv->wake_fd[0]);
+  close(srv->wake_fd[1]);
+  close(srv->listen_fd);
+  free(srv->conns);
+  free(srv->export);
+  for (i=0; i<HTTP_DELTA_HISTORY; ++i) {
+    free(srv->deltas[i].json);
+    free(srv->deltas[i].removed);
+  }
+  for (i=0; i<HTTP_NSORT; ++i) {
+    ierr = PetscFree(srv->order[i].index);CHKERRQ(ierr);
+    ierr = PetscFree(srv->pending_order[i].index);CHKERRQ(ierr);
+  }
+  ierr = PetscFree(srv->changed);CHKERRQ(ierr);
+  ierr = PetscFree(srv->pending_changed);CHKERRQ(ierr);
+  ierr = PetscFree(srv->summaries);CHKERRQ(ierr);
+  ierr = PetscFree(srv->pending);CHKERRQ(ierr);
+  for (i=0; i<srv->nranks; ++i) {
+    free(srv->ranks[i].summaries);
+  }
+  free(srv->ranks);
+  free(srv->names);
+  free(srv->name_offsets);
+  free(srv->wanted);
+  free(srv->progress);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode http_server_add(http_server *srv, process_data_summary *psumm)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (srv->npending == srv->pending_capacity) {
+    srv->pending_capacity = srv->pending_capacity ? 2 * srv->pending_capacity : 64;
+    ierr = PetscRealloc(srv->pending_capacity * sizeof(process_data_summary),&srv->pending);CHKERRQ(ierr);
+  }
+  srv->pending[srv->npending++] = *psumm;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode http_server_publish(http_server *srv)
+{
+  PetscErrorCode       ierr;
+  process_data_summary *summaries;
+  PetscInt             capacity,order_capacity,*remap,nfresh,nremoved=0,i;
+  http_sort_entry      *fresh;
+  http_order           order;
+  http_buffer          delta;
+  http_delta           *slot;
+  char                 *old;
+  int32_t              *removed,*old_removed;
+  uint64_t             *changed;
+  int                  k;
+  PetscFunctionBeginUser;
+  qsort(srv->pending,srv->npending,sizeof(process_data_summary),http_summary_cmp);
+  if (srv->pending_order_capacity < srv->npending) {
+    srv->pending_order_capacity = srv->pending_capacity;
+    for (k=0; k<HTTP_NSORT; ++k) {
+      ierr = PetscRealloc(srv->pending_order_capacity * sizeof(PetscInt),&srv->pending_order[k].index);CHKERRQ(ierr);
+    }
+    ierr = PetscRealloc(srv->pending_order_capacity * sizeof(uint64_t),&srv->pending_changed);CHKERRQ(ierr);
+  }
+  /* the driver is the only thread that changes the summaries, so it can read
+     them without the lock, and match them with the new ones once for the delta
+     every watcher gets and for every order */
+  ierr = PetscMalloc2(srv->nsummaries,&remap,srv->npending,&fresh);CHKERRQ(ierr);
+  nfresh = http_server_match(srv,remap,fresh);
+  memset(&delta,0,sizeof(delta));
+  http_buffer_delta(&delta,srv,remap,fresh,nfresh);
+  if (delta.failed) {
+    /* the watchers that would need it get a full snapshot instead */
+    free(delta.data);
+    delta.data = NULL;
+  }
+  for (k=0; k<HTTP_NSORT; ++k) {
+    http_server_order(srv,(HttpSortKey)k,remap,fresh,nfresh);
+  }
+  /* what an export since an earlier epoch needs: when each summary last
+     changed, and the processes that are gone */
+  for (i=0; i<srv->nsummaries; ++i) {
+    if (remap[i] >= 0) {
+      srv->pending_changed[remap[i]] = srv->changed[i];
+    } else {
+      nremoved += remap[i] == HTTP_REMOVED;
+    }
+  }
+  for (i=0; i<nfresh; ++i) {
+    srv->pending_changed[fresh[i].index] = srv->epoch + 1;
+  }
+  removed = (int32_t*)malloc((2 * nremoved + 1) * sizeof(int32_t));
+  for (i=0,nremoved=0; removed && i<srv->nsummaries; ++i) {
+    if (remap[i] == HTTP_REMOVED) {
+      removed[2*nremoved] = (int32_t)srv->summaries[i].rank;
+      removed[2*nremoved+1] = (int32_t)srv->summaries[i].pid;
+      ++nremoved;
+    }
+  }
+  ierr = PetscFree2(remap,fresh);CHKERRQ(ierr);
+  /* swap rather than copy, so both sets of arrays are reused from poll to poll */
+  pthread_mutex_lock(&srv->lock);
+  summaries = srv->summaries;
+  capacity = srv->capacity;
+  srv->summaries = srv->pending;
+  srv->capacity = srv->pending_capacity;
+  srv->nsummaries = srv->npending;
+  for (k=0; k<HTTP_NSORT; ++k) {
+    order = srv->order[k];
+    srv->order[k] = srv->pending_order[k];
+    srv->pending_order[k] = order;
+  }
+  changed = srv->changed;
+  srv->changed = srv->pending_changed;
+  srv->pending_changed = changed;
+  order_capacity = srv->order_capacity;
+  srv->order_capacity = srv->pending_order_capacity;
+  srv->pending_order_capacity = order_capacity;
+  slot = &srv->deltas[++srv->epoch % HTTP_DELTA_HISTORY];
+  old = slot->json;
+  old_removed = slot->removed;
+  slot->epoch = srv->epoch;
+  slot->json = delta.data;
+  slot->len = delta.len;
+  slot->removed = removed;
+  /* without its removals, an epoch cannot be part of an export since an earlier one */
+  slot->nremoved = removed ? nremoved : 0;
+  if (!removed) {
+    slot->epoch = 0;
+  }
+  pthread_mutex_unlock(&srv->lock);
+  free(old);
+  free(old_removed);
+  srv->pending = summaries;
+  srv->pending_capacity = capacity;
+  srv->npending = 0;
+  ierr = http_server_wake(srv);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode http_server_progress(http_server *srv, PetscInt nranks, const http_progress *progress)
+{
+  http_progress *copy,*old,ingest;
+  PetscInt      r;
+  PetscFunctionBeginUser;
+  copy = (http_progress*)malloc((nranks ? nranks : 1) * sizeof(http_progress));
+  if (!copy) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_MEM,"Could not allocate the HTTP server's ingestion progress");
+  }
+  if (nranks) {
+    memcpy(copy,progress,nranks * sizeof(http_progress));
+  }
+  memset(&ingest,0,sizeof(ingest));
+  for (r=0; r<nranks; ++r) {
+    ingest.consumed += progress[r].consumed;
+    ingest.total += progress[r].total;
+    ingest.backfilling += !!progress[r].backfilling;
+  }
+  pthread_mutex_lock(&srv->lock);
+  old = srv->progress;
+  srv->progress = copy;
+  srv->nprogress = nranks;
+  srv->ingest = ingest;
+  pthread_mutex_unlock(&srv->lock);
+  free(old);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode http_server_fanout_publish(http_server *srv, PetscInt nranks, const PetscMPIInt *nnames, const uint64_t *names)
+{
+  PetscErrorCode ierr;
+  http_rank      *ranks,*old;
+  PetscInt       *offsets,*wanted,*old_offsets,*old_wanted,r,nold;
+  uint64_t       *copy,*old_names;
+  PetscFunctionBeginUser;
+  ranks = (http_rank*)calloc(nranks ? nranks : 1,sizeof(http_rank));
+  offsets = (PetscInt*)malloc((nranks + 1) * sizeof(PetscInt));
+  wanted = (PetscInt*)malloc((nranks ? nranks : 1) * sizeof(PetscInt));
+  if (!ranks || !offsets || !wanted) {
+    free(ranks);
+    free(offsets);
+    free(wanted);
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_MEM,"Could not allocate the HTTP server's ranks");
+  }
+  offsets[0] = 0;
+  for (r=0; r<nranks; ++r) {
+    offsets[r+1] = offsets[r] + nnames[r];
+  }
+  copy = (uint64_t*)malloc((offsets[nranks] ? offsets[nranks] : 1) * sizeof(uint64_t));
+  if (!copy) {
+    free(ranks);
+    free(offsets);
+    free(wanted);
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_MEM,"Could not allocate the HTTP server's index");
+  }
+  if (offsets[nranks]) {
+    memcpy(copy,names,offsets[nranks] * sizeof(uint64_t));
+  }
+  pthread_mutex_lock(&srv->lock);
+  old = srv->ranks;
+  nold = srv->nranks;
+  old_offsets = srv->name_offsets;
+  old_wanted = srv->wanted;
+  old_names = srv->names;
+  srv->ranks = ranks;
+  srv->nranks = nranks;
+  srv->names = copy;
+  srv->name_offsets = offsets;
+  srv->wanted = wanted;
+  srv->nwanted = 0;
+  srv->fanout = PETSC_TRUE;
+  pthread_mutex_unlock(&srv->lock);
+  for (r=0; r<nold; ++r) {
+    free(old[r].summaries);
+  }
+  free(old);
+  free(old_offsets);
+  free(old_wanted);
+  free(old_names);
+  /* requests waiting for ranks ask for them again */
+  ierr = http_server_wake(srv);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode http_server_fanout_wait(http_server *srv, PetscReal seconds, PetscInt *rank)
+{
+  struct timespec deadline;
+  PetscFunctionBeginUser;
+  clock_gettime(CLOCK_REALTIME,&deadline);
+  deadline.tv_sec += (time_t)seconds;
+  deadline.tv_nsec += (long)(1.0e9 * (seconds - (time_t)seconds));
+  if (deadline.tv_nsec >= 1000000000L) {
+    ++deadline.tv_sec;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  *rank = -1;
+  pthread_mutex_lock(&srv->lock);
+  while (!srv->nwanted && pthread_cond_timedwait(&srv->wanted_cond,&srv->lock,&deadline) != ETIMEDOUT);
+  if (srv->nwanted) {
+    *rank = srv->wanted[0];
+    memmove(srv->wanted,srv->wanted + 1,--srv->nwanted * sizeof(PetscInt));
+  }
+  pthread_mutex_unlock(&srv->lock);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode http_server_fanout_deliver(http_server *srv, PetscInt rank, process_data_summary *summaries, PetscInt n)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  pthread_mutex_lock(&srv->lock);
+  if (rank >= 0 && rank < srv->nranks && srv->ranks[rank].state == HTTP_RANK_WANTED) {
+    srv->ranks[rank].summaries = summaries;
+    srv->ranks[rank].nsummaries = n;
+    srv->ranks[rank].state = HTTP_RANK_READY;
+    summaries = NULL;
+  }
+  pthread_mutex_unlock(&srv->lock);
+  free(summaries);
+  ierr = http_server_wake(srv);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
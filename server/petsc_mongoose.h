@@ -0,0 +1,271 @@
+#ifndef DCPROF_PETSC_MONGOOSE_H
+#define DCPROF_PETSC_MONGOOSE_H
+#include "petsc_webserver.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/* an HTTP server embedded in the driver, as an alternative to spawning the Flask
+   backend. It runs in its own thread on rank 0, a poll() loop over nonblocking
+   sockets, and answers
+     GET /api/get/all
+     GET /api/get/{rank}/{pid}
+     GET /api/get/{name}
+   with the same {"response": ...} or {"error": ...} bodies as the backend, from
+   the summaries gathered in the last poll rather than from the output file. The
+   summaries themselves are JSON objects with the fields of summary_view().
+
+   Watchers can follow the summaries as they change instead of polling all of
+   them. Each publish is an epoch, and http_server_publish() diffs it against the
+   previous one once, into
+     {"epoch": E, "full": false, "changed": [summaries], "removed": [[rank,pid],...]}
+   which is kept for the last HTTP_DELTA_HISTORY epochs and handed to every
+   watcher as is. A watcher that is further behind (or new) gets the same object
+   with "full": true and every summary in "changed", and drops what it had.
+   Epochs start at the wall-clock time the server started, in ms, rather than at
+   0, so an E from before a restart is behind every epoch of the new server and
+   gets a full snapshot rather than a delta it never had the base of.
+     GET /api/stream[?since=E]
+       Server-Sent Events: one event (delta or snapshot) per epoch after E, with
+       the epoch as its id, so EventSource resumes with Last-Event-ID by itself
+     GET /api/deltas?since=E[&timeout=s]
+       long poll: {"response": [events]} as soon as there are epochs after E, or
+       an empty list after timeout seconds (default 30)
+
+   and can select from them instead of fetching all of them:
+     GET /api/select?[name=N][&rank=R][&pid_min=P][&pid_max=P][&sort=K][&order=asc|desc]
+                     [&offset=O][&limit=L][&top=T]
+   returns the summaries that match every filter given, sorted by K (tx_kb,
+   rx_kb, n_event or avg_latency; largest first unless order=asc, and those with
+   no avg_latency last) or else by (rank,pid), from the O'th match on, at most L
+   of them. top=T is sort=K (tx_kb by default), limit=T. For each key, publishing
+   keeps an order of the summaries: the ones that have not changed since the last
+   epoch keep their relative order, so only the changed ones are sorted and then
+   merged in, and a request for the top T walks the first T entries of it.
+
+   Scrapers that want all of them, or what changed since their last scrape, can
+   have them as columns instead of JSON:
+     GET /api/export[?since=E]
+   answers with application/octet-stream: an http_export_header, the names (comm
+   and job_id) each row refers to as NUL-terminated strings, one array per field
+   of the rows (see http_export_header), and the (rank,pid) of the processes
+   removed since E. All of it is little-endian, and each part is padded to a
+   multiple of 8 bytes. Without E, or if E is further back than the server keeps
+   removals for, the rows are all the summaries and full is 1; a scraper applies
+   removed and then replaces the rows it has. The full export of an epoch is only
+   encoded once. snapshot_reader.read_export() decodes it.
+
+   Prometheus can scrape them too:
+     GET /metrics
+   answers in the text exposition format (version 0.0.4): a counter or gauge per
+   field, for each process, labelled with its rank, pid and comm (gauges with no
+   value are left out), and per rank histograms of how many processes have what
+   average connection latency and RTT. Each process PID churn brings along is a
+   new series for Prometheus to keep, so only the max_series processes with the
+   most tx_kb are labelled (dcprof_processes_unlabelled counts the others); the
+   histograms count all of them. A scrape copies what it exports out under lock
+   once, and then writes it, a chunk (Transfer-Encoding: chunked) at a time, into
+   the connection's buffer whenever the socket has taken the last one, so that it
+   never holds more than HTTP_METRICS_CHUNK bytes of text nor allocates per line.
+
+   With --fanout, root no longer gathers the summaries every poll, and
+     GET /api/get/all, /api/get/{rank}/{pid} and /api/get/{name}
+   are answered from the ranks' own (see rank_store.h) instead: the server asks
+   the driver for the ranks a request is about (one rank, those whose index has
+   the name, or all of them), parks the request until the driver has fetched
+   them, and keeps what it fetched until the next poll, for every request about
+   the same ranks. A request still waiting after HTTP_FANOUT_MS is answered with
+   504. The other endpoints serve the summaries of the last poll that was
+   gathered.
+
+   The driver starts the server before it reads any input, and works through the
+   backlog its input files have at startup a chunk at a time (see
+   --backfill_chunk), publishing a poll after each, so that the summaries are
+   there early and refined poll by poll. Every response says how far ingestion is
+   once the driver has said so, in
+     X-Ingest-Progress: consumed/total
+     X-Ingest-Backfilling: k
+   the bytes of input all the ranks have read out of the bytes there are, and how
+   many of the ranks still have backlog; and, per rank,
+     GET /api/progress
+   answers with {"response": {"consumed": C, "total": T, "backfilling": k,
+   "ranks": [{"rank": r, "consumed": c, "total": t, "backfilling": b}, ...]}}.
+
+   The driver copies each gathered summary in with http_server_add() and makes the
+   poll's set visible with http_server_publish(), which swaps it with the one
+   being served under a mutex. The server thread holds the same mutex only while
+   it formats a response, so requests never see a half-published poll and the
+   driver never waits for a slow client. Connections are kept alive for HTTP/1.1
+   clients (unless they ask otherwise), so a client that polls pays for the TCP
+   handshake once.
+
+   The server thread never calls PETSc, which is not thread-safe; all PETSc
+   allocation happens in the driver's thread. */
+
+#define HTTP_MAX_CONNECTIONS 1024
+#define HTTP_MAX_REQUEST_LEN 8192
+#define HTTP_DELTA_HISTORY   64
+#define HTTP_MAX_BACKLOG     (8<<20)  /* bytes queued for a watcher, past a snapshot, before it is dropped */
+#define HTTP_KEEPALIVE_MS    15000    /* between SSE comments on an idle stream */
+#define HTTP_LONGPOLL_MS     30000    /* default and longest timeout of a long poll */
+#define HTTP_LONGPOLL_MAX_MS 300000
+#define HTTP_FANOUT_MS       30000    /* before a request waiting for ranks gives up */
+#define HTTP_METRICS_CHUNK   (64<<10) /* of /metrics text written at a time */
+#define HTTP_METRICS_MAX_SERIES 5000  /* default number of processes /metrics labels */
+#define HTTP_PROGRESS_HEADERS_LEN 128
+
+typedef enum {HTTP_CONN_REQUEST,HTTP_CONN_STREAM,HTTP_CONN_LONGPOLL,HTTP_CONN_METRICS,HTTP_CONN_FANOUT} HttpConnMode;
+
+typedef struct http_metrics_s http_metrics;
+
+typedef struct {
+  int          fd;
+  char         request[HTTP_MAX_REQUEST_LEN];
+  size_t       nread;
+  char         *response;     /* malloc()ed; bytes nsent to response_len are queued */
+  size_t       response_len,response_capacity,nsent;
+  PetscBool    keep_alive;
+  HttpConnMode mode;
+  uint64_t     since;         /* the last epoch a watcher has */
+  size_t       snapshot_len;  /* of the full snapshot queued last, which HTTP_MAX_BACKLOG leaves out */
+  int64_t      deadline_ms;   /* of a long poll, or of a stream's next keepalive */
+  http_metrics *metrics;      /* malloc()ed; what is left of a /metrics scrape */
+  char         *path;         /* malloc()ed; of a request waiting for ranks */
+  PetscBool    head;
+} http_connection;
+
+typedef enum {HTTP_RANK_NONE,HTTP_RANK_WANTED,HTTP_RANK_READY} HttpRankState;
+
+/* what the server has of a rank's summaries in this poll, with --fanout */
+typedef struct {
+  HttpRankState        state;
+  process_data_summary *summaries;  /* malloc()ed and sorted by pid, once ready */
+  PetscInt             nsummaries;
+} http_rank;
+
+/* how far a rank has read its input files */
+typedef struct {
+  int64_t consumed,total;     /* bytes read, and the bytes the files have */
+  int64_t backfilling;        /* 1 while it has more backlog than it reads in a poll */
+} http_progress;
+
+/* the keys /api/select sorts by */
+typedef enum {HTTP_SORT_TX_KB,HTTP_SORT_RX_KB,HTTP_SORT_N_EVENT,HTTP_SORT_AVG_LATENCY,HTTP_NSORT} HttpSortKey;
+
+typedef struct {
+  PetscInt *index;            /* of the summaries, largest value first, those with none (NaN) last */
+  PetscInt nvalued;           /* how many have a value */
+} http_order;
+
+typedef struct {
+  uint64_t epoch;
+  char     *json;             /* malloc()ed; NULL if it could not be built */
+  size_t   len;
+  int32_t  *removed;          /* malloc()ed (rank,pid) pairs of the processes gone in the epoch */
+  PetscInt nremoved;
+} http_delta;
+
+#define HTTP_EXPORT_MAGIC   "DCPCOLS"
+#define HTTP_EXPORT_VERSION 1
+
+/* followed by the names, and then nrows each of
+     int32   rank, pid, app_rank
+     uint32  name, job_id (indices of names)
+     int64   tx_kb, rx_kb, n_event, nretrans, ndrop, rss_kb, read_bytes, write_bytes,
+             ctx_switches
+     float64 avg_latency, avg_lifetime, fraction_ipv6, avg_rtt, p99_rtt, avg_handshake,
+             avg_established, cpu_seconds, bytes_per_cpu_second
+   and nremoved each of int32 rank and pid */
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t full;              /* 1 if the rows are all the summaries, not the changes since */
+  uint64_t epoch,since;
+  uint32_t nrows,nremoved;
+  uint32_t nnames;
+  uint32_t names_len;         /* in bytes, before padding */
+} http_export_header;
+
+typedef struct {
+  pthread_t            thread;
+  pthread_mutex_t      lock;
+  int                  listen_fd,wake_fd[2];
+  PetscInt             port;
+  PetscInt             max_series; /* of /metrics */
+  /* the poll being served, sorted by (rank,pid), and the deltas that led up to
+     it; only changed under lock */
+  process_data_summary *summaries;
+  PetscInt             nsummaries,capacity;
+  uint64_t             epoch,epoch0; /* epoch0 is the one the server started at */
+  http_delta           deltas[HTTP_DELTA_HISTORY]; /* by epoch modulo HTTP_DELTA_HISTORY */
+  http_order           order[HTTP_NSORT];
+  uint64_t             *changed;   /* the epoch each summary last changed in */
+  PetscInt             order_capacity; /* of the index of each order, and of changed */
+  /* the poll being copied in by the driver */
+  process_data_summary *pending;
+  PetscInt             npending,pending_capacity;
+  http_order           pending_order[HTTP_NSORT];
+  uint64_t             *pending_changed;
+  PetscInt             pending_order_capacity;
+  /* with --fanout, the ranks /api/get is answered from, the index of the names
+     each has, and the ones the server is waiting for; only changed under lock */
+  PetscBool            fanout;
+  http_rank            *ranks;
+  PetscInt             nranks;
+  uint64_t             *names;        /* rank r's, sorted, are name_offsets[r] to name_offsets[r+1] */
+  PetscInt             *name_offsets;
+  PetscInt             *wanted;       /* a queue of nwanted ranks, which the driver fetches */
+  PetscInt             nwanted;
+  pthread_cond_t       wanted_cond;
+  /* how far each rank has read its input, and all of them (with the number of
+     ranks backfilling); only changed under lock */
+  http_progress        *progress;
+  PetscInt             nprogress;
+  http_progress        ingest;
+  /* only touched by the server thread */
+  http_connection      *conns;
+  PetscInt             nconns;
+  long long            nrequests;
+  char                 *export;    /* the full export of export_epoch */
+  size_t               export_len;
+  uint64_t             export_epoch;
+} http_server;
+
+/* listens on the TCP port in the third parameter on the address the host name in
+   the second resolves to, or on all interfaces if it is NULL, and starts the
+   server thread; /metrics labels at most the number of processes in the fourth */
+extern PetscErrorCode http_server_start(http_server *, const char *, PetscInt, PetscInt);
+
+/* stops the server thread, closes its connections and frees the summaries */
+extern PetscErrorCode http_server_stop(http_server *);
+
+/* copies the summary in the second parameter into the set the next
+   http_server_publish() makes visible */
+extern PetscErrorCode http_server_add(http_server *, process_data_summary *);
+
+/* replaces the summaries being served with the ones added since the last call,
+   as the next epoch, and sends what changed to the watchers */
+extern PetscErrorCode http_server_publish(http_server *);
+
+/* takes how far the ranks have read their input: the number of ranks in the
+   second parameter, and each one's progress in the third */
+extern PetscErrorCode http_server_progress(http_server *, PetscInt, const http_progress *);
+
+/* hashes a name for the index of http_server_fanout_publish() */
+extern uint64_t http_name_hash(const char *);
+
+/* starts a poll of --fanout: forgets the ranks fetched in the last one and takes
+   an index of their names: the number of ranks in the second parameter, how many
+   hashes each has in the third, and all of them, sorted within each rank, in the
+   fourth */
+extern PetscErrorCode http_server_fanout_publish(http_server *, PetscInt, const PetscMPIInt *, const uint64_t *);
+
+/* waits at most the number of seconds in the second parameter for the server to
+   want the summaries of a rank, and returns it in the third, or -1 */
+extern PetscErrorCode http_server_fanout_wait(http_server *, PetscReal, PetscInt *);
+
+/* hands the server the summaries of the rank in the second parameter: the array
+   in the third (malloc()ed and sorted by pid; the server frees it), of the
+   length in the fourth */
+extern PetscErrorCode http_server_fanout_deliver(http_server *, PetscInt, process_data_summary *, PetscInt);
+
+#endif
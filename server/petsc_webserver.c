@@ -1,37 +1,14 @@
+#define  _POSIX_C_SOURCE 200809L
 #include "petsc_webserver.h"
+#include "event_store.h"
+#include "node_stats.h"
+#include "process_tree.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <petscsys.h>
 #include <limits.h>
 
-
-PetscErrorCode create_tcpaccept_entry_bag(tcpaccept_entry **entryptr, PetscBag *bagptr, PetscInt n)
-{
-  PetscErrorCode ierr;
-  tcpaccept_entry *entry;
-  PetscBag        bag;
-  char            obj_name[100];
-  PetscFunctionBeginUser;
-  ierr = PetscBagCreate(PETSC_COMM_WORLD,sizeof(tcpaccept_entry),&bag);CHKERRQ(ierr);
-  ierr = PetscBagGetData(bag,(void**)&entry);CHKERRQ(ierr);
-  sprintf(obj_name,"tcpaccept_entry_%d",n);
-  ierr = PetscBagSetName(bag,obj_name,"An entry generated by the tcpaccept program");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->pid,-1,"pid","Process ID that accepted the connection");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->ip,4,"ip","IP address version");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->rport,0,"rport","Remote port");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->lport,0,"lport","Local port");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->laddr,IP_ADDR_MAX_LEN,"0.0.0.0","laddr","Local IP address");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->raddr,IP_ADDR_MAX_LEN,"0.0.0.0","raddr","Remote IP address");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->comm,COMM_MAX_LEN,"[unknown]","comm","Process name");CHKERRQ(ierr);
-  
-  *entryptr = entry;
-  *bagptr = bag;
-  PetscFunctionReturn(0);
-}
-
-
-
 PetscErrorCode buffer_create(entry_buffer *buf, size_t num_items)
 {
   PetscFunctionBeginUser;
@@ -73,13 +50,11 @@ PetscBool buffer_empty(entry_buffer *buf)
   return (buf->num_items == 0);
 }
 
-
 size_t buffer_capacity(entry_buffer *buf)
 {
   return buf->capacity;
 }
 
-
 size_t buffer_size(entry_buffer *buf)
 {
   if (!buf) {
@@ -91,7 +66,6 @@ size_t buffer_size(entry_buffer *buf)
   return buf->num_items;
 }
 
-
 PetscInt buffer_try_insert(entry_buffer *buf, PetscBag dataptr)
 {
   if (!buf) {
@@ -142,7 +116,6 @@ long get_file_end_offset(file_wrapper *file)
   return offset;
 }
 
-
 long has_new_data(file_wrapper *file)
 {
   long old_offset, new_offset;
@@ -205,335 +178,379 @@ PetscErrorCode parse_ipv6(const char *str, char *ip)
   PetscFunctionReturn(0);
 }
 
-
+/* is the token made of digits only? Header lines fail this where data lines have a PID */
+static PetscBool is_integer(const char *str)
+{
+  if (!str || !*str) {
+    return PETSC_FALSE;
+  }
+  for (; *str; ++str) {
+    if (*str < '0' || *str > '9') {
+      return PETSC_FALSE;
+    }
+  }
+  return PETSC_TRUE;
+}
 
 #define CHECK_TOKEN(str,tok,i) do {		\
-  if (!tok) { \
+  if (!(tok)) { \
     PetscFPrintf(PETSC_COMM_WORLD,stderr,"Failed to find expected token number %D in string %s\n",i,str); \
-  return i; \
+  return (i); \
   }\
   } while(0)
 
-
-
-PetscErrorCode tcpaccept_entry_parse_line(tcpaccept_entry *entry, char *str)
-{
-  PetscErrorCode ierr;
-  char *substr;
-  const char sep[2] = " ";
-  size_t len;
-  PetscFunctionBeginUser;
-  substr = strtok(str,sep);
-  CHECK_TOKEN(str,substr,0);
-  entry->pid = atoi(substr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,1);
-  ierr = PetscStrlen(substr,&len);CHKERRQ(ierr);
-  ierr = PetscStrncpy(entry->comm,substr,len+1);CHKERRQ(ierr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,2);
-  entry->ip = atoi(substr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,3);
-  if (entry->ip == 4) {
-    ierr = parse_ipv4(substr,entry->raddr);CHKERRQ(ierr);
-  } else {
-    ierr = parse_ipv6(substr,entry->raddr);CHKERRQ(ierr);
+/* everything below up to register_mpi_types() that is specific to one entry type is
+   generated from its field list in entry_schema.h */
+
+#define ENTRY_REGISTER_INT(name,len,def,help)  ierr = PetscBagRegisterInt(bag,&entry->name,def,#name,help);CHKERRQ(ierr);
+#define ENTRY_REGISTER_IP(name,len,def,help)   ierr = PetscBagRegisterInt(bag,&entry->name,def,#name,help);CHKERRQ(ierr);
+#define ENTRY_REGISTER_REAL(name,len,def,help) ierr = PetscBagRegisterReal(bag,&entry->name,def,#name,help);CHKERRQ(ierr);
+#define ENTRY_REGISTER_STR(name,len,def,help)  ierr = PetscBagRegisterString(bag,&entry->name,len,def,#name,help);CHKERRQ(ierr);
+#define ENTRY_REGISTER_ADDR(name,len,def,help) ierr = PetscBagRegisterString(bag,&entry->name,len,def,#name,help);CHKERRQ(ierr);
+#define ENTRY_FIELD_REGISTER(T,name,kind,len,col,def,help) ENTRY_REGISTER_##kind(name,len,def,help)
+
+#define DEFINE_CREATE_ENTRY_BAG(T,FIELDS,description)			\
+  PetscErrorCode create_##T##_bag(T **entryptr, PetscBag *bagptr, PetscInt n) \
+  {									\
+    PetscErrorCode ierr;						\
+    T              *entry;						\
+    PetscBag       bag;							\
+    char           obj_name[100];					\
+    PetscFunctionBeginUser;						\
+    ierr = PetscBagCreate(PETSC_COMM_WORLD,sizeof(T),&bag);CHKERRQ(ierr); \
+    ierr = PetscBagGetData(bag,(void**)&entry);CHKERRQ(ierr);		\
+    sprintf(obj_name,#T "_%d",(int)n);					\
+    ierr = PetscBagSetName(bag,obj_name,description);CHKERRQ(ierr);	\
+    FIELDS(ENTRY_FIELD_REGISTER,T)					\
+    *entryptr = entry;							\
+    *bagptr = bag;							\
+    PetscFunctionReturn(0);						\
   }
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,4);
-  entry->rport = atoi(substr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,5);
-  if (entry->ip == 4) {
-    ierr = parse_ipv4(substr,entry->laddr);CHKERRQ(ierr);
-  } else {
-    ierr = parse_ipv6(substr,entry->laddr);CHKERRQ(ierr);
-  }
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,6);
-  entry->lport = atoi(substr);
-  PetscFunctionReturn(0);
-}
-  
-PetscErrorCode tcpconnect_entry_parse_line(tcpconnect_entry *entry, char *str)
-{
-  PetscErrorCode ierr;
-  char *substr;
-  const char sep[2] = " ";
-  size_t len;
-  PetscFunctionBeginUser;
-  substr = strtok(str,sep);
-  CHECK_TOKEN(str,substr,0);
-  entry->pid = atoi(substr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,1);
-  ierr = PetscStrlen(substr,&len);CHKERRQ(ierr);
-  ierr = PetscStrncpy(entry->comm,substr,len+1);CHKERRQ(ierr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,2);
-  entry->ip = atoi(substr);
-  while (entry->ip == 0) {
-    /* in case comm has a space */
-    substr = strtok(NULL,sep);
-    CHECK_TOKEN(str,substr,2);
-    entry->ip = atoi(substr);
+
+#define ENTRY_MPI_TYPE_INT  MPIU_INT
+#define ENTRY_MPI_TYPE_IP   MPIU_INT
+#define ENTRY_MPI_TYPE_REAL MPIU_REAL
+#define ENTRY_MPI_TYPE_STR  MPI_CHAR
+#define ENTRY_MPI_TYPE_ADDR MPI_CHAR
+#define ENTRY_FIELD_DISPLACEMENT(T,name,kind,len,col,def,help) offsetof(T,name),
+#define ENTRY_FIELD_MPI_TYPE(T,name,kind,len,col,def,help)     ENTRY_MPI_TYPE_##kind,
+#define ENTRY_FIELD_BLOCK_LEN(T,name,kind,len,col,def,help)    len,
+
+/* one block per field */
+#define DEFINE_ENTRY_MPI_TYPE(T,FIELDS)					\
+  static void T##_create_mpi_type(MPI_Datatype *dtype)			\
+  {									\
+    MPI_Aint     displacements[] = {FIELDS(ENTRY_FIELD_DISPLACEMENT,T)}; \
+    MPI_Datatype dtypes[] = {FIELDS(ENTRY_FIELD_MPI_TYPE,T)};		\
+    int          block_lens[] = {FIELDS(ENTRY_FIELD_BLOCK_LEN,T)};	\
+    MPI_Type_create_struct(sizeof(block_lens)/sizeof(block_lens[0]),block_lens, \
+			   displacements,dtypes,dtype);			\
   }
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,3);
-  if (entry->ip == 4) {
-    ierr = parse_ipv4(substr,entry->saddr);CHKERRQ(ierr);
-  } else {
-    ierr = parse_ipv6(substr,entry->saddr);CHKERRQ(ierr);
+
+#define ENTRY_PARSE_INT(name,len)  entry->name = atoi(substr);
+/* a token that is not a number is the rest of a process name with spaces, which
+   is on the column before */
+#define ENTRY_PARSE_IP(name,len)					\
+  if (!is_integer(substr)) {						\
+    ierr = PetscStrlcat(entry->comm," ",COMM_MAX_LEN);CHKERRQ(ierr);	\
+    ierr = PetscStrlcat(entry->comm,substr,COMM_MAX_LEN);CHKERRQ(ierr); \
+    continue;								\
+  }									\
+  entry->name = atoi(substr);
+#define ENTRY_PARSE_REAL(name,len) entry->name = atof(substr);
+#define ENTRY_PARSE_STR(name,len)  ierr = PetscStrncpy(entry->name,substr,len);CHKERRQ(ierr);
+#define ENTRY_PARSE_ADDR(name,len)					\
+  if (entry->ip == 4) {							\
+    ierr = parse_ipv4(substr,entry->name);CHKERRQ(ierr);		\
+  } else {								\
+    ierr = parse_ipv6(substr,entry->name);CHKERRQ(ierr);		\
   }
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,4);
-  if (entry->ip == 4) {
-    ierr = parse_ipv4(substr,entry->daddr);CHKERRQ(ierr);
-  } else {
-    ierr = parse_ipv6(substr,entry->daddr);CHKERRQ(ierr);
+#define ENTRY_FIELD_PARSE(T,name,kind,len,col,def,help) case col: ENTRY_PARSE_##kind(name,len) break;
+#define ENTRY_FIELD_COUNT(T,name,kind,len,col,def,help) +1
+
+/* a parser for lines made of one token per field, in column order, separated by
+   any of the characters in separators. Headers and blank lines, whose first token
+   is not a PID, return non-zero quietly; lines with too few tokens return non-zero
+   with a message */
+#define DEFINE_ENTRY_PARSE_LINE(T,FIELDS,separators)			\
+  PetscErrorCode T##_parse_line(T *entry, char *str)			\
+  {									\
+    PetscErrorCode ierr;						\
+    char           *substr;						\
+    const char     sep[] = separators;					\
+    PetscInt       col = 0,ncols = 0 FIELDS(ENTRY_FIELD_COUNT,T);	\
+    PetscFunctionBeginUser;						\
+    substr = strtok(str,sep);						\
+    if (!is_integer(substr)) {						\
+      PetscFunctionReturn(1);						\
+    }									\
+    for (; substr && col<ncols; substr=strtok(NULL,sep)) {		\
+      switch (col) {							\
+	FIELDS(ENTRY_FIELD_PARSE,T)					\
+      }									\
+      ++col;								\
+    }									\
+    CHECK_TOKEN(str,col == ncols ? str : NULL,col+1);			\
+    PetscFunctionReturn(0);						\
   }
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,5);
-  entry->dport = atoi(substr);
-  PetscFunctionReturn(0);
-}
 
+DEFINE_CREATE_ENTRY_BAG(tcpaccept_entry,TCPACCEPT_ENTRY_FIELDS,"An entry generated by the tcpaccept program")
+DEFINE_CREATE_ENTRY_BAG(tcpconnect_entry,TCPCONNECT_ENTRY_FIELDS,"An entry generated by the tcpconnect program")
+DEFINE_CREATE_ENTRY_BAG(tcpconnlat_entry,TCPCONNLAT_ENTRY_FIELDS,"An entry generated by the tcpconnlat program")
+DEFINE_CREATE_ENTRY_BAG(tcplife_entry,TCPLIFE_ENTRY_FIELDS,"An entry generated by the tcplife program")
+DEFINE_CREATE_ENTRY_BAG(tcpretrans_entry,TCPRETRANS_ENTRY_FIELDS,"An entry generated by the tcpretrans program")
+DEFINE_CREATE_ENTRY_BAG(tcpstates_entry,TCPSTATES_ENTRY_FIELDS,"An entry generated by the tcpstates program")
+DEFINE_CREATE_ENTRY_BAG(tcprtt_entry,TCPRTT_ENTRY_FIELDS,"A histogram row generated by the tcprtt program")
+DEFINE_CREATE_ENTRY_BAG(tcpdrop_entry,TCPDROP_ENTRY_FIELDS,"An entry generated by the tcpdrop program")
+
+DEFINE_ENTRY_MPI_TYPE(tcpaccept_entry,TCPACCEPT_ENTRY_FIELDS)
+DEFINE_ENTRY_MPI_TYPE(tcpconnect_entry,TCPCONNECT_ENTRY_FIELDS)
+DEFINE_ENTRY_MPI_TYPE(tcpconnlat_entry,TCPCONNLAT_ENTRY_FIELDS)
+DEFINE_ENTRY_MPI_TYPE(tcplife_entry,TCPLIFE_ENTRY_FIELDS)
+DEFINE_ENTRY_MPI_TYPE(tcpretrans_entry,TCPRETRANS_ENTRY_FIELDS)
+DEFINE_ENTRY_MPI_TYPE(tcpstates_entry,TCPSTATES_ENTRY_FIELDS)
+DEFINE_ENTRY_MPI_TYPE(tcprtt_entry,TCPRTT_ENTRY_FIELDS)
+DEFINE_ENTRY_MPI_TYPE(tcpdrop_entry,TCPDROP_ENTRY_FIELDS)
+
+/* tcplife -s is comma-delimited, the others space-delimited */
+DEFINE_ENTRY_PARSE_LINE(tcpaccept_entry,TCPACCEPT_ENTRY_FIELDS," \n")
+DEFINE_ENTRY_PARSE_LINE(tcpconnect_entry,TCPCONNECT_ENTRY_FIELDS," \n")
+DEFINE_ENTRY_PARSE_LINE(tcpconnlat_entry,TCPCONNLAT_ENTRY_FIELDS," \n")
+DEFINE_ENTRY_PARSE_LINE(tcplife_entry,TCPLIFE_ENTRY_FIELDS,",\n")
 
-PetscErrorCode create_tcpconnect_entry_bag(tcpconnect_entry **entryptr, PetscBag *bagptr, PetscInt n)
-{
-  PetscErrorCode ierr;
-  tcpconnect_entry *entry;
-  PetscBag        bag;
-  char            obj_name[100];
-  PetscFunctionBeginUser;
-  ierr = PetscBagCreate(PETSC_COMM_WORLD,sizeof(tcpconnect_entry),&bag);CHKERRQ(ierr);
-  ierr = PetscBagGetData(bag,(void**)&entry);CHKERRQ(ierr);
-  sprintf(obj_name,"tcpconnect_entry_%d",n);
-  ierr = PetscBagSetName(bag,obj_name,"An entry generated by the tcpconnect program");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->pid,-1,"pid","Process ID that requested the connection");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->ip,4,"ip","IP address version");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->dport,0,"dport","Destination port");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->saddr,IP_ADDR_MAX_LEN,"0.0.0.0","saddr","Source IP address");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->daddr,IP_ADDR_MAX_LEN,"0.0.0.0","daddr","Destination IP address");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->comm,COMM_MAX_LEN,"[unknown]","comm","Process name");CHKERRQ(ierr);
   
-  *entryptr = entry;
-  *bagptr = bag;
-  PetscFunctionReturn(0);
-}
 
+PetscInt tcp_state_from_name(const char *name)
+{
+  PetscInt i;
+  for (i=1; i<NUM_TCP_STATES; ++i) {
+    if (!strcmp(TcpStates[i],name)) {
+      return i;
+    }
+  }
+  return 0;
+}
 
-PetscErrorCode create_tcplife_entry_bag(tcplife_entry **entryptr, PetscBag *bagptr, PetscInt n)
+/* splits ADDR:PORT, where an IPv6 ADDR has colons of its own */
+static PetscErrorCode split_addr_port(const char *str, char *addr, PetscInt *port)
 {
-  PetscErrorCode ierr;
-  tcplife_entry *entry;
-  PetscBag        bag;
-  char            obj_name[100];
-  PetscFunctionBeginUser;
-  ierr = PetscBagCreate(PETSC_COMM_WORLD,sizeof(tcplife_entry),&bag);CHKERRQ(ierr);
-  ierr = PetscBagGetData(bag,(void**)&entry);CHKERRQ(ierr);
-  sprintf(obj_name,"tcplife_entry_%d",n);
-  ierr = PetscBagSetName(bag,obj_name,"An entry generated by the tcplife program");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->pid,-1,"pid","Process ID that requested the connection");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->ip,4,"ip","IP address version");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->lport,0,"lport","Local port");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->rport,0,"rport","Remote port");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->tx_kb,0,"tx_kb","Transmitted kB");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->rx_kb,0,"rx_kb","Received kB");CHKERRQ(ierr);
-  ierr = PetscBagRegisterReal(bag,&entry->ms,0.,"ms","Milliseconds");
-  ierr = PetscBagRegisterString(bag,&entry->laddr,IP_ADDR_MAX_LEN,"0.0.0.0","laddr","Local IP address");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->raddr,IP_ADDR_MAX_LEN,"0.0.0.0","raddr","Remote IP address");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->comm,COMM_MAX_LEN,"[unknown]","comm","Process name");CHKERRQ(ierr);
-  
-  *entryptr = entry;
-  *bagptr = bag;
+  const char *colon = strrchr(str,':');
+  size_t     len;
+  PetscFunctionBeginUser;
+  if (!colon) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_WRONG,"Expected ADDR:PORT, got %s",str);
+  }
+  len = PetscMin((size_t)(colon - str),IP_ADDR_MAX_LEN-1);
+  memcpy(addr,str,len);
+  addr[len] = '\0';
+  *port = atoi(colon+1);
   PetscFunctionReturn(0);
 }
 
-
-PetscErrorCode tcplife_entry_parse_line(tcplife_entry *entry, char *str)
+PetscErrorCode tcpretrans_entry_parse_line(tcpretrans_entry *entry, char *str)
 {
   PetscErrorCode ierr;
   char *substr;
-  const char sep[2] = ",";
+  const char sep[3] = " \n";
   size_t len;
   PetscFunctionBeginUser;
   substr = strtok(str,sep);
-  CHECK_TOKEN(str,substr,0);
+  if (!substr) {
+    /* blank line */
+    PetscFunctionReturn(1);
+  }
+  if (strchr(substr,':')) {
+    /* HH:MM:SS */
+    substr = strtok(NULL,sep);
+    CHECK_TOKEN(str,substr,1);
+  }
+  if (!is_integer(substr)) {
+    /* header */
+    PetscFunctionReturn(1);
+  }
   entry->pid = atoi(substr);
   substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,1);
-  ierr = PetscStrlen(substr,&len);CHKERRQ(ierr);
-  ierr = PetscStrncpy(entry->comm,substr,len+1);CHKERRQ(ierr);
-  substr = strtok(NULL,sep);
   CHECK_TOKEN(str,substr,2);
   entry->ip = atoi(substr);
+  while (!(is_integer(substr) && (entry->ip == 4 || entry->ip == 6))) {
+    /* newer versions print COMM, which may have spaces */
+    substr = strtok(NULL,sep);
+    CHECK_TOKEN(str,substr,2);
+    entry->ip = atoi(substr);
+  }
   substr = strtok(NULL,sep);
   CHECK_TOKEN(str,substr,3);
-  if (entry->ip == 4) {
-    ierr = parse_ipv4(substr,entry->laddr);CHKERRQ(ierr);
-  } else {
-    ierr = parse_ipv6(substr,entry->laddr);CHKERRQ(ierr);
-  }
+  ierr = PetscStrncpy(entry->laddr_port,substr,COMM_MAX_LEN);CHKERRQ(ierr);
   substr = strtok(NULL,sep);
   CHECK_TOKEN(str,substr,4);
-  entry->lport = atoi(substr);
+  entry->tlp = (PetscInt)(substr[0] == 'L');
   substr = strtok(NULL,sep);
   CHECK_TOKEN(str,substr,5);
-  if (entry->ip == 4) {
-    ierr = parse_ipv4(substr,entry->raddr);CHKERRQ(ierr);
-  } else {
-    ierr = parse_ipv6(substr,entry->raddr);CHKERRQ(ierr);
-  }
+  ierr = PetscStrncpy(entry->raddr_port,substr,COMM_MAX_LEN);CHKERRQ(ierr);
   substr = strtok(NULL,sep);
   CHECK_TOKEN(str,substr,6);
-  entry->rport = atoi(substr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,7);
-  entry->tx_kb = atoi(substr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,8);
-  entry->rx_kb = atoi(substr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,9);
-  entry->ms = atof(substr);
+  ierr = PetscStrlen(substr,&len);CHKERRQ(ierr);
+  ierr = PetscStrncpy(entry->state,substr,len+1);CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
-PetscErrorCode create_tcpconnlat_entry_bag(tcpconnlat_entry **entryptr, PetscBag *bagptr, PetscInt n)
+#define TCPSTATES_MAX_TOKENS 32
+
+PetscErrorCode tcpstates_entry_parse_line(tcpstates_entry *entry, char *str)
 {
   PetscErrorCode ierr;
-  tcpconnlat_entry *entry;
-  PetscBag        bag;
-  char            obj_name[100];
+  char *tok[TCPSTATES_MAX_TOKENS];
+  const char sep[3] = " \n";
+  PetscInt ntok=0,first,i;
   PetscFunctionBeginUser;
-  ierr = PetscBagCreate(PETSC_COMM_WORLD,sizeof(tcpconnlat_entry),&bag);CHKERRQ(ierr);
-  ierr = PetscBagGetData(bag,(void**)&entry);CHKERRQ(ierr);
-  sprintf(obj_name,"tcpconnlat_entry_%d",n);
-  ierr = PetscBagRegisterInt(bag,&entry->pid,-1,"pid","Process ID that accepted the connection");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->ip,4,"ip","IP address version");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->dport,0,"dport","Remote port");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->saddr,IP_ADDR_MAX_LEN,"0.0.0.0","saddr","Source IP address");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->daddr,IP_ADDR_MAX_LEN,"0.0.0.0","daddr","Destination IP address");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->comm,COMM_MAX_LEN,"[unknown]","comm","Process name");CHKERRQ(ierr);
-
-  *entryptr = entry;
-  *bagptr = bag;
+  for (tok[0]=strtok(str,sep); tok[ntok] && ntok<TCPSTATES_MAX_TOKENS-1; tok[ntok]=strtok(NULL,sep)) {
+    ++ntok;
+  }
+  /* SKADDR PID COMM... and 8 fields after COMM, which may have spaces; so parse
+     the fields from the end */
+  first = (ntok && (strchr(tok[0],':') || strchr(tok[0],'.'))) ? 1 : 0; /* -T or -t */
+  if (ntok - first < 11 || !is_integer(tok[first+1]) || strcmp(tok[ntok-3],"->")) {
+    /* header */
+    PetscFunctionReturn(1);
+  }
+  entry->pid = atoi(tok[first+1]);
+  ierr = PetscStrncpy(entry->comm,tok[first+2],COMM_MAX_LEN);CHKERRQ(ierr);
+  for (i=first+3; i<ntok-8; ++i) {
+    ierr = PetscStrlcat(entry->comm," ",COMM_MAX_LEN);CHKERRQ(ierr);
+    ierr = PetscStrlcat(entry->comm,tok[i],COMM_MAX_LEN);CHKERRQ(ierr);
+  }
+  ierr = PetscStrncpy(entry->laddr,tok[ntok-8],IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  entry->ip = strchr(entry->laddr,':') ? 6 : 4;
+  entry->lport = atoi(tok[ntok-7]);
+  ierr = PetscStrncpy(entry->raddr,tok[ntok-6],IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  entry->rport = atoi(tok[ntok-5]);
+  entry->oldstate = tcp_state_from_name(tok[ntok-4]);
+  entry->newstate = tcp_state_from_name(tok[ntok-2]);
+  entry->ms = atof(tok[ntok-1]);
   PetscFunctionReturn(0);
 }
 
-PetscErrorCode create_tcpretrans_entry_bag(tcpretrans_entry **entryptr, PetscBag *bagptr, PetscInt n)
+PetscErrorCode tcprtt_entry_parse_line(tcprtt_entry *entry, char *str)
 {
   PetscErrorCode ierr;
-  tcpretrans_entry *entry;
-  PetscBag        bag;
-  char            obj_name[100];
+  char           *p,*end,*arrow,*colon;
+  PetscReal      lo,hi,bound;
+  long           count;
+  size_t         len;
   PetscFunctionBeginUser;
-  ierr = PetscBagCreate(PETSC_COMM_WORLD,sizeof(tcpconnlat_entry),&bag);CHKERRQ(ierr);
-  ierr = PetscBagGetData(bag,(void**)&entry);CHKERRQ(ierr);
-  sprintf(obj_name,"tcpconnlat_entry_%d",n);
-  ierr = PetscBagRegisterInt(bag,&entry->pid,-1,"pid","Process ID that accepted the connection");CHKERRQ(ierr);
-  ierr = PetscBagRegisterInt(bag,&entry->ip,4,"ip","IP address version");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->laddr_port,COMM_MAX_LEN,"0.0.0.0:0","laddr_port","Local IP_address:tcp_port");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->raddr_port,COMM_MAX_LEN,"0.0.0.0:0","raddr_port","Remote IP_address:tcp_port");CHKERRQ(ierr);
-  ierr = PetscBagRegisterString(bag,&entry->state,COMM_MAX_LEN,"[unknown]","state","TCP session state");CHKERRQ(ierr);
-
-  *entryptr = entry;
-  *bagptr = bag;
+  if (entry->unit_us <= 0.0) {
+    entry->unit_us = 1.0;
+  }
+  for (p=str; *p == ' ' || *p == '\t'; ++p);
+  arrow = strstr(p,"->");
+  colon = strchr(p,':');
+  if (!arrow || !colon || colon < arrow) {
+    /* not a row: a unit line ("usecs : count distribution"), a section
+       header ("Remote Addres = 10.0.0.1"), a timestamp or a blank line */
+    if (!strncmp(p,"msecs",5)) {
+      entry->unit_us = 1000.0;
+    } else if (!strncmp(p,"usecs",5)) {
+      entry->unit_us = 1.0;
+    } else if ((colon = strchr(p,'=')) && strncmp(p,"avg",3)) {
+      for (++colon; *colon == ' '; ++colon);
+      len = strcspn(colon," \n");
+      len = PetscMin(len,IP_ADDR_MAX_LEN-1);
+      memcpy(entry->section,colon,len);
+      entry->section[len] = '\0';
+    }
+    PetscFunctionReturn(1);
+  }
+  lo = strtod(p,&end);
+  if (end == p) {
+    PetscFunctionReturn(1);
+  }
+  hi = strtod(arrow+2,&end);
+  count = strtol(colon+1,&end,10);
+  if (count <= 0) {
+    /* empty rows are not events */
+    PetscFunctionReturn(1);
+  }
+  if (!entry->section[0]) {
+    ierr = PetscStrncpy(entry->section,"all",IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  }
+  entry->pid = 0;
+  entry->count = (PetscInt)count;
+  entry->lo_us = lo * entry->unit_us;
+  entry->hi_us = hi * entry->unit_us;
+  /* the first bucket whose bound 2^bin us is above the row */
+  for (entry->bin=0,bound=1.0; entry->bin<TCP_RTT_HIST_BINS-1 && bound<=entry->hi_us; ++entry->bin,bound*=2.0);
   PetscFunctionReturn(0);
 }
 
-PetscErrorCode tcpretrans_entry_parse_line(tcpretrans_entry *entry, char *str)
+PetscErrorCode tcpdrop_entry_parse_line(tcpdrop_entry *entry, char *str)
 {
   PetscErrorCode ierr;
   char *substr;
-  const char sep[2] = " ";
+  const char sep[3] = " \n";
   size_t len;
   PetscFunctionBeginUser;
-  SETERRQ(PETSC_COMM_WORLD,1,"Error, tcpretrans_entry_parse_line() not implemented yet");
+  if (str[0] == ' ' || str[0] == '\t' || str[0] == '\n') {
+    /* a kernel stack frame of the previous drop, or the blank line after it */
+    PetscFunctionReturn(1);
+  }
   substr = strtok(str,sep);
-  CHECK_TOKEN(str,substr,0);
-  entry->pid = atoi(substr);
-  substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,1);
-  entry->ip = atoi(substr);
-  while (entry->ip == 0) {
-    /* in case comm has a space */
+  if (!substr) {
+    /* blank line */
+    PetscFunctionReturn(1);
+  }
+  if (strchr(substr,':')) {
+    /* HH:MM:SS */
     substr = strtok(NULL,sep);
     CHECK_TOKEN(str,substr,1);
-    entry->ip = atoi(substr);
   }
-
-
-  strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,4);
-  ierr = PetscStrlen(substr,&len);CHKERRQ(ierr);
-  ierr = PetscStrncpy(entry->state,substr,len+1);CHKERRQ(ierr);
-
-
-  PetscFunctionReturn(0);
-}
-
-PetscErrorCode tcpconnlat_entry_parse_line(tcpconnlat_entry *entry, char *str)
-{
-  PetscErrorCode ierr;
-  char *substr;
-  const char sep[2] = " ";
-  size_t len;
-  PetscFunctionBeginUser;
-  substr = strtok(str,sep);
-  CHECK_TOKEN(str,substr,0);
+  if (!is_integer(substr)) {
+    /* header */
+    PetscFunctionReturn(1);
+  }
   entry->pid = atoi(substr);
   substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,1);
-  ierr = PetscStrlen(substr,&len);CHKERRQ(ierr);
-  ierr = PetscStrncpy(entry->comm,substr,len+1);CHKERRQ(ierr);
-  substr = strtok(NULL,sep);
   CHECK_TOKEN(str,substr,2);
   entry->ip = atoi(substr);
   substr = strtok(NULL,sep);
   CHECK_TOKEN(str,substr,3);
-  if (entry->ip == 4) {
-    ierr = parse_ipv4(substr,entry->saddr);CHKERRQ(ierr);
-  } else {
-    ierr = parse_ipv6(substr,entry->saddr);CHKERRQ(ierr);
-  }
-  substr = strtok(NULL,sep);
+  ierr = split_addr_port(substr,entry->laddr,&entry->lport);CHKERRQ(ierr);
+  substr = strtok(NULL,sep); /* > */
   CHECK_TOKEN(str,substr,4);
-  if (entry->ip == 4) {
-    ierr = parse_ipv4(substr,entry->daddr);CHKERRQ(ierr);
-  } else {
-    ierr = parse_ipv6(substr,entry->daddr);CHKERRQ(ierr);
-  }
+  substr = strtok(NULL,sep);
+  CHECK_TOKEN(str,substr,5);
+  ierr = split_addr_port(substr,entry->raddr,&entry->rport);CHKERRQ(ierr);
   substr = strtok(NULL,sep);
   CHECK_TOKEN(str,substr,6);
-  entry->dport = atoi(substr);
+  ierr = PetscStrncpy(entry->state,substr,TCP_STATE_LEN);CHKERRQ(ierr);
   substr = strtok(NULL,sep);
-  CHECK_TOKEN(str,substr,7);
-  entry->lat_ms = atof(substr);
+  if (substr) {
+    /* (FLAGS) */
+    if (substr[0] == '(') {
+      ++substr;
+    }
+    ierr = PetscStrlen(substr,&len);CHKERRQ(ierr);
+    if (len && substr[len-1] == ')') {
+      substr[len-1] = '\0';
+    }
+    ierr = PetscStrncpy(entry->flags,substr,TCP_FLAGS_LEN);CHKERRQ(ierr);
+  } else {
+    entry->flags[0] = '\0';
+  }
   PetscFunctionReturn(0);
 }
 
-
-
-
 PetscErrorCode process_data_initialize(process_data *dat)
 {
   PetscMemzero(dat,sizeof(process_data));
   return 0;
 }
 
-
-
-
-
-
 PetscErrorCode process_statistics_init(process_statistics *pstats)
 {
   PetscErrorCode ierr;
   PetscFunctionBeginUser;
   ierr = PetscHMapDataCreate(&(pstats->ht));CHKERRQ(ierr);
+  pstats->tree = NULL;
   PetscFunctionReturn(0);
 }
 
@@ -545,6 +562,23 @@ PetscErrorCode process_statistics_destroy(process_statistics *pstats)
   PetscFunctionReturn(0);
 }
 
+/* credits the entry to the subtree of every ancestor of its PID (and of the PID
+   itself) in pstats->tree, by adding it to the tree's rollup with each of their
+   PIDs in turn. The rollup has no tree, so this does not recurse. */
+#define PROCESS_STATISTICS_ROLL_UP(pstats,entry,add) do {		\
+    PetscInt pid_,node_;						\
+    if ((pstats)->tree) {						\
+      pid_ = (entry)->pid;						\
+      ierr = process_tree_find((pstats)->tree,pid_,&node_);CHKERRQ(ierr); \
+      for (; node_ >= 0; node_ = (pstats)->tree->nodes[node_].parent) {	\
+	(entry)->pid = (pstats)->tree->nodes[node_].pid;		\
+	ierr = add(&(pstats)->tree->rollup,entry);			\
+	(entry)->pid = pid_;						\
+	CHKERRQ(ierr);							\
+      }									\
+    }									\
+  } while (0)
+
 PetscErrorCode process_statistics_add_accept(process_statistics *pstats,
 					     tcpaccept_entry *entry)
 {
@@ -560,10 +594,10 @@ PetscErrorCode process_statistics_add_accept(process_statistics *pstats,
   }
   PetscStrncpy(pdata.comm,entry->comm,COMM_MAX_LEN);
   ierr = PetscHMapDataSet(pstats->ht,entry->pid,pdata);CHKERRQ(ierr);
+  PROCESS_STATISTICS_ROLL_UP(pstats,entry,process_statistics_add_accept);
   PetscFunctionReturn(0);
 }
 
-
 PetscErrorCode process_statistics_add_connect(process_statistics *pstats,
 					      tcpconnect_entry *entry)
 {
@@ -579,10 +613,10 @@ PetscErrorCode process_statistics_add_connect(process_statistics *pstats,
   }
   PetscStrncpy(pdata.comm,entry->comm,COMM_MAX_LEN);
   ierr = PetscHMapDataSet(pstats->ht,entry->pid,pdata);CHKERRQ(ierr);
+  PROCESS_STATISTICS_ROLL_UP(pstats,entry,process_statistics_add_connect);
   PetscFunctionReturn(0);
 }
 
-
 PetscErrorCode process_statistics_add_connlat(process_statistics *pstats,
 					      tcpconnlat_entry *entry)
 {
@@ -599,6 +633,7 @@ PetscErrorCode process_statistics_add_connlat(process_statistics *pstats,
   }
   PetscStrncpy(pdata.comm,entry->comm,COMM_MAX_LEN);
   ierr = PetscHMapDataSet(pstats->ht,entry->pid,pdata);CHKERRQ(ierr);
+  PROCESS_STATISTICS_ROLL_UP(pstats,entry,process_statistics_add_connlat);
   PetscFunctionReturn(0);
 }
 
@@ -620,10 +655,10 @@ PetscErrorCode process_statistics_add_life(process_statistics *pstats,
   }
   PetscStrncpy(pdata.comm,entry->comm,COMM_MAX_LEN);
   ierr = PetscHMapDataSet(pstats->ht,entry->pid,pdata);CHKERRQ(ierr);
+  PROCESS_STATISTICS_ROLL_UP(pstats,entry,process_statistics_add_life);
   PetscFunctionReturn(0);
 }
 
-
 PetscErrorCode process_statistics_add_retrans(process_statistics *pstats,
 					      tcpretrans_entry *entry)
 {
@@ -637,101 +672,173 @@ PetscErrorCode process_statistics_add_retrans(process_statistics *pstats,
   } else if (entry->ip == 6) {
     ++pdata.nipv6;
   }
-  PetscStrncpy(pdata.comm,"[unknown]",sizeof("[unknown]"));
+  /* tcpretrans has no process name; keep the one other tools found, if any */
   ierr = PetscHMapDataSet(pstats->ht,entry->pid,pdata);CHKERRQ(ierr);
+  PROCESS_STATISTICS_ROLL_UP(pstats,entry,process_statistics_add_retrans);
   PetscFunctionReturn(0);
 }
 
-
-static PetscBool registered = PETSC_FALSE;
-PetscErrorCode register_mpi_types()
+PetscErrorCode process_statistics_add_states(process_statistics *pstats,
+					     tcpstates_entry *entry)
 {
+  PetscErrorCode ierr;
+  process_data   pdata;
   PetscFunctionBeginUser;
-  if (registered) {
-    PetscFunctionReturn(0);
+  ierr = PetscHMapDataGet(pstats->ht,entry->pid,&pdata);CHKERRQ(ierr);
+  ++pdata.nstates;
+  switch (entry->oldstate) {
+    case 2: /* SYN_SENT */
+    case 3: /* SYN_RECV */
+    case 12: /* NEW_SYN_RECV */
+      ++pdata.nhandshake;
+      pdata.handshake_ms += entry->ms;
+      break;
+    case 1: /* ESTABLISHED */
+      ++pdata.nestablished;
+      pdata.established_ms += entry->ms;
+      break;
+    case 4: /* FIN_WAIT1 */
+    case 5: /* FIN_WAIT2 */
+    case 6: /* TIME_WAIT */
+    case 8: /* CLOSE_WAIT */
+    case 9: /* LAST_ACK */
+    case 11: /* CLOSING */
+      ++pdata.nclosing;
+      pdata.closing_ms += entry->ms;
+      break;
+    default:
+      break;
   }
-  MPI_Aint accept_displacements[] = {offsetof(tcpaccept_entry,pid),
-				     offsetof(tcpaccept_entry,ip),
-				     offsetof(tcpaccept_entry,rport),
-				     offsetof(tcpaccept_entry,lport),
-				     offsetof(tcpaccept_entry,laddr),
-				     offsetof(tcpaccept_entry,raddr),
-				     offsetof(tcpaccept_entry,comm)};
-  MPI_Datatype accept_dtypes[] = {MPI_INT,MPI_INT,MPI_INT,MPI_INT,MPI_CHAR,
-				  MPI_CHAR,MPI_CHAR};
-
-
-  int accept_block_lens[] = {1,1,1,1,IP_ADDR_MAX_LEN,IP_ADDR_MAX_LEN,COMM_MAX_LEN};
-
-  MPI_Type_create_struct(7,accept_block_lens,accept_displacements,accept_dtypes,
-			 &MPI_DTYPES[DTYPE_ACCEPT]);
-
-  MPI_Aint connect_displacements[] = {offsetof(tcpconnect_entry,pid),
-				      offsetof(tcpconnect_entry,ip),
-				      offsetof(tcpconnect_entry,dport),
-				      offsetof(tcpconnect_entry,saddr),
-				      offsetof(tcpconnect_entry,daddr),
-				      offsetof(tcpconnect_entry,comm)};
+  if (entry->ip == 4) {
+    ++pdata.nipv4;
+  } else if (entry->ip == 6) {
+    ++pdata.nipv6;
+  }
+  PetscStrncpy(pdata.comm,entry->comm,COMM_MAX_LEN);
+  ierr = PetscHMapDataSet(pstats->ht,entry->pid,pdata);CHKERRQ(ierr);
+  PROCESS_STATISTICS_ROLL_UP(pstats,entry,process_statistics_add_states);
+  PetscFunctionReturn(0);
+}
 
-  MPI_Datatype connect_dtypes[] = {MPI_INT,MPI_INT,MPI_INT,MPI_CHAR,MPI_CHAR,
-				   MPI_CHAR};
+PetscErrorCode process_statistics_add_rtt(process_statistics *pstats,
+					  tcprtt_entry *entry)
+{
+  PetscErrorCode ierr;
+  process_data   pdata;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapDataGet(pstats->ht,entry->pid,&pdata);CHKERRQ(ierr);
+  pdata.nrtt += entry->count;
+  /* the row's midpoint stands in for each of its samples */
+  pdata.rttus += entry->count * 0.5 * (entry->lo_us + entry->hi_us);
+  pdata.rtt_hist[entry->bin] += entry->count;
+  ierr = PetscHMapDataSet(pstats->ht,entry->pid,pdata);CHKERRQ(ierr);
+  PROCESS_STATISTICS_ROLL_UP(pstats,entry,process_statistics_add_rtt);
+  PetscFunctionReturn(0);
+}
 
-  int connect_block_lens[] = {1,1,1,IP_ADDR_MAX_LEN,IP_ADDR_MAX_LEN,
-			      COMM_MAX_LEN};
+PetscErrorCode process_statistics_add_drop(process_statistics *pstats,
+					   tcpdrop_entry *entry)
+{
+  PetscErrorCode ierr;
+  process_data   pdata;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapDataGet(pstats->ht,entry->pid,&pdata);CHKERRQ(ierr);
+  ++pdata.ndrop;
+  if (entry->ip == 4) {
+    ++pdata.nipv4;
+  } else if (entry->ip == 6) {
+    ++pdata.nipv6;
+  }
+  ierr = PetscHMapDataSet(pstats->ht,entry->pid,pdata);CHKERRQ(ierr);
+  PROCESS_STATISTICS_ROLL_UP(pstats,entry,process_statistics_add_drop);
+  PetscFunctionReturn(0);
+}
 
-  MPI_Type_create_struct(6,connect_block_lens,connect_displacements,connect_dtypes,
-			 &MPI_DTYPES[DTYPE_CONNECT]);
-  
+PetscErrorCode process_statistics_add_pdata(process_statistics *pstats, PetscInt pid, process_data *add)
+{
+  PetscErrorCode ierr;
+  process_data   pdata;
+  PetscInt       i,node;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapDataGet(pstats->ht,pid,&pdata);CHKERRQ(ierr);
+  pdata.naccept += add->naccept;
+  pdata.nconnect += add->nconnect;
+  pdata.nconnlat += add->nconnlat;
+  pdata.nlife += add->nlife;
+  pdata.nretrans += add->nretrans;
+  pdata.tx_kb += add->tx_kb;
+  pdata.rx_kb += add->rx_kb;
+  pdata.nipv4 += add->nipv4;
+  pdata.nipv6 += add->nipv6;
+  pdata.latms += add->latms;
+  pdata.lifems += add->lifems;
+  pdata.nstates += add->nstates;
+  pdata.nhandshake += add->nhandshake;
+  pdata.nestablished += add->nestablished;
+  pdata.nclosing += add->nclosing;
+  pdata.ndrop += add->ndrop;
+  pdata.nrtt += add->nrtt;
+  pdata.handshake_ms += add->handshake_ms;
+  pdata.established_ms += add->established_ms;
+  pdata.closing_ms += add->closing_ms;
+  pdata.rttus += add->rttus;
+  for (i=0; i<TCP_RTT_HIST_BINS; ++i) {
+    pdata.rtt_hist[i] += add->rtt_hist[i];
+  }
+  /* tools without a process name leave the default; don't let that hide a real one */
+  if (add->comm[0] && strcmp(add->comm,default_pdata.comm)) {
+    PetscStrncpy(pdata.comm,add->comm,COMM_MAX_LEN);
+  }
+  ierr = PetscHMapDataSet(pstats->ht,pid,pdata);CHKERRQ(ierr);
+  if (pstats->tree) {
+    ierr = process_tree_find(pstats->tree,pid,&node);CHKERRQ(ierr);
+    for (; node >= 0; node = pstats->tree->nodes[node].parent) {
+      ierr = process_statistics_add_pdata(&pstats->tree->rollup,pstats->tree->nodes[node].pid,add);CHKERRQ(ierr);
+    }
+  }
+  PetscFunctionReturn(0);
+}
 
-  MPI_Aint connlat_displacements[] = {offsetof(tcpconnlat_entry,pid),
-				      offsetof(tcpconnlat_entry,ip),
-				      offsetof(tcpconnlat_entry,dport),
-				      offsetof(tcpconnlat_entry,lat_ms),
-				      offsetof(tcpconnlat_entry,saddr),
-				      offsetof(tcpconnlat_entry,daddr),
-				      offsetof(tcpconnlat_entry,comm)};
-
-  MPI_Datatype connlat_dtypes[] = {MPI_INT,MPI_INT,MPI_INT,
-				   MPI_DOUBLE,MPI_CHAR,MPI_CHAR,MPI_CHAR};
-
-  int connlat_block_lens[] = {1,1,1,1,IP_ADDR_MAX_LEN,IP_ADDR_MAX_LEN,
-			      COMM_MAX_LEN};
-
-  MPI_Type_create_struct(7,connlat_block_lens,connlat_displacements,
-			 connlat_dtypes,&MPI_DTYPES[DTYPE_CONNLAT]);
-
-  MPI_Aint life_displacements[] = {offsetof(tcplife_entry,pid),
-				   offsetof(tcplife_entry,ip),
-				   offsetof(tcplife_entry,lport),
-				   offsetof(tcplife_entry,rport),
-				   offsetof(tcplife_entry,tx_kb),
-				   offsetof(tcplife_entry,rx_kb),
-				   offsetof(tcplife_entry,ms),
-				   offsetof(tcplife_entry,laddr),
-				   offsetof(tcplife_entry,raddr),
-				   offsetof(tcplife_entry,comm),
-				   offsetof(tcplife_entry,time)};
-  MPI_Datatype life_dtypes[] = {MPI_INT,MPI_INT,MPI_INT,MPI_INT,MPI_INT,MPI_INT,
-				MPI_DOUBLE,MPI_CHAR,MPI_CHAR,MPI_CHAR,MPI_CHAR};
-
-  int life_block_lens[] = {1,1,1,1,1,1,1,IP_ADDR_MAX_LEN,IP_ADDR_MAX_LEN,
-			   COMM_MAX_LEN,TIME_LEN};
-
-  MPI_Type_create_struct(11,life_block_lens,life_displacements,life_dtypes,
-			 &MPI_DTYPES[DTYPE_LIFE]);
-
-  MPI_Aint retrans_displacements[] = {offsetof(tcpretrans_entry,pid),
-				      offsetof(tcpretrans_entry,ip),
-				      offsetof(tcpretrans_entry,laddr_port),
-				      offsetof(tcpretrans_entry,raddr_port),
-				      offsetof(tcpretrans_entry,state)};
-  
-  MPI_Datatype retrans_dtypes[] = {MPI_INT,MPI_INT,MPI_CHAR,MPI_CHAR,MPI_CHAR};
-  int retrans_block_lens[] = {1,1,COMM_MAX_LEN,COMM_MAX_LEN,COMM_MAX_LEN};
+PetscErrorCode process_statistics_add_traffic(process_statistics *pstats, PetscInt pid, const char *comm,
+					      long long tx_kb, long long rx_kb, long long nretrans)
+{
+  PetscErrorCode ierr;
+  process_data   pdata;
+  PetscInt       node;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapDataGet(pstats->ht,pid,&pdata);CHKERRQ(ierr);
+  pdata.tx_kb += tx_kb;
+  pdata.rx_kb += rx_kb;
+  pdata.nretrans += nretrans;
+  PetscStrncpy(pdata.comm,comm,COMM_MAX_LEN);
+  ierr = PetscHMapDataSet(pstats->ht,pid,pdata);CHKERRQ(ierr);
+  if (pstats->tree) {
+    ierr = process_tree_find(pstats->tree,pid,&node);CHKERRQ(ierr);
+    for (; node >= 0; node = pstats->tree->nodes[node].parent) {
+      ierr = process_statistics_add_traffic(&pstats->tree->rollup,pstats->tree->nodes[node].pid,comm,
+					    tx_kb,rx_kb,nretrans);CHKERRQ(ierr);
+    }
+  }
+  PetscFunctionReturn(0);
+}
 
-  MPI_Type_create_struct(5,retrans_block_lens,retrans_displacements,
-			 retrans_dtypes,&MPI_DTYPES[DTYPE_RETRANS]);
+MPI_Datatype MPI_DTYPES[NUM_SERVER_MPI_DTYPES];
 
+static PetscBool registered = PETSC_FALSE;
+PetscErrorCode register_mpi_types()
+{
+  PetscFunctionBeginUser;
+  if (registered) {
+    PetscFunctionReturn(0);
+  }
+  tcpaccept_entry_create_mpi_type(&MPI_DTYPES[DTYPE_ACCEPT]);
+  tcpconnect_entry_create_mpi_type(&MPI_DTYPES[DTYPE_CONNECT]);
+  tcpconnlat_entry_create_mpi_type(&MPI_DTYPES[DTYPE_CONNLAT]);
+  tcplife_entry_create_mpi_type(&MPI_DTYPES[DTYPE_LIFE]);
+  tcpretrans_entry_create_mpi_type(&MPI_DTYPES[DTYPE_RETRANS]);
+  tcpstates_entry_create_mpi_type(&MPI_DTYPES[DTYPE_STATES]);
+  tcprtt_entry_create_mpi_type(&MPI_DTYPES[DTYPE_RTT]);
+  tcpdrop_entry_create_mpi_type(&MPI_DTYPES[DTYPE_DROP]);
 
   MPI_Aint pdata_displacements[] = {offsetof(process_data_summary,pid),
 				    offsetof(process_data_summary,rank),
@@ -743,18 +850,62 @@ PetscErrorCode register_mpi_types()
 				    offsetof(process_data_summary,avg_lifetime),
 				    //offsetof(process_data_summary,sd_lifetime),
 				    offsetof(process_data_summary,fraction_ipv6),
+				    offsetof(process_data_summary,nretrans),
+				    offsetof(process_data_summary,avg_rtt),
+				    offsetof(process_data_summary,cpu_seconds),
+				    offsetof(process_data_summary,bytes_per_cpu_second),
+				    offsetof(process_data_summary,rss_kb),
+				    offsetof(process_data_summary,read_bytes),
+				    offsetof(process_data_summary,write_bytes),
+				    offsetof(process_data_summary,ctx_switches),
+				    offsetof(process_data_summary,app_rank),
+				    offsetof(process_data_summary,job_id),
 				    offsetof(process_data_summary,comm)};
 
-  MPI_Datatype pdata_dtypes[] = {MPI_INT,MPI_INT,MPI_LONG,MPI_LONG,MPI_LONG,
-				 MPI_DOUBLE,MPI_DOUBLE,MPI_DOUBLE,MPI_CHAR};
+  MPI_Datatype pdata_dtypes[] = {MPIU_INT,MPIU_INT,MPI_LONG,MPI_LONG,MPI_LONG,
+				 MPIU_REAL,MPIU_REAL,MPIU_REAL,MPI_LONG,MPIU_REAL,
+				 MPIU_REAL,MPIU_REAL,
+				 MPI_LONG,MPI_LONG,MPI_LONG,MPI_LONG,MPIU_INT,MPI_CHAR,MPI_CHAR};
 
-  int pdata_block_lens[] = {1,1,1,1,1,1,1,1,COMM_MAX_LEN};
+  /* nretrans,ndrop and avg_rtt,p99_rtt,avg_handshake,avg_established are contiguous */
+  int pdata_block_lens[] = {1,1,1,1,1,1,1,1,2,4,1,1,1,1,1,1,1,JOB_ID_LEN,COMM_MAX_LEN};
 
-  MPI_Type_create_struct(9,pdata_block_lens,pdata_displacements,pdata_dtypes,
+  MPI_Type_create_struct(19,pdata_block_lens,pdata_displacements,pdata_dtypes,
 			 &MPI_DTYPES[DTYPE_SUMMARY]);
 
+  MPI_Aint group_displacements[] = {offsetof(event_group_row,rank),
+				     offsetof(event_group_row,count),
+				     offsetof(event_group_row,tx_kb),
+				     offsetof(event_group_row,rx_kb),
+				     offsetof(event_group_row,sum_latency),
+				     offsetof(event_group_row,max_latency),
+				     offsetof(event_group_row,sum_duration),
+				     offsetof(event_group_row,key)};
+
+  MPI_Datatype group_dtypes[] = {MPIU_INT,MPI_LONG,MPI_LONG,MPI_LONG,
+				 MPIU_REAL,MPIU_REAL,MPIU_REAL,MPI_CHAR};
+
+  int group_block_lens[] = {1,1,1,1,1,1,1,EVENT_GROUP_KEY_LEN};
+
+  MPI_Type_create_struct(8,group_block_lens,group_displacements,group_dtypes,
+			 &MPI_DTYPES[DTYPE_GROUP_ROW]);
+
+  MPI_Aint node_displacements[] = {offsetof(node_summary,rank),
+				    offsetof(node_summary,interval),
+				    offsetof(node_summary,total),
+				    offsetof(node_summary,rate),
+				    offsetof(node_summary,peak_rate),
+				    offsetof(node_summary,host)};
+
+  MPI_Datatype node_dtypes[] = {MPIU_INT,MPIU_REAL,MPI_LONG,MPIU_REAL,MPIU_REAL,MPI_CHAR};
+
+  int node_block_lens[] = {1,1,NUM_NODE_COUNTERS,NUM_NODE_COUNTERS,NUM_NODE_COUNTERS,NODE_HOST_LEN};
+
+  MPI_Type_create_struct(6,node_block_lens,node_displacements,node_dtypes,
+			 &MPI_DTYPES[DTYPE_NODE]);
+
   PetscInt i;
-  for (i=0; i<6; ++i) {
+  for (i=0; i<NUM_SERVER_MPI_DTYPES; ++i) {
     MPI_Type_commit(&MPI_DTYPES[i]);
   }
 
@@ -762,9 +913,10 @@ PetscErrorCode register_mpi_types()
   PetscFunctionReturn(0);
 }
 
-
 PetscErrorCode process_data_summarize(PetscInt pid, process_data *pdata, process_data_summary *psumm)
 {
+  PetscInt  i;
+  long long seen;
   PetscFunctionBeginUser;
   psumm->pid = pid;
   psumm->tx_kb = pdata->tx_kb;
@@ -774,11 +926,27 @@ PetscErrorCode process_data_summarize(PetscInt pid, process_data *pdata, process
   psumm->avg_latency = pdata->latms / pdata->nconnlat;
   psumm->avg_lifetime = pdata->lifems / pdata->nlife;
   psumm->fraction_ipv6 = ((PetscReal)(pdata->nipv6))/ ((PetscReal)(pdata->nipv6) + (PetscReal)(pdata->nipv4));
+  psumm->n_event += pdata->nstates + pdata->ndrop;
+  psumm->nretrans = pdata->nretrans;
+  psumm->ndrop = pdata->ndrop;
+  psumm->avg_rtt = pdata->nrtt ? 1.0e-3 * pdata->rttus / pdata->nrtt : 0.0;
+  psumm->p99_rtt = 0.0;
+  if (pdata->nrtt) {
+    /* the upper bound of the bucket holding the 99th percentile */
+    for (i=0,seen=0; i<TCP_RTT_HIST_BINS; ++i) {
+      seen += pdata->rtt_hist[i];
+      if (100 * seen >= 99 * pdata->nrtt) {
+	psumm->p99_rtt = 1.0e-3 * PetscPowReal(2.0,(PetscReal)i);
+	break;
+      }
+    }
+  }
+  psumm->avg_handshake = pdata->nhandshake ? pdata->handshake_ms / pdata->nhandshake : 0.0;
+  psumm->avg_established = pdata->nestablished ? pdata->established_ms / pdata->nestablished : 0.0;
   PetscStrncpy(psumm->comm,pdata->comm,COMM_MAX_LEN);
   PetscFunctionReturn(0);
 }
 
-
 PetscErrorCode process_statistics_get_summary(process_statistics *pstats, PetscInt pid, process_data_summary *psumm)
 {
   process_data pdata;
@@ -799,6 +967,25 @@ PetscErrorCode process_statistics_get_pid_data(process_statistics *pstats,
   PetscFunctionReturn(0);
 }
 
+PetscErrorCode process_statistics_clear(process_statistics *pstats)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapDataClear(pstats->ht);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode process_statistics_remove(process_statistics *pstats, PetscInt pid)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapDataDel(pstats->ht,pid);CHKERRQ(ierr);
+  if (pstats->tree) {
+    ierr = PetscHMapDataDel(pstats->tree->rollup.ht,pid);CHKERRQ(ierr);
+    ierr = process_tree_remove(pstats->tree,pid);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
 
 PetscErrorCode process_statistics_num_entries(process_statistics *pstats, PetscInt *n)
 {
@@ -808,9 +995,6 @@ PetscErrorCode process_statistics_num_entries(process_statistics *pstats, PetscI
   PetscFunctionReturn(0);
 }
 
-
-
-
   
 PetscErrorCode process_statistics_get_all(process_statistics *pstats, process_data *pdatas, PetscInt *pids)
 {
@@ -822,7 +1006,6 @@ PetscErrorCode process_statistics_get_all(process_statistics *pstats, process_da
 }
     
 
-
 PetscErrorCode create_process_summary_bag(process_data_summary **psumm, PetscBag *bag, PetscInt rank, PetscInt nentry)
 {
   PetscErrorCode ierr;
@@ -844,6 +1027,20 @@ PetscErrorCode create_process_summary_bag(process_data_summary **psumm, PetscBag
   ierr = PetscBagRegisterReal(pbag,&ps->avg_lifetime,0.0,"avg_lifetime","Average lifetime of a TCP event from tcplife");CHKERRQ(ierr);
   //ierr = PetscBagRegisterReal(pbag,&ps->sd_lifetime,0.0,"sd_lifetime","Standard deviation of the lifetimes of TCP events from tcplife");CHKERRQ(ierr);
   ierr = PetscBagRegisterReal(pbag,&ps->fraction_ipv6,0.0,"fraction_ipv6","Fraction of the TCP events that used IP v6 instead of v4");CHKERRQ(ierr);
+  ierr = PetscBagRegisterInt64(pbag,&ps->nretrans,0,"nretrans","Number of retransmits and tail loss probes from tcpretrans");CHKERRQ(ierr);
+  ierr = PetscBagRegisterInt64(pbag,&ps->ndrop,0,"ndrop","Number of packets dropped by the kernel from tcpdrop");CHKERRQ(ierr);
+  ierr = PetscBagRegisterReal(pbag,&ps->avg_rtt,0.0,"avg_rtt","Average RTT in ms from tcprtt");CHKERRQ(ierr);
+  ierr = PetscBagRegisterReal(pbag,&ps->p99_rtt,0.0,"p99_rtt","99th percentile RTT in ms (bucket upper bound) from tcprtt");CHKERRQ(ierr);
+  ierr = PetscBagRegisterReal(pbag,&ps->avg_handshake,0.0,"avg_handshake","Average time in SYN_SENT/SYN_RECV in ms from tcpstates");CHKERRQ(ierr);
+  ierr = PetscBagRegisterReal(pbag,&ps->avg_established,0.0,"avg_established","Average time in ESTABLISHED in ms from tcpstates");CHKERRQ(ierr);
+  ierr = PetscBagRegisterReal(pbag,&ps->cpu_seconds,0.0,"cpu_seconds","User plus system CPU time from /proc/<pid>/stat");CHKERRQ(ierr);
+  ierr = PetscBagRegisterReal(pbag,&ps->bytes_per_cpu_second,0.0,"bytes_per_cpu_second","Bytes sent and received per CPU-second");CHKERRQ(ierr);
+  ierr = PetscBagRegisterInt64(pbag,&ps->rss_kb,0,"rss_kb","Resident set size in kilobytes from /proc/<pid>/status");CHKERRQ(ierr);
+  ierr = PetscBagRegisterInt64(pbag,&ps->read_bytes,0,"read_bytes","Bytes read from storage from /proc/<pid>/io");CHKERRQ(ierr);
+  ierr = PetscBagRegisterInt64(pbag,&ps->write_bytes,0,"write_bytes","Bytes written to storage from /proc/<pid>/io");CHKERRQ(ierr);
+  ierr = PetscBagRegisterInt64(pbag,&ps->ctx_switches,0,"ctx_switches","Voluntary plus involuntary context switches");CHKERRQ(ierr);
+  ierr = PetscBagRegisterInt(pbag,&ps->app_rank,-1,"app_rank","Rank of the process in its MPI job, -1 if none");CHKERRQ(ierr);
+  ierr = PetscBagRegisterString(pbag,&ps->job_id,JOB_ID_LEN,"","job_id","ID of the batch or MPI job the process belongs to");CHKERRQ(ierr);
   ierr = PetscBagRegisterString(pbag,&ps->comm,COMM_MAX_LEN,"[unknown]","comm","Process name");CHKERRQ(ierr);
 
   *bag = pbag;
@@ -851,7 +1048,6 @@ PetscErrorCode create_process_summary_bag(process_data_summary **psumm, PetscBag
   PetscFunctionReturn(0);
 }
 
-
 PetscErrorCode buffer_gather_summaries(entry_buffer *buf)
 {
   PetscErrorCode ierr;
@@ -861,12 +1057,28 @@ PetscErrorCode buffer_gather_summaries(entry_buffer *buf)
 }
 
 #define summary_cpy(to,from) \
+  (to).pid = (from).pid;\
   (to).rank = (from).rank;\
   (to).tx_kb = (from).tx_kb;\
   (to).rx_kb = (from).rx_kb;\
   (to).n_event = (from).n_event;\
   (to).avg_latency = (from).avg_latency;\
+  (to).avg_lifetime = (from).avg_lifetime;\
   (to).fraction_ipv6 = (from).fraction_ipv6;\
+  (to).nretrans = (from).nretrans;\
+  (to).ndrop = (from).ndrop;\
+  (to).avg_rtt = (from).avg_rtt;\
+  (to).p99_rtt = (from).p99_rtt;\
+  (to).avg_handshake = (from).avg_handshake;\
+  (to).avg_established = (from).avg_established;\
+  (to).cpu_seconds = (from).cpu_seconds;\
+  (to).bytes_per_cpu_second = (from).bytes_per_cpu_second;\
+  (to).rss_kb = (from).rss_kb;\
+  (to).read_bytes = (from).read_bytes;\
+  (to).write_bytes = (from).write_bytes;\
+  (to).ctx_switches = (from).ctx_switches;\
+  (to).app_rank = (from).app_rank;\
+  PetscStrncpy((to).job_id,(from).job_id,JOB_ID_LEN);\
   PetscStrncpy((to).comm,(from).comm,COMM_MAX_LEN)
 
 PetscErrorCode buffer_gather(entry_buffer *buf, SERVER_MPI_DTYPE dtype)
@@ -875,6 +1087,7 @@ PetscErrorCode buffer_gather(entry_buffer *buf, SERVER_MPI_DTYPE dtype)
   PetscInt       rank,size,nitem=0,nextant=0,i,ires;
   process_data_summary *summaries=NULL,*summary,*ssummaries=NULL;
   PetscBag             bag;
+  PetscMPIInt          nsend,*counts=NULL,*displs=NULL;
   PetscFunctionBeginUser;
   MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
   MPI_Comm_size(PETSC_COMM_WORLD,&size);
@@ -883,7 +1096,7 @@ PetscErrorCode buffer_gather(entry_buffer *buf, SERVER_MPI_DTYPE dtype)
     /* only one process in the communicator; already on root */
     PetscFunctionReturn(0);
   }
-  /* prepare for MPI_Reduce() to get number of summaries coming into root */
+  /* prepare for MPI_Gather() to get the number of summaries coming into root */
   if (rank) {
     summs = 0;
     if (buf->num_items > INT_MAX) {
@@ -909,17 +1122,30 @@ PetscErrorCode buffer_gather(entry_buffer *buf, SERVER_MPI_DTYPE dtype)
     nextant = (PetscInt)buf->num_items;
   }
   
-  MPI_Reduce(&nitem,&summs,1,MPI_INT,MPI_SUM,0,PETSC_COMM_WORLD);
+  /* ranks send different numbers of summaries (none at all from the workers of
+     a node_share), so root needs every count to place them */
+  nsend = (PetscMPIInt)nitem;
+  if (!rank) {
+    ierr = PetscMalloc2(size,&counts,size,&displs);CHKERRQ(ierr);
+  }
+  MPI_Gather(&nsend,1,MPI_INT,counts,1,MPI_INT,0,PETSC_COMM_WORLD);
 
   if (!rank) {
+    for (i=0; i<size; ++i) {
+      displs[i] = (PetscMPIInt)summs;
+      summs += counts[i];
+    }
     if (nextant + summs >= buf->capacity) {
-      SETERRQ3(PETSC_COMM_WORLD,1,"Buffer on root has capacity %D, but currently holds %D entries and is being asked to accept %D more! Increase the buffer size on root.",buf->capacity,nextant,nitem);
+      SETERRQ3(PETSC_COMM_WORLD,1,"Buffer on root has capacity %D, but currently holds %D entries and is being asked to accept %D more! Increase the buffer size on root.",buf->capacity,nextant,summs);
     }
     ierr = PetscMalloc1((summs+nextant) * sizeof(summaries),&summaries);CHKERRQ(ierr);
   }
-  MPI_Gather(ssummaries,nitem,MPI_DTYPES[dtype],
-	     summaries,summs,MPI_DTYPES[dtype],
-	     0,PETSC_COMM_WORLD);
+  MPI_Gatherv(ssummaries,nsend,MPI_DTYPES[dtype],
+	      summaries,counts,displs,MPI_DTYPES[dtype],
+	      0,PETSC_COMM_WORLD);
+  if (!rank) {
+    ierr = PetscFree2(counts,displs);CHKERRQ(ierr);
+  }
   /* push the new summaries into the buffer */
   if (!rank) {
     for (i=0; i<summs; ++i) {
@@ -932,7 +1158,22 @@ PetscErrorCode buffer_gather(entry_buffer *buf, SERVER_MPI_DTYPE dtype)
       summary->rx_kb = summaries[i].rx_kb;
       summary->n_event = summaries[i].n_event;
       summary->avg_latency = summaries[i].avg_latency;
+      summary->avg_lifetime = summaries[i].avg_lifetime;
       summary->fraction_ipv6 = summaries[i].fraction_ipv6;
+      summary->nretrans = summaries[i].nretrans;
+      summary->ndrop = summaries[i].ndrop;
+      summary->avg_rtt = summaries[i].avg_rtt;
+      summary->p99_rtt = summaries[i].p99_rtt;
+      summary->avg_handshake = summaries[i].avg_handshake;
+      summary->avg_established = summaries[i].avg_established;
+      summary->cpu_seconds = summaries[i].cpu_seconds;
+      summary->bytes_per_cpu_second = summaries[i].bytes_per_cpu_second;
+      summary->rss_kb = summaries[i].rss_kb;
+      summary->read_bytes = summaries[i].read_bytes;
+      summary->write_bytes = summaries[i].write_bytes;
+      summary->ctx_switches = summaries[i].ctx_switches;
+      summary->app_rank = summaries[i].app_rank;
+      ierr = PetscStrncpy(summary->job_id,summaries[i].job_id,JOB_ID_LEN);CHKERRQ(ierr);
       ierr = PetscStrncpy(summary->comm,summaries[i].comm,COMM_MAX_LEN);CHKERRQ(ierr);
       
       ires = buffer_try_insert(buf,bag);
@@ -969,5 +1210,21 @@ PetscErrorCode summary_view(FILE *fd, process_data_summary *psum)
   PetscFPrintf(PETSC_COMM_WORLD,fd,"avg_latency   = %g\n",psum->avg_latency);
   PetscFPrintf(PETSC_COMM_WORLD,fd,"avg_lifetime  = %g\n",psum->avg_lifetime);
   PetscFPrintf(PETSC_COMM_WORLD,fd,"fraction_ipv6 = %.3g\n",psum->fraction_ipv6);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"nretrans      = %ld\n",psum->nretrans);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"ndrop         = %ld\n",psum->ndrop);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"avg_rtt       = %g\n",psum->avg_rtt);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"p99_rtt       = %g\n",psum->p99_rtt);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"avg_handshake = %g\n",psum->avg_handshake);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"avg_established = %g\n",psum->avg_established);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"cpu_seconds   = %g\n",psum->cpu_seconds);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"rss_kb        = %ld\n",psum->rss_kb);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"read_bytes    = %ld\n",psum->read_bytes);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"write_bytes   = %ld\n",psum->write_bytes);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"ctx_switches  = %ld\n",psum->ctx_switches);
+  PetscFPrintf(PETSC_COMM_WORLD,fd,"bytes_per_cpu_second = %g\n",psum->bytes_per_cpu_second);
+  if (psum->job_id[0] || psum->app_rank >= 0) {
+    PetscFPrintf(PETSC_COMM_WORLD,fd,"job_id        = %s\n",psum->job_id);
+    PetscFPrintf(PETSC_COMM_WORLD,fd,"app_rank      = %D\n",psum->app_rank);
+  }
   PetscFunctionReturn(0);
 }
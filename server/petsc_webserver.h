@@ -4,12 +4,24 @@
 #include <unistd.h>
 #include <petsc/private/hashtable.h>
 #include <petsc/private/hashmap.h>
+#include "entry_schema.h"
 
 #define IP_ADDR_MAX_LEN 45
 #define COMM_MAX_LEN    PETSC_MAX_PATH_LEN
+#define JOB_ID_LEN      64
 
-typedef enum {TCPACCEPT,TCPCONNECT,TCPCONNLAT,TCPLIFE,TCPRETRANS} InputType;
-static const char *InputTypes[] = {"ACCEPT","CONNECT","CONNLAT","LIFE","RETRANS","TCP",0};
+typedef enum {TCPACCEPT,TCPCONNECT,TCPCONNLAT,TCPLIFE,TCPRETRANS,TCPSTATES,TCPRTT,TCPDROP} InputType;
+static const char *InputTypes[] = {"ACCEPT","CONNECT","CONNLAT","LIFE","RETRANS","STATES","RTT","DROP","TCP",0};
+
+/* the kernel's TCP states, indexed by their numbers in include/net/tcp_states.h */
+#define NUM_TCP_STATES 13
+#define TCP_STATE_LEN  16
+static const char *TcpStates[] = {"UNKNOWN","ESTABLISHED","SYN_SENT","SYN_RECV","FIN_WAIT1","FIN_WAIT2",
+				  "TIME_WAIT","CLOSE","CLOSE_WAIT","LAST_ACK","LISTEN","CLOSING",
+				  "NEW_SYN_RECV",0};
+
+/* returns the number of the TCP state named by the parameter, or 0 if it is not a state name */
+extern PetscInt tcp_state_from_name(const char *);
 
 typedef enum 
   {
@@ -18,10 +30,16 @@ typedef enum
    DTYPE_CONNLAT=2,
    DTYPE_LIFE=3,
    DTYPE_RETRANS=4,
-   DTYPE_SUMMARY=5
+   DTYPE_SUMMARY=5,
+   DTYPE_GROUP_ROW=6,
+   DTYPE_NODE=7,
+   DTYPE_STATES=8,
+   DTYPE_RTT=9,
+   DTYPE_DROP=10,
+   NUM_SERVER_MPI_DTYPES=11
   } SERVER_MPI_DTYPE;
 
-MPI_Datatype MPI_DTYPES[6];
+extern MPI_Datatype MPI_DTYPES[NUM_SERVER_MPI_DTYPES];
 
 /* call this at the beginning of the program, but after MPI_Init(), for 
    any program that needs to send any of the XXX_entry types here, as well
@@ -29,10 +47,7 @@ MPI_Datatype MPI_DTYPES[6];
    and indexed by the SERVER_MPI_DTYPES enum. */
 extern PetscErrorCode register_mpi_types();
 
-typedef struct {
-  PetscInt pid, ip, rport, lport;
-  char     laddr[IP_ADDR_MAX_LEN],raddr[IP_ADDR_MAX_LEN],comm[COMM_MAX_LEN];
-} tcpaccept_entry;
+ENTRY_STRUCT(tcpaccept_entry,TCPACCEPT_ENTRY_FIELDS);
 
 /* creates a PetscBag with PetscBagCreate() to serialize a
    tcpaccept_entry, and stores  a pointer to that entry
@@ -49,10 +64,7 @@ extern PetscErrorCode create_tcpaccept_entry_bag(tcpaccept_entry **, PetscBag *,
    and the result is written to the first parameter */
 extern PetscErrorCode tcpaccept_entry_parse_line(tcpaccept_entry *, char *);
 
-typedef struct {
-  PetscInt pid,ip,dport;
-  char     saddr[IP_ADDR_MAX_LEN],daddr[IP_ADDR_MAX_LEN],comm[COMM_MAX_LEN];
-} tcpconnect_entry;
+ENTRY_STRUCT(tcpconnect_entry,TCPCONNECT_ENTRY_FIELDS);
 
 /* creates a PetscBag with PetscBagCreate() to serialize a
    tcpconnect_entry, and stores  a pointer to that entry
@@ -69,11 +81,7 @@ extern PetscErrorCode create_tcpconnect_entry_bag(tcpconnect_entry **, PetscBag
    and the result is written to the first parameter */
 extern PetscErrorCode tcpconnect_entry_parse_line(tcpconnect_entry *, char *);
 
-typedef struct {
-  PetscInt  pid,ip,dport;
-  PetscReal lat_ms;
-  char      saddr[IP_ADDR_MAX_LEN],daddr[IP_ADDR_MAX_LEN],comm[COMM_MAX_LEN];
-} tcpconnlat_entry;
+ENTRY_STRUCT(tcpconnlat_entry,TCPCONNLAT_ENTRY_FIELDS);
 
 /* creates a PetscBag with PetscBagCreate() to serialize a
    tcpconnlat_entry, and stores  a pointer to that entry
@@ -89,13 +97,8 @@ extern PetscErrorCode create_tcpconnlat_entry_bag(tcpconnlat_entry **, PetscBag
    which is stored in the second parameter, 
    and the result is written to the first parameter */
 extern PetscErrorCode tcpconnlat_entry_parse_line(tcpconnlat_entry *, char *);
-#define TIME_LEN 9
 
-typedef struct {
-  PetscInt  pid,ip,lport,rport,tx_kb,rx_kb;
-  PetscReal ms;
-  char      laddr[IP_ADDR_MAX_LEN],raddr[IP_ADDR_MAX_LEN],comm[COMM_MAX_LEN],time[TIME_LEN];
-} tcplife_entry;
+ENTRY_STRUCT(tcplife_entry,TCPLIFE_ENTRY_FIELDS);
 
 /* creates a PetscBag with PetscBagCreate() to serialize a
    tcplife_entry, and stores  a pointer to that entry
@@ -117,11 +120,7 @@ extern PetscErrorCode create_tcplife_entry_bag(tcplife_entry **, PetscBag *, Pet
    whose input is space-delimited. */
 extern PetscErrorCode tcplife_entry_parse_line(tcplife_entry *, char *);
 
-
-typedef struct {
-  PetscInt pid,ip;
-  char     laddr_port[COMM_MAX_LEN],raddr_port[COMM_MAX_LEN],state[COMM_MAX_LEN];/* TODO: find out how long these really should be, cuz this is longer than necessary. not too important though. */
-} tcpretrans_entry;
+ENTRY_STRUCT(tcpretrans_entry,TCPRETRANS_ENTRY_FIELDS);
 
 /* creates a PetscBag with PetscBagCreate() to serialize a
    tcpretrans_entry, and stores  a pointer to that entry
@@ -132,9 +131,59 @@ typedef struct {
    same. */
 extern PetscErrorCode create_tcpretrans_entry_bag(tcpretrans_entry **, PetscBag *, PetscInt);
 
-
+/* parses a line of the form
+   [TIME] PID [COMM] IP LADDR:LPORT T> RADDR:RPORT STATE
+   (the output of `tcpretrans`, where T is R for a retransmit and L for a
+   tail loss probe) which is stored in the second parameter, and the result
+   is written to the first parameter. Returns non-zero for header lines. */
 extern PetscErrorCode tcpretrans_entry_parse_line(tcpretrans_entry *, char *);
 
+ENTRY_STRUCT(tcpstates_entry,TCPSTATES_ENTRY_FIELDS);
+
+/* creates a PetscBag to serialize a tcpstates_entry; the parameters are
+   the same as those of create_tcpaccept_entry_bag() */
+extern PetscErrorCode create_tcpstates_entry_bag(tcpstates_entry **, PetscBag *, PetscInt);
+
+/* parses a line of the form
+   [TIME] SKADDR PID COMM LADDR LPORT RADDR RPORT OLDSTATE -> NEWSTATE MS
+   (the output of `tcpstates`, with or without -T or -t) which is stored in
+   the second parameter, and the result is written to the first parameter.
+   Returns non-zero for header lines. */
+extern PetscErrorCode tcpstates_entry_parse_line(tcpstates_entry *, char *);
+
+/* log2 buckets of RTT in microseconds: bucket i holds RTTs below 2^i us */
+#define TCP_RTT_HIST_BINS 32
+
+ENTRY_STRUCT(tcprtt_entry,TCPRTT_ENTRY_FIELDS);
+
+/* creates a PetscBag to serialize a tcprtt_entry; the parameters are
+   the same as those of create_tcpaccept_entry_bag() */
+extern PetscErrorCode create_tcprtt_entry_bag(tcprtt_entry **, PetscBag *, PetscInt);
+
+/* parses one line of the histograms printed by `tcprtt`, e.g.
+        usecs               : count     distribution
+            8 -> 15         : 3        |*****                 |
+   Every row with a non-zero count is an event, and is written to the first
+   parameter. Unit lines (usecs/msecs) and section headers ("Remote Addres = ...")
+   are remembered in the entry for the rows that follow them, so the same entry
+   must be passed for every line of a file. Returns non-zero for lines that are
+   not histogram rows. */
+extern PetscErrorCode tcprtt_entry_parse_line(tcprtt_entry *, char *);
+
+#define TCP_FLAGS_LEN 32
+
+ENTRY_STRUCT(tcpdrop_entry,TCPDROP_ENTRY_FIELDS);
+
+/* creates a PetscBag to serialize a tcpdrop_entry; the parameters are
+   the same as those of create_tcpaccept_entry_bag() */
+extern PetscErrorCode create_tcpdrop_entry_bag(tcpdrop_entry **, PetscBag *, PetscInt);
+
+/* parses a line of the form
+   [TIME] PID IP SADDR:SPORT > DADDR:DPORT STATE (FLAGS)
+   (the output of `tcpdrop`) which is stored in the second parameter, and the
+   result is written to the first parameter. The kernel stack lines that
+   follow each drop return non-zero, as do header lines. */
+extern PetscErrorCode tcpdrop_entry_parse_line(tcpdrop_entry *, char *);
 
 typedef struct {
   /* a circular buffer */
@@ -192,11 +241,14 @@ extern PetscErrorCode buffer_gather_summaries(entry_buffer *);
    undefined behavior in the MPI_Gather(), and probably cause a crash */
 extern PetscErrorCode buffer_gather(entry_buffer *, SERVER_MPI_DTYPE);
 
-
 typedef struct {
   long long naccept,nconnect,nconnlat,nlife,nretrans,
             tx_kb,rx_kb,nipv4,nipv6;
   PetscReal latms,lifems;
+  /* tcpstates: time spent in the handshake, established and closing states */
+  long long nstates,nhandshake,nestablished,nclosing,ndrop,nrtt;
+  PetscReal handshake_ms,established_ms,closing_ms,rttus;
+  long long rtt_hist[TCP_RTT_HIST_BINS];
   char      comm[COMM_MAX_LEN];
 } process_data;
 
@@ -204,6 +256,16 @@ typedef struct {
   PetscInt  pid,rank;
   long      tx_kb,rx_kb,n_event;
   PetscReal avg_latency,avg_lifetime,fraction_ipv6;
+  /* from tcpretrans, tcpdrop, tcprtt and tcpstates; times in ms */
+  long      nretrans,ndrop;
+  PetscReal avg_rtt,p99_rtt,avg_handshake,avg_established;
+  /* from /proc, filled in by proc_sampler_summarize() */
+  PetscReal cpu_seconds,bytes_per_cpu_second;
+  long      rss_kb,read_bytes,write_bytes,ctx_switches;
+  /* the MPI job and rank of the process, filled in by job_resolver_summarize();
+     app_rank is -1 and job_id empty if it is not part of a job */
+  PetscInt  app_rank;
+  char      job_id[JOB_ID_LEN];
   char      comm[COMM_MAX_LEN];
 } process_data_summary;
 
@@ -218,7 +280,6 @@ extern PetscErrorCode process_data_summarize(PetscInt, process_data *, process_d
 
 #define pid_hash(pid) pid
 
-
 #define process_data_equal(lhs,rhs) ( lhs.naccept == rhs.naccept && \
 				      lhs.nconnect == rhs.nconnect &&	\
 				      lhs.nconnlat == rhs.nconnlat && \
@@ -232,7 +293,7 @@ extern PetscErrorCode process_data_summarize(PetscInt, process_data *, process_d
 
 #define int_equal(lhs,rhs) (lhs == rhs)
 
-static process_data default_pdata = {0,0,0,0,0,0,0,0,0,0.0,0.0,"[unknown]"};
+static process_data default_pdata = {0,0,0,0,0,0,0,0,0,0.0,0.0,0,0,0,0,0,0,0.0,0.0,0.0,0.0,{0},"[unknown]"};
 
 PETSC_HASH_MAP(HMapData,PetscInt,process_data,PetscHashInt,int_equal,default_pdata);
 
@@ -247,8 +308,11 @@ extern PetscErrorCode create_process_data_bag(process_data **, PetscBag *);
 /* the third parameter is the MPI_Comm rank, fourth is the number of the entry*/
 extern PetscErrorCode create_process_summary_bag(process_data_summary **, PetscBag *, PetscInt, PetscInt);
 
+typedef struct process_tree_s process_tree;
+
 typedef struct {
   PetscHMapData ht;
+  process_tree  *tree; /* if not NULL, every event is also credited to the PID's ancestors there, see process_tree.h */
 } process_statistics;
 
 extern PetscErrorCode process_statistics_get_summary(process_statistics *, PetscInt, process_data_summary *);
@@ -258,12 +322,20 @@ extern PetscErrorCode process_statistics_num_entries(process_statistics *, Petsc
 /* second and third parameters are pointers to array of process_data and PetscInt (pid) respectively, each of the length retrieved from process_statistics_num_entries() */
 extern PetscErrorCode process_statistics_get_all(process_statistics *, process_data *, PetscInt *);
 
-
 extern PetscErrorCode process_statistics_init(process_statistics *);
 
 extern PetscErrorCode process_statistics_destroy(process_statistics *);
 
-extern PetscErrorCode process_statistics_add_pdata(process_statistics *, process_data *);
+/* adds the counts and sums of the process_data in the third parameter to those of
+   the PID in the second, e.g. to merge tables filled by different ranks */
+extern PetscErrorCode process_statistics_add_pdata(process_statistics *, PetscInt, process_data *);
+
+/* drops every PID from the process_statistics (but not from its tree's rollup) */
+extern PetscErrorCode process_statistics_clear(process_statistics *);
+
+/* drops the PID in the second parameter from the process_statistics and from its
+   tree and the tree's rollup, if any */
+extern PetscErrorCode process_statistics_remove(process_statistics *, PetscInt);
 
 extern PetscErrorCode process_statistics_add_accept(process_statistics *,
 						    tcpaccept_entry *);
@@ -280,22 +352,35 @@ extern PetscErrorCode process_statistics_add_life(process_statistics *,
 extern PetscErrorCode process_statistics_add_retrans(process_statistics *,
 						     tcpretrans_entry *);
 
+extern PetscErrorCode process_statistics_add_states(process_statistics *,
+						    tcpstates_entry *);
+
+extern PetscErrorCode process_statistics_add_rtt(process_statistics *,
+						 tcprtt_entry *);
+
+extern PetscErrorCode process_statistics_add_drop(process_statistics *,
+						  tcpdrop_entry *);
+
+/* credits the kilobytes sent and received and the retransmits in the last three
+   parameters to the PID in the second parameter, whose name is in the third. For
+   collectors that see running totals (e.g. sock_diag) rather than events. */
+extern PetscErrorCode process_statistics_add_traffic(process_statistics *, PetscInt, const char *,
+						     long long, long long, long long);
+
 extern PetscErrorCode process_statistics_get_pid_data(process_statistics *,
 						      PetscInt,
 						      process_data *);
 						      
 
 typedef struct {
-  FILE *file;
-  long offset;
+  FILE      *file;
+  long      offset;
+  PetscBool behind; /* whether the last read stopped short of the end (see --backfill_chunk) */
 } file_wrapper;
 
-
 extern long get_file_end_offset(file_wrapper *);
 
 /* returns 0 if no new data; if the return value is non-zero, it is the difference between the new and old end-of-file. However, the file is moved back to the old end, so you can read the new data. */
 extern long has_new_data(file_wrapper *);
 
-
-
 #endif
@@ -8,23 +8,128 @@ import argparse
 import jsonpickle
 from typing import NamedTuple
 import operator
+import heapq
+import functools
+import threading
+from array import array
+from email.utils import formatdate, parsedate_to_datetime
+import history_reader
+import snapshot_reader
 
 app = Flask(__name__)
 
 entries = {}
 entries_by_name = {}
+entries_by_job = {}
+node_entries = {}
 
 datafile = '/opt/tcpsummary'
+history_prefix = None
+shm_segment = None
+
+# what the dicts above were parsed from (see data_version()), so that they are
+# only rebuilt when it changes
+parsed_version = None
+# Flask serves each request on a thread of its own: the dicts (and
+# snapshot_epoch) are swapped for new ones, and parsed_version, shm_seen and the
+# response cache changed, only while holding it
+data_lock = threading.Lock()
+# the responses served for the current version, by request path and query string
+response_cache = {}
+response_cache_version = None
+RESPONSE_CACHE_SIZE = 1024
+# when a shared memory sequence number was first seen, as its Last-Modified
+shm_seen = (None, 0.0)
+# the epoch of the snapshot the dicts were parsed from; 0 for a text file
+snapshot_epoch = 0
+# the (inode, mtime) of the progress file last read, and what it said
+progress_seen = (None, None)
+
+def entry_from_record(rec):
+    return Entry(rec['rank'],rec['pid'],rec['name'],rec['tx_kb'],rec['rx_kb'],rec['n_event'],
+                 rec['avg_latency'],rec['avg_lifetime'],rec['fraction_ipv6'] * 100,
+                 **{key : rec[key] for key in OPTIONAL_FIELDS})
+
+def open_snapshot(filename):
+    """The current snapshot, from shared memory (with --shm) or the file, or
+    None if the file is text."""
+    if shm_segment is not None:
+        return shm_segment.read()
+    if snapshot_reader.is_snapshot(filename):
+        return snapshot_reader.Snapshot(filename)
+    return None
+
+def data_version(filename):
+    """What the summaries are at the moment, in O(1): the sequence number of the
+    shared memory segment with --shm, or else the file's (inode, mtime, size),
+    which change whenever the driver renames a new file into place. Also when
+    that was, in seconds since the epoch."""
+    global shm_seen
+    if shm_segment is not None:
+        seq = shm_segment.sequence()
+        if shm_seen[0] != seq:
+            shm_seen = (seq, time.time())
+        return ('shm', seq), shm_seen[1]
+    st = os.stat(filename)
+    return (st.st_ino, st.st_mtime_ns, st.st_size), st.st_mtime
+
+def read_snapshot(snap):
+    """Returns the dicts above and snapshot_epoch, as parsed from snap."""
+    entries, entries_by_name, entries_by_job, node_entries = {}, {}, {}, {}
+    if snap is None:
+        return entries, entries_by_name, entries_by_job, node_entries, 0
+    with snap:
+        for rec in snap.records():
+            entr = entry_from_record(rec)
+            entries.setdefault(entr.rank,{})[entr.pid] = entr
+            entries_by_name.setdefault(entr.name,[]).append(entr)
+            if entr.job_id or entr.app_rank >= 0:
+                entries_by_job.setdefault((entr.job_id, entr.app_rank),[]).append(entr)
+        for node in snap.nodes():
+            node_entries[node['rank']] = node
+        return entries, entries_by_name, entries_by_job, node_entries, snap.epoch
 
 def read_file(filename):
+    """Parses the summaries into the dicts above, unless they already hold the
+    current version of them. A request that is served while another one parses
+    waits for it rather than parsing the same version again."""
+    global parsed_version
     global entries
     global entries_by_name
+    global entries_by_job
+    global node_entries
+    global snapshot_epoch
+    with data_lock:
+        version, _ = data_version(filename)
+        if version == parsed_version:
+            return
+        parsed = parse_file(filename)
+        entries, entries_by_name, entries_by_job, node_entries, snapshot_epoch = parsed
+        # a change while parsing only costs one more parse
+        parsed_version = version
+
+def parse_file(filename):
+    """Returns the dicts above and snapshot_epoch, as parsed from filename."""
+    if shm_segment is not None or snapshot_reader.is_snapshot(filename):
+        return read_snapshot(open_snapshot(filename))
+    entries, entries_by_name, entries_by_job, node_entries = {}, {}, {}, {}
     lines = open(filename,'r').readlines()
     lines_per_entry = 7 #7 data fields and a header
     N = len(lines)
     i = 0
     while i < N:
-        if lines[i].startswith('Summary of network traffic on rank '):
+        if lines[i].startswith('Node summary of rank '):
+            m = NODE_HEADER.match(lines[i])
+            node = {'rank' : int(m.group(1)), 'host' : m.group(2), 'interval' : float(m.group(3)), 'counters' : {}}
+            while i + 1 < N:
+                c = NODE_COUNTER.match(lines[i+1])
+                if not c:
+                    break
+                i += 1
+                node['counters'][c.group(1)] = {'total' : int(c.group(2)), 'rate' : float(c.group(3)),
+                                                'peak_rate' : float(c.group(4))}
+            node_entries[node['rank']] = node
+        elif lines[i].startswith('Summary of network traffic on rank '):
             if i + lines_per_entry >= N:
                 print(f"Error, found early-terminated entry starting with header {lines[i]}")
                 break #start of an entry, but no end; something went wrong
@@ -59,10 +164,16 @@ def read_file(filename):
             i += 1
             spl = lines[i].split('= ')
             fraction_ipv6 = float(spl[1])
+            # the TCP state/RTT and /proc fields follow, one 'key = value' line each
+            proc = {}
+            while i + 1 < N and lines[i+1].split('=')[0].strip() in OPTIONAL_FIELDS:
+                i += 1
+                key, value = [x.strip() for x in lines[i].split('=',1)]
+                proc[key] = OPTIONAL_FIELDS[key](value)
             #val = [name,tx_kb,rx_kb,n_event,
             #       avg_lat,avg_life,fraction_ipv6]
             entr = Entry(mpi_rank,pid,name,tx_kb,rx_kb,n_event,
-                         avg_lat,avg_life,fraction_ipv6 * 100)
+                         avg_lat,avg_life,fraction_ipv6 * 100,**proc)
 
             if mpi_rank in entries:
                 entries[mpi_rank][pid] = entr
@@ -73,11 +184,27 @@ def read_file(filename):
                 entries_by_name[name].append(entr)
             else:
                 entries_by_name[name] = [entr]
-            
-            
+
+            if entr.job_id or entr.app_rank >= 0:
+                key = (entr.job_id, entr.app_rank)
+                entries_by_job.setdefault(key,[]).append(entr)
+
         i += 1
+    return entries, entries_by_name, entries_by_job, node_entries, 0
+
+
+NODE_HEADER = re.compile(r'Node summary of rank (\d+) on host (\S+) over (\S+) seconds:')
+NODE_COUNTER = re.compile(r'(\w+)\s+= (-?\d+) \((\S+)/s, peak (\S+)/s\)')
 
+PROC_FIELDS = {'cpu_seconds' : float, 'rss_kb' : int, 'read_bytes' : int,
+               'write_bytes' : int, 'ctx_switches' : int, 'bytes_per_cpu_second' : float}
 
+TCP_FIELDS = {'nretrans' : int, 'ndrop' : int, 'avg_rtt' : float, 'p99_rtt' : float,
+              'avg_handshake' : float, 'avg_established' : float}
+
+JOB_FIELDS = {'job_id' : str, 'app_rank' : int}
+
+OPTIONAL_FIELDS = {**TCP_FIELDS, **PROC_FIELDS, **JOB_FIELDS}
 
 class Entry(NamedTuple):
     rank: int = 0
@@ -89,6 +216,20 @@ class Entry(NamedTuple):
     avg_lat: float = 0.0
     avg_life: float = 0.0
     pct_ipv6: float = 0.0
+    nretrans: int = 0
+    ndrop: int = 0
+    avg_rtt: float = 0.0
+    p99_rtt: float = 0.0
+    avg_handshake: float = 0.0
+    avg_established: float = 0.0
+    cpu_seconds: float = 0.0
+    rss_kb: int = 0
+    read_bytes: int = 0
+    write_bytes: int = 0
+    ctx_switches: int = 0
+    bytes_per_cpu_second: float = 0.0
+    job_id: str = ''
+    app_rank: int = -1
 
     def __repr__(self):
         return self.formatted()
@@ -129,6 +270,48 @@ class Entry(NamedTuple):
   <tr>
     {data('Percent IPv6')}{data(f'{self.pct_ipv6:2.2f}')}
   </tr>
+  <tr>
+    {data('Retransmits')}{data(self.nretrans)}
+  </tr>
+  <tr>
+    {data('Drops')}{data(self.ndrop)}
+  </tr>
+  <tr>
+    {data('Average RTT (ms)')}{data(self.avg_rtt)}
+  </tr>
+  <tr>
+    {data('99th Percentile RTT (ms)')}{data(self.p99_rtt)}
+  </tr>
+  <tr>
+    {data('Average Handshake Time (ms)')}{data(self.avg_handshake)}
+  </tr>
+  <tr>
+    {data('Average Time Established (ms)')}{data(self.avg_established)}
+  </tr>
+  <tr>
+    {data('CPU Time (s)')}{data(self.cpu_seconds)}
+  </tr>
+  <tr>
+    {data('Resident Memory (kB)')}{data(self.rss_kb)}
+  </tr>
+  <tr>
+    {data('Storage Bytes Read')}{data(self.read_bytes)}
+  </tr>
+  <tr>
+    {data('Storage Bytes Written')}{data(self.write_bytes)}
+  </tr>
+  <tr>
+    {data('Context Switches')}{data(self.ctx_switches)}
+  </tr>
+  <tr>
+    {data('Network Bytes per CPU-second')}{data(f'{self.bytes_per_cpu_second:.1f}')}
+  </tr>
+  <tr>
+    {data('Job')}{data(self.job_id)}
+  </tr>
+  <tr>
+    {data('Application Rank')}{data(self.app_rank)}
+  </tr>
 </table>
 
         '''
@@ -145,6 +328,20 @@ _________________________________________________________________
 |        Average connection latency  = {self.avg_lat:8.2f}                 |
 |        Average connection lifetime = {self.avg_life:8.2f}                 |
 |        Percent IPv6............... = {self.pct_ipv6:2.2f}                    |
+|        retransmits................ = {self.nretrans:8d}                 |
+|        drops...................... = {self.ndrop:8d}                 |
+|        Average RTT (ms)........... = {self.avg_rtt:8.2f}                 |
+|        99th percentile RTT (ms)... = {self.p99_rtt:8.2f}                 |
+|        Average handshake (ms)..... = {self.avg_handshake:8.2f}                 |
+|        Average established (ms)... = {self.avg_established:8.2f}                 |
+|        CPU seconds................ = {self.cpu_seconds:8.2f}                 |
+|        resident kB................ = {self.rss_kb:8d}                 |
+|        storage bytes read......... = {self.read_bytes:12d}             |
+|        storage bytes written...... = {self.write_bytes:12d}             |
+|        context switches........... = {self.ctx_switches:8d}                 |
+|        network bytes per CPU-sec.. = {self.bytes_per_cpu_second:10.1f}               |
+|        job........................ = {self.job_id:15s}          |
+|        application rank........... = {self.app_rank:8d}                 |
 |_______________________________________________________________|
         """
         return fstr
@@ -198,8 +395,11 @@ def table(entry_pairs):
     html += '</table>'
     return html
 
+def all_entries():
+    return [e for rk in entries.values() for e in rk.values()]
+
 def get_max(attr):
-    return max(entries.values(),key=operator.attrgetter(attr))
+    return max(all_entries(),key=operator.attrgetter(attr))
 
 def get_max_from(dct, attr):
     return max(dct.values(),key=operator.attrgetter(attr))
@@ -208,7 +408,7 @@ def get_max_transmitter():
     return get_max('tx_kb')
 
 def get_max_receiver():
-    return get_max('rb_kx')
+    return get_max('rx_kb')
 
 def get_max_event():
     return get_max('nevent')
@@ -221,7 +421,63 @@ def get_max_lifetime():
 
 
         
+def etag_matches(header, etag):
+    for tag in header.split(','):
+        tag = tag.strip()
+        if tag == '*' or (tag[2:] if tag.startswith('W/') else tag) == etag:
+            return True
+    return False
+
+def not_modified(etag, mtime):
+    """Whether the conditional headers of the request say the client has the
+    current version: If-None-Match, or else If-Modified-Since."""
+    if 'If-None-Match' in request.headers:
+        return etag_matches(request.headers['If-None-Match'],etag)
+    if 'If-Modified-Since' in request.headers:
+        try:
+            return int(mtime) <= parsedate_to_datetime(request.headers['If-Modified-Since']).timestamp()
+        except (TypeError, ValueError):
+            return False
+    return False
+
+def conditional(view):
+    """Serves a view of the summaries in datafile with an ETag and Last-Modified
+    of their version. While that does not change, a conditional GET gets 304 and
+    a repeated one the response served the first time, both without reading the
+    file."""
+    @functools.wraps(view)
+    def wrapper(*args, **kwargs):
+        global response_cache_version
+        key = request.full_path
+        with data_lock:
+            version, mtime = data_version(datafile)
+            if response_cache_version != version:
+                response_cache.clear()
+                response_cache_version = version
+            cached = response_cache.get(key)
+        etag = '"' + '-'.join(f'{x:x}' if isinstance(x,int) else str(x) for x in version) + '"'
+        headers = {'ETag' : etag, 'Last-Modified' : formatdate(mtime,usegmt=True), 'Cache-Control' : 'no-cache'}
+        if not_modified(etag,mtime):
+            return Response(status=304,headers=headers)
+        if cached is None:
+            resp = app.make_response(view(*args,**kwargs))
+            if resp.status_code != 200:
+                resp.headers.update(headers)
+                return resp
+            cached = (resp.get_data(), resp.mimetype)
+            with data_lock:
+                # only if the view was served from the version the ETag is of,
+                # which a new version read in the meantime would have replaced
+                if parsed_version == version and response_cache_version == version:
+                    if len(response_cache) >= RESPONSE_CACHE_SIZE:
+                        response_cache.clear()
+                    response_cache[key] = cached
+        data, mimetype = cached
+        return Response(response=data,status=200,mimetype=mimetype,headers=headers)
+    return wrapper
+
 @app.route('/')
+@conditional
 def root():
     read_file(datafile)
     return make_entry_table()
@@ -231,6 +487,7 @@ def good_response(resp):
     return Response(response=jsonpickle.encode({'response' : resp}),status=200,mimetype='application/json')
 
 @app.route('/api/get/all',methods=['GET'])
+@conditional
 def get_all():
     read_file(datafile)
     resp = format_entries()
@@ -242,7 +499,18 @@ def key_not_found_response(key,dname):
     return Response(response=jsonpickle.encode({'error' : resp}),status=404,mimetype='application/json')
 
 @app.route('/api/get/<int:rank>/<int:pid>',methods=['GET'])
+@conditional
 def get(rank,pid):
+    if shm_segment is not None or snapshot_reader.is_snapshot(datafile):
+        # one binary search in the snapshot, rather than reading all of it
+        snap = open_snapshot(datafile)
+        rec = None
+        if snap is not None:
+            with snap:
+                rec = snap.find(rank,pid)
+        if rec is None:
+            return key_not_found_response(f'{rank}/{pid}','entries')
+        return good_response(entry_from_record(rec).formatted())
     read_file(datafile)
     try:
         entry = entries[rank]
@@ -260,7 +528,128 @@ def get(rank,pid):
 
 
 
+# the keys /api/select sorts by, and the Entry fields they are
+SORT_KEYS = {'tx_kb' : 'tx_kb', 'rx_kb' : 'rx_kb', 'n_event' : 'nevent', 'avg_latency' : 'avg_lat'}
+
+# the Entry field of each field of a summary (in /api/select and /api/export)
+# that is not named the same
+EXPORT_FIELDS = {'n_event' : 'nevent', 'avg_latency' : 'avg_lat', 'avg_lifetime' : 'avg_life'}
+
+# the fields of an /api/select row, in the order the native server writes them
+SELECT_FIELDS = ('rank', 'pid', 'name', 'tx_kb', 'rx_kb', 'n_event', 'avg_latency', 'avg_lifetime',
+                 'fraction_ipv6', 'nretrans', 'ndrop', 'avg_rtt', 'p99_rtt', 'avg_handshake',
+                 'avg_established', 'cpu_seconds', 'rss_kb', 'read_bytes', 'write_bytes',
+                 'ctx_switches', 'bytes_per_cpu_second', 'job_id', 'app_rank')
+
+def summary_fields(e):
+    """The entry as the native server writes a summary: under the names of
+    process_data_summary, fraction_ipv6 as a fraction and no value (NaN) as null."""
+    row = {}
+    for field in SELECT_FIELDS:
+        x = e.pct_ipv6 / 100 if field == 'fraction_ipv6' else getattr(e,EXPORT_FIELDS.get(field,field))
+        row[field] = None if isinstance(x,float) and not math.isfinite(x) else x
+    return row
+
+def select_entries(name=None, rank=None, pid_min=None, pid_max=None, sort=None, desc=True, offset=0, limit=None):
+    """The entries that match every filter given, sorted by the Entry field sort
+    (those without a value, NaN, last) or else by (rank, pid), from the offset'th
+    on, at most limit of them. Largest first with a limit is heapq.nlargest(),
+    O(N log k) rather than a sort of all of them."""
+    if rank is not None:
+        candidates = list(entries.get(rank,{}).values())
+    elif name is not None:
+        candidates = entries_by_name.get(name,[])
+    else:
+        candidates = all_entries()
+    matches = [e for e in candidates
+               if (name is None or e.name == name) and (rank is None or e.rank == rank)
+               and (pid_min is None or e.pid >= pid_min) and (pid_max is None or e.pid <= pid_max)]
+    end = None if limit is None else offset + limit
+    if sort is None:
+        matches.sort(key=lambda e: (e.rank, e.pid))
+        return matches[offset:end]
+    valued = [e for e in matches if not math.isnan(getattr(e,sort))]
+    missing = sorted((e for e in matches if math.isnan(getattr(e,sort))),key=lambda e: (e.rank, e.pid))
+    # equal values in (rank, pid) order largest first, and the other way smallest
+    # first, like the native server
+    key = lambda e: (getattr(e,sort), -e.rank, -e.pid)
+    if desc:
+        valued = heapq.nlargest(end,valued,key=key) if end is not None else sorted(valued,key=key,reverse=True)
+    else:
+        valued = heapq.nsmallest(end,valued,key=key) if end is not None else sorted(valued,key=key)
+    return (valued + missing)[offset:end]
+
+def bad_request(resp):
+    return Response(response=jsonpickle.encode({'error' : resp}),status=400,mimetype='application/json')
+
+@app.route('/api/select',methods=['GET'])
+@conditional
+def select():
+    """Filters (name, rank, pid_min, pid_max), sorts (sort, order) and pages
+    (offset, limit, or top for the largest) the entries; see petsc_mongoose.h."""
+    args = {}
+    try:
+        for arg in ('rank', 'pid_min', 'pid_max', 'offset', 'limit', 'top'):
+            if arg in request.args:
+                args[arg] = int(request.args[arg])
+    except ValueError:
+        return bad_request('rank, pid_min, pid_max, offset, limit and top must be integers')
+    if args.get('offset',0) < 0 or args.get('limit',0) < 0 or args.get('top',0) < 0:
+        return bad_request('offset, limit and top must not be negative')
+    sort = request.args.get('sort')
+    if sort is not None and sort not in SORT_KEYS:
+        return bad_request(f'Unknown sort key {sort}; use {", ".join(SORT_KEYS)}')
+    order = request.args.get('order','desc')
+    if order not in ('asc', 'desc'):
+        return bad_request('order must be asc or desc')
+    if 'top' in args:
+        args['limit'] = args['top']
+        sort = sort or 'tx_kb'
+    read_file(datafile)
+    selected = select_entries(request.args.get('name'),args.get('rank'),args.get('pid_min'),args.get('pid_max'),
+                              SORT_KEYS.get(sort),order == 'desc',args.get('offset',0),args.get('limit'))
+    return good_response([summary_fields(e) for e in selected])
+
+def export_entries(since):
+    """The entries as the columns of the native server's /api/export (see
+    petsc_mongoose.h). The backend keeps no history, so a scraper that has the
+    current epoch gets no rows, and any other gets all of them."""
+    full = not (snapshot_epoch and since == snapshot_epoch)
+    rows = sorted(all_entries(),key=lambda e: (e.rank, e.pid)) if full else []
+    names = {}
+    for e in rows:
+        names.setdefault(e.name,len(names))
+        names.setdefault(e.job_id,len(names))
+    strings = b''.join(n.encode() + b'\0' for n in names)
+    def pad(b):
+        return b + bytes(-len(b) % 8)
+    parts = [snapshot_reader.EXPORT_HEADER.pack(snapshot_reader.EXPORT_MAGIC,snapshot_reader.EXPORT_VERSION,
+                                                int(full),snapshot_epoch,0 if full else since,len(rows),0,
+                                                len(names),len(strings)),
+             pad(strings)]
+    for field, fmt in snapshot_reader.EXPORT_COLUMNS:
+        if field in ('name', 'job_id'):
+            values = [names[getattr(e,field)] for e in rows]
+        elif field == 'fraction_ipv6':
+            values = [e.pct_ipv6 / 100 for e in rows]
+        else:
+            values = [getattr(e,EXPORT_FIELDS.get(field,field)) for e in rows]
+        parts.append(pad(array(fmt,values).tobytes()))
+    return b''.join(parts)
+
+@app.route('/api/export',methods=['GET'])
+@conditional
+def export():
+    """All the summaries as columns, for scrapers; see export_entries()."""
+    try:
+        since = int(request.args['since']) if 'since' in request.args else None
+    except ValueError:
+        return bad_request('since must be an integer')
+    read_file(datafile)
+    return Response(response=export_entries(since),status=200,mimetype='application/octet-stream')
+
 @app.route('/api/get/<string:name>',methods=['GET'])
+@conditional
 def get_name(name):
     read_file(datafile)
     try:
@@ -271,6 +660,7 @@ def get_name(name):
     return good_response(resp)
 
 @app.route('/<name>',methods=['GET'])
+@conditional
 def get_name_html(name):
     read_file(datafile)
     try:
@@ -284,7 +674,208 @@ def get_name_html(name):
     return html
 
 
+def query_files():
+    """The driver reads standing queries from <datafile>.query and writes their
+    results to <datafile>.query_results after every poll."""
+    return datafile + '.query', datafile + '.query_results'
+
+# as the driver's event_query_parse() takes them (see event_store.h)
+QUERY_COLUMNS = ('type', 'pid', 'name', 'laddr', 'raddr', 'lport', 'rport', 'ip', 'tx_kb', 'rx_kb',
+                 'latency', 'duration', 'time', 'none')
+QUERY_STRING_COLUMNS = ('type', 'name', 'laddr', 'raddr')
+QUERY_UNGROUPABLE = ('latency', 'duration', 'time')
+QUERY_TERM = re.compile(r'([^=!<>]+)(!=|<=|>=|=|<|>)(.*)$')
+QUERY_MAX_PREDICATES = 8
+QUERY_MAX_LEN = 256
+# the driver's MAX_STANDING_QUERIES
+MAX_STANDING_QUERIES = 64
+
+def query_error(q):
+    """Why the driver would not run the query q, or None if it would."""
+    if len(q) >= QUERY_MAX_LEN:
+        return f'A query must be shorter than {QUERY_MAX_LEN} characters'
+    npred = 0
+    for term in re.split(r'[, ]+',q):
+        if not term:
+            continue
+        m = QUERY_TERM.match(term)
+        if not m:
+            return f'Query term {term} is not of the form COLUMN OP VALUE'
+        col, op, value = m.group(1), m.group(2), m.group(3)
+        if op == '=' and col in ('since', 'group'):
+            if col == 'group':
+                if value.lower() not in QUERY_COLUMNS:
+                    return f'Unknown event column {value}'
+                if value.lower() in QUERY_UNGROUPABLE:
+                    return f'Cannot group by column {value}'
+                continue
+        elif col.lower() not in QUERY_COLUMNS:
+            return f'Unknown event column {col}'
+        elif col.lower() == 'none':
+            return 'Cannot filter on column none'
+        elif col.lower() in QUERY_STRING_COLUMNS:
+            if op not in ('=', '!='):
+                return f'Column {col} only supports = and !='
+            npred += 1
+            continue
+        else:
+            npred += 1
+        try:
+            float(value)
+        except ValueError:
+            return f'Query value {value} is not a number'
+    if npred > QUERY_MAX_PREDICATES:
+        return f'A query may have at most {QUERY_MAX_PREDICATES} predicates'
+    return None
+
+def read_query_results(filename):
+    results = {}
+    if not os.path.exists(filename):
+        return results
+    current = None
+    for line in open(filename,'r').readlines():
+        if line.startswith('Query result for '):
+            query = line[len('Query result for '):line.rindex(' (')]
+            current = results[query] = []
+        elif current is not None and line.startswith('rank = '):
+            row = {}
+            for field in line.rstrip('\n').split(', '):
+                key, _, val = field.partition(' = ')
+                try:
+                    row[key] = float(val) if '.' in val or 'e' in val else int(val)
+                except ValueError:
+                    row[key] = val
+            current.append(row)
+    return results
+
+@app.route('/api/query',methods=['GET'])
+def query():
+    q = request.args.get('q','')
+    if not q:
+        return Response(response=jsonpickle.encode({'error' : 'Missing query parameter q'}),status=400,mimetype='application/json')
+    error = query_error(q)
+    if error:
+        return bad_request(error)
+    query_file, result_file = query_files()
+    with data_lock:
+        standing = []
+        if os.path.exists(query_file):
+            standing = [l.rstrip('\n') for l in open(query_file,'r').readlines()]
+        if q not in standing:
+            if len([l for l in standing if l and not l.startswith('#')]) >= MAX_STANDING_QUERIES:
+                return Response(response=jsonpickle.encode({'error' : f'All {MAX_STANDING_QUERIES} standing queries are taken'}),
+                                status=503,mimetype='application/json')
+            with open(query_file,'a') as f:
+                f.write(q + '\n')
+    results = read_query_results(result_file)
+    if q not in results:
+        resp = f"Query {q} registered; results will be available after the next poll"
+        return Response(response=jsonpickle.encode({'pending' : resp}),status=202,mimetype='application/json')
+    return good_response(results[q])
+
+@app.route('/api/history/<int:rank>/<int:pid>',methods=['GET'])
+def get_history(rank,pid):
+    prefix = history_prefix or datafile + '.history'
+    try:
+        t0 = int(float(request.args.get('start',0)) * 1000)
+        t1 = int(float(request.args.get('end',time.time())) * 1000)
+    except ValueError:
+        return Response(response=jsonpickle.encode({'error' : 'start and end must be seconds since the epoch'}),status=400,mimetype='application/json')
+    filename = f"{prefix}.rank{rank}"
+    if not os.path.exists(filename):
+        return key_not_found_response(rank,'history files')
+    if 'step' in request.args:
+        try:
+            step = int(float(request.args['step']) * 1000)
+        except ValueError:
+            return Response(response=jsonpickle.encode({'error' : 'step must be in seconds'}),status=400,mimetype='application/json')
+        res, buckets = history_reader.read_rollups(filename,pid,t0,t1,step)
+        return good_response({'resolution' : res / 1000, 'buckets' : buckets})
+    return good_response(history_reader.read_history(filename,pid,t0,t1))
+
+def progress_file():
+    """The driver writes how far the ranks have read their input, as the body of
+    the native server's /api/progress, to <datafile>.progress after every poll."""
+    return datafile + '.progress'
+
+def read_progress():
+    """The last progress the driver wrote, or None before it has; only read
+    again when the driver has replaced the file."""
+    global progress_seen
+    try:
+        st = os.stat(progress_file())
+    except OSError:
+        return None
+    version = (st.st_ino, st.st_mtime_ns)
+    if progress_seen[0] != version:
+        try:
+            with open(progress_file(),'r') as f:
+                progress_seen = (version, jsonpickle.decode(f.read())['response'])
+        except (OSError, ValueError, KeyError, TypeError):
+            pass
+    return progress_seen[1]
+
+@app.after_request
+def ingest_progress(resp):
+    """Says how far ingestion is on every response, like the native server."""
+    progress = read_progress()
+    if progress is not None:
+        resp.headers['X-Ingest-Progress'] = f"{progress['consumed']}/{progress['total']}"
+        resp.headers['X-Ingest-Backfilling'] = str(progress['backfilling'])
+    return resp
+
+@app.route('/api/progress',methods=['GET'])
+def get_progress():
+    progress = read_progress()
+    if progress is None:
+        progress = {'consumed' : 0, 'total' : 0, 'backfilling' : 0, 'ranks' : []}
+    return good_response(progress)
+
+JOB_SUM_FIELDS = ('tx_kb', 'rx_kb', 'nevent', 'nretrans', 'ndrop', 'cpu_seconds')
+
+def summarize_job(job_id):
+    """Aggregates the entries of every application rank of the job: the
+    per-rank sums of JOB_SUM_FIELDS, and those sums over the whole job."""
+    ranks = {}
+    for (jid, app_rank), ents in entries_by_job.items():
+        if jid != job_id:
+            continue
+        row = {f : sum(getattr(e,f) for e in ents) for f in JOB_SUM_FIELDS}
+        row['processes'] = [{'rank' : e.rank, 'pid' : e.pid, 'name' : e.name} for e in ents]
+        ranks[app_rank] = row
+    total = {f : sum(r[f] for r in ranks.values()) for f in JOB_SUM_FIELDS}
+    return {'job_id' : job_id, 'total' : total, 'ranks' : [dict(app_rank=rk,**ranks[rk]) for rk in sorted(ranks)]}
+
+@app.route('/api/job/all',methods=['GET'])
+@conditional
+def get_jobs():
+    read_file(datafile)
+    return good_response([summarize_job(jid) for jid in sorted({jid for jid, _ in entries_by_job})])
+
+@app.route('/api/job/<string:job_id>',methods=['GET'])
+@conditional
+def get_job(job_id):
+    read_file(datafile)
+    if not any(jid == job_id for jid, _ in entries_by_job):
+        return key_not_found_response(job_id,'entries_by_job')
+    return good_response(summarize_job(job_id))
+
+@app.route('/api/node/all',methods=['GET'])
+@conditional
+def get_nodes():
+    read_file(datafile)
+    return good_response([node_entries[rk] for rk in sorted(node_entries)])
+
+@app.route('/api/node/<int:rank>',methods=['GET'])
+@conditional
+def get_node(rank):
+    read_file(datafile)
+    if rank not in node_entries:
+        return key_not_found_response(rank,'node_entries')
+    return good_response(node_entries[rank])
+
 @app.route('/names',methods=['GET'])
+@conditional
 def get_names():
     read_file(datafile)
     html = table([('',nm) for nm in entries_by_name])
@@ -295,8 +886,13 @@ if __name__ == '__main__':
     parser.add_argument('-f','--file',default='/opt/tcpsummary',help='Where is the PETSc webserver (program webserver) dumping its output to?')
     parser.add_argument('-p','--port',type=int,default=5000,help='Which port to run Flask on?')
     parser.add_argument('--no_flask',action='store_true')
+    parser.add_argument('--history_prefix',default=None,help='Prefix of the per-rank history files (default <file>.history)')
+    parser.add_argument('--shm',default=None,help='Read the summaries from this shared memory segment (the driver\'s --shm) instead of the file')
     args = parser.parse_args()
     datafile = args.file
+    if args.shm:
+        shm_segment = snapshot_reader.SharedSnapshot(args.shm)
+    history_prefix = args.history_prefix
     if args.no_flask:
         read_file(datafile)
         print(format_entries())
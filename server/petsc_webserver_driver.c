@@ -1,20 +1,52 @@
 #define  _POSIX_C_SOURCE 200809L
 #include "petsc_webserver.h"
+#include "event_store.h"
+#include "history_store.h"
+#include "proc_sampler.h"
+#include "node_stats.h"
+#include "sock_diag.h"
+#include "event_source.h"
+#include "event_filter.h"
+#include "job_resolver.h"
+#include "process_tree.h"
+#include "pid_reaper.h"
+#include "node_share.h"
+#include "petsc_mongoose.h"
+#include "summary_snapshot.h"
+#include "summary_shm.h"
+#include "rank_store.h"
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <signal.h>
 #include <execinfo.h>
+#include <errno.h>
+#include <time.h>
 
 static const char help[] = "PETSc webserver: This program periodically reads the output of the eBPF programs\n"
-  "tcpaccept, tcpconnect, tcpconnlat, tcplife, and tcpretrans, summarizes that data, and stores that data in a\n"
+  "tcpaccept, tcpconnect, tcpconnlat, tcplife, tcpretrans, tcpstates, tcprtt and tcpdrop, summarizes that data, and stores that data in a\n"
   "message queue. The summaries are then gathered to the root node (MPI rank 0), where it is written to an output\n"
-  "file. Once the existing input files have been read to their ends, the root process spawns a new subcommunicator\n"
+  "file. After the first poll (see --backfill_chunk), the root process spawns a new subcommunicator\n"
   "via MPI_Comm_spawn() and launches a Python webserver (currently written with Flask) on that spawned process\n"
   "that reads the output file, and serves requests to a REST API. Available endpoints are:\n"
   "-------------------------------------------------------------------------------------------\n"
   "GET /api/get/all (gets data for all processes on all MPI ranks)\n"
   "GET /api/get/{rank}/{pid} (gets data for the process with PID {pid} on MPI rank {rank})\n"
   "GET /api/get/{name} (gets data on all MPI ranks for all processes with name {name}\n"
+  "GET /api/select?[name={name}][&rank={rank}][&pid_min={pid}][&pid_max={pid}][&sort={key}][&order=asc|desc]\n"
+  "       [&offset={n}][&limit={n}][&top={n}] (gets the processes that match the filters, sorted by tx_kb, rx_kb,\n"
+  "       n_event or avg_latency (largest first), a page at a time; top={n} is the {n} largest)\n"
+  "GET /api/export[?since={epoch}] (gets all the processes as binary columns, for scrapers, or with the native\n"
+  "       server only those that changed after {epoch}; see petsc_mongoose.h and snapshot_reader.read_export())\n"
+  "GET /api/history/{rank}/{pid}?start={t0}&end={t1}[&step={s}] (gets the stored history of a process\n"
+  "       between two times, in seconds since the epoch; needs --history. With step, gets\n"
+  "       min/max/sum/count rollups from the coarsest of 1 min, 10 min and 1 h that fits the step)\n"
+  "GET /api/node/all, GET /api/node/{rank} (gets the NIC and TCP stack counters and rates of each node;\n"
+  "       needs --node_sample)\n"
+  "GET /api/query?q={query} (runs a standing query against the recent events on every rank, e.g.\n"
+  "       q=rport=5432,latency>10,since=60,group=name; the time of an event is its own for event records\n"
+  "       and for lines with a -T column, or else when it was read, so a since= that reaches back to a\n"
+  "       backlog read without its times is not run)\n"
   "-------------------------------------------------------------------------------------------\n"
   "Usage:\n"
   "Options:\n"
@@ -24,28 +56,143 @@ static const char help[] = "PETSc webserver: This program periodically reads the
   "       be launched as an MPI child with MPI_Comm_split() with argv 'python3 <python_server> -f <output> -p <port>'\n"
   "--webserver_host [filename] : (optional, default ubuntu-mpi-1) hostname of\n"
   "       the machine that should run the webserver program.\n"
-  "       and will run a webserver on the appropriate port.\n"
-  "-file [filename] : (optional if any of --XXX_file are given) input file\n"
-  "-type [TCPACCEPT,TCPCONNECT,TCPRETRANS,TCPLIFE,TCPCONNLAT] : (required only if -file is given) what sort of\n"
+  "       and will run a webserver on the appropriate port. With --native_server, the address\n"
+  "       rank 0 listens on (default all interfaces)\n"
+  "-file [filename] : (optional if any of --XXX_file, --sock_diag or --event_source are given) input file\n"
+  "-type [ACCEPT,CONNECT,CONNLAT,LIFE,RETRANS,STATES,RTT,DROP] : (required only if -file is given) what sort of\n"
   "       input file is the -file argument?\n"
   "--accept_file [filename] : (optional) file for tcpaccept data\n"
   "--connect_file [filename] : (optional) file for tcpconnect data\n"
   "--connlat_file [filename] : (optional) file for tcpconnlat data\n"
   "--life_file [filename] : (optional) file for tcplife data\n"
   "--retrans_file [filename] : (optional) file for tcpretrans data\n"
-  "-o (--output) [filename] : (optional, default stdout) file to output data to\n"
+  "--states_file [filename] : (optional) file for tcpstates data (time spent in each TCP state)\n"
+  "--rtt_file [filename] : (optional) file for tcprtt histograms; tcprtt does not see processes, so its\n"
+  "       samples are credited to PID 0\n"
+  "--drop_file [filename] : (optional) file for tcpdrop data\n"
+  "-o (--output) [filename] : (optional, default stdout) file to output data to. Summaries are written to a\n"
+  "       file as a binary snapshot (see summary_snapshot.h), replaced atomically every poll; stdout and\n"
+  "       stderr get text\n"
+  "--text_output [filename] : (optional) also write the summaries as text to this file (in place of stdout\n"
+  "       or stderr) every poll, replacing it atomically\n"
+  "--shm [name] : (optional, default /dcprof) also publish every poll's snapshot in the POSIX shared memory\n"
+  "       segment of this name on rank 0, for local readers (see summary_shm.h and snapshot_reader.py)\n"
+  "--shm_local : (optional) every rank also publishes its own summaries in <name>.rank<N>\n"
   "-p (--port) [port (int)] : (optional, default 5000) which TCP port to use to serve requests\n"
+  "--native_server : (optional) serve /api/get/all, /api/get/{rank}/{pid}, /api/get/{name}, /api/select and\n"
+  "       /api/export from a thread of rank 0 itself, straight from the summaries of the last poll, instead of\n"
+  "       launching the Python webserver; its summaries are JSON objects rather than text. The other endpoints\n"
+  "       need the Python one.\n"
+  "       It also streams what changes from poll to poll (see petsc_mongoose.h):\n"
+  "       GET /api/stream[?since={epoch}] (Server-Sent Events, one per poll, resuming with Last-Event-ID)\n"
+  "       GET /api/deltas?since={epoch}[&timeout={s}] (long poll for the polls after {epoch})\n"
+  "       and serves Prometheus: GET /metrics (a counter or gauge per field, labelled with rank, pid and comm,\n"
+  "       and per rank histograms of the processes' connection latency and RTT)\n"
+  "--metrics_max_series [n] : (optional, default 5000) how many processes /metrics labels, those with the\n"
+  "       most tx_kb; the rest are only counted, so that PIDs coming and going cannot swamp Prometheus\n"
+  "--fanout : (optional, needs --native_server) every rank keeps its own summaries readable in an MPI window,\n"
+  "       and root only gathers them every --gather_every polls; /api/get/all, /api/get/{rank}/{pid} and\n"
+  "       /api/get/{name} read the ranks they are about when asked, once per poll (see rank_store.h)\n"
+  "--gather_every [n] : (optional, default 12) with --fanout, how often root still gathers every summary,\n"
+  "       for the output file and the other endpoints, which so lag the ranks by up to that many polls;\n"
+  "       must be at least 1\n"
+  "--backfill_chunk [bytes] : (optional, default 16777216) how much of each input file (and of a REPLAY or\n"
+  "       LOG --event_source) a poll reads at most, so that a backlog is worked through over several polls,\n"
+  "       published after each, with no wait in between, rather than before anything is served; 0 reads to\n"
+  "       the end. Every response says how far that is (X-Ingest-Progress), and GET /api/progress (and\n"
+  "       <output>.progress) how far each rank is\n"
   "--buffer_capcity [capacity] : (optional, default 10,000) size of the buffer (number of entries)\n"
   "--polling_interval [interval] : (optional, default 5.0) how many seconds to wait before\n"
-  "       checking the file for more data after reaching the end?\n";
-
+  "       checking the file for more data after reaching the end?\n"
+  "--event_store_capacity [capacity] : (optional, default 65536) how many of the most recent events each\n"
+  "       rank keeps for queries; 0 disables the event store\n"
+  "--query_file [filename] : (optional, default <output>.query) file of standing queries, one per line\n"
+  "--query_output [filename] : (optional, default <output>.query_results) file the query results are\n"
+  "       written to after every poll\n"
+  "--history : (optional) append every poll's summaries to a compressed per-rank time series\n"
+  "--history_file [prefix] : (optional, default <output>.history) the time series of rank N is\n"
+  "       stored in <prefix>.rank<N>; implies --history\n"
+  "--proc_sample : (optional) on every poll, read CPU time, RSS, storage I/O and context switches of each\n"
+  "       PID from /proc and add them (and bytes per CPU-second) to its summary\n"
+  "--proc_max_fds [n] : (optional, default 768) how many /proc files the sampler keeps open between polls\n"
+  "--rollup : (optional) summarize each process together with all of its descendants, so that e.g. the\n"
+  "       summary of mpirun holds the totals of every rank and helper it started. Descendants are found\n"
+  "       from the ppid in /proc/<pid>/stat when a PID is first seen\n"
+  "--reap : (optional) evict processes that exited (and had no new events for a poll) from the summaries,\n"
+  "       appending their last summary to a binary archive, so the work per poll follows the live processes\n"
+  "--pid_ttl [seconds] : (optional, default 0, i.e. never) also evict processes idle for this long; implies --reap\n"
+  "--archive_file [filename] : (optional, default <output>.archive.rank<N>) the archive of rank N is stored in\n"
+  "       <filename>.rank<N>; implies --reap\n"
+  "--archive_retention [seconds] : (optional, default 604800) how long archived summaries are kept; 0 keeps\n"
+  "       them forever\n"
+  "--node_share_capacity [n] : (optional, default 1024) when several ranks run on one node, they split\n"
+  "       the input files among them and the node's first rank merges what the others read, n PIDs at a\n"
+  "       time, through an MPI shared-memory window. Only that rank reads --sock_diag, --event_source and\n"
+  "       the --node_sample counters\n"
+  "--jobs : (optional) attribute each PID to the MPI job and application rank it belongs to, from the\n"
+  "       launcher's variables in /proc/<pid>/environ (or the job's cgroup), and add job_id and app_rank to\n"
+  "       its summary. Each PID is resolved once, and again only if it has been reused\n"
+  "--sock_diag : (optional) collect TCP data natively instead of (or as well as) from the bcc tools: every\n"
+  "       poll, dump the TCP sockets over NETLINK_SOCK_DIAG and map them to processes through /proc/<pid>/fd.\n"
+  "       Does not need root, but without it only sees the sockets of the user's own processes\n"
+  "--node_sample : (optional) sample NIC and TCP stack counters from /proc/net/dev, /proc/net/snmp and\n"
+  "       /proc/net/netstat on every rank, and write a per-node summary with their rates after the process\n"
+  "       summaries\n"
+  "--node_sample_interval [seconds] : (optional, default 0.25) how often to sample the node counters while\n"
+  "       waiting for the next poll\n"
+  "--event_source [RINGBUF,REPLAY,LOG] : (optional) read binary event records instead of (or as well as)\n"
+  "       text: RINGBUF consumes them from a BPF ring buffer map (needs a build with libbpf), REPLAY from a\n"
+  "       file written with --event_record, and LOG maps an event log written by event_log_convert; files\n"
+  "       are followed as they grow\n"
+  "--event_source_path [path] : (required for REPLAY and LOG, default /sys/fs/bpf/dcprof_events for\n"
+  "       RINGBUF) the pinned ring buffer map or the file\n"
+  "--event_record [filename] : (optional) also write every event read from the text files to this file as\n"
+  "       binary records, for --event_source REPLAY\n"
+  "--filter [expression] : (optional) only ingest the events that match the expression, e.g.\n"
+  "       'comm=mpi* && !(rport=22 || raddr=10.0.0.0/8)'. Predicates are comm=GLOB, pid=N[-M], lport=N[-M],\n"
+  "       rport=N[-M], port=N[-M], raddr=ADDR[/N] and ip=4|6 (or != for their negation), combined with !, &&\n"
+  "       (or a comma), || and parentheses. tcprtt histograms are not filtered; use tcprtt's own options\n";
 
 entry_buffer   buf;
 char           *line;
-file_wrapper   input, accept_input, connect_input, connlat_input, life_input, retrans_input;
+file_wrapper   input, accept_input, connect_input, connlat_input, life_input, retrans_input,
+               states_input, rtt_input, drop_input;
 process_statistics pstats;
+event_store    estore;
+history_store  hstore;
+proc_sampler   sampler;
+job_resolver   jresolver;
+process_tree   ptree;
+pid_reaper     reaper;
+node_share     nshare;
+http_server    hserver;
+rank_store     rstore;
+summary_snapshot snapshot,local_snapshot;
+summary_shm    shm,local_shm;
+node_sampler   nsampler;
+sock_diag_collector sdiag;
+event_source   esource;
+FILE           *record_output = NULL;
+event_filter   filter;
+/* the most read_file() reads of a file in one poll (0 for no limit), and whether
+   it stopped short of the end of one in this poll */
+long           backfill_chunk = 0;
+PetscBool      backfilling = PETSC_FALSE;
+/* the last time a backlog (a file's first read, or a poll that stopped short of its
+   end) stored events with no time of their own (see event_time_column()) in the event
+   store; they all have that time, so since= cannot tell them apart until it passes */
+PetscLogDouble backlog_time = 0.0;
+
+/* what handle_record() needs; the binary counterpart of handle_line()'s arguments */
+typedef struct {
+  PetscInt           mypid;
+  process_statistics *pstats;
+  event_store        *estore;
+  PetscLogDouble     now;
+} record_context;
 
 #define BACKTRACE_DEPTH 20
+#define MAX_STANDING_QUERIES 64
 
 void segv_handler(int sig) {
   void *bt[BACKTRACE_DEPTH];
@@ -61,94 +208,328 @@ void segv_handler(int sig) {
 PetscErrorCode handle_line(char *line, PetscInt nentry, InputType input_type, PetscInt mypid,
 			   tcpaccept_entry *accept_entry, tcpconnect_entry *connect_entry,
 			   tcpconnlat_entry *connlat_entry, tcplife_entry *life_entry,
-			   tcpretrans_entry *retrans_entry, PetscBool *ignore_entry,
-			   process_statistics *pstats)
+			   tcpretrans_entry *retrans_entry, tcpstates_entry *states_entry,
+			   tcprtt_entry *rtt_entry, tcpdrop_entry *drop_entry, PetscBool *ignore_entry,
+			   PetscBool *parsed, process_statistics *pstats, event_store *estore, PetscLogDouble now)
 {
   PetscErrorCode ierr;
   PetscFunctionBeginUser;
-  
+  /* header, blank and malformed lines leave the entries as they were */
+  *parsed = PETSC_FALSE;
   switch (input_type) {
     case TCPACCEPT:
       //ierr = create_tcpaccept_entry_bag(accept_entry,bagptr,nentry);CHKERRQ(ierr);
       ierr = tcpaccept_entry_parse_line(accept_entry,line); if (ierr) break;
+      *parsed = PETSC_TRUE;
       if ((accept_entry)->pid == mypid || ierr) {
 	/* if the traffic came from this program, don't upload it to the server */
 	*ignore_entry = PETSC_TRUE;
 	//break;
       }
+      if (!event_filter_match_accept(&filter,accept_entry)) {
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
       ierr = process_statistics_add_accept(pstats,accept_entry);CHKERRQ(ierr);
+      if (estore) {
+	ierr = event_store_add_accept(estore,accept_entry,now);CHKERRQ(ierr);
+      }
       break;
     case TCPCONNECT:
       ierr = tcpconnect_entry_parse_line(connect_entry,line);if (ierr) break;
+      *parsed = PETSC_TRUE;
       //PetscPrintf(PETSC_COMM_WORLD,"parsed bag %D\n",nentry);
       if ((connect_entry)->pid == mypid || ierr) {
 	/* if the traffic came from this program, don't upload it to the server */
 	*ignore_entry = PETSC_TRUE;
 	break;
       }
+      if (!event_filter_match_connect(&filter,connect_entry)) {
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
       ierr = process_statistics_add_connect(pstats,connect_entry);CHKERRQ(ierr);
+      if (estore) {
+	ierr = event_store_add_connect(estore,connect_entry,now);CHKERRQ(ierr);
+      }
       break;
     case TCPCONNLAT:
       ierr = tcpconnlat_entry_parse_line(connlat_entry,line);if (ierr) break;
+      *parsed = PETSC_TRUE;
       if ((connlat_entry)->pid == mypid || ierr) {
 	/* if the traffic came from this program, don't upload it to the server*/
 	*ignore_entry = PETSC_TRUE;
 	break;
       }
+      if (!event_filter_match_connlat(&filter,connlat_entry)) {
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
       ierr = process_statistics_add_connlat(pstats,connlat_entry);CHKERRQ(ierr);
+      if (estore) {
+	ierr = event_store_add_connlat(estore,connlat_entry,now);CHKERRQ(ierr);
+      }
       break;
     case TCPLIFE:
       ierr = tcplife_entry_parse_line(life_entry,line);if (ierr) break;
+      *parsed = PETSC_TRUE;
       if ((life_entry)->pid == mypid || ierr) {
 	/* if the traffic came from this program, don't upload it to the server */
 	*ignore_entry = PETSC_TRUE;
 	break;
       }
+      if (!event_filter_match_life(&filter,life_entry)) {
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
       ierr = process_statistics_add_life(pstats,life_entry);CHKERRQ(ierr);
+      if (estore) {
+	ierr = event_store_add_life(estore,life_entry,now);CHKERRQ(ierr);
+      }
       break;
     case TCPRETRANS:
       ierr = tcpretrans_entry_parse_line(retrans_entry,line);if (ierr) break;
+      *parsed = PETSC_TRUE;
       if ((retrans_entry)->pid == mypid || ierr) {
 	/* if the traffic came from this program, don't upload it to the server */
 	*ignore_entry = PETSC_TRUE;
 	break;
       }
+      if (!event_filter_match_retrans(&filter,retrans_entry)) {
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
       ierr = process_statistics_add_retrans(pstats,retrans_entry);CHKERRQ(ierr);
       break;
+    case TCPSTATES:
+      ierr = tcpstates_entry_parse_line(states_entry,line);if (ierr) break;
+      *parsed = PETSC_TRUE;
+      if ((states_entry)->pid == mypid || ierr) {
+	/* if the traffic came from this program, don't upload it to the server */
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
+      if (!event_filter_match_states(&filter,states_entry)) {
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
+      ierr = process_statistics_add_states(pstats,states_entry);CHKERRQ(ierr);
+      break;
+    case TCPRTT:
+      /* histogram rows; the other lines of the histogram only update the parser's state */
+      ierr = tcprtt_entry_parse_line(rtt_entry,line);if (ierr) break;
+      *parsed = PETSC_TRUE;
+      ierr = process_statistics_add_rtt(pstats,rtt_entry);CHKERRQ(ierr);
+      break;
+    case TCPDROP:
+      ierr = tcpdrop_entry_parse_line(drop_entry,line);if (ierr) break;
+      *parsed = PETSC_TRUE;
+      if ((drop_entry)->pid == mypid || ierr) {
+	/* if the traffic came from this program, don't upload it to the server */
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
+      if (!event_filter_match_drop(&filter,drop_entry)) {
+	*ignore_entry = PETSC_TRUE;
+	break;
+      }
+      ierr = process_statistics_add_drop(pstats,drop_entry);CHKERRQ(ierr);
+      break;
     }
 
   PetscFunctionReturn(0);
 }
 
+/* the no-parse path of handle_line() for records from an event_source */
+PetscErrorCode handle_record(const event_record *rec, void *ctx)
+{
+  PetscErrorCode ierr;
+  record_context *rctx = (record_context*)ctx;
+  PetscFunctionBeginUser;
+  if ((PetscInt)rec->pid == rctx->mypid) {
+    /* if the traffic came from this program, don't upload it to the server */
+    PetscFunctionReturn(0);
+  }
+  if (!event_filter_match_record(&filter,rec)) {
+    PetscFunctionReturn(0);
+  }
+  ierr = process_statistics_add_event(rctx->pstats,rec);CHKERRQ(ierr);
+  if (rctx->estore) {
+    ierr = event_store_add_record(rctx->estore,rec,rctx->now);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
 
-PetscErrorCode read_file(FILE *fd, size_t *linesize, char **line, PetscInt *nentry, InputType input_type, PetscInt mypid,
+/* reads every record the event source has (or the first backfill_chunk bytes of
+   them); each is stored with its own time, or the ingestion time if it has none */
+PetscErrorCode read_event_source(event_source *src, PetscInt mypid, process_statistics *pstats, event_store *estore)
+{
+  PetscErrorCode ierr;
+  record_context rctx;
+  PetscInt       nread;
+  PetscFunctionBeginUser;
+  rctx.mypid = mypid;
+  rctx.pstats = pstats;
+  rctx.estore = estore;
+  ierr = PetscTime(&rctx.now);CHKERRQ(ierr);
+  ierr = event_source_poll(src,handle_record,&rctx,&nread);CHKERRQ(ierr);
+  if (src->behind) {
+    backfilling = PETSC_TRUE;
+  }
+  PetscFPrintf(PETSC_COMM_WORLD,stderr,"Handled %D event records.\n",nread);
+  PetscFunctionReturn(0);
+}
+
+/* appends the entry handle_line() just parsed to the --event_record file, with the
+   time in the last parameter */
+PetscErrorCode record_entry(FILE *fd, InputType input_type,
+			    tcpaccept_entry *accept_entry, tcpconnect_entry *connect_entry,
+			    tcpconnlat_entry *connlat_entry, tcplife_entry *life_entry,
+			    tcpretrans_entry *retrans_entry, PetscLogDouble time)
+{
+  PetscErrorCode ierr;
+  event_record   rec;
+  PetscFunctionBeginUser;
+  switch (input_type) {
+    case TCPACCEPT:
+      ierr = event_record_from_accept(&rec,accept_entry);CHKERRQ(ierr);
+      break;
+    case TCPCONNECT:
+      ierr = event_record_from_connect(&rec,connect_entry);CHKERRQ(ierr);
+      break;
+    case TCPCONNLAT:
+      ierr = event_record_from_connlat(&rec,connlat_entry);CHKERRQ(ierr);
+      break;
+    case TCPLIFE:
+      ierr = event_record_from_life(&rec,life_entry);CHKERRQ(ierr);
+      break;
+    case TCPRETRANS:
+      ierr = event_record_from_retrans(&rec,retrans_entry);CHKERRQ(ierr);
+      break;
+    default:
+      /* event records only carry the five original tools */
+      PetscFunctionReturn(0);
+  }
+  rec.ts_ns = (uint64_t)(time * 1.0e9);
+  ierr = event_record_write(fd,&rec);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* tcpaccept, tcpconnect, tcpconnlat and tcplife print the time of each event in a
+   first column with -T (HH:MM:SS) or -t (seconds since the tool started). If the line
+   in the first parameter starts with one, moves it past it. The event's time, in
+   seconds since the epoch, is stored in the fourth parameter: the most recent time
+   with that time of day for -T, or else the ingestion time in the third parameter,
+   which the last parameter then says */
+static PetscErrorCode event_time_column(char **line, const char *sep, PetscLogDouble now, PetscLogDouble *time, PetscBool *ingested)
+{
+  struct tm tm;
+  time_t    secs;
+  int       h,m,s,n=0;
+  char      *end;
+  PetscFunctionBeginUser;
+  *time = now;
+  *ingested = PETSC_TRUE;
+  if (sscanf(*line,"%d:%d:%d%n",&h,&m,&s,&n) == 3 && (*line)[n] && strchr(sep,(*line)[n])) {
+    secs = (time_t)now;
+    localtime_r(&secs,&tm);
+    tm.tm_hour = h;
+    tm.tm_min = m;
+    tm.tm_sec = s;
+    tm.tm_isdst = -1;
+    secs = mktime(&tm);
+    if ((PetscLogDouble)secs > now + 1.0) {
+      /* from before midnight, read after it */
+      secs -= 24*3600;
+    }
+    *time = (PetscLogDouble)secs;
+    *ingested = PETSC_FALSE;
+    *line += n + 1;
+    PetscFunctionReturn(0);
+  }
+  (void)strtod(*line,&end);
+  if (end != *line && *end && strchr(sep,*end) && memchr(*line,'.',(size_t)(end - *line))) {
+    /* -t has no epoch to go by */
+    *line = end + 1;
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode read_file(file_wrapper *input, size_t *linesize, char **line, PetscInt *nentry, InputType input_type, PetscInt mypid,
 			   tcpaccept_entry *accept_entry, tcpconnect_entry *connect_entry,
 			   tcpconnlat_entry *connlat_entry, tcplife_entry *life_entry,
-			   tcpretrans_entry *retrans_entry, PetscBool *ignore_entry,
-			   process_statistics *pstats)
+			   tcpretrans_entry *retrans_entry, tcpstates_entry *states_entry,
+			   tcprtt_entry *rtt_entry, tcpdrop_entry *drop_entry, PetscBool *ignore_entry,
+			   process_statistics *pstats, event_store *estore)
 {
   size_t nread;
   PetscErrorCode ierr;
+  PetscLogDouble now,time;
+  PetscInt       nrejected;
+  PetscBool      parsed,ingested,stamped=PETSC_FALSE,backlog=(PetscBool)(ftell(input->file) == 0 || input->behind);
+  long           consumed=0;
+  char           *start;
   PetscFunctionBeginUser;
+  /* the events read in this batch without a time of their own get the same ingestion time */
+  ierr = PetscTime(&now);CHKERRQ(ierr);
   /* skip header lines */
   //getline(line,linesize,fd);
   //getline(line,linesize,fd);
   *nentry = 0;
 
-  while ((nread = getline(line,linesize,fd)) != -1) {
-    ierr = handle_line(*line,*nentry,input_type,
+  nrejected = filter.nrejected;
+  /* a backlog is read backfill_chunk bytes per poll, so that the polls in between
+     are published */
+  while ((!backfill_chunk || consumed < backfill_chunk) && (nread = getline(line,linesize,input->file)) != -1) {
+    consumed += nread;
+    start = *line;
+    time = now;
+    ingested = PETSC_TRUE;
+    if (input_type <= TCPLIFE) {
+      /* tcplife -s is comma-delimited */
+      ierr = event_time_column(&start,input_type == TCPLIFE ? ",\n" : " \n",now,&time,&ingested);CHKERRQ(ierr);
+    }
+    ierr = handle_line(start,*nentry,input_type,
 		       mypid,accept_entry,connect_entry,
 		       connlat_entry,life_entry,retrans_entry,
-		       ignore_entry,pstats);CHKERRQ(ierr);
+		       states_entry,rtt_entry,drop_entry,
+		       ignore_entry,&parsed,pstats,estore,time);CHKERRQ(ierr);
+    if (parsed && estore && ingested) {
+      stamped = PETSC_TRUE;
+    }
     if (*ignore_entry) {
-      PetscFPrintf(PETSC_COMM_WORLD,stderr,"Ignoring entry\n");
+      if (filter.nrejected == nrejected) {
+	PetscFPrintf(PETSC_COMM_WORLD,stderr,"Ignoring entry\n");
+      }
+      nrejected = filter.nrejected;
       *ignore_entry = PETSC_FALSE;
       continue;
-    } else {
+    } else if (parsed) {
       ++(*nentry);
+      if (record_output) {
+	ierr = record_entry(record_output,input_type,accept_entry,connect_entry,
+			    connlat_entry,life_entry,retrans_entry,time);CHKERRQ(ierr);
+      }
     }
   }
-  PetscFPrintf(PETSC_COMM_WORLD,stderr,"Handled %D entries.\n",*nentry);
+  input->behind = (PetscBool)(backfill_chunk && consumed >= backfill_chunk);
+  if (input->behind) {
+    backfilling = PETSC_TRUE;
+  }
+  if (stamped && (backlog || input->behind)) {
+    backlog_time = now;
+  }
+  /* where the next poll goes on from (see has_new_data()) */
+  input->offset = ftell(input->file);
+  if (record_output) {
+    /* so a replaying reader sees whole batches */
+    fflush(record_output);
+  }
+  if (filter.ninsns) {
+    PetscFPrintf(PETSC_COMM_WORLD,stderr,"Handled %D entries; %D events filtered out so far.\n",*nentry,filter.nrejected);
+  } else {
+    PetscFPrintf(PETSC_COMM_WORLD,stderr,"Handled %D entries.\n",*nentry);
+  }
   PetscFunctionReturn(0);
 }
 
@@ -165,6 +546,137 @@ void sigabrt_handler(int sig_num)
   exit(sig_num);
 }
 
+/* runs the standing queries in query_filename against the event store on every rank and
+   writes the gathered results to query_output_filename on root. A query with since=
+   whose window reaches back to the backlog_time of any rank is not run. Collective. */
+PetscErrorCode serve_queries(event_store *estore, const char *query_filename, const char *query_output_filename)
+{
+  PetscErrorCode ierr;
+  PetscInt       rank,nqueries,q,n;
+  FILE           *fd=NULL;
+  char           tmp_filename[PETSC_MAX_PATH_LEN+8];
+  PetscLogDouble now,last;
+  static event_query queries[MAX_STANDING_QUERIES];
+  PetscFunctionBeginUser;
+  if (!estore || !query_filename[0]) {
+    PetscFunctionReturn(0);
+  }
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  ierr = event_query_read_file(query_filename,queries,MAX_STANDING_QUERIES,&nqueries);CHKERRQ(ierr);
+  if (!nqueries) {
+    PetscFunctionReturn(0);
+  }
+  if (!rank) {
+    if (strcmp(query_output_filename,"stdout")) {
+      /* renamed into place once complete, so the backend never reads half of them */
+      snprintf(tmp_filename,sizeof(tmp_filename),"%s.tmp",query_output_filename);
+      fd = fopen(tmp_filename,"w");
+    } else {
+      fd = stdout;
+    }
+    if (!fd) {
+      PetscFPrintf(PETSC_COMM_SELF,stderr,"Could not open %s to write query results\n",tmp_filename);
+    }
+  }
+  /* the same on every rank, so every rank runs the same queries */
+  MPI_Allreduce(&backlog_time,&last,1,MPI_DOUBLE,MPI_MAX,PETSC_COMM_WORLD);
+  ierr = PetscTime(&now);CHKERRQ(ierr);
+  MPI_Bcast(&now,1,MPI_DOUBLE,0,PETSC_COMM_WORLD);
+  for (q=0,n=0; q<nqueries; ++q) {
+    if (queries[q].since > 0.0 && now - queries[q].since <= last) {
+      if (fd) {
+	PetscFPrintf(PETSC_COMM_SELF,fd,"Query %s not run: its events from the last %g s include a backlog read without their times\n",
+		     queries[q].text,queries[q].since);
+      }
+      continue;
+    }
+    queries[n++] = queries[q];
+  }
+  nqueries = n;
+  ierr = event_store_gather_queries(estore,queries,nqueries,fd);CHKERRQ(ierr);
+  if (fd && fd != stdout && (fclose(fd) || rename(tmp_filename,query_output_filename))) {
+    PetscFPrintf(PETSC_COMM_SELF,stderr,"Could not write query results to %s: %s\n",query_output_filename,strerror(errno));
+  }
+  PetscFunctionReturn(0);
+}
+
+/* gathers how far every rank has read its input files and its event source (the
+   second parameter, if not NULL) to root, which hands that to the native server in
+   the first parameter and writes it, as the body of its /api/progress, to
+   progress_filename (unless it is empty). Tells every rank in the last parameter
+   whether any of them is still backfilling. Collective. */
+PetscErrorCode gather_progress(http_server *srv, event_source *src, const char *progress_filename, PetscBool *any_backfilling)
+{
+  PetscErrorCode ierr;
+  PetscMPIInt    rank,size,r,mine,any;
+  file_wrapper   *files[] = {&input,&accept_input,&connect_input,&connlat_input,&life_input,&retrans_input,
+			     &states_input,&rtt_input,&drop_input};
+  http_progress  progress,*all=NULL,total;
+  struct stat    st;
+  size_t         i;
+  int64_t        consumed,size_bytes;
+  int            failed;
+  FILE           *fd;
+  char           tmp_filename[PETSC_MAX_PATH_LEN+32];
+  PetscFunctionBeginUser;
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  MPI_Comm_size(PETSC_COMM_WORLD,&size);
+  ierr = PetscMemzero(&progress,sizeof(progress));CHKERRQ(ierr);
+  for (i=0; i<sizeof(files)/sizeof(files[0]); ++i) {
+    if (files[i]->file) {
+      progress.consumed += files[i]->offset;
+      if (!fstat(fileno(files[i]->file),&st)) {
+	progress.total += st.st_size;
+      }
+    }
+  }
+  if (src) {
+    ierr = event_source_progress(src,&consumed,&size_bytes);CHKERRQ(ierr);
+    progress.consumed += consumed;
+    progress.total += size_bytes;
+  }
+  progress.backfilling = backfilling;
+  if (!rank) {
+    ierr = PetscMalloc1(size,&all);CHKERRQ(ierr);
+  }
+  ierr = MPI_Gather(&progress,3,MPI_INT64_T,all,3,MPI_INT64_T,0,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  if (!rank) {
+    if (srv) {
+      ierr = http_server_progress(srv,size,all);CHKERRQ(ierr);
+    }
+    if (progress_filename[0]) {
+      ierr = PetscMemzero(&total,sizeof(total));CHKERRQ(ierr);
+      for (r=0; r<size; ++r) {
+	total.consumed += all[r].consumed;
+	total.total += all[r].total;
+	total.backfilling += !!all[r].backfilling;
+      }
+      snprintf(tmp_filename,sizeof(tmp_filename),"%s.tmp",progress_filename);
+      fd = fopen(tmp_filename,"w");
+      if (fd) {
+	fprintf(fd,"{\"response\": {\"consumed\": %lld, \"total\": %lld, \"backfilling\": %lld, \"ranks\": [",
+		(long long)total.consumed,(long long)total.total,(long long)total.backfilling);
+	for (r=0; r<size; ++r) {
+	  fprintf(fd,"%s{\"rank\": %d, \"consumed\": %lld, \"total\": %lld, \"backfilling\": %s}",r ? ", " : "",r,
+		  (long long)all[r].consumed,(long long)all[r].total,all[r].backfilling ? "true" : "false");
+	}
+	fprintf(fd,"]}}\n");
+	failed = ferror(fd);
+	if (fclose(fd) || failed || rename(tmp_filename,progress_filename)) {
+	  PetscFPrintf(PETSC_COMM_SELF,stderr,"Could not write the ingestion progress to %s: %s\n",progress_filename,strerror(errno));
+	}
+      } else {
+	PetscFPrintf(PETSC_COMM_SELF,stderr,"Could not open %s to write the ingestion progress\n",tmp_filename);
+      }
+    }
+    ierr = PetscFree(all);CHKERRQ(ierr);
+  }
+  mine = (PetscMPIInt)backfilling;
+  ierr = MPI_Allreduce(&mine,&any,1,MPI_INT,MPI_MAX,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  *any_backfilling = (PetscBool)(any != 0);
+  PetscFunctionReturn(0);
+}
+
 PetscErrorCode fork_server(MPI_Comm *inter, char *launcher_path, char *server_path, char *server_input_file, char *webserver_host, PetscInt port)
 {
   MPI_Comm newcomm;
@@ -191,40 +703,341 @@ PetscErrorCode fork_server(MPI_Comm *inter, char *launcher_path, char *server_pa
   PetscFunctionReturn(spawn_error);
 }
 
+/* what poll_once() needs: the stores main() set up (NULL for those not asked
+   for), and what is carried from one poll to the next */
+typedef struct {
+  PetscInt           mypid,rank;
+  InputType          input_type;
+  PetscBool          has_input_filename,has_accept,has_connect,has_connlat,has_life,has_retrans,
+		     has_states,has_rtt,has_drop;
+  size_t             linesize;
+  PetscInt           nentry;
+  tcpaccept_entry    accept_entry;
+  tcpconnect_entry   connect_entry;
+  tcpconnlat_entry   connlat_entry;
+  tcplife_entry      life_entry;
+  tcpretrans_entry   retrans_entry;
+  tcpstates_entry    states_entry;
+  tcprtt_entry       rtt_entry;
+  tcpdrop_entry      drop_entry;
+  PetscBool          ignore_entry;
+  process_statistics *summary_stats;
+  event_store        *estore;
+  history_store      *hstore;
+  http_server        *hserver;
+  rank_store         *rstore;
+  PetscInt           gather_every,npoll;
+  summary_snapshot   *snapshot;
+  summary_shm        *shm,*local_shm;
+  proc_sampler       *sampler;
+  job_resolver       *jresolver;
+  process_tree       *ptree;
+  pid_reaper         *reaper;
+  node_sampler       *nsampler;
+  sock_diag_collector *sdiag;
+  event_source       *esource;
+  FILE               *output;
+  PetscBool          has_text_output,has_node_sample;
+  const char         *text_filename,*text_tmp_filename;
+  node_summary       nsumm;
+  const char         *query_filename,*query_output_filename,*progress_filename;
+} poll_context;
+
+/* one poll: reads what is new in every input (at most backfill_chunk bytes of
+   each), summarizes it, and publishes the summaries everywhere they were asked
+   for. The node counters are sampled by the caller, in between polls. Tells
+   every rank in the second parameter whether any rank is still backfilling.
+   Collective. */
+PetscErrorCode poll_once(poll_context *ctx, PetscBool *any_backfilling)
+{
+  PetscErrorCode       ierr;
+  PetscBag             bag;
+  PetscInt             i,ires,num_pid,*pids;
+  process_data         *pdata;
+  process_data_summary *psumm;
+  PetscBool            gather;
+  int                  text_failed;
+  int64_t              now_ms;
+  PetscFunctionBeginUser;
+  backfilling = PETSC_FALSE;
+  if (ctx->has_input_filename && has_new_data(&input)) {
+    ierr = read_file(&input,&ctx->linesize,&line,&ctx->nentry,ctx->input_type,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->has_accept && has_new_data(&accept_input)) {
+    ierr = read_file(&accept_input,&ctx->linesize,&line,&ctx->nentry,TCPACCEPT,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->has_connect && has_new_data(&connect_input)) {
+    ierr = read_file(&connect_input,&ctx->linesize,&line,&ctx->nentry,TCPCONNECT,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->has_connlat && has_new_data(&connlat_input)) {
+    ierr = read_file(&connlat_input,&ctx->linesize,&line,&ctx->nentry,TCPCONNLAT,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->has_life && has_new_data(&life_input)) {
+    ierr = read_file(&life_input,&ctx->linesize,&line,&ctx->nentry,TCPLIFE,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->has_retrans && has_new_data(&retrans_input)) {
+    ierr = read_file(&retrans_input,&ctx->linesize,&line,&ctx->nentry,TCPRETRANS,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->has_states && has_new_data(&states_input)) {
+    ierr = read_file(&states_input,&ctx->linesize,&line,&ctx->nentry,TCPSTATES,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->has_rtt && has_new_data(&rtt_input)) {
+    ierr = read_file(&rtt_input,&ctx->linesize,&line,&ctx->nentry,TCPRTT,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->has_drop && has_new_data(&drop_input)) {
+    ierr = read_file(&drop_input,&ctx->linesize,&line,&ctx->nentry,TCPDROP,ctx->mypid,&ctx->accept_entry,
+		     &ctx->connect_entry,&ctx->connlat_entry,&ctx->life_entry,&ctx->retrans_entry,
+		     &ctx->states_entry,&ctx->rtt_entry,&ctx->drop_entry,
+		     &ctx->ignore_entry,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->esource) {
+    ierr = read_event_source(ctx->esource,ctx->mypid,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+  if (ctx->sdiag) {
+    ierr = sock_diag_collect(ctx->sdiag,&pstats,ctx->estore);CHKERRQ(ierr);
+  }
+
+  ierr = node_share_merge(&nshare,&pstats);CHKERRQ(ierr);
+
+  ierr = process_statistics_num_entries(ctx->summary_stats,&num_pid);CHKERRQ(ierr);
+  /* done with input files, summarize data */
+  ierr = PetscCalloc1(num_pid,&pids);CHKERRQ(ierr);
+  ierr = PetscCalloc1(num_pid,&pdata);CHKERRQ(ierr);
+
+  ierr = process_statistics_get_all(ctx->summary_stats,pdata,pids);CHKERRQ(ierr);
+  if (ctx->sampler) {
+    ierr = proc_sampler_poll(ctx->sampler,num_pid,pids);CHKERRQ(ierr);
+  }
+  if (ctx->jresolver) {
+    ierr = job_resolver_poll(ctx->jresolver,num_pid,pids);CHKERRQ(ierr);
+  }
+  now_ms = history_now_ms();
+  for (i=0; i<num_pid; ++i) {
+    ierr = create_process_summary_bag(&psumm,&bag,ctx->rank,i);CHKERRQ(ierr);
+    ierr = process_data_summarize(pids[i],&pdata[i],psumm);CHKERRQ(ierr);
+    if (ctx->ptree) {
+      ierr = process_tree_summarize(ctx->ptree,psumm);CHKERRQ(ierr);
+    }
+    if (ctx->sampler) {
+      ierr = proc_sampler_summarize(ctx->sampler,psumm);CHKERRQ(ierr);
+    }
+    if (ctx->jresolver) {
+      ierr = job_resolver_summarize(ctx->jresolver,psumm);CHKERRQ(ierr);
+    }
+    if (ctx->hstore) {
+      ierr = history_store_append(ctx->hstore,psumm,now_ms);CHKERRQ(ierr);
+    }
+    if (ctx->reaper) {
+      ierr = pid_reaper_observe(ctx->reaper,psumm,now_ms);CHKERRQ(ierr);
+    }
+    if (ctx->local_shm) {
+      ierr = summary_snapshot_add(&local_snapshot,psumm);CHKERRQ(ierr);
+    }
+    if (ctx->rstore) {
+      ierr = rank_store_add(ctx->rstore,psumm);CHKERRQ(ierr);
+    }
+    ires = buffer_try_insert(&buf,bag);
+    if (ires == -1) {
+      PetscFPrintf(PETSC_COMM_WORLD,stderr,"Error: buffer is full! Try increasing the capacity. Discarding this entry with pid %D and comm %s\n.",pids[i],psumm->comm);
+    }
+  }
+  ierr = PetscFree(pids);CHKERRQ(ierr);
+  ierr = PetscFree(pdata);CHKERRQ(ierr);
+  if (ctx->local_shm) {
+    ierr = summary_snapshot_seal(&local_snapshot,now_ms);CHKERRQ(ierr);
+    ierr = summary_shm_publish(ctx->local_shm,&local_snapshot);CHKERRQ(ierr);
+    ierr = summary_snapshot_write(&local_snapshot);CHKERRQ(ierr);
+  }
+
+  if (ctx->reaper) {
+    ierr = pid_reaper_evict(ctx->reaper,&pstats,ctx->hstore,ctx->estore,ctx->sampler,ctx->jresolver,ctx->sdiag,now_ms);CHKERRQ(ierr);
+  }
+  if (ctx->hstore) {
+    ierr = history_store_sync(ctx->hstore,now_ms);CHKERRQ(ierr);
+  }
+
+  if (ctx->rstore) {
+    ierr = rank_store_publish(ctx->rstore,ctx->hserver);CHKERRQ(ierr);
+  }
+
+  MPI_Barrier(PETSC_COMM_WORLD);
+  /* with --fanout, only every gather_every'th poll is gathered; the ranks answer
+     for themselves in between */
+  gather = (PetscBool)(!ctx->rstore || ctx->npoll % ctx->gather_every == 0);
+  ++(ctx->npoll);
+  if (gather) {
+    ierr = buffer_gather_summaries(&buf);CHKERRQ(ierr);
+  } else {
+    while (!buffer_empty(&buf)) {
+      ierr = buffer_pop(&buf);CHKERRQ(ierr);
+    }
+  }
+
+  if (!ctx->rank && gather) {
+    if (ctx->has_text_output) {
+      ctx->output = fopen(ctx->text_tmp_filename,"w");
+      if (!ctx->output) {
+	PetscFPrintf(PETSC_COMM_SELF,stderr,"Could not open %s to write the summaries: %s\n",ctx->text_tmp_filename,strerror(errno));
+      }
+    }
+    while (!buffer_empty(&buf)) {
+      ierr = buffer_get_item(&buf,&bag);CHKERRQ(ierr);
+      ierr = PetscBagGetData(bag,(void**)&psumm);CHKERRQ(ierr);
+      if (ctx->output) {
+	ierr = summary_view(ctx->output,psumm);CHKERRQ(ierr);
+      }
+      if (ctx->snapshot) {
+	ierr = summary_snapshot_add(ctx->snapshot,psumm);CHKERRQ(ierr);
+      }
+      if (ctx->hserver) {
+	ierr = http_server_add(ctx->hserver,psumm);CHKERRQ(ierr);
+      }
+      ierr = buffer_pop(&buf);CHKERRQ(ierr);
+    }
+    if (ctx->hserver) {
+      ierr = http_server_publish(ctx->hserver);CHKERRQ(ierr);
+    }
+  }
+  if (ctx->nsampler) {
+    ierr = node_sampler_summarize(ctx->nsampler,ctx->rank,&ctx->nsumm);CHKERRQ(ierr);
+  }
+  if (ctx->has_node_sample) {
+    ierr = node_summary_gather(&ctx->nsumm,gather ? ctx->output : NULL,gather ? ctx->snapshot : NULL);CHKERRQ(ierr);
+  }
+  if (!ctx->rank && gather) {
+    if (ctx->snapshot) {
+      ierr = summary_snapshot_seal(ctx->snapshot,now_ms);CHKERRQ(ierr);
+      if (ctx->shm) {
+	ierr = summary_shm_publish(ctx->shm,ctx->snapshot);CHKERRQ(ierr);
+      }
+      ierr = summary_snapshot_write(ctx->snapshot);CHKERRQ(ierr);
+    }
+    if (ctx->has_text_output && ctx->output) {
+      text_failed = ferror(ctx->output);
+      if (fclose(ctx->output) || text_failed || rename(ctx->text_tmp_filename,ctx->text_filename)) {
+	PetscFPrintf(PETSC_COMM_SELF,stderr,"Could not write the summaries to %s: %s\n",ctx->text_filename,strerror(errno));
+      }
+      ctx->output = NULL;
+    }
+  }
+  ierr = serve_queries(ctx->estore,ctx->query_filename,ctx->query_output_filename);CHKERRQ(ierr);
+  ierr = gather_progress(ctx->hserver,ctx->esource,ctx->progress_filename,any_backfilling);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* puts the name in the third parameter followed by the suffix in the fourth into
+   the first parameter, which holds the number of characters in the second. Unless
+   the rank in the fifth parameter is negative, .rank<rank> follows the suffix.
+   A name that does not fit is an error, rather than a file named after part of it. */
+static PetscErrorCode derived_filename(char *filename, size_t len, const char *name, const char *suffix, PetscInt rank)
+{
+  PetscErrorCode ierr;
+  size_t         count;
+  PetscFunctionBeginUser;
+  if (rank < 0) {
+    ierr = PetscSNPrintfCount(filename,len,"%s%s",&count,name,suffix);CHKERRQ(ierr);
+  } else {
+    ierr = PetscSNPrintfCount(filename,len,"%s%s.rank%D",&count,name,suffix,rank);CHKERRQ(ierr);
+  }
+  if (count > len) {
+    SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_ARG_SIZ,"The file name %s%s... is longer than %D characters",name,suffix,(PetscInt)len - 1);
+  }
+  PetscFunctionReturn(0);
+}
+
 int main(int argc, char **argv)
 {
   PetscErrorCode ierr;
-  PetscBag       bag;
-  size_t         buf_capacity,linesize;
-  PetscInt       N,ires,nentry,mypid,rank,size,num_pid,i,*pids,flask_port;
+  size_t         buf_capacity;
+  PetscInt       N,mypid,rank,size,flask_port,metrics_max_series;
   PetscReal      polling_interval;
   char           filename[PETSC_MAX_PATH_LEN],url_filename[PETSC_MAX_PATH_LEN],sawsurl[256];
   char           accept_filename[PETSC_MAX_PATH_LEN], connect_filename[PETSC_MAX_PATH_LEN],
                  connlat_filename[PETSC_MAX_PATH_LEN], output_filename[PETSC_MAX_PATH_LEN],
                  life_filename[PETSC_MAX_PATH_LEN], retrans_filename[PETSC_MAX_PATH_LEN],
+                 states_filename[PETSC_MAX_PATH_LEN], rtt_filename[PETSC_MAX_PATH_LEN],
+                 drop_filename[PETSC_MAX_PATH_LEN],
     python_server_name[PETSC_MAX_PATH_LEN], python_launcher_name[PETSC_MAX_PATH_LEN],
-    webserver_host[PETSC_MAX_PATH_LEN];
+    webserver_host[PETSC_MAX_PATH_LEN], query_filename[PETSC_MAX_PATH_LEN],
+    query_output_filename[PETSC_MAX_PATH_LEN], history_filename[PETSC_MAX_PATH_LEN],
+    history_prefix[PETSC_MAX_PATH_LEN], event_source_path[PETSC_MAX_PATH_LEN],
+    event_record_filename[PETSC_MAX_PATH_LEN], filter_text[EVENT_FILTER_MAX_LEN];
   MPI_Comm       server_comm;
   FILE           *output;
-  PetscBool      has_filename,has_filename2,ignore_entry,has_accept,has_connect,has_connlat,has_life,has_retrans,has_input_filename,has_port;
+  PetscBool      has_filename,has_filename2,has_accept,has_connect,has_connlat,has_life,has_retrans,has_input_filename,has_port,has_output_file;
   InputType      input_type;
-  tcpaccept_entry accept_entry;
-  tcpconnect_entry connect_entry;
-  tcpconnlat_entry connlat_entry;
-  tcplife_entry life_entry;
-  tcpretrans_entry retrans_entry;
-  process_data       *pdata;
-  process_data_summary *psumm;
+  PetscBool      has_states,has_rtt,has_drop;
+  event_store    *estore_ptr=NULL;
+  history_store  *hstore_ptr=NULL;
+  PetscBool      has_history,has_proc_sample;
+  http_server    *hserver_ptr=NULL;
+  PetscBool      has_native_server,has_webserver_host;
+  rank_store     *rstore_ptr=NULL;
+  PetscBool      has_fanout;
+  PetscInt       gather_every;
+  summary_snapshot *snapshot_ptr=NULL;
+  PetscBool      has_text_output;
+  char           text_filename[PETSC_MAX_PATH_LEN],text_tmp_filename[PETSC_MAX_PATH_LEN+8];
+  summary_shm    *shm_ptr=NULL,*local_shm_ptr=NULL;
+  PetscBool      has_shm,has_shm_local;
+  char           shm_name[PETSC_MAX_PATH_LEN],local_shm_name[PETSC_MAX_PATH_LEN+16];
+  proc_sampler   *sampler_ptr=NULL;
+  job_resolver   *jresolver_ptr=NULL;
+  PetscBool      has_jobs;
+  process_tree   *ptree_ptr=NULL;
+  PetscBool      has_rollup;
+  process_statistics *summary_stats;
+  pid_reaper     *reaper_ptr=NULL;
+  PetscBool      node_leader;
+  PetscBool      has_reap,has_pid_ttl,has_archive_file;
+  PetscReal      pid_ttl,archive_retention;
+  char           archive_filename[PETSC_MAX_PATH_LEN],archive_prefix[PETSC_MAX_PATH_LEN];
+  node_sampler   *nsampler_ptr=NULL;
+  sock_diag_collector *sdiag_ptr=NULL;
+  PetscBool      has_sock_diag;
+  event_source   *esource_ptr=NULL;
+  EventSourceType event_source_type;
+  PetscBool      has_event_source,has_event_source_path;
+  PetscBool      has_node_sample;
+  PetscReal      node_sample_interval,slept;
+  PetscBool      any_backfilling;
+  char           progress_filename[PETSC_MAX_PATH_LEN+16];
+  poll_context   ctx;
   ierr = PetscInitialize(&argc,&argv,NULL,help);if (ierr) return ierr;
   ierr = register_mpi_types();CHKERRQ(ierr);
   mypid = getpid();
   MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
   MPI_Comm_size(PETSC_COMM_WORLD,&size);
   line = NULL;
-  linesize = 0;
+  ierr = PetscMemzero(&ctx,sizeof(ctx));CHKERRQ(ierr);
   //signal(SIGSEGV,segv_handler);
   //signal(SIGABRT,sigabrt_handler);
-  has_filename = has_filename2 = ignore_entry = has_accept = has_connect = has_connlat = has_life = has_retrans = has_input_filename = PETSC_FALSE;
+  has_filename = has_filename2 = has_accept = has_connect = has_connlat = has_life = has_retrans = has_input_filename = PETSC_FALSE;
+  has_states = has_rtt = has_drop = PETSC_FALSE;
 
   ierr = PetscOptionsGetString(NULL,NULL,"--python_server",python_server_name,PETSC_MAX_PATH_LEN,&has_filename);
   if (!has_filename) {
@@ -234,8 +1047,8 @@ int main(int argc, char **argv)
   if (!has_filename) {
     strcpy(python_launcher_name,"./webserver_launcher");
   }
-  ierr = PetscOptionsGetString(NULL,NULL,"--webserver_host",webserver_host,PETSC_MAX_PATH_LEN,&has_filename);CHKERRQ(ierr);
-  if (!has_filename) {
+  ierr = PetscOptionsGetString(NULL,NULL,"--webserver_host",webserver_host,PETSC_MAX_PATH_LEN,&has_webserver_host);CHKERRQ(ierr);
+  if (!has_webserver_host) {
     if (!rank) {
       ierr = gethostname(webserver_host,PETSC_MAX_PATH_LEN);
       if (ierr) {
@@ -249,8 +1062,50 @@ int main(int argc, char **argv)
   ierr = PetscOptionsGetString(NULL,NULL,"--connlat_file",connlat_filename,PETSC_MAX_PATH_LEN,&has_connlat);CHKERRQ(ierr);
   ierr = PetscOptionsGetString(NULL,NULL,"--life_file",life_filename,PETSC_MAX_PATH_LEN,&has_life);CHKERRQ(ierr);
   ierr = PetscOptionsGetString(NULL,NULL,"--retrans_file",retrans_filename,PETSC_MAX_PATH_LEN,&has_retrans);CHKERRQ(ierr);
-  if (!(has_input_filename || has_accept || has_connect || has_connlat || has_life || has_retrans)) {
-    SETERRQ(PETSC_COMM_WORLD,1,"Must provide an input filename (-file and -type and/or any of --accept_file,--connect_file,etc.)");
+  ierr = PetscOptionsGetString(NULL,NULL,"--states_file",states_filename,PETSC_MAX_PATH_LEN,&has_states);CHKERRQ(ierr);
+  ierr = PetscOptionsGetString(NULL,NULL,"--rtt_file",rtt_filename,PETSC_MAX_PATH_LEN,&has_rtt);CHKERRQ(ierr);
+  ierr = PetscOptionsGetString(NULL,NULL,"--drop_file",drop_filename,PETSC_MAX_PATH_LEN,&has_drop);CHKERRQ(ierr);
+  ierr = PetscOptionsHasName(NULL,NULL,"--sock_diag",&has_sock_diag);CHKERRQ(ierr);
+  ierr = PetscOptionsGetEnum(NULL,NULL,"--event_source",EventSourceTypes,(PetscEnum*)&event_source_type,&has_event_source);CHKERRQ(ierr);
+  ierr = PetscOptionsGetString(NULL,NULL,"--event_source_path",event_source_path,PETSC_MAX_PATH_LEN,&has_event_source_path);CHKERRQ(ierr);
+  if (!(has_input_filename || has_accept || has_connect || has_connlat || has_life || has_retrans
+	|| has_states || has_rtt || has_drop || has_sock_diag || has_event_source)) {
+    SETERRQ(PETSC_COMM_WORLD,1,"Must provide an input filename (-file and -type and/or any of --accept_file,--connect_file,etc.), --sock_diag or --event_source");
+  }
+  /* deal the input files out among the ranks on this node; the sources that cannot
+     be split stay with the node's leader */
+  N = 1024;
+  ierr = PetscOptionsGetInt(NULL,NULL,"--node_share_capacity",&N,&has_filename);CHKERRQ(ierr);
+  ierr = node_share_create(&nshare,PETSC_COMM_WORLD,N);CHKERRQ(ierr);
+  node_leader = (PetscBool)node_share_is_leader(&nshare);
+  if (nshare.node_size > 1) {
+    has_input_filename = node_share_claim(&nshare,has_input_filename);
+    has_accept = node_share_claim(&nshare,has_accept);
+    has_connect = node_share_claim(&nshare,has_connect);
+    has_connlat = node_share_claim(&nshare,has_connlat);
+    has_life = node_share_claim(&nshare,has_life);
+    has_retrans = node_share_claim(&nshare,has_retrans);
+    has_states = node_share_claim(&nshare,has_states);
+    has_rtt = node_share_claim(&nshare,has_rtt);
+    has_drop = node_share_claim(&nshare,has_drop);
+    has_sock_diag = (PetscBool)(has_sock_diag && node_leader);
+    has_event_source = (PetscBool)(has_event_source && node_leader);
+  }
+  if (has_event_source) {
+    if (!has_event_source_path) {
+      if (event_source_type != EVENT_SOURCE_RINGBUF) {
+	SETERRQ(PETSC_COMM_WORLD,1,"--event_source REPLAY and LOG need --event_source_path");
+      }
+      strcpy(event_source_path,EVENT_SOURCE_DEFAULT_PIN);
+    }
+    ierr = event_source_open(&esource,event_source_type,event_source_path);CHKERRQ(ierr);
+    esource_ptr = &esource;
+  }
+  ierr = PetscOptionsGetString(NULL,NULL,"--filter",filter_text,EVENT_FILTER_MAX_LEN,&has_filename);CHKERRQ(ierr);
+  ierr = event_filter_compile(has_filename ? filter_text : "",&filter);CHKERRQ(ierr);
+  ierr = PetscOptionsGetString(NULL,NULL,"--event_record",event_record_filename,PETSC_MAX_PATH_LEN,&has_filename);CHKERRQ(ierr);
+  if (has_filename) {
+    ierr = event_record_file_open(event_record_filename,&record_output);CHKERRQ(ierr);
   }
   ierr = PetscOptionsGetString(NULL,NULL,"-o",output_filename,PETSC_MAX_PATH_LEN,&has_filename);CHKERRQ(ierr);
   if (!has_filename) {
@@ -262,212 +1117,374 @@ int main(int argc, char **argv)
       output = stdout;
     } else if(strcmp(output_filename,"stderr") == 0) {
       output = stderr;
-    } else if (!rank) {
-      output = fopen(output_filename,"w");
+    } else {
+      /* the summaries go to a binary snapshot; text only if asked for */
+      output = NULL;
     }
   } else {
     output = stdout;
   }
+  has_output_file = (PetscBool)((has_filename || has_filename2) && strcmp(output_filename,"stdout") && strcmp(output_filename,"stderr"));
+  shm_name[0] = '\0';
+  ierr = PetscOptionsGetString(NULL,NULL,"--shm",shm_name,PETSC_MAX_PATH_LEN,&has_shm);CHKERRQ(ierr);
+  ierr = PetscOptionsHasName(NULL,NULL,"--shm_local",&has_shm_local);CHKERRQ(ierr);
+  if ((has_shm || has_shm_local) && !shm_name[0]) {
+    strcpy(shm_name,"/dcprof");
+  }
+  if ((has_output_file || has_shm) && !rank) {
+    ierr = summary_snapshot_create(&snapshot,has_output_file ? output_filename : NULL);CHKERRQ(ierr);
+    snapshot_ptr = &snapshot;
+  }
+  if (has_shm && !rank) {
+    ierr = summary_shm_create(&shm,shm_name);CHKERRQ(ierr);
+    shm_ptr = &shm;
+  }
+  if (has_shm_local) {
+    sprintf(local_shm_name,"%s.rank%d",shm_name,rank);
+    ierr = summary_snapshot_create(&local_snapshot,NULL);CHKERRQ(ierr);
+    ierr = summary_shm_create(&local_shm,local_shm_name);CHKERRQ(ierr);
+    local_shm_ptr = &local_shm;
+  }
+  ierr = PetscOptionsGetString(NULL,NULL,"--text_output",text_filename,PETSC_MAX_PATH_LEN,&has_text_output);CHKERRQ(ierr);
+  if (has_text_output) {
+    sprintf(text_tmp_filename,"%s.tmp",text_filename);
+  }
 
   flask_port = 5000;
   ierr = PetscOptionsGetInt(NULL,NULL,"-p",&flask_port,&has_port);CHKERRQ(ierr);
   if (!has_port) {
     ierr = PetscOptionsGetInt(NULL,NULL,"--port",&flask_port,&has_port);CHKERRQ(ierr);
   }
-  ignore_entry = PETSC_FALSE;
-  N = 10000;
-  ierr = PetscOptionsGetInt(NULL,NULL,"--buffer_capacity",&N,&has_filename);CHKERRQ(ierr);
+  ierr = PetscOptionsHasName(NULL,NULL,"--native_server",&has_native_server);CHKERRQ(ierr);
+  metrics_max_series = HTTP_METRICS_MAX_SERIES;
+  ierr = PetscOptionsGetInt(NULL,NULL,"--metrics_max_series",&metrics_max_series,NULL);CHKERRQ(ierr);
+  if (has_native_server && !rank) {
+    ierr = http_server_start(&hserver,has_webserver_host ? webserver_host : NULL,flask_port,metrics_max_series);CHKERRQ(ierr);
+    hserver_ptr = &hserver;
+  }
+  ierr = PetscOptionsHasName(NULL,NULL,"--fanout",&has_fanout);CHKERRQ(ierr);
+  gather_every = 12;
+  ierr = PetscOptionsGetInt(NULL,NULL,"--gather_every",&gather_every,NULL);CHKERRQ(ierr);
+  if (has_fanout) {
+    if (!has_native_server) {
+      SETERRQ(PETSC_COMM_WORLD,1,"--fanout needs --native_server, which answers from the ranks");
+    }
+    if (gather_every <= 0) {
+      SETERRQ(PETSC_COMM_WORLD,1,"--gather_every must be positive");
+    }
+    ierr = rank_store_create(&rstore,1024);CHKERRQ(ierr);
+    rstore_ptr = &rstore;
+  }
   polling_interval = 5.0;
   ierr = PetscOptionsGetReal(NULL,NULL,"--polling_interval",&polling_interval,&has_filename);
+  N = 16777216;
+  ierr = PetscOptionsGetInt(NULL,NULL,"--backfill_chunk",&N,&has_filename);CHKERRQ(ierr);
+  if (N < 0) {
+    SETERRQ(PETSC_COMM_WORLD,1,"--backfill_chunk must not be negative");
+  }
+  backfill_chunk = (long)N;
+  if (esource_ptr) {
+    esource.max_bytes = (size_t)backfill_chunk;
+  }
+  if (has_output_file) {
+    sprintf(progress_filename,"%s.progress",output_filename);
+  } else {
+    progress_filename[0] = '\0';
+  }
   
+  N = 65536;
+  ierr = PetscOptionsGetInt(NULL,NULL,"--event_store_capacity",&N,&has_filename);CHKERRQ(ierr);
+  if (N > 0) {
+    ierr = event_store_create(&estore,(size_t)N);CHKERRQ(ierr);
+    estore_ptr = &estore;
+  }
+  ierr = PetscOptionsGetString(NULL,NULL,"--query_file",query_filename,PETSC_MAX_PATH_LEN,&has_filename);CHKERRQ(ierr);
+  if (!has_filename) {
+    if (has_output_file) {
+      ierr = derived_filename(query_filename,PETSC_MAX_PATH_LEN,output_filename,".query",-1);CHKERRQ(ierr);
+    } else {
+      query_filename[0] = '\0';
+    }
+  }
+  ierr = PetscOptionsGetString(NULL,NULL,"--query_output",query_output_filename,PETSC_MAX_PATH_LEN,&has_filename);CHKERRQ(ierr);
+  if (!has_filename) {
+    if (has_output_file) {
+      ierr = derived_filename(query_output_filename,PETSC_MAX_PATH_LEN,output_filename,".query_results",-1);CHKERRQ(ierr);
+    } else {
+      strcpy(query_output_filename,"stdout");
+    }
+  }
+
+  ierr = PetscOptionsHasName(NULL,NULL,"--history",&has_history);CHKERRQ(ierr);
+  ierr = PetscOptionsGetString(NULL,NULL,"--history_file",history_prefix,PETSC_MAX_PATH_LEN,&has_filename);CHKERRQ(ierr);
+  if (has_filename) {
+    ierr = derived_filename(history_filename,PETSC_MAX_PATH_LEN,history_prefix,"",rank);CHKERRQ(ierr);
+  } else if (has_history) {
+    if (!has_output_file) {
+      SETERRQ(PETSC_COMM_WORLD,1,"--history needs an output file (-o) or --history_file to know where to store the history");
+    }
+    ierr = derived_filename(history_filename,PETSC_MAX_PATH_LEN,output_filename,".history",rank);CHKERRQ(ierr);
+  }
+  if (has_history || has_filename) {
+    ierr = history_store_open(&hstore,history_filename,rank);CHKERRQ(ierr);
+    hstore_ptr = &hstore;
+  }
+
+  ierr = PetscOptionsHasName(NULL,NULL,"--reap",&has_reap);CHKERRQ(ierr);
+  pid_ttl = 0.0;
+  ierr = PetscOptionsGetReal(NULL,NULL,"--pid_ttl",&pid_ttl,&has_pid_ttl);CHKERRQ(ierr);
+  archive_retention = 604800.0;
+  ierr = PetscOptionsGetReal(NULL,NULL,"--archive_retention",&archive_retention,&has_filename);CHKERRQ(ierr);
+  ierr = PetscOptionsGetString(NULL,NULL,"--archive_file",archive_prefix,PETSC_MAX_PATH_LEN,&has_archive_file);CHKERRQ(ierr);
+  if (has_reap || has_pid_ttl || has_archive_file) {
+    if (has_archive_file) {
+      ierr = derived_filename(archive_filename,PETSC_MAX_PATH_LEN,archive_prefix,"",rank);CHKERRQ(ierr);
+    } else if (has_output_file) {
+      ierr = derived_filename(archive_filename,PETSC_MAX_PATH_LEN,output_filename,".archive",rank);CHKERRQ(ierr);
+    } else {
+      SETERRQ(PETSC_COMM_WORLD,1,"--reap needs an output file (-o) or --archive_file to know where to archive evicted processes");
+    }
+    if (pid_ttl < 0.0 || archive_retention < 0.0) {
+      SETERRQ(PETSC_COMM_WORLD,1,"--pid_ttl and --archive_retention must not be negative");
+    }
+    ierr = pid_reaper_open(&reaper,archive_filename,rank,(int64_t)(1000*pid_ttl),(int64_t)(1000*archive_retention));CHKERRQ(ierr);
+    reaper_ptr = &reaper;
+  }
+
+  ierr = PetscOptionsHasName(NULL,NULL,"--proc_sample",&has_proc_sample);CHKERRQ(ierr);
+  if (has_proc_sample) {
+    N = 768;
+    ierr = PetscOptionsGetInt(NULL,NULL,"--proc_max_fds",&N,&has_filename);CHKERRQ(ierr);
+    ierr = proc_sampler_create(&sampler,N);CHKERRQ(ierr);
+    sampler_ptr = &sampler;
+  }
+
+  ierr = PetscOptionsHasName(NULL,NULL,"--jobs",&has_jobs);CHKERRQ(ierr);
+  if (has_jobs) {
+    ierr = job_resolver_create(&jresolver);CHKERRQ(ierr);
+    jresolver_ptr = &jresolver;
+  }
+
+  ierr = PetscOptionsHasName(NULL,NULL,"--node_sample",&has_node_sample);CHKERRQ(ierr);
+  node_sample_interval = 0.25;
+  ierr = PetscOptionsGetReal(NULL,NULL,"--node_sample_interval",&node_sample_interval,&has_filename);CHKERRQ(ierr);
+  if (has_node_sample) {
+    if (node_sample_interval <= 0.0) {
+      SETERRQ(PETSC_COMM_WORLD,1,"--node_sample_interval must be positive");
+    }
+    /* the other ranks of the node still take part in node_summary_gather() */
+    ctx.nsumm.rank = -1;
+    if (node_leader) {
+      ierr = node_sampler_create(&nsampler);CHKERRQ(ierr);
+      nsampler_ptr = &nsampler;
+    }
+  }
+
+  N = 10000;
+  ierr = PetscOptionsGetInt(NULL,NULL,"--buffer_capacity",&N,&has_filename);CHKERRQ(ierr);
   buf_capacity = (size_t)N;
   ierr = buffer_create(&buf,buf_capacity);CHKERRQ(ierr);
   //signal(SIGINT,sigint_handler);
   ierr = PetscOptionsGetEnum(NULL,NULL,"-type",InputTypes,(PetscEnum*)&input_type,&has_filename);CHKERRQ(ierr);
   ierr = process_statistics_init(&pstats);CHKERRQ(ierr);
-  /* read each file */
+  summary_stats = &pstats;
+  ierr = PetscOptionsHasName(NULL,NULL,"--rollup",&has_rollup);CHKERRQ(ierr);
+  /* workers hand their data to the leader before it is summarized, and the leader rolls it up */
+  if (has_rollup && node_leader) {
+    ierr = process_tree_create(&ptree);CHKERRQ(ierr);
+    ptree_ptr = &ptree;
+    pstats.tree = ptree_ptr;
+    /* summaries are of whole subtrees; the per-PID data is still kept in pstats */
+    summary_stats = &ptree.rollup;
+  }
+  if (has_sock_diag) {
+    ierr = sock_diag_create(&sdiag,mypid);CHKERRQ(ierr);
+    sdiag_ptr = &sdiag;
+  }
+  /* open each file; every poll reads what is new in it, backfill_chunk bytes at most */
   if (has_input_filename) {
     if (access(filename,R_OK) != 0) {
       SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",filename);
     }
     input.file = fopen(filename,"r");
-
-    ierr = read_file(input.file,&linesize,&line,&nentry,input_type,mypid,&accept_entry,
-		     &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		     &ignore_entry,&pstats);CHKERRQ(ierr);
-  } /* if has_input_filename */
-
+  }
   if (has_accept) {
     if (access(accept_filename,R_OK) != 0) {
       SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",accept_filename);
     }
     accept_input.file = fopen(accept_filename,"r");
-    ierr = read_file(accept_input.file,&linesize,&line,&nentry,TCPACCEPT,mypid,&accept_entry,
-		     &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		     &ignore_entry,&pstats);CHKERRQ(ierr);
   }
-
   if (has_connect) {
     if (access(connect_filename,R_OK) != 0) {
       SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",connect_filename);
     }
     connect_input.file = fopen(connect_filename,"r");
-    ierr = read_file(connect_input.file,&linesize,&line,&nentry,TCPCONNECT,mypid,&accept_entry,
-		     &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		     &ignore_entry,&pstats);CHKERRQ(ierr);
   }
-
   if (has_connlat) {
     if (access(connlat_filename,R_OK) != 0) {
       SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",connlat_filename);
     }
     connlat_input.file = fopen(connlat_filename,"r");
-    ierr = read_file(connlat_input.file,&linesize,&line,&nentry,TCPCONNLAT,mypid,&accept_entry,
-		     &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		     &ignore_entry,&pstats);CHKERRQ(ierr);
   }
-
   if (has_life) {
     if (access(life_filename,R_OK) != 0) {
       SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",life_filename);
     }
     life_input.file = fopen(life_filename,"r");
-    ierr = read_file(life_input.file,&linesize,&line,&nentry,TCPLIFE,mypid,&accept_entry,
-		     &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		     &ignore_entry,&pstats);CHKERRQ(ierr);
   }
-
   if (has_retrans) {
     if (access(retrans_filename,R_OK) != 0) {
       SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",retrans_filename);
     }
     retrans_input.file = fopen(retrans_filename,"r");
-    ierr = read_file(retrans_input.file,&linesize,&line,&nentry,TCPRETRANS,mypid,&accept_entry,
-		     &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		     &ignore_entry,&pstats);CHKERRQ(ierr);
   }
-  
-
-
-  ierr = process_statistics_num_entries(&pstats,&num_pid);CHKERRQ(ierr);
-  /* done with input files, summarize data */
-  ierr = PetscCalloc1(num_pid,&pids);CHKERRQ(ierr);
-  ierr = PetscCalloc1(num_pid,&pdata);CHKERRQ(ierr);
-
-  ierr = process_statistics_get_all(&pstats,pdata,pids);CHKERRQ(ierr);
-  for (i=0; i<num_pid; ++i) {
-    ierr = create_process_summary_bag(&psumm,&bag,rank,i);CHKERRQ(ierr);
-    ierr = process_data_summarize(pids[i],&pdata[i],psumm);CHKERRQ(ierr);
-    ires = buffer_try_insert(&buf,bag);
-    if (ires == -1) {
-      PetscFPrintf(PETSC_COMM_WORLD,stderr,"Error: buffer is full! Try increasing the capacity. Discarding this entry with pid %D and comm %s\n.",pids[i],psumm->comm);
-    } 
+  if (has_states) {
+    if (access(states_filename,R_OK) != 0) {
+      SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",states_filename);
+    }
+    states_input.file = fopen(states_filename,"r");
   }
-
-  MPI_Barrier(PETSC_COMM_WORLD);
-  ierr = buffer_gather_summaries(&buf);CHKERRQ(ierr);
-  
-  if (!rank) {
-    while (!buffer_empty(&buf)) {
-      ierr = buffer_get_item(&buf,&bag);CHKERRQ(ierr);
-      ierr = PetscBagGetData(bag,(void**)&psumm);CHKERRQ(ierr);
-      ierr = summary_view(output,psumm);CHKERRQ(ierr);
-      ierr = buffer_pop(&buf);CHKERRQ(ierr);
+  if (has_rtt) {
+    if (access(rtt_filename,R_OK) != 0) {
+      SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",rtt_filename);
     }
+    rtt_input.file = fopen(rtt_filename,"r");
   }
-  if (!rank) {
-    if (output && output != stdout && output != stderr) {
-      fclose(output);
+  if (has_drop) {
+    if (access(drop_filename,R_OK) != 0) {
+      SETERRQ1(PETSC_COMM_WORLD,1,"Could not find readable file %s\n",drop_filename);
     }
+    drop_input.file = fopen(drop_filename,"r");
   }
-  
-  if (!rank) {
+
+  ctx.mypid = mypid;
+  ctx.rank = rank;
+  ctx.input_type = input_type;
+  ctx.has_input_filename = has_input_filename;
+  ctx.has_accept = has_accept;
+  ctx.has_connect = has_connect;
+  ctx.has_connlat = has_connlat;
+  ctx.has_life = has_life;
+  ctx.has_retrans = has_retrans;
+  ctx.has_states = has_states;
+  ctx.has_rtt = has_rtt;
+  ctx.has_drop = has_drop;
+  ctx.summary_stats = summary_stats;
+  ctx.estore = estore_ptr;
+  ctx.hstore = hstore_ptr;
+  ctx.hserver = hserver_ptr;
+  ctx.rstore = rstore_ptr;
+  ctx.gather_every = gather_every;
+  ctx.snapshot = snapshot_ptr;
+  ctx.shm = shm_ptr;
+  ctx.local_shm = local_shm_ptr;
+  ctx.sampler = sampler_ptr;
+  ctx.jresolver = jresolver_ptr;
+  ctx.ptree = ptree_ptr;
+  ctx.reaper = reaper_ptr;
+  ctx.nsampler = nsampler_ptr;
+  ctx.sdiag = sdiag_ptr;
+  ctx.esource = esource_ptr;
+  ctx.output = output;
+  ctx.has_text_output = has_text_output;
+  ctx.text_filename = text_filename;
+  ctx.text_tmp_filename = text_tmp_filename;
+  ctx.has_node_sample = has_node_sample;
+  ctx.query_filename = query_filename;
+  ctx.query_output_filename = query_output_filename;
+  ctx.progress_filename = progress_filename;
+
+  /* the node counters are otherwise sampled while waiting for the next poll */
+  if (nsampler_ptr) {
+    ierr = node_sampler_sample(nsampler_ptr);CHKERRQ(ierr);
+  }
+  ierr = poll_once(&ctx,&any_backfilling);CHKERRQ(ierr);
+
+  if (!rank && !hserver_ptr) {
     // launch server
-    if (output != stdout && output != stderr) {
+    if (has_output_file) {
       ierr = fork_server(&server_comm,python_launcher_name,python_server_name,output_filename,webserver_host,flask_port);CHKERRQ(ierr);
     } else {
       PetscFPrintf(PETSC_COMM_WORLD,stderr,"Must provide an output filename with -o or --output if you want the webserver to launch!\n");
     }
   }
-  /* done with the file; now wait for more data; */
+  /* done with the file (or its first chunk); now wait for more data; */
   while (PETSC_TRUE) {
-    if (has_input_filename && has_new_data(&input)) {
-      ierr = read_file(input.file,&linesize,&line,&nentry,input_type,mypid,
-		       &accept_entry, &connect_entry,&connlat_entry,&life_entry,
-		       &retrans_entry,&ignore_entry,&pstats);CHKERRQ(ierr);
-    }
-    if (has_accept && has_new_data(&accept_input))  {
-      ierr = read_file(accept_input.file,&linesize,&line,&nentry,TCPACCEPT,mypid,&accept_entry,
-		       &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		       &ignore_entry,&pstats);CHKERRQ(ierr);
-    } 
-    if (has_connect && has_new_data(&connect_input)) {
-      ierr = read_file(connect_input.file,&linesize,&line,&nentry,TCPCONNECT,mypid,&accept_entry,
-		       &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		       &ignore_entry,&pstats);CHKERRQ(ierr);
-    }
-    if (has_connlat && has_new_data(&connlat_input)) {
-      ierr = read_file(connlat_input.file,&linesize,&line,&nentry,TCPCONNLAT,mypid,&accept_entry,
-		       &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		       &ignore_entry,&pstats);CHKERRQ(ierr);
-    }
-    if (has_life && has_new_data(&life_input)) {
-      ierr = read_file(life_input.file,&linesize,&line,&nentry,TCPLIFE,mypid,&accept_entry,
-		       &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		       &ignore_entry,&pstats);CHKERRQ(ierr);
-    }
-    if (has_retrans && has_new_data(&retrans_input)) {
-      ierr = read_file(retrans_input.file,&linesize,&line,&nentry,TCPRETRANS,mypid,&accept_entry,
-		       &connect_entry,&connlat_entry,&life_entry,&retrans_entry,
-		       &ignore_entry,&pstats);CHKERRQ(ierr);
-    } 
-    
-    ierr = process_statistics_num_entries(&pstats,&num_pid);CHKERRQ(ierr);
-    if (!pids) {
-      ierr = PetscMalloc(num_pid * sizeof(PetscInt),&pids);CHKERRQ(ierr);
-    } else {
-      ierr = PetscRealloc(num_pid * sizeof(PetscInt),&pids);CHKERRQ(ierr);
-    }
-    if (!pdata) {
-      ierr = PetscMalloc(num_pid * sizeof(process_data),&pdata);CHKERRQ(ierr);
-    } else {
-      ierr = PetscFree(pdata);CHKERRQ(ierr);
-      ierr = PetscMalloc(num_pid * sizeof(process_data),&pdata);CHKERRQ(ierr);
-    }
-    ierr = process_statistics_get_all(&pstats,pdata,pids);CHKERRQ(ierr);
-
-    for (i=0; i<num_pid; ++i) {
-      ierr = create_process_summary_bag(&psumm,&bag,rank,i);CHKERRQ(ierr);
-      ierr = process_data_summarize(pids[i],&pdata[i],psumm);CHKERRQ(ierr);
-      ires = buffer_try_insert(&buf,bag);
-      if (ires == -1) {
-	PetscFPrintf(PETSC_COMM_WORLD,stderr,"Error: buffer is full! Try increasing the capacity. Discarding this entry with pid %D and comm %s\n.",pids[i],psumm->comm);
+    ierr = poll_once(&ctx,&any_backfilling);CHKERRQ(ierr);
+    /* wait for new entries, unless some rank is still working through a
+       backlog: then every rank goes on to the next chunk right away */
+    if (any_backfilling) {
+      if (rstore_ptr) {
+	ierr = rank_store_serve(rstore_ptr,hserver_ptr,0.0);CHKERRQ(ierr);
       }
-    }
-
-    ierr = buffer_gather_summaries(&buf);CHKERRQ(ierr);
-      
-    if (!rank) {
-      if (output != stdout && output != stderr) {
-	output = fopen(output_filename,"w");
-      }
-      while (!buffer_empty(&buf)) {
-	ierr = buffer_get_item(&buf,&bag);CHKERRQ(ierr);
-	ierr = PetscBagGetData(bag,(void**)&psumm);CHKERRQ(ierr);
-	ierr = summary_view(output,psumm);CHKERRQ(ierr);
-	ierr = buffer_pop(&buf);CHKERRQ(ierr);
+      if (nsampler_ptr) {
+	ierr = node_sampler_sample(nsampler_ptr);CHKERRQ(ierr);
       }
-      if (output != stdout && output != stderr) {
-	fclose(output);
+    } else if (nsampler_ptr) {
+      /* slice the wait so the node counters are sampled more often than we poll */
+      for (slept=0.0; slept<polling_interval; slept+=node_sample_interval) {
+	if (rstore_ptr) {
+	  ierr = rank_store_serve(rstore_ptr,hserver_ptr,PetscMin(node_sample_interval,polling_interval-slept));CHKERRQ(ierr);
+	} else {
+	  ierr = PetscSleep(PetscMin(node_sample_interval,polling_interval-slept));CHKERRQ(ierr);
+	}
+	ierr = node_sampler_sample(nsampler_ptr);CHKERRQ(ierr);
       }
+    } else if (rstore_ptr) {
+      /* fetching the ranks root's server asks for in the meantime */
+      ierr = rank_store_serve(rstore_ptr,hserver_ptr,polling_interval);CHKERRQ(ierr);
+    } else {
+      ierr = PetscSleep(polling_interval);CHKERRQ(ierr);
     }
-      
-      /* wait for new entries */
-    ierr = PetscSleep(polling_interval);CHKERRQ(ierr);
   }
   /* end main event loop */
-  ierr = PetscFree(pids);CHKERRQ(ierr);
-  ierr = PetscFree(pdata);CHKERRQ(ierr);
+  if (hserver_ptr) {
+    ierr = http_server_stop(hserver_ptr);CHKERRQ(ierr);
+  }
+  if (rstore_ptr) {
+    ierr = rank_store_destroy(rstore_ptr);CHKERRQ(ierr);
+  }
+  if (snapshot_ptr) {
+    ierr = summary_snapshot_destroy(snapshot_ptr);CHKERRQ(ierr);
+  }
+  if (shm_ptr) {
+    ierr = summary_shm_destroy(shm_ptr);CHKERRQ(ierr);
+  }
+  if (local_shm_ptr) {
+    ierr = summary_shm_destroy(local_shm_ptr);CHKERRQ(ierr);
+    ierr = summary_snapshot_destroy(&local_snapshot);CHKERRQ(ierr);
+  }
+  if (estore_ptr) {
+    ierr = event_store_destroy(estore_ptr);CHKERRQ(ierr);
+  }
+  if (hstore_ptr) {
+    ierr = history_store_close(hstore_ptr);CHKERRQ(ierr);
+  }
+  if (sampler_ptr) {
+    ierr = proc_sampler_destroy(sampler_ptr);CHKERRQ(ierr);
+  }
+  if (jresolver_ptr) {
+    ierr = job_resolver_destroy(jresolver_ptr);CHKERRQ(ierr);
+  }
+  if (ptree_ptr) {
+    ierr = process_tree_destroy(ptree_ptr);CHKERRQ(ierr);
+  }
+  if (reaper_ptr) {
+    ierr = pid_reaper_close(reaper_ptr);CHKERRQ(ierr);
+  }
+  ierr = node_share_destroy(&nshare);CHKERRQ(ierr);
+  if (nsampler_ptr) {
+    ierr = node_sampler_destroy(nsampler_ptr);CHKERRQ(ierr);
+  }
+  if (sdiag_ptr) {
+    ierr = sock_diag_destroy(sdiag_ptr);CHKERRQ(ierr);
+  }
+  if (esource_ptr) {
+    ierr = event_source_close(esource_ptr);CHKERRQ(ierr);
+  }
+  if (record_output) {
+    fclose(record_output);
+  }
   PetscFinalize();
   return 0;
 }
@@ -0,0 +1,262 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "pid_reaper.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* removes the records evicted more than retention_ms before the time in the second
+   parameter by copying the rest into a new file that replaces the archive. Records
+   are in eviction order, so the ones to drop are a prefix. */
+static PetscErrorCode pid_archive_compact(pid_reaper *reaper, int64_t now_ms)
+{
+  pid_archive_header hdr;
+  pid_archive_record rec;
+  struct stat        st;
+  off_t              off,nrecords,lo,hi,mid;
+  char               tmpname[PETSC_MAX_PATH_LEN+8],buf[1<<16];
+  ssize_t            n;
+  int                tmpfd;
+  PetscFunctionBeginUser;
+  reaper->last_compact_ms = now_ms;
+  if (reaper->retention_ms <= 0) {
+    PetscFunctionReturn(0);
+  }
+  if (fstat(reaper->fd,&st)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not stat archive file %s\n",reaper->filename);
+  }
+  nrecords = (st.st_size - (off_t)sizeof(hdr)) / (off_t)sizeof(rec);
+  /* the first record that is recent enough to keep */
+  lo = 0;
+  hi = nrecords;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (pread(reaper->fd,&rec,sizeof(rec),sizeof(hdr) + mid*sizeof(rec)) != sizeof(rec)) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not read archive file %s\n",reaper->filename);
+    }
+    if (rec.t_evicted < now_ms - reaper->retention_ms) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (!lo) {
+    PetscFunctionReturn(0);
+  }
+  sprintf(tmpname,"%s.tmp",reaper->filename);
+  tmpfd = open(tmpname,O_WRONLY | O_CREAT | O_TRUNC,0644);
+  if (tmpfd < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open %s\n",tmpname);
+  }
+  if (pread(reaper->fd,&hdr,sizeof(hdr),0) != sizeof(hdr) || write(tmpfd,&hdr,sizeof(hdr)) != sizeof(hdr)) {
+    close(tmpfd);
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not copy the header of archive file %s\n",reaper->filename);
+  }
+  for (off=sizeof(hdr) + lo*sizeof(rec); (n = pread(reaper->fd,buf,sizeof(buf),off)) > 0; off+=n) {
+    if (write(tmpfd,buf,n) != n) {
+      close(tmpfd);
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write %s\n",tmpname);
+    }
+  }
+  close(tmpfd);
+  if (rename(tmpname,reaper->filename)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not replace archive file %s\n",reaper->filename);
+  }
+  close(reaper->fd);
+  reaper->fd = open(reaper->filename,O_RDWR | O_APPEND);
+  if (reaper->fd < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not reopen archive file %s\n",reaper->filename);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode pid_reaper_open(pid_reaper *reaper, const char *filename, PetscInt rank, int64_t ttl_ms, int64_t retention_ms)
+{
+  PetscErrorCode     ierr;
+  pid_archive_header hdr;
+  struct stat        st;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(reaper,sizeof(pid_reaper));CHKERRQ(ierr);
+  ierr = PetscStrncpy(reaper->filename,filename,PETSC_MAX_PATH_LEN);CHKERRQ(ierr);
+  ierr = PetscHMapICreate(&reaper->pid_to_activity);CHKERRQ(ierr);
+  reaper->rank = rank;
+  reaper->ttl_ms = ttl_ms;
+  reaper->retention_ms = retention_ms;
+  reaper->fd = open(filename,O_RDWR | O_CREAT | O_APPEND,0644);
+  if (reaper->fd < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open archive file %s\n",filename);
+  }
+  if (fstat(reaper->fd,&st)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not stat archive file %s\n",filename);
+  }
+  if (st.st_size < (off_t)sizeof(hdr)) {
+    ierr = PetscMemzero(&hdr,sizeof(hdr));CHKERRQ(ierr);
+    ierr = PetscStrncpy(hdr.magic,PID_ARCHIVE_MAGIC,sizeof(hdr.magic));CHKERRQ(ierr);
+    hdr.version = PID_ARCHIVE_VERSION;
+    hdr.record_size = sizeof(pid_archive_record);
+    hdr.rank = rank;
+    if (ftruncate(reaper->fd,0) || write(reaper->fd,&hdr,sizeof(hdr)) != sizeof(hdr)) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write the header of archive file %s\n",filename);
+    }
+    reaper->last_compact_ms = history_now_ms();
+    PetscFunctionReturn(0);
+  }
+  if (pread(reaper->fd,&hdr,sizeof(hdr),0) != sizeof(hdr) || strncmp(hdr.magic,PID_ARCHIVE_MAGIC,sizeof(hdr.magic))) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"%s is not a PID archive\n",filename);
+  }
+  if (hdr.version != PID_ARCHIVE_VERSION || hdr.record_size != sizeof(pid_archive_record)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"PID archive %s was written with an incompatible layout\n",filename);
+  }
+  ierr = pid_archive_compact(reaper,history_now_ms());CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode pid_reaper_close(pid_reaper *reaper)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (reaper->fd >= 0) {
+    close(reaper->fd);
+    reaper->fd = -1;
+  }
+  ierr = PetscFree(reaper->activity);CHKERRQ(ierr);
+  ierr = PetscFree(reaper->evicted);CHKERRQ(ierr);
+  ierr = PetscHMapIDestroy(&reaper->pid_to_activity);CHKERRQ(ierr);
+  reaper->nactivity = reaper->activity_capacity = 0;
+  reaper->nevicted = reaper->evicted_capacity = 0;
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode pid_archive_append(pid_reaper *reaper, process_data_summary *psumm, pid_activity *act,
+					 PidReapReason reason, int64_t now_ms)
+{
+  PetscErrorCode     ierr;
+  pid_archive_record rec;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(&rec,sizeof(rec));CHKERRQ(ierr);
+  rec.t_first = act->t_first;
+  rec.t_last = act->t_last;
+  rec.t_evicted = now_ms;
+  rec.pid = (int32_t)psumm->pid;
+  rec.reason = (int32_t)reason;
+  rec.app_rank = (int32_t)psumm->app_rank;
+  rec.tx_kb = psumm->tx_kb;
+  rec.rx_kb = psumm->rx_kb;
+  rec.n_event = psumm->n_event;
+  rec.nretrans = psumm->nretrans;
+  rec.ndrop = psumm->ndrop;
+  rec.rss_kb = psumm->rss_kb;
+  rec.read_bytes = psumm->read_bytes;
+  rec.write_bytes = psumm->write_bytes;
+  rec.avg_latency = psumm->avg_latency;
+  rec.avg_lifetime = psumm->avg_lifetime;
+  rec.fraction_ipv6 = psumm->fraction_ipv6;
+  rec.avg_rtt = psumm->avg_rtt;
+  rec.p99_rtt = psumm->p99_rtt;
+  rec.cpu_seconds = psumm->cpu_seconds;
+  ierr = PetscStrncpy(rec.comm,psumm->comm,PID_ARCHIVE_COMM_LEN);CHKERRQ(ierr);
+  ierr = PetscStrncpy(rec.job_id,psumm->job_id,JOB_ID_LEN);CHKERRQ(ierr);
+  if (write(reaper->fd,&rec,sizeof(rec)) != sizeof(rec)) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not archive PID %D to %s\n",psumm->pid,reaper->filename);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode pid_reaper_observe(pid_reaper *reaper, process_data_summary *psumm, int64_t now_ms)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  pid_activity   *act;
+  PetscBool      changed,exited;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(reaper->pid_to_activity,psumm->pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    if (reaper->nactivity == reaper->activity_capacity) {
+      reaper->activity_capacity = reaper->activity_capacity ? 2*reaper->activity_capacity : 64;
+      ierr = PetscRealloc(reaper->activity_capacity*sizeof(pid_activity),&reaper->activity);CHKERRQ(ierr);
+    }
+    i = reaper->nactivity++;
+    act = &reaper->activity[i];
+    act->pid = psumm->pid;
+    act->t_first = act->t_last = now_ms;
+    act->n_event = psumm->n_event;
+    act->tx_kb = psumm->tx_kb;
+    act->rx_kb = psumm->rx_kb;
+    ierr = PetscHMapISet(reaper->pid_to_activity,psumm->pid,i);CHKERRQ(ierr);
+    /* give a new PID at least one poll, even if it already exited */
+    PetscFunctionReturn(0);
+  }
+  act = &reaper->activity[i];
+  changed = (PetscBool)(psumm->n_event != act->n_event || psumm->tx_kb != act->tx_kb || psumm->rx_kb != act->rx_kb);
+  if (changed) {
+    act->t_last = now_ms;
+    act->n_event = psumm->n_event;
+    act->tx_kb = psumm->tx_kb;
+    act->rx_kb = psumm->rx_kb;
+    PetscFunctionReturn(0);
+  }
+  exited = (PetscBool)(psumm->pid > 0 && kill((pid_t)psumm->pid,0) && errno == ESRCH);
+  if (exited) {
+    ierr = pid_archive_append(reaper,psumm,act,PID_REAP_EXITED,now_ms);CHKERRQ(ierr);
+    ++(reaper->nexited);
+  } else if (reaper->ttl_ms > 0 && now_ms - act->t_last >= reaper->ttl_ms) {
+    ierr = pid_archive_append(reaper,psumm,act,PID_REAP_IDLE,now_ms);CHKERRQ(ierr);
+    ++(reaper->nidle);
+  } else {
+    PetscFunctionReturn(0);
+  }
+  if (reaper->nevicted == reaper->evicted_capacity) {
+    reaper->evicted_capacity = reaper->evicted_capacity ? 2*reaper->evicted_capacity : 64;
+    ierr = PetscRealloc(reaper->evicted_capacity*sizeof(PetscInt),&reaper->evicted);CHKERRQ(ierr);
+  }
+  reaper->evicted[reaper->nevicted++] = psumm->pid;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode pid_reaper_evict(pid_reaper *reaper, process_statistics *pstats, history_store *hist, event_store *estore,
+				proc_sampler *sampler, job_resolver *jresolver, sock_diag_collector *sdiag, int64_t now_ms)
+{
+  PetscErrorCode ierr;
+  PetscInt       k,i,last,pid;
+  PetscFunctionBeginUser;
+  if (estore) {
+    ierr = event_store_forget(estore,reaper->nevicted,reaper->evicted);CHKERRQ(ierr);
+  }
+  for (k=0; k<reaper->nevicted; ++k) {
+    pid = reaper->evicted[k];
+    ierr = process_statistics_remove(pstats,pid);CHKERRQ(ierr);
+    if (hist) {
+      ierr = history_store_forget(hist,pid);CHKERRQ(ierr);
+    }
+    if (sampler) {
+      ierr = proc_sampler_forget(sampler,pid);CHKERRQ(ierr);
+    }
+    if (jresolver) {
+      ierr = job_resolver_forget(jresolver,pid);CHKERRQ(ierr);
+    }
+    if (sdiag) {
+      ierr = sock_diag_forget(sdiag,pid);CHKERRQ(ierr);
+    }
+    /* keep the activity array dense by moving the last entry into the hole */
+    ierr = PetscHMapIGet(reaper->pid_to_activity,pid,&i);CHKERRQ(ierr);
+    if (i < 0) {
+      continue;
+    }
+    ierr = PetscHMapIDel(reaper->pid_to_activity,pid);CHKERRQ(ierr);
+    last = reaper->nactivity - 1;
+    if (i != last) {
+      reaper->activity[i] = reaper->activity[last];
+      ierr = PetscHMapISet(reaper->pid_to_activity,reaper->activity[i].pid,i);CHKERRQ(ierr);
+    }
+    --(reaper->nactivity);
+  }
+  reaper->nevicted = 0;
+  if (reaper->retention_ms > 0 && now_ms - reaper->last_compact_ms >= PID_ARCHIVE_COMPACT_MS) {
+    ierr = pid_archive_compact(reaper,now_ms);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
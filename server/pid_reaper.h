@@ -0,0 +1,93 @@
+#ifndef DCPROF_PID_REAPER_H
+#define DCPROF_PID_REAPER_H
+#include "petsc_webserver.h"
+#include "history_store.h"
+#include "event_store.h"
+#include "proc_sampler.h"
+#include "job_resolver.h"
+#include "sock_diag.h"
+#include <stdint.h>
+#include <petsc/private/hashmapi.h>
+
+/* keeps process_statistics down to the processes that are still doing something.
+   Every poll, each summarized PID is checked with pid_reaper_observe(); a PID is
+   evicted when
+     EXITED : the process is gone (kill(pid,0) fails with ESRCH) and none of its
+              data changed since the previous poll, which leaves one poll for the
+              tcplife and tcpstates events of its last connections to arrive
+     IDLE   : none of its data changed for ttl_ms (if ttl_ms > 0)
+   Its last summary is appended to an archive file of fixed-size records, and
+   pid_reaper_evict() then drops it from the hot table, so the work of a poll is
+   proportional to the processes that are alive. An evicted PID that shows up
+   again starts over from zero.
+
+   Archive layout: a pid_archive_header, then pid_archive_records in the order
+   they were evicted. Records evicted more than retention_ms ago are removed by
+   rewriting the file when it is opened and then at most once every
+   PID_ARCHIVE_COMPACT_MS. */
+
+#define PID_ARCHIVE_MAGIC      "DCPARCH"
+#define PID_ARCHIVE_VERSION    1
+#define PID_ARCHIVE_COMM_LEN   32
+#define PID_ARCHIVE_COMPACT_MS 3600000
+
+typedef enum {PID_REAP_EXITED,PID_REAP_IDLE} PidReapReason;
+static const char *PidReapReasons[] = {"EXITED","IDLE",0};
+
+typedef struct {
+  char     magic[8];
+  uint32_t version,record_size;
+  int32_t  rank,reserved;
+} pid_archive_header;
+
+typedef struct {
+  int64_t t_first,t_last,t_evicted; /* first seen, last changed, evicted; ms since the epoch */
+  int32_t pid,reason,app_rank,reserved;
+  int64_t tx_kb,rx_kb,n_event,nretrans,ndrop,rss_kb,read_bytes,write_bytes;
+  double  avg_latency,avg_lifetime,fraction_ipv6,avg_rtt,p99_rtt,cpu_seconds;
+  char    comm[PID_ARCHIVE_COMM_LEN];
+  char    job_id[JOB_ID_LEN];
+} pid_archive_record;
+
+/* what the PID's data looked like at the previous poll */
+typedef struct {
+  PetscInt pid;
+  int64_t  t_first,t_last;
+  long     n_event,tx_kb,rx_kb;
+} pid_activity;
+
+typedef struct {
+  pid_activity *activity;
+  PetscInt     nactivity,activity_capacity;
+  PetscHMapI   pid_to_activity;
+  PetscInt     *evicted;   /* PIDs archived since the last pid_reaper_evict() */
+  PetscInt     nevicted,evicted_capacity;
+  PetscInt     nexited,nidle; /* totals */
+  int64_t      ttl_ms,retention_ms,last_compact_ms;
+  int          fd;
+  PetscInt     rank;
+  char         filename[PETSC_MAX_PATH_LEN];
+} pid_reaper;
+
+/* opens (creating if necessary) the archive file named by the second parameter for
+   the MPI rank in the third parameter. The fourth parameter is the idle TTL and the
+   fifth how long archived records are kept, both in ms; 0 disables either. */
+extern PetscErrorCode pid_reaper_open(pid_reaper *, const char *, PetscInt, int64_t, int64_t);
+
+extern PetscErrorCode pid_reaper_close(pid_reaper *);
+
+/* records the summary in the second parameter, made at the time (ms since the
+   epoch) in the third parameter, and archives it if its PID is to be evicted.
+   The summary must be complete, i.e. include what proc_sampler_summarize() and
+   job_resolver_summarize() add. */
+extern PetscErrorCode pid_reaper_observe(pid_reaper *, process_data_summary *, int64_t);
+
+/* removes every PID archived since the last call from the process_statistics
+   (and its rollup, if any), and forgets it in each of the history store, event
+   store, proc_sampler, job_resolver and sock_diag_collector that is not NULL.
+   Call once per poll, after the summaries are made and before
+   history_store_sync(). */
+extern PetscErrorCode pid_reaper_evict(pid_reaper *, process_statistics *, history_store *, event_store *,
+				       proc_sampler *, job_resolver *, sock_diag_collector *, int64_t);
+
+#endif
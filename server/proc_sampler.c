@@ -0,0 +1,220 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "proc_sampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* io_fd of a process whose /proc/<pid>/io we may not read (it needs ptrace access) */
+#define PROC_FD_UNAVAILABLE -2
+
+PetscErrorCode proc_sampler_create(proc_sampler *sampler, PetscInt max_open_fds)
+{
+  PetscErrorCode ierr;
+  long           ticks;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(sampler,sizeof(proc_sampler));CHKERRQ(ierr);
+  ierr = PetscHMapICreate(&sampler->pid_to_sample);CHKERRQ(ierr);
+  sampler->max_open_fds = max_open_fds;
+  ticks = sysconf(_SC_CLK_TCK);
+  sampler->ticks_per_second = ticks > 0 ? (PetscReal)ticks : 100.0;
+  PetscFunctionReturn(0);
+}
+
+static void proc_sample_close(proc_sampler *sampler, proc_sample *ps)
+{
+  int *fds[] = {&ps->stat_fd,&ps->status_fd,&ps->io_fd};
+  int i;
+  for (i=0; i<3; ++i) {
+    if (*fds[i] >= 0) {
+      close(*fds[i]);
+      --(sampler->nopen_fds);
+    }
+    *fds[i] = -1;
+  }
+}
+
+PetscErrorCode proc_sampler_destroy(proc_sampler *sampler)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  for (i=0; i<sampler->nsamples; ++i) {
+    proc_sample_close(sampler,&sampler->samples[i]);
+  }
+  ierr = PetscFree(sampler->samples);CHKERRQ(ierr);
+  ierr = PetscHMapIDestroy(&sampler->pid_to_sample);CHKERRQ(ierr);
+  sampler->nsamples = sampler->capacity = 0;
+  PetscFunctionReturn(0);
+}
+
+/* reads /proc/<pid>/<file> into sampler->buf (NUL-terminated), opening it into *fd
+   first if needed and keeping it open while the fd budget allows. Returns 0 on
+   success and the errno of the failure otherwise. */
+static int proc_read(proc_sampler *sampler, PetscInt pid, const char *file, int *fd)
+{
+  char    path[64];
+  ssize_t len;
+  int     err;
+  if (*fd < 0) {
+    snprintf(path,sizeof(path),"/proc/%d/%s",(int)pid,file);
+    *fd = open(path,O_RDONLY | O_CLOEXEC);
+    if (*fd < 0) {
+      err = errno;
+      *fd = -1;
+      return err;
+    }
+    ++(sampler->nopen_fds);
+  }
+  len = pread(*fd,sampler->buf,PROC_READ_BUF_LEN-1,0);
+  err = len < 0 ? errno : 0;
+  sampler->buf[len > 0 ? len : 0] = '\0';
+  if (err || sampler->nopen_fds > sampler->max_open_fds) {
+    close(*fd);
+    *fd = -1;
+    --(sampler->nopen_fds);
+  }
+  return err;
+}
+
+/* the value after the "key:" line in a /proc key-value file, or -1 */
+static long proc_field(const char *buf, const char *key)
+{
+  const char *p = strstr(buf,key);
+  return p ? strtol(p + strlen(key),NULL,10) : -1;
+}
+
+/* utime and stime are fields 14 and 15 of /proc/<pid>/stat; the command name
+   (field 2) is in parentheses and may itself contain spaces and parentheses */
+static PetscBool proc_parse_stat(const char *buf, PetscReal ticks_per_second, PetscReal *cpu_seconds)
+{
+  const char         *p = strrchr(buf,')');
+  int                field;
+  unsigned long long utime,stime;
+  char               *end;
+  if (!p) {
+    return PETSC_FALSE;
+  }
+  for (field=2; field<14 && p; ++field) {
+    p = strchr(p + 1,' ');
+  }
+  if (!p) {
+    return PETSC_FALSE;
+  }
+  utime = strtoull(p + 1,&end,10);
+  stime = strtoull(end,NULL,10);
+  *cpu_seconds = (PetscReal)(utime + stime) / ticks_per_second;
+  return PETSC_TRUE;
+}
+
+static PetscErrorCode proc_sampler_get(proc_sampler *sampler, PetscInt pid, proc_sample **ps)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(sampler->pid_to_sample,pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    if (sampler->nsamples == sampler->capacity) {
+      sampler->capacity = sampler->capacity ? 2*sampler->capacity : 64;
+      ierr = PetscRealloc(sampler->capacity*sizeof(proc_sample),&sampler->samples);CHKERRQ(ierr);
+    }
+    i = sampler->nsamples++;
+    ierr = PetscMemzero(&sampler->samples[i],sizeof(proc_sample));CHKERRQ(ierr);
+    sampler->samples[i].pid = pid;
+    sampler->samples[i].stat_fd = sampler->samples[i].status_fd = sampler->samples[i].io_fd = -1;
+    sampler->samples[i].alive = PETSC_TRUE;
+    ierr = PetscHMapISet(sampler->pid_to_sample,pid,i);CHKERRQ(ierr);
+  }
+  *ps = &sampler->samples[i];
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode proc_sampler_poll(proc_sampler *sampler, PetscInt npid, PetscInt *pids)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  proc_sample    *ps;
+  PetscReal      cpu_seconds;
+  long           rss,voluntary,involuntary;
+  int            err;
+  PetscFunctionBeginUser;
+  for (i=0; i<npid; ++i) {
+    if (pids[i] <= 0) {
+      continue;
+    }
+    ierr = proc_sampler_get(sampler,pids[i],&ps);CHKERRQ(ierr);
+    if (!ps->alive) {
+      continue;
+    }
+    /* stat first: if the process is gone there is no point reading the rest */
+    err = proc_read(sampler,ps->pid,"stat",&ps->stat_fd);
+    if (err || !proc_parse_stat(sampler->buf,sampler->ticks_per_second,&cpu_seconds)) {
+      ps->alive = PETSC_FALSE;
+      proc_sample_close(sampler,ps);
+      continue;
+    }
+    ps->cpu_seconds = cpu_seconds;
+    if (!proc_read(sampler,ps->pid,"status",&ps->status_fd)) {
+      /* kernel threads have no VmRSS */
+      rss = proc_field(sampler->buf,"VmRSS:");
+      ps->rss_kb = rss < 0 ? 0 : rss;
+      voluntary = proc_field(sampler->buf,"\nvoluntary_ctxt_switches:");
+      involuntary = proc_field(sampler->buf,"nonvoluntary_ctxt_switches:");
+      ps->ctx_switches = (voluntary < 0 ? 0 : voluntary) + (involuntary < 0 ? 0 : involuntary);
+    }
+    if (ps->io_fd != PROC_FD_UNAVAILABLE) {
+      err = proc_read(sampler,ps->pid,"io",&ps->io_fd);
+      if (err == EACCES || err == EPERM) {
+	ps->io_fd = PROC_FD_UNAVAILABLE;
+      } else if (!err) {
+	ps->read_bytes = proc_field(sampler->buf,"\nread_bytes:");
+	ps->write_bytes = proc_field(sampler->buf,"\nwrite_bytes:");
+      }
+    }
+    ps->sampled = PETSC_TRUE;
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode proc_sampler_summarize(proc_sampler *sampler, process_data_summary *psumm)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  proc_sample    *ps;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(sampler->pid_to_sample,psumm->pid,&i);CHKERRQ(ierr);
+  if (i < 0 || !sampler->samples[i].sampled) {
+    PetscFunctionReturn(0);
+  }
+  ps = &sampler->samples[i];
+  psumm->cpu_seconds = ps->cpu_seconds;
+  psumm->rss_kb = ps->rss_kb;
+  psumm->read_bytes = ps->read_bytes;
+  psumm->write_bytes = ps->write_bytes;
+  psumm->ctx_switches = ps->ctx_switches;
+  psumm->bytes_per_cpu_second = ps->cpu_seconds > 0.0 ? 1024.0 * (PetscReal)(psumm->tx_kb + psumm->rx_kb) / ps->cpu_seconds : 0.0;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode proc_sampler_forget(proc_sampler *sampler, PetscInt pid)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,last;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(sampler->pid_to_sample,pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    PetscFunctionReturn(0);
+  }
+  proc_sample_close(sampler,&sampler->samples[i]);
+  ierr = PetscHMapIDel(sampler->pid_to_sample,pid);CHKERRQ(ierr);
+  /* keep the samples dense by moving the last one into the hole */
+  last = sampler->nsamples - 1;
+  if (i != last) {
+    sampler->samples[i] = sampler->samples[last];
+    ierr = PetscHMapISet(sampler->pid_to_sample,sampler->samples[i].pid,i);CHKERRQ(ierr);
+  }
+  --(sampler->nsamples);
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,52 @@
+#ifndef DCPROF_PROC_SAMPLER_H
+#define DCPROF_PROC_SAMPLER_H
+#include "petsc_webserver.h"
+#include <petsc/private/hashmapi.h>
+
+/* samples what each process seen in the TCP data costs on this node: CPU time and
+   context switches from /proc/<pid>/stat and /proc/<pid>/status, RSS from
+   /proc/<pid>/status and storage read/write bytes from /proc/<pid>/io. The files
+   of each PID are opened once and re-read with pread() on every poll, so a poll is
+   three syscalls per PID. A procfs fd stays bound to the process it was opened
+   for, so once a read fails with ESRCH the PID is marked dead, its fds are closed
+   and it is never read again; its last sample is kept. */
+
+#define PROC_READ_BUF_LEN 4096
+
+typedef struct {
+  PetscInt  pid;
+  int       stat_fd,status_fd,io_fd;
+  PetscBool alive,sampled;
+  PetscReal cpu_seconds;
+  long      rss_kb,read_bytes,write_bytes,ctx_switches;
+} proc_sample;
+
+typedef struct {
+  proc_sample *samples;
+  PetscInt    nsamples,capacity;
+  PetscHMapI  pid_to_sample;
+  PetscInt    nopen_fds,max_open_fds; /* past max_open_fds, files are opened and closed on every read */
+  PetscReal   ticks_per_second;
+  char        buf[PROC_READ_BUF_LEN];
+} proc_sampler;
+
+/* the second parameter is the most fds the sampler keeps open between polls */
+extern PetscErrorCode proc_sampler_create(proc_sampler *, PetscInt);
+
+/* closes all cached fds and frees the sampler */
+extern PetscErrorCode proc_sampler_destroy(proc_sampler *);
+
+/* samples every PID in the array in the third parameter (of the length in the
+   second parameter), e.g. as returned by process_statistics_get_all() */
+extern PetscErrorCode proc_sampler_poll(proc_sampler *, PetscInt, PetscInt *);
+
+/* copies the latest sample of the summary's PID into the summary in the second
+   parameter, and derives bytes_per_cpu_second from its tx_kb and rx_kb. Summaries
+   of PIDs that were never sampled are left as they are. */
+extern PetscErrorCode proc_sampler_summarize(proc_sampler *, process_data_summary *);
+
+/* closes the fds of the PID in the second parameter and drops its sample; if the PID
+   shows up again, it is sampled as a new process */
+extern PetscErrorCode proc_sampler_forget(proc_sampler *, PetscInt);
+
+#endif
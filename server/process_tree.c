@@ -0,0 +1,155 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "process_tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+PetscErrorCode process_tree_create(process_tree *tree)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(tree,sizeof(process_tree));CHKERRQ(ierr);
+  ierr = PetscHMapICreate(&tree->pid_to_node);CHKERRQ(ierr);
+  ierr = process_statistics_init(&tree->rollup);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode process_tree_destroy(process_tree *tree)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscFree(tree->nodes);CHKERRQ(ierr);
+  ierr = PetscHMapIDestroy(&tree->pid_to_node);CHKERRQ(ierr);
+  ierr = process_statistics_destroy(&tree->rollup);CHKERRQ(ierr);
+  tree->nnodes = tree->capacity = 0;
+  PetscFunctionReturn(0);
+}
+
+/* reads the name and ppid of the node's PID from /proc/<pid>/stat, which is
+   "pid (comm) state ppid ..."; comm may itself contain spaces and parentheses.
+   Leaves the node as it is if the process is gone. */
+static void process_node_read_stat(process_node *node)
+{
+  char    path[64],buf[512];
+  char    *open_paren,*close_paren;
+  ssize_t n;
+  size_t  len;
+  int     fd,ppid;
+  snprintf(path,sizeof(path),"/proc/%d/stat",(int)node->pid);
+  fd = open(path,O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  n = read(fd,buf,sizeof(buf)-1);
+  close(fd);
+  if (n <= 0) {
+    return;
+  }
+  buf[n] = '\0';
+  open_paren = strchr(buf,'(');
+  close_paren = strrchr(buf,')');
+  if (!open_paren || !close_paren || close_paren < open_paren) {
+    return;
+  }
+  len = PetscMin((size_t)(close_paren - open_paren - 1),(size_t)PROCESS_TREE_COMM_LEN - 1);
+  memcpy(node->comm,open_paren + 1,len);
+  node->comm[len] = '\0';
+  /* the fields after comm are the state and then ppid */
+  if (sscanf(close_paren + 1," %*s %d",&ppid) == 1) {
+    node->ppid = (PetscInt)ppid;
+  }
+}
+
+static PetscErrorCode process_tree_add_node(process_tree *tree, PetscInt pid, PetscInt *node)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (tree->nnodes == tree->capacity) {
+    tree->capacity = tree->capacity ? 2*tree->capacity : 64;
+    ierr = PetscRealloc(tree->capacity*sizeof(process_node),&tree->nodes);CHKERRQ(ierr);
+  }
+  *node = tree->nnodes++;
+  ierr = PetscMemzero(&tree->nodes[*node],sizeof(process_node));CHKERRQ(ierr);
+  tree->nodes[*node].pid = pid;
+  tree->nodes[*node].parent = -1;
+  if (pid > 0) {
+    process_node_read_stat(&tree->nodes[*node]);
+  }
+  ierr = PetscHMapISet(tree->pid_to_node,pid,*node);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode process_tree_find(process_tree *tree, PetscInt pid, PetscInt *node)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,prev=-1,depth;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(tree->pid_to_node,pid,node);CHKERRQ(ierr);
+  if (*node >= 0) {
+    PetscFunctionReturn(0);
+  }
+  /* add the PID, then its ancestors until one is already in the tree. Since a PID
+     in the tree is never added again, a stale ppid cannot make this loop */
+  for (depth=0; depth<PROCESS_TREE_MAX_DEPTH; ++depth) {
+    ierr = PetscHMapIGet(tree->pid_to_node,pid,&i);CHKERRQ(ierr);
+    if (i >= 0) {
+      tree->nodes[prev].parent = i;
+      break;
+    }
+    ierr = process_tree_add_node(tree,pid,&i);CHKERRQ(ierr);
+    if (prev >= 0) {
+      tree->nodes[prev].parent = i;
+    } else {
+      *node = i;
+    }
+    prev = i;
+    pid = tree->nodes[i].ppid;
+    if (pid <= 1 || pid == 2) {
+      /* the parent is init or kthreadd, whose subtrees are the whole node */
+      break;
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode process_tree_summarize(process_tree *tree, process_data_summary *psumm)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(tree->pid_to_node,psumm->pid,&i);CHKERRQ(ierr);
+  if (i >= 0 && tree->nodes[i].comm[0]) {
+    ierr = PetscStrncpy(psumm->comm,tree->nodes[i].comm,COMM_MAX_LEN);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode process_tree_remove(process_tree *tree, PetscInt pid)
+{
+  PetscErrorCode ierr;
+  PetscInt       node,last,i;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(tree->pid_to_node,pid,&node);CHKERRQ(ierr);
+  if (node < 0) {
+    PetscFunctionReturn(0);
+  }
+  ierr = PetscHMapIDel(tree->pid_to_node,pid);CHKERRQ(ierr);
+  /* its children become roots, as the kernel hands them to init; and the last
+     node moves into the hole, so its children follow it */
+  last = tree->nnodes - 1;
+  for (i=0; i<tree->nnodes; ++i) {
+    if (tree->nodes[i].parent == node) {
+      tree->nodes[i].parent = -1;
+    } else if (tree->nodes[i].parent == last) {
+      tree->nodes[i].parent = node;
+    }
+  }
+  if (node != last) {
+    tree->nodes[node] = tree->nodes[last];
+    ierr = PetscHMapISet(tree->pid_to_node,tree->nodes[node].pid,node);CHKERRQ(ierr);
+  }
+  --(tree->nnodes);
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,55 @@
+#ifndef DCPROF_PROCESS_TREE_H
+#define DCPROF_PROCESS_TREE_H
+#include "petsc_webserver.h"
+#include <petsc/private/hashmapi.h>
+
+/* rolls the TCP data of each process up into all of its ancestors, so that the
+   row of mpirun (or orted, hydra_pmi_proxy, a batch script, ...) holds the totals
+   of everything it spawned. The parent links come from the ppid in
+   /proc/<pid>/stat: the first time a PID is seen, it and whichever of its
+   ancestors are not in the tree yet are added, walking up until a PID that is,
+   or one whose parent is init (or the kernel). A process that has already exited
+   when it is first seen has no parent and is a root.
+
+   The tree holds a second process_statistics, rollup, keyed by PID like the
+   driver's but with each PID's data being that of its whole subtree. A
+   process_statistics whose tree field points at a process_tree credits every
+   event to the PID's node and its ancestors as well, so an event costs O(depth)
+   hash table updates, and the tree never needs to be rebuilt. A node keeps the
+   parent it had when it was added, until the PID is evicted (see pid_reaper.h):
+   then its node goes, and its children become roots. A PID that shows up again
+   is added anew, with the parent it has then. */
+
+#define PROCESS_TREE_MAX_DEPTH 64 /* ancestors added for one new PID at most */
+#define PROCESS_TREE_COMM_LEN  16 /* TASK_COMM_LEN */
+
+typedef struct {
+  PetscInt pid,ppid;
+  PetscInt parent; /* index of the parent's node, or -1 for a root */
+  char     comm[PROCESS_TREE_COMM_LEN]; /* from /proc/<pid>/stat; empty if it could not be read */
+} process_node;
+
+struct process_tree_s {
+  process_node       *nodes;
+  PetscInt           nnodes,capacity;
+  PetscHMapI         pid_to_node;
+  process_statistics rollup;
+};
+
+extern PetscErrorCode process_tree_create(process_tree *);
+
+extern PetscErrorCode process_tree_destroy(process_tree *);
+
+/* stores the index in tree->nodes of the node of the PID in the second parameter
+   in the third, adding it and its missing ancestors if it is new */
+extern PetscErrorCode process_tree_find(process_tree *, PetscInt, PetscInt *);
+
+/* removes the node of the PID in the second parameter, if there is one; its
+   children become roots. O(number of nodes). */
+extern PetscErrorCode process_tree_remove(process_tree *, PetscInt);
+
+/* replaces the process name of a rollup summary (which is that of whichever
+   descendant last had an event) with the name of the subtree's root process */
+extern PetscErrorCode process_tree_summarize(process_tree *, process_data_summary *);
+
+#endif
@@ -0,0 +1,197 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "rank_store.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+/* how often ranks other than root call into MPI while they wait */
+#define RANK_STORE_PROGRESS_MS 10
+
+static int rank_store_pid_cmp(const void *a, const void *b)
+{
+  PetscInt x = ((const process_data_summary*)a)->pid,y = ((const process_data_summary*)b)->pid;
+  return x < y ? -1 : x > y;
+}
+
+static int rank_store_hash_cmp(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a,y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static PetscErrorCode rank_store_allocate(rank_store *rs, PetscInt capacity)
+{
+  PetscErrorCode ierr;
+  PetscMPIInt    rank;
+  PetscFunctionBeginUser;
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  rs->capacity = capacity;
+  ierr = MPI_Win_allocate((MPI_Aint)(sizeof(rank_store_header) + capacity * sizeof(process_data_summary)),1,
+			  MPI_INFO_NULL,PETSC_COMM_WORLD,&rs->base,&rs->win);CHKERRQ(ierr);
+  ierr = MPI_Win_lock(MPI_LOCK_EXCLUSIVE,rank,0,rs->win);CHKERRQ(ierr);
+  rs->base->epoch = rs->epoch;
+  rs->base->count = 0;
+  ierr = MPI_Win_unlock(rank,rs->win);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode rank_store_create(rank_store *rs, PetscInt capacity)
+{
+  PetscErrorCode ierr;
+  PetscMPIInt    rank,size;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(rs,sizeof(rank_store));CHKERRQ(ierr);
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  MPI_Comm_size(PETSC_COMM_WORLD,&size);
+  ierr = rank_store_allocate(rs,capacity > 0 ? capacity : 1);CHKERRQ(ierr);
+  if (!rank) {
+    ierr = PetscMalloc2(size,&rs->nnames,size,&rs->displs);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode rank_store_destroy(rank_store *rs)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = MPI_Win_free(&rs->win);CHKERRQ(ierr);
+  ierr = PetscFree(rs->pending);CHKERRQ(ierr);
+  ierr = PetscFree(rs->names);CHKERRQ(ierr);
+  ierr = PetscFree2(rs->nnames,rs->displs);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode rank_store_add(rank_store *rs, process_data_summary *psumm)
+{
+  PetscErrorCode ierr;
+  PetscMPIInt    rank;
+  PetscFunctionBeginUser;
+  if (rs->npending == rs->pending_capacity) {
+    rs->pending_capacity = rs->pending_capacity ? 2 * rs->pending_capacity : 64;
+    ierr = PetscRealloc(rs->pending_capacity * sizeof(process_data_summary),&rs->pending);CHKERRQ(ierr);
+  }
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  rs->pending[rs->npending] = *psumm;
+  rs->pending[rs->npending++].rank = rank;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode rank_store_publish(rank_store *rs, http_server *srv)
+{
+  PetscErrorCode ierr;
+  PetscMPIInt    rank,size,nnames=0,total=0,r;
+  PetscInt       i,most,capacity;
+  uint64_t       *names=NULL;
+  PetscFunctionBeginUser;
+  MPI_Comm_rank(PETSC_COMM_WORLD,&rank);
+  MPI_Comm_size(PETSC_COMM_WORLD,&size);
+  qsort(rs->pending,rs->npending,sizeof(process_data_summary),rank_store_pid_cmp);
+  ++rs->epoch;
+
+  /* every rank has to take part in growing the window */
+  ierr = MPI_Allreduce(&rs->npending,&most,1,MPIU_INT,MPI_MAX,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  if (most > rs->capacity) {
+    for (capacity=rs->capacity; capacity<most; capacity*=2);
+    ierr = MPI_Win_free(&rs->win);CHKERRQ(ierr);
+    ierr = rank_store_allocate(rs,capacity);CHKERRQ(ierr);
+  }
+  ierr = MPI_Win_lock(MPI_LOCK_EXCLUSIVE,rank,0,rs->win);CHKERRQ(ierr);
+  ierr = PetscMemcpy(rs->base + 1,rs->pending,rs->npending * sizeof(process_data_summary));CHKERRQ(ierr);
+  rs->base->epoch = rs->epoch;
+  rs->base->count = rs->npending;
+  ierr = MPI_Win_unlock(rank,rs->win);CHKERRQ(ierr);
+
+  /* the index: the distinct names of the rank, by hash */
+  ierr = PetscMalloc1(rs->npending + 1,&names);CHKERRQ(ierr);
+  for (i=0; i<rs->npending; ++i) {
+    names[i] = http_name_hash(rs->pending[i].comm);
+  }
+  qsort(names,rs->npending,sizeof(uint64_t),rank_store_hash_cmp);
+  for (i=0; i<rs->npending; ++i) {
+    if (!nnames || names[i] != names[nnames-1]) {
+      names[nnames++] = names[i];
+    }
+  }
+  ierr = MPI_Gather(&nnames,1,MPI_INT,rs->nnames,1,MPI_INT,0,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  if (!rank) {
+    for (r=0; r<size; ++r) {
+      rs->displs[r] = total;
+      total += rs->nnames[r];
+    }
+    if (total > rs->names_capacity) {
+      rs->names_capacity = total;
+      ierr = PetscFree(rs->names);CHKERRQ(ierr);
+      ierr = PetscMalloc1(rs->names_capacity,&rs->names);CHKERRQ(ierr);
+    }
+  }
+  ierr = MPI_Gatherv(names,nnames,MPI_UINT64_T,rs->names,rs->nnames,rs->displs,MPI_UINT64_T,0,PETSC_COMM_WORLD);CHKERRQ(ierr);
+  ierr = PetscFree(names);CHKERRQ(ierr);
+  rs->npending = 0;
+  if (!rank && srv) {
+    ierr = http_server_fanout_publish(srv,size,rs->nnames,rs->names);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* copies the summaries of the rank in the second parameter out of the window,
+   into an array malloc()ed for the server */
+static PetscErrorCode rank_store_fetch(rank_store *rs, PetscMPIInt rank, process_data_summary **summaries, PetscInt *n)
+{
+  PetscErrorCode    ierr;
+  rank_store_header hdr;
+  size_t            len;
+  PetscFunctionBeginUser;
+  ierr = MPI_Win_lock(MPI_LOCK_SHARED,rank,0,rs->win);CHKERRQ(ierr);
+  ierr = MPI_Get(&hdr,sizeof(hdr),MPI_BYTE,rank,0,sizeof(hdr),MPI_BYTE,rs->win);CHKERRQ(ierr);
+  ierr = MPI_Win_flush(rank,rs->win);CHKERRQ(ierr);
+  len = hdr.count * sizeof(process_data_summary);
+  if (len > INT_MAX) {
+    MPI_Win_unlock(rank,rs->win);
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_SUP,"Rank %d has too many summaries (%D) to fetch at once",rank,(PetscInt)hdr.count);
+  }
+  *summaries = (process_data_summary*)malloc(len ? len : 1);
+  if (!*summaries) {
+    MPI_Win_unlock(rank,rs->win);
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_MEM,"Could not allocate the summaries of rank %d",rank);
+  }
+  if (len) {
+    ierr = MPI_Get(*summaries,(int)len,MPI_BYTE,rank,sizeof(hdr),(int)len,MPI_BYTE,rs->win);CHKERRQ(ierr);
+  }
+  ierr = MPI_Win_unlock(rank,rs->win);CHKERRQ(ierr);
+  *n = (PetscInt)hdr.count;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode rank_store_serve(rank_store *rs, http_server *srv, PetscReal seconds)
+{
+  PetscErrorCode       ierr;
+  PetscLogDouble       start,now;
+  PetscInt             rank,n;
+  PetscMPIInt          flag;
+  process_data_summary *summaries;
+  struct timespec      pause={0,RANK_STORE_PROGRESS_MS * 1000000L};
+  PetscFunctionBeginUser;
+  ierr = PetscTime(&start);CHKERRQ(ierr);
+  now = start;
+  /* with no time left, still fetches every rank the server already wants */
+  do {
+    rank = -1;
+    if (srv) {
+      ierr = http_server_fanout_wait(srv,PetscMax(seconds - (now - start),0.0),&rank);CHKERRQ(ierr);
+      if (rank >= 0) {
+	ierr = rank_store_fetch(rs,(PetscMPIInt)rank,&summaries,&n);CHKERRQ(ierr);
+	ierr = http_server_fanout_deliver(srv,rank,summaries,n);CHKERRQ(ierr);
+      }
+    } else {
+      /* MPI implementations without a progress thread only serve root's reads
+	 of this rank's window from inside an MPI call */
+      MPI_Iprobe(MPI_ANY_SOURCE,MPI_ANY_TAG,PETSC_COMM_WORLD,&flag,MPI_STATUS_IGNORE);
+      if (seconds > 0.0) {
+	nanosleep(&pause,NULL);
+      }
+    }
+    ierr = PetscTime(&now);CHKERRQ(ierr);
+  } while (now - start < seconds || rank >= 0);
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,62 @@
+#ifndef DCPROF_RANK_STORE_H
+#define DCPROF_RANK_STORE_H
+#include "petsc_webserver.h"
+#include "petsc_mongoose.h"
+#include <stdint.h>
+
+/* keeps each rank's summaries queryable where they are, so that root need not
+   gather all of them every poll (see --fanout). Every rank copies the summaries
+   of its last poll, sorted by PID, into its part of an MPI_Win_allocate()
+   window, a rank_store_header followed by capacity summaries, under an exclusive
+   lock on itself. Root reads the part of a rank it needs with MPI_Get() under a
+   shared lock, which the rank takes no part in, so root fetches only the ranks a
+   request is about.
+
+   To know which ranks a /api/get/{name} is about, root gathers an index every
+   poll: the (FNV-1a) hashes of the names each rank has, which is far less than
+   the summaries. The native server keeps what root has fetched until the next
+   poll, so every request about a rank in the same poll is answered without
+   going back to it. */
+
+typedef struct {
+  int64_t epoch;  /* polls published */
+  int64_t count;  /* of summaries that follow */
+} rank_store_header;
+
+typedef struct {
+  MPI_Win              win;
+  rank_store_header    *base;       /* this rank's part of the window */
+  PetscInt             capacity;    /* summaries each part holds */
+  int64_t              epoch;
+  /* this poll's, until rank_store_publish() */
+  process_data_summary *pending;
+  PetscInt             npending,pending_capacity;
+  /* the index, on root */
+  uint64_t             *names;
+  PetscMPIInt          *nnames,*displs;
+  PetscInt             names_capacity;
+} rank_store;
+
+/* allocates the window with room for the number of summaries in the second
+   parameter on each rank, which grows as needed. Collective. */
+extern PetscErrorCode rank_store_create(rank_store *, PetscInt);
+
+/* frees the window. Collective. */
+extern PetscErrorCode rank_store_destroy(rank_store *);
+
+/* adds the summary in the second parameter to the ones the next
+   rank_store_publish() makes visible */
+extern PetscErrorCode rank_store_add(rank_store *, process_data_summary *);
+
+/* replaces the rank's summaries in the window with the ones added since the last
+   call, and gathers the index to root, which hands it to the server in the
+   second parameter (NULL elsewhere). Collective. */
+extern PetscErrorCode rank_store_publish(rank_store *, http_server *);
+
+/* waits for the number of seconds in the third parameter. On root, meanwhile,
+   fetches the ranks the server in the second parameter asks for as soon as it
+   does; elsewhere, keeps calling into MPI so that root's reads progress. With
+   no time to wait, root only fetches the ranks the server already wants. */
+extern PetscErrorCode rank_store_serve(rank_store *, http_server *, PetscReal);
+
+#endif
@@ -1,3 +1,5 @@
 #!/bin/sh
+# NPERNODE ranks per node split that node's input files among themselves
+NPERNODE=${NPERNODE:-1}
 
-$MPIEXEC -n $NNODE --map-by ppr:1:node ./webserver --accept_file $HOME/tcpaccept_data/tcpaccept.log --connect_file $HOME/tcpconnect_data/tcpconnect.log --connlat_file $HOME/tcpconnlat_data/tcpconnlat.log --life_file $HOME/tcplife_data/tcplife.log --retrans_file $HOME/tcpretrans_data/tcpretrans.log -o $HOME/tcpdata.log
+$MPIEXEC -n $(($NNODE * $NPERNODE)) --map-by ppr:$NPERNODE:node ./webserver --accept_file $HOME/tcpaccept_data/tcpaccept.log --connect_file $HOME/tcpconnect_data/tcpconnect.log --connlat_file $HOME/tcpconnlat_data/tcpconnlat.log --life_file $HOME/tcplife_data/tcplife.log --retrans_file $HOME/tcpretrans_data/tcpretrans.log -o $HOME/tcpdata.log
@@ -0,0 +1,206 @@
+"""Reader for the binary summary snapshots written by summary_snapshot.c.
+
+The file is a header, the process records sorted by (rank, pid), the node
+records sorted by rank, and a table of NUL-terminated strings that the records
+point into. The driver replaces the whole file with rename(), so a mapped
+snapshot stays consistent for as long as it is open.
+
+The same snapshot can also be read from the shared memory segment that
+summary_shm.c publishes it in, with SharedSnapshot.
+
+read_export() decodes the columns the native server's /api/export answers with
+(see petsc_mongoose.h).
+"""
+import mmap
+import os
+import struct
+
+MAGIC = b'DCPSNAP\0'
+VERSION = 1
+HEADER = struct.Struct('<8sIIIIQqQQQQQQII')
+# rank, pid, app_rank, comm, job_id, reserved, then the int64 and double fields
+RECORD = struct.Struct('<iiiIII9q9d')
+RECORD_KEY = struct.Struct('<ii')
+INT_FIELDS = ['tx_kb', 'rx_kb', 'n_event', 'nretrans', 'ndrop', 'rss_kb',
+              'read_bytes', 'write_bytes', 'ctx_switches']
+REAL_FIELDS = ['avg_latency', 'avg_lifetime', 'fraction_ipv6', 'avg_rtt', 'p99_rtt',
+               'avg_handshake', 'avg_established', 'cpu_seconds', 'bytes_per_cpu_second']
+SHM_MAGIC = b'DCPSHM\0\0'
+# magic, seq, size, len
+SHM_HEADER = struct.Struct('<8sQQQ')
+SHM_SEQ = struct.Struct('<Q')
+EXPORT_MAGIC = b'DCPCOLS\0'
+EXPORT_VERSION = 1
+# magic, version, full, epoch, since, nrows, nremoved, nnames, names_len
+EXPORT_HEADER = struct.Struct('<8sIIQQIIII')
+EXPORT_COLUMNS = ([('rank', 'i'), ('pid', 'i'), ('app_rank', 'i'), ('name', 'I'), ('job_id', 'I')]
+                  + [(f, 'q') for f in INT_FIELDS] + [(f, 'd') for f in REAL_FIELDS])
+
+
+def is_snapshot(filename):
+    try:
+        with open(filename, 'rb') as f:
+            return f.read(len(MAGIC)) == MAGIC
+    except OSError:
+        return False
+
+
+class Snapshot:
+    """A snapshot mapped from a file, or in data (bytes) if given."""
+    def __init__(self, filename=None, data=None):
+        if data is None:
+            with open(filename, 'rb') as f:
+                self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        else:
+            self.map = data
+            filename = 'the snapshot'
+        (magic, version, header_size, record_size, node_record_size, self.epoch,
+         self.time_ms, self.nrecords, self.records_offset, self.nnodes, self.nodes_offset,
+         self.strings_offset, strings_len, self.ncounters, counter_names) = HEADER.unpack_from(self.map, 0)
+        if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+            self.close()
+            raise ValueError(f'{filename} is not a version {VERSION} summary snapshot')
+        self.node = struct.Struct(f'<iId{self.ncounters}q{self.ncounters}d{self.ncounters}d')
+        if node_record_size != self.node.size:
+            self.close()
+            raise ValueError(f'{filename} has node records of an unknown size')
+        self.counter_names = []
+        offset = counter_names
+        for _ in range(self.ncounters):
+            name = self.string(offset)
+            self.counter_names.append(name)
+            offset += len(name) + 1
+
+    def close(self):
+        if isinstance(self.map, mmap.mmap):
+            self.map.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def string(self, offset):
+        start = self.strings_offset + offset
+        return self.map[start:self.map.find(b'\0', start)].decode(errors='replace')
+
+    def record(self, i):
+        values = RECORD.unpack_from(self.map, self.records_offset + i * RECORD.size)
+        rec = {'rank': values[0], 'pid': values[1], 'app_rank': values[2],
+               'name': self.string(values[3]), 'job_id': self.string(values[4])}
+        rec.update(zip(INT_FIELDS, values[6:15]))
+        rec.update(zip(REAL_FIELDS, values[15:24]))
+        return rec
+
+    def records(self):
+        for i in range(self.nrecords):
+            yield self.record(i)
+
+    def find(self, rank, pid):
+        """The record of the PID on the rank, by binary search, or None."""
+        lo, hi = 0, self.nrecords
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if RECORD_KEY.unpack_from(self.map, self.records_offset + mid * RECORD.size) < (rank, pid):
+                lo = mid + 1
+            else:
+                hi = mid
+        if lo < self.nrecords and RECORD_KEY.unpack_from(self.map, self.records_offset + lo * RECORD.size) == (rank, pid):
+            return self.record(lo)
+        return None
+
+    def nodes(self):
+        n = self.ncounters
+        for i in range(self.nnodes):
+            values = self.node.unpack_from(self.map, self.nodes_offset + i * self.node.size)
+            counters = {}
+            for c, name in enumerate(self.counter_names):
+                counters[name] = {'total': values[3 + c], 'rate': values[3 + n + c],
+                                  'peak_rate': values[3 + 2 * n + c]}
+            yield {'rank': values[0], 'host': self.string(values[1]), 'interval': values[2],
+                   'counters': counters}
+
+
+class SharedSnapshot:
+    """Reads the snapshots published in a summary_shm.c segment, e.g. '/dcprof'.
+
+    read() copies the current snapshot out between two reads of the sequence
+    number, and tries again if the driver was writing in the meantime.
+    """
+    def __init__(self, name):
+        self.name = name
+        self.file = open('/dev/shm/' + name.lstrip('/'), 'rb')
+        self.map = None
+        self._map()
+        if self.map[:len(SHM_MAGIC)] != SHM_MAGIC:
+            self.close()
+            raise ValueError(f'{name} is not a summary segment')
+
+    def _map(self):
+        if self.map is not None:
+            self.map.close()
+        self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+
+    def sequence(self):
+        """The sequence number of the last poll published, which only changes
+        when a new one is; the driver may be publishing the next one already."""
+        while True:
+            seq = SHM_SEQ.unpack_from(self.map, 8)[0]
+            if not seq & 1:
+                return seq
+            os.sched_yield()
+
+    def read(self):
+        """A Snapshot of the last poll published, or None if there is none yet."""
+        while True:
+            magic, seq, size, length = SHM_HEADER.unpack_from(self.map, 0)
+            if seq & 1:
+                os.sched_yield()
+                continue
+            if size > len(self.map):
+                self._map()
+                continue
+            if SHM_HEADER.size + length > len(self.map):
+                continue
+            data = self.map[SHM_HEADER.size:SHM_HEADER.size + length]
+            if SHM_SEQ.unpack_from(self.map, 8)[0] == seq:
+                break
+        return Snapshot(data=data) if length else None
+
+    def close(self):
+        if self.map is not None:
+            self.map.close()
+            self.map = None
+        self.file.close()
+
+
+def _pad8(n):
+    return (n + 7) & ~7
+
+
+def read_export(data):
+    """Decodes an /api/export payload into a dict of epoch, since, full, columns
+    (a list per field, with the names in name and job_id) and removed, a list
+    of (rank, pid). Apply removed, then the rows, to what the last export left."""
+    view = memoryview(data)
+    (magic, version, full, epoch, since, nrows, nremoved,
+     nnames, names_len) = EXPORT_HEADER.unpack_from(view, 0)
+    if magic != EXPORT_MAGIC or version != EXPORT_VERSION:
+        raise ValueError(f'not a version {EXPORT_VERSION} export')
+    offset = EXPORT_HEADER.size
+    names = bytes(view[offset:offset + names_len]).split(b'\0')[:nnames]
+    names = [n.decode(errors='replace') for n in names]
+    offset += _pad8(names_len)
+    columns = {}
+    for field, fmt in EXPORT_COLUMNS:
+        size = nrows * struct.calcsize(fmt)
+        columns[field] = view[offset:offset + size].cast(fmt).tolist()
+        offset += _pad8(size)
+    for field in ('name', 'job_id'):
+        columns[field] = [names[i] for i in columns[field]]
+    size = nremoved * 4
+    ranks = view[offset:offset + size].cast('i').tolist()
+    pids = view[offset + _pad8(size):offset + _pad8(size) + size].cast('i').tolist()
+    return {'epoch': epoch, 'since': since, 'full': bool(full), 'columns': columns,
+            'removed': list(zip(ranks, pids))}
@@ -0,0 +1,494 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "sock_diag.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+
+#define SOCK_DIAG_BUF_LEN 32768
+#define SOCK_LISTEN       10 /* TCP_LISTEN in the kernel's tcp_states.h */
+/* inode_to_pid value of an inode no readable process holds, last seen in the given poll */
+#define SOCK_DIAG_UNRESOLVED(poll) (-2 - (poll))
+
+PetscErrorCode sock_diag_create(sock_diag_collector *coll, PetscInt mypid)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(coll,sizeof(sock_diag_collector));CHKERRQ(ierr);
+  coll->nl_fd = socket(AF_NETLINK,SOCK_DGRAM | SOCK_CLOEXEC,NETLINK_SOCK_DIAG);
+  if (coll->nl_fd < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_LIB,"Could not open a NETLINK_SOCK_DIAG socket: %s\n",strerror(errno));
+  }
+  coll->root = (PetscBool)(geteuid() == 0);
+  coll->uid = (uint32_t)getuid();
+  coll->mypid = mypid;
+  coll->buflen = SOCK_DIAG_BUF_LEN;
+  ierr = PetscMalloc1(coll->buflen,&coll->buf);CHKERRQ(ierr);
+  ierr = PetscHMapInodeCreate(&coll->inode_to_pid);CHKERRQ(ierr);
+  ierr = PetscHMapInodeCreate(&coll->inode_to_socket);CHKERRQ(ierr);
+  ierr = PetscHMapICreate(&coll->pid_to_process);CHKERRQ(ierr);
+  ierr = PetscHMapICreate(&coll->listen_ports);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode sock_diag_destroy(sock_diag_collector *coll)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  if (coll->nl_fd >= 0) {
+    close(coll->nl_fd);
+  }
+  coll->nl_fd = -1;
+  ierr = PetscFree(coll->buf);CHKERRQ(ierr);
+  ierr = PetscFree(coll->sockets);CHKERRQ(ierr);
+  ierr = PetscFree(coll->processes);CHKERRQ(ierr);
+  ierr = PetscFree(coll->raw);CHKERRQ(ierr);
+  coll->nraw = coll->raw_capacity = 0;
+  ierr = PetscHMapInodeDestroy(&coll->inode_to_pid);CHKERRQ(ierr);
+  ierr = PetscHMapInodeDestroy(&coll->inode_to_socket);CHKERRQ(ierr);
+  ierr = PetscHMapIDestroy(&coll->pid_to_process);CHKERRQ(ierr);
+  ierr = PetscHMapIDestroy(&coll->listen_ports);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode sock_diag_handle_msg(sock_diag_collector *coll, struct nlmsghdr *nlh)
+{
+  PetscErrorCode       ierr;
+  struct inet_diag_msg *diag = (struct inet_diag_msg*)NLMSG_DATA(nlh);
+  struct rtattr        *attr;
+  struct tcp_info      info;
+  int                  attrlen;
+  sock_diag_raw        *raw;
+  PetscFunctionBeginUser;
+  if (diag->idiag_state == SOCK_LISTEN) {
+    ierr = PetscHMapISet(coll->listen_ports,ntohs(diag->id.idiag_sport),1);CHKERRQ(ierr);
+    PetscFunctionReturn(0);
+  }
+  /* TIME_WAIT and other orphaned sockets have no inode and so no process */
+  if (!diag->idiag_inode || (!coll->root && diag->idiag_uid != coll->uid)) {
+    PetscFunctionReturn(0);
+  }
+  if (coll->nraw == coll->raw_capacity) {
+    coll->raw_capacity = coll->raw_capacity ? 2*coll->raw_capacity : 256;
+    ierr = PetscRealloc(coll->raw_capacity*sizeof(sock_diag_raw),&coll->raw);CHKERRQ(ierr);
+  }
+  raw = &coll->raw[coll->nraw++];
+  ierr = PetscMemzero(raw,sizeof(sock_diag_raw));CHKERRQ(ierr);
+  ierr = PetscMemzero(&info,sizeof(info));CHKERRQ(ierr);
+  raw->inode = diag->idiag_inode;
+  raw->uid = diag->idiag_uid;
+  raw->family = diag->idiag_family;
+  raw->lport = ntohs(diag->id.idiag_sport);
+  raw->rport = ntohs(diag->id.idiag_dport);
+  inet_ntop(diag->idiag_family,diag->id.idiag_src,raw->laddr,IP_ADDR_MAX_LEN);
+  inet_ntop(diag->idiag_family,diag->id.idiag_dst,raw->raddr,IP_ADDR_MAX_LEN);
+  attr = (struct rtattr*)(diag + 1);
+  attrlen = (int)(nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*diag)));
+  for (; RTA_OK(attr,attrlen); attr = RTA_NEXT(attr,attrlen)) {
+    if (attr->rta_type == INET_DIAG_INFO) {
+      /* older kernels send a shorter tcp_info; the missing fields stay 0 */
+      memcpy(&info,RTA_DATA(attr),PetscMin((size_t)RTA_PAYLOAD(attr),sizeof(info)));
+    }
+  }
+  raw->bytes_acked = info.tcpi_bytes_acked;
+  raw->bytes_received = info.tcpi_bytes_received;
+  raw->rtt_us = info.tcpi_rtt;
+  raw->total_retrans = info.tcpi_total_retrans;
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode sock_diag_dump(sock_diag_collector *coll, int family)
+{
+  PetscErrorCode     ierr;
+  struct sockaddr_nl nladdr;
+  struct {
+    struct nlmsghdr         nlh;
+    struct inet_diag_req_v2 req;
+  } msg;
+  struct nlmsghdr    *nlh;
+  ssize_t            len;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(&nladdr,sizeof(nladdr));CHKERRQ(ierr);
+  ierr = PetscMemzero(&msg,sizeof(msg));CHKERRQ(ierr);
+  nladdr.nl_family = AF_NETLINK;
+  msg.nlh.nlmsg_len = sizeof(msg);
+  msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+  msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  msg.req.sdiag_family = family;
+  msg.req.sdiag_protocol = IPPROTO_TCP;
+  msg.req.idiag_states = ~0U;
+  msg.req.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+  if (sendto(coll->nl_fd,&msg,sizeof(msg),0,(struct sockaddr*)&nladdr,sizeof(nladdr)) < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_LIB,"Could not send the sock_diag request: %s\n",strerror(errno));
+  }
+  while (PETSC_TRUE) {
+    len = recv(coll->nl_fd,coll->buf,coll->buflen,0);
+    if (len < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_LIB,"Could not read the sock_diag dump: %s\n",strerror(errno));
+    }
+    for (nlh = (struct nlmsghdr*)coll->buf; NLMSG_OK(nlh,len); nlh = NLMSG_NEXT(nlh,len)) {
+      if (nlh->nlmsg_type == NLMSG_DONE) {
+	PetscFunctionReturn(0);
+      }
+      if (nlh->nlmsg_type == NLMSG_ERROR) {
+	SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_LIB,"The kernel refused the sock_diag dump: %s\n",
+		 strerror(-((struct nlmsgerr*)NLMSG_DATA(nlh))->error));
+      }
+      ierr = sock_diag_handle_msg(coll,nlh);CHKERRQ(ierr);
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode sock_diag_set_comm(sock_diag_collector *coll, PetscInt pid)
+{
+  PetscErrorCode    ierr;
+  PetscInt          i;
+  char              path[64];
+  int               fd;
+  ssize_t           len;
+  sock_diag_process *proc;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(coll->pid_to_process,pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    if (coll->nprocesses == coll->process_capacity) {
+      coll->process_capacity = coll->process_capacity ? 2*coll->process_capacity : 64;
+      ierr = PetscRealloc(coll->process_capacity*sizeof(sock_diag_process),&coll->processes);CHKERRQ(ierr);
+    }
+    i = coll->nprocesses++;
+    ierr = PetscHMapISet(coll->pid_to_process,pid,i);CHKERRQ(ierr);
+  }
+  /* re-read on every rescan, in case the PID was reused */
+  proc = &coll->processes[i];
+  proc->pid = pid;
+  ierr = PetscStrncpy(proc->comm,"[unknown]",SOCK_DIAG_COMM_LEN);CHKERRQ(ierr);
+  snprintf(path,sizeof(path),"/proc/%d/comm",(int)pid);
+  fd = open(path,O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    len = read(fd,proc->comm,SOCK_DIAG_COMM_LEN-1);
+    if (len > 0) {
+      proc->comm[len] = '\0';
+      proc->comm[strcspn(proc->comm,"\n")] = '\0';
+    }
+    close(fd);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* walks /proc/<pid>/fd of every process we may read and records which process
+   holds each socket inode */
+static PetscErrorCode sock_diag_rescan(sock_diag_collector *coll)
+{
+  PetscErrorCode ierr;
+  DIR            *proc,*fds;
+  struct dirent  *pent,*fent;
+  struct stat    st;
+  char           path[64],link[64];
+  ssize_t        len;
+  unsigned int   inode;
+  PetscInt       pid;
+  PetscBool      has_socket;
+  PetscFunctionBeginUser;
+  ++(coll->nrescans);
+  proc = opendir("/proc");
+  if (!proc) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open /proc\n");
+  }
+  while ((pent = readdir(proc))) {
+    if (pent->d_name[0] < '0' || pent->d_name[0] > '9') {
+      continue;
+    }
+    pid = (PetscInt)atoi(pent->d_name);
+    if (pid == coll->mypid) {
+      continue;
+    }
+    if (snprintf(path,sizeof(path),"/proc/%s/fd",pent->d_name) >= (int)sizeof(path)) {
+      continue;
+    }
+    /* without root, other users' fd directories are unreadable; don't try */
+    if (!coll->root && (stat(path,&st) || st.st_uid != coll->uid)) {
+      continue;
+    }
+    fds = opendir(path);
+    if (!fds) {
+      continue;
+    }
+    has_socket = PETSC_FALSE;
+    while ((fent = readdir(fds))) {
+      if (fent->d_name[0] == '.') {
+	continue;
+      }
+      /* a pid and a descriptor always fit; anything longer is not one */
+      if (snprintf(path,sizeof(path),"/proc/%s/fd/%s",pent->d_name,fent->d_name) >= (int)sizeof(path)) {
+	continue;
+      }
+      len = readlink(path,link,sizeof(link)-1);
+      if (len <= 0) {
+	continue;
+      }
+      link[len] = '\0';
+      if (sscanf(link,"socket:[%u]",&inode) == 1) {
+	ierr = PetscHMapInodeSet(coll->inode_to_pid,inode,pid);CHKERRQ(ierr);
+	has_socket = PETSC_TRUE;
+      }
+    }
+    closedir(fds);
+    if (has_socket) {
+      ierr = sock_diag_set_comm(coll,pid);CHKERRQ(ierr);
+    }
+  }
+  closedir(proc);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode sock_diag_get_comm(sock_diag_collector *coll, PetscInt pid, char *comm)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(coll->pid_to_process,pid,&i);CHKERRQ(ierr);
+  ierr = PetscStrncpy(comm,i >= 0 ? coll->processes[i].comm : "[unknown]",COMM_MAX_LEN);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* a socket seen for the first time: an accept or a connect, and a connection latency */
+static PetscErrorCode sock_diag_open(sock_diag_collector *coll, sock_diag_socket *sock, sock_diag_raw *raw,
+				     process_statistics *pstats, event_store *estore, PetscLogDouble now)
+{
+  PetscErrorCode   ierr;
+  PetscBool        listening;
+  tcpaccept_entry  accept_entry;
+  tcpconnect_entry connect_entry;
+  tcpconnlat_entry connlat_entry;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIHas(coll->listen_ports,raw->lport,&listening);CHKERRQ(ierr);
+  if (listening) {
+    accept_entry.pid = sock->pid;
+    accept_entry.ip = sock->ip;
+    accept_entry.lport = sock->lport;
+    accept_entry.rport = sock->rport;
+    ierr = PetscStrncpy(accept_entry.laddr,sock->laddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+    ierr = PetscStrncpy(accept_entry.raddr,sock->raddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+    ierr = sock_diag_get_comm(coll,sock->pid,accept_entry.comm);CHKERRQ(ierr);
+    ierr = process_statistics_add_accept(pstats,&accept_entry);CHKERRQ(ierr);
+    if (estore) {
+      ierr = event_store_add_accept(estore,&accept_entry,now);CHKERRQ(ierr);
+    }
+    PetscFunctionReturn(0);
+  }
+  connect_entry.pid = connlat_entry.pid = sock->pid;
+  connect_entry.ip = connlat_entry.ip = sock->ip;
+  connect_entry.dport = connlat_entry.dport = sock->rport;
+  connlat_entry.lat_ms = raw->rtt_us / 1000.0;
+  ierr = PetscStrncpy(connect_entry.saddr,sock->laddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  ierr = PetscStrncpy(connect_entry.daddr,sock->raddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  ierr = sock_diag_get_comm(coll,sock->pid,connect_entry.comm);CHKERRQ(ierr);
+  ierr = PetscStrncpy(connlat_entry.saddr,sock->laddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  ierr = PetscStrncpy(connlat_entry.daddr,sock->raddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  ierr = PetscStrncpy(connlat_entry.comm,connect_entry.comm,COMM_MAX_LEN);CHKERRQ(ierr);
+  ierr = process_statistics_add_connect(pstats,&connect_entry);CHKERRQ(ierr);
+  ierr = process_statistics_add_connlat(pstats,&connlat_entry);CHKERRQ(ierr);
+  if (estore) {
+    ierr = event_store_add_connect(estore,&connect_entry,now);CHKERRQ(ierr);
+    ierr = event_store_add_connlat(estore,&connlat_entry,now);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* a socket that is gone: a tcplife event. Its bytes were already credited as they grew. */
+static PetscErrorCode sock_diag_close(sock_diag_collector *coll, sock_diag_socket *sock,
+				      process_statistics *pstats, event_store *estore, PetscLogDouble now)
+{
+  PetscErrorCode ierr;
+  tcplife_entry  life_entry;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(&life_entry,sizeof(life_entry));CHKERRQ(ierr);
+  life_entry.pid = sock->pid;
+  life_entry.ip = sock->ip;
+  life_entry.lport = sock->lport;
+  life_entry.rport = sock->rport;
+  life_entry.ms = 1000.0 * (PetscReal)(now - sock->first_seen);
+  ierr = PetscStrncpy(life_entry.laddr,sock->laddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  ierr = PetscStrncpy(life_entry.raddr,sock->raddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+  ierr = sock_diag_get_comm(coll,sock->pid,life_entry.comm);CHKERRQ(ierr);
+  ierr = process_statistics_add_life(pstats,&life_entry);CHKERRQ(ierr);
+  if (estore) {
+    life_entry.tx_kb = (PetscInt)sock->total_tx_kb;
+    life_entry.rx_kb = (PetscInt)sock->total_rx_kb;
+    ierr = event_store_add_life(estore,&life_entry,now);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* a rescan indexes every socket fd, including UNIX and netlink sockets that never
+   show up in a TCP dump; keep only the inodes of the current dump */
+static PetscErrorCode sock_diag_prune(sock_diag_collector *coll)
+{
+  PetscErrorCode ierr;
+  PetscInt       n,off=0,k,isock;
+  uint32_t       *inodes;
+  PetscInt       *pids;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapInodeGetSize(coll->inode_to_pid,&n);CHKERRQ(ierr);
+  ierr = PetscMalloc2(n,&inodes,n,&pids);CHKERRQ(ierr);
+  ierr = PetscHMapInodeGetPairs(coll->inode_to_pid,&off,inodes,pids);CHKERRQ(ierr);
+  for (k=0; k<off; ++k) {
+    if (pids[k] < 0) {
+      if (pids[k] == SOCK_DIAG_UNRESOLVED(coll->npolls)) {
+	continue;
+      }
+    } else {
+      ierr = PetscHMapInodeGet(coll->inode_to_socket,inodes[k],&isock);CHKERRQ(ierr);
+      if (isock >= 0) {
+	continue;
+      }
+    }
+    ierr = PetscHMapInodeDel(coll->inode_to_pid,inodes[k]);CHKERRQ(ierr);
+  }
+  ierr = PetscFree2(inodes,pids);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode sock_diag_collect(sock_diag_collector *coll, process_statistics *pstats, event_store *estore)
+{
+  PetscErrorCode   ierr;
+  PetscInt         i,pid,isock;
+  PetscBool        rescanned = PETSC_FALSE;
+  PetscLogDouble   now;
+  sock_diag_raw    *raw;
+  sock_diag_socket *sock;
+  long long        tx_kb,rx_kb;
+  char             comm[COMM_MAX_LEN];
+  PetscFunctionBeginUser;
+  ierr = PetscTime(&now);CHKERRQ(ierr);
+  ++(coll->npolls);
+  coll->nraw = 0;
+  ierr = PetscHMapIClear(coll->listen_ports);CHKERRQ(ierr);
+  ierr = sock_diag_dump(coll,AF_INET);CHKERRQ(ierr);
+  ierr = sock_diag_dump(coll,AF_INET6);CHKERRQ(ierr);
+  for (i=0; i<coll->nsockets; ++i) {
+    coll->sockets[i].seen = PETSC_FALSE;
+  }
+  for (i=0; i<coll->nraw; ++i) {
+    raw = &coll->raw[i];
+    ierr = PetscHMapInodeGet(coll->inode_to_pid,raw->inode,&pid);CHKERRQ(ierr);
+    if (pid == -1 && !rescanned) {
+      /* an inode we have never looked for: the fd index is stale */
+      ierr = sock_diag_rescan(coll);CHKERRQ(ierr);
+      rescanned = PETSC_TRUE;
+      ierr = PetscHMapInodeGet(coll->inode_to_pid,raw->inode,&pid);CHKERRQ(ierr);
+    }
+    if (pid < 0) {
+      /* not held by any process we can read; don't rescan for it again, but
+	 remember when it was last seen so it can be forgotten once it closes */
+      ierr = PetscHMapInodeSet(coll->inode_to_pid,raw->inode,SOCK_DIAG_UNRESOLVED(coll->npolls));CHKERRQ(ierr);
+      continue;
+    }
+    ierr = PetscHMapInodeGet(coll->inode_to_socket,raw->inode,&isock);CHKERRQ(ierr);
+    if (isock < 0) {
+      if (coll->nsockets == coll->socket_capacity) {
+	coll->socket_capacity = coll->socket_capacity ? 2*coll->socket_capacity : 256;
+	ierr = PetscRealloc(coll->socket_capacity*sizeof(sock_diag_socket),&coll->sockets);CHKERRQ(ierr);
+      }
+      isock = coll->nsockets++;
+      sock = &coll->sockets[isock];
+      ierr = PetscMemzero(sock,sizeof(sock_diag_socket));CHKERRQ(ierr);
+      sock->inode = raw->inode;
+      sock->pid = pid;
+      sock->ip = raw->family == AF_INET6 ? 6 : 4;
+      sock->lport = raw->lport;
+      sock->rport = raw->rport;
+      sock->first_seen = now;
+      ierr = PetscStrncpy(sock->laddr,raw->laddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+      ierr = PetscStrncpy(sock->raddr,raw->raddr,IP_ADDR_MAX_LEN);CHKERRQ(ierr);
+      ierr = PetscHMapInodeSet(coll->inode_to_socket,raw->inode,isock);CHKERRQ(ierr);
+      if (coll->npolls == 1) {
+	/* open before we started: what it moved until now is not ours to credit */
+	sock->baseline = PETSC_TRUE;
+	sock->tx_kb = (long long)(raw->bytes_acked / 1024);
+	sock->rx_kb = (long long)(raw->bytes_received / 1024);
+	sock->nretrans = (long long)raw->total_retrans;
+      } else {
+	ierr = sock_diag_open(coll,sock,raw,pstats,estore,now);CHKERRQ(ierr);
+      }
+    }
+    sock = &coll->sockets[isock];
+    sock->seen = PETSC_TRUE;
+    /* credit whole kilobytes as they are acknowledged or received */
+    sock->total_tx_kb = (long long)(raw->bytes_acked / 1024);
+    sock->total_rx_kb = (long long)(raw->bytes_received / 1024);
+    tx_kb = sock->total_tx_kb - sock->tx_kb;
+    rx_kb = sock->total_rx_kb - sock->rx_kb;
+    if (tx_kb > 0 || rx_kb > 0 || (long long)raw->total_retrans > sock->nretrans) {
+      ierr = sock_diag_get_comm(coll,pid,comm);CHKERRQ(ierr);
+      ierr = process_statistics_add_traffic(pstats,pid,comm,PetscMax(tx_kb,0),PetscMax(rx_kb,0),
+					    PetscMax((long long)raw->total_retrans - sock->nretrans,0));CHKERRQ(ierr);
+      sock->tx_kb = PetscMax(sock->tx_kb,sock->total_tx_kb);
+      sock->rx_kb = PetscMax(sock->rx_kb,sock->total_rx_kb);
+      sock->nretrans = PetscMax(sock->nretrans,(long long)raw->total_retrans);
+    }
+  }
+  /* sockets missing from this dump have closed */
+  for (i=0; i<coll->nsockets; ) {
+    sock = &coll->sockets[i];
+    if (sock->seen) {
+      ++i;
+      continue;
+    }
+    if (!sock->baseline) {
+      ierr = sock_diag_close(coll,sock,pstats,estore,now);CHKERRQ(ierr);
+    }
+    ierr = PetscHMapInodeDel(coll->inode_to_socket,sock->inode);CHKERRQ(ierr);
+    ierr = PetscHMapInodeDel(coll->inode_to_pid,sock->inode);CHKERRQ(ierr);
+    if (i != coll->nsockets - 1) {
+      coll->sockets[i] = coll->sockets[coll->nsockets-1];
+      ierr = PetscHMapInodeSet(coll->inode_to_socket,coll->sockets[i].inode,i);CHKERRQ(ierr);
+    }
+    --(coll->nsockets);
+  }
+  if (rescanned) {
+    ierr = sock_diag_prune(coll);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode sock_diag_forget(sock_diag_collector *coll, PetscInt pid)
+{
+  PetscErrorCode ierr;
+  PetscInt       i,k,last;
+  PetscFunctionBeginUser;
+  ierr = PetscHMapIGet(coll->pid_to_process,pid,&i);CHKERRQ(ierr);
+  if (i < 0) {
+    PetscFunctionReturn(0);
+  }
+  /* an idle process may still hold sockets, whose events need its name */
+  for (k=0; k<coll->nsockets; ++k) {
+    if (coll->sockets[k].pid == pid) {
+      PetscFunctionReturn(0);
+    }
+  }
+  ierr = PetscHMapIDel(coll->pid_to_process,pid);CHKERRQ(ierr);
+  /* keep the processes dense by moving the last one into the hole */
+  last = coll->nprocesses - 1;
+  if (i != last) {
+    coll->processes[i] = coll->processes[last];
+    ierr = PetscHMapISet(coll->pid_to_process,coll->processes[i].pid,i);CHKERRQ(ierr);
+  }
+  --(coll->nprocesses);
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,93 @@
+#ifndef DCPROF_SOCK_DIAG_H
+#define DCPROF_SOCK_DIAG_H
+#include "petsc_webserver.h"
+#include "event_store.h"
+#include <stdint.h>
+#include <petsctime.h>
+#include <petsc/private/hashmapi.h>
+#include <petsc/private/hashmap.h>
+
+/* a collector that needs neither root nor bcc: every poll it dumps the TCP sockets
+   of this node over NETLINK_SOCK_DIAG with INET_DIAG_INFO, which gives the
+   tcp_info of each socket (bytes_acked, bytes_received, rtt, total_retrans).
+   Sockets are mapped to PIDs through an index of socket inodes built by reading
+   the /proc/<pid>/fd links; the index is only rebuilt when a dump contains an
+   inode it has not seen before. Without root only the caller's own processes'
+   fds are readable, so only the caller's sockets are collected.
+
+   Snapshots are turned into the same updates the bcc tools produce: a socket seen
+   for the first time is an accept (if its local port is listening) or a connect,
+   with its smoothed RTT as the connection latency; bytes and retransmits are
+   credited as they grow; and a socket that disappears is a tcplife event. The
+   first dump is a baseline: the sockets already open then were not opened while
+   we watched, so they are neither accepts, connects nor tcplife events when they
+   close, and only what they send and receive from then on is credited. */
+
+#define SOCK_DIAG_COMM_LEN 16 /* TASK_COMM_LEN */
+
+/* socket inodes are unsigned 32-bit numbers, which a PetscInt key may not hold */
+PETSC_HASH_MAP(HMapInode,uint32_t,PetscInt,PetscHash_UInt32,PetscHashEqual,-1);
+
+/* one socket of the current dump */
+typedef struct {
+  uint32_t inode,uid;
+  int      family;
+  PetscInt lport,rport;
+  char     laddr[IP_ADDR_MAX_LEN],raddr[IP_ADDR_MAX_LEN];
+  uint64_t bytes_acked,bytes_received;
+  uint32_t rtt_us,total_retrans;
+} sock_diag_raw;
+
+typedef struct {
+  uint32_t       inode;
+  PetscInt       pid,ip;
+  PetscInt       lport,rport;
+  char           laddr[IP_ADDR_MAX_LEN],raddr[IP_ADDR_MAX_LEN];
+  long long      tx_kb,rx_kb;   /* already credited to process_statistics */
+  long long      nretrans;      /* already credited */
+  long long      total_tx_kb,total_rx_kb; /* as of the last dump */
+  PetscLogDouble first_seen;
+  PetscBool      baseline;      /* open at the first dump */
+  PetscBool      seen;          /* present in the current dump */
+} sock_diag_socket;
+
+typedef struct {
+  PetscInt pid;
+  char     comm[SOCK_DIAG_COMM_LEN];
+} sock_diag_process;
+
+typedef struct {
+  int               nl_fd;
+  PetscBool         root;
+  uint32_t          uid;
+  PetscInt          mypid;
+  PetscHMapInode    inode_to_pid;    /* negative once a rescan did not find the inode */
+  PetscHMapInode    inode_to_socket; /* index into sockets */
+  sock_diag_socket  *sockets;
+  PetscInt          nsockets,socket_capacity;
+  PetscHMapI        pid_to_process;  /* index into processes */
+  sock_diag_process *processes;
+  PetscInt          nprocesses,process_capacity;
+  PetscHMapI        listen_ports;
+  PetscInt          npolls,nrescans;
+  unsigned char     *buf;
+  size_t            buflen;
+  sock_diag_raw     *raw;            /* the current dump */
+  PetscInt          nraw,raw_capacity;
+} sock_diag_collector;
+
+/* opens the netlink socket. Sockets of the PID in the second parameter (this program) are ignored. */
+extern PetscErrorCode sock_diag_create(sock_diag_collector *, PetscInt);
+
+extern PetscErrorCode sock_diag_destroy(sock_diag_collector *);
+
+/* dumps the TCP sockets and feeds what changed since the last call into the
+   process_statistics in the second parameter and, if it is not NULL, the
+   event_store in the third */
+extern PetscErrorCode sock_diag_collect(sock_diag_collector *, process_statistics *, event_store *);
+
+/* drops the name kept of the PID in the second parameter, unless it still holds one
+   of the sockets being tracked */
+extern PetscErrorCode sock_diag_forget(sock_diag_collector *, PetscInt);
+
+#endif
@@ -0,0 +1,200 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "summary_shm.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SUMMARY_SHM_MIN_SIZE (1<<20)
+
+/* (re)maps the whole segment, at its current size */
+static PetscErrorCode summary_shm_map(summary_shm *shm, int prot)
+{
+  struct stat st;
+  PetscFunctionBeginUser;
+  if (shm->map) {
+    munmap(shm->map,shm->size);
+    shm->map = NULL;
+  }
+  if (fstat(shm->fd,&st)) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not stat shared memory segment %s: %s\n",shm->name,strerror(errno));
+  }
+  shm->size = (size_t)st.st_size;
+  if (shm->size < sizeof(summary_shm_header)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Shared memory segment %s is too small\n",shm->name);
+  }
+  shm->map = mmap(NULL,shm->size,prot,MAP_SHARED,shm->fd,0);
+  if (shm->map == MAP_FAILED) {
+    shm->map = NULL;
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_MEM,"Could not map shared memory segment %s: %s\n",shm->name,strerror(errno));
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_shm_create(summary_shm *shm, const char *name)
+{
+  PetscErrorCode     ierr;
+  summary_shm_header *hdr;
+  struct stat        st;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(shm,sizeof(summary_shm));CHKERRQ(ierr);
+  ierr = PetscStrncpy(shm->name,name,PETSC_MAX_PATH_LEN);CHKERRQ(ierr);
+  shm->fd = shm_open(name,O_RDWR | O_CREAT,0644);
+  if (shm->fd < 0) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open shared memory segment %s: %s\n",name,strerror(errno));
+  }
+  /* never shrink a segment left by a previous run: its readers may still have
+     all of it mapped */
+  if (fstat(shm->fd,&st)) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not stat shared memory segment %s: %s\n",name,strerror(errno));
+  }
+  if ((size_t)st.st_size < SUMMARY_SHM_MIN_SIZE && ftruncate(shm->fd,SUMMARY_SHM_MIN_SIZE)) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not size shared memory segment %s: %s\n",name,strerror(errno));
+  }
+  ierr = summary_shm_map(shm,PROT_READ | PROT_WRITE);CHKERRQ(ierr);
+  hdr = (summary_shm_header*)shm->map;
+  if (memcmp(hdr->magic,SUMMARY_SHM_MAGIC,sizeof(SUMMARY_SHM_MAGIC))) {
+    ierr = PetscMemzero(hdr,sizeof(*hdr));CHKERRQ(ierr);
+    memcpy(hdr->magic,SUMMARY_SHM_MAGIC,sizeof(SUMMARY_SHM_MAGIC));
+  } else if (hdr->seq & 1) {
+    /* the previous writer died while copying */
+    hdr->len = 0;
+    __atomic_store_n(&hdr->seq,hdr->seq + 1,__ATOMIC_RELEASE);
+  }
+  hdr->size = shm->size;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_shm_destroy(summary_shm *shm)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = summary_shm_close(shm);CHKERRQ(ierr);
+  shm_unlink(shm->name);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_shm_publish(summary_shm *shm, summary_snapshot *snap)
+{
+  PetscErrorCode     ierr;
+  summary_shm_header *hdr = (summary_shm_header*)shm->map;
+  struct iovec       iov[4];
+  size_t             len,size;
+  uint64_t           seq;
+  char               *dst;
+  int                i;
+  PetscFunctionBeginUser;
+  len = summary_snapshot_iov(snap,iov);
+  seq = hdr->seq;
+  __atomic_store_n(&hdr->seq,seq + 1,__ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  if (sizeof(summary_shm_header) + len > shm->size) {
+    for (size=shm->size; size < sizeof(summary_shm_header) + len; size*=2);
+    if (ftruncate(shm->fd,(off_t)size)) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not grow shared memory segment %s: %s\n",shm->name,strerror(errno));
+    }
+    ierr = summary_shm_map(shm,PROT_READ | PROT_WRITE);CHKERRQ(ierr);
+    hdr = (summary_shm_header*)shm->map;
+    hdr->size = shm->size;
+  }
+  dst = (char*)shm->map + sizeof(summary_shm_header);
+  for (i=0; i<4; ++i) {
+    memcpy(dst,iov[i].iov_base,iov[i].iov_len);
+    dst += iov[i].iov_len;
+  }
+  hdr->len = len;
+  __atomic_store_n(&hdr->seq,seq + 2,__ATOMIC_RELEASE);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_shm_open(summary_shm *shm, const char *name)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(shm,sizeof(summary_shm));CHKERRQ(ierr);
+  ierr = PetscStrncpy(shm->name,name,PETSC_MAX_PATH_LEN);CHKERRQ(ierr);
+  shm->fd = shm_open(name,O_RDONLY,0);
+  if (shm->fd < 0) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open shared memory segment %s: %s\n",name,strerror(errno));
+  }
+  ierr = summary_shm_map(shm,PROT_READ);CHKERRQ(ierr);
+  if (memcmp(((summary_shm_header*)shm->map)->magic,SUMMARY_SHM_MAGIC,sizeof(SUMMARY_SHM_MAGIC))) {
+    ierr = summary_shm_close(shm);CHKERRQ(ierr);
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"%s is not a summary segment\n",name);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_shm_close(summary_shm *shm)
+{
+  PetscFunctionBeginUser;
+  if (shm->map) {
+    munmap(shm->map,shm->size);
+    shm->map = NULL;
+  }
+  if (shm->fd >= 0) {
+    close(shm->fd);
+    shm->fd = -1;
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_shm_read(summary_shm *shm, char **buf, size_t *capacity, summary_snapshot_view *view)
+{
+  PetscErrorCode     ierr;
+  summary_shm_header *hdr;
+  uint64_t           seq;
+  size_t             len;
+  struct timespec    start,now;
+  PetscInt           ntries;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(view,sizeof(summary_snapshot_view));CHKERRQ(ierr);
+  for (ntries=0;; ++ntries) {
+    if (ntries == 1) {
+      clock_gettime(CLOCK_MONOTONIC,&start);
+    } else if (ntries > 1) {
+      /* a writer that died while copying leaves seq odd until the next one takes
+	 the segment over */
+      clock_gettime(CLOCK_MONOTONIC,&now);
+      if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 > SUMMARY_SHM_READ_TIMEOUT_MS) {
+	SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"No consistent snapshot in %s after %d ms; is its writer alive?\n",shm->name,SUMMARY_SHM_READ_TIMEOUT_MS);
+      }
+    }
+    hdr = (summary_shm_header*)shm->map;
+    seq = __atomic_load_n(&hdr->seq,__ATOMIC_ACQUIRE);
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+    if (hdr->size > shm->size) {
+      ierr = summary_shm_map(shm,PROT_READ);CHKERRQ(ierr);
+      continue;
+    }
+    len = hdr->len;
+    if (sizeof(summary_shm_header) + len > shm->size) {
+      continue;
+    }
+    if (len > *capacity) {
+      *capacity = len;
+      ierr = PetscRealloc(*capacity,buf);CHKERRQ(ierr);
+    }
+    memcpy(*buf,(char*)shm->map + sizeof(summary_shm_header),len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&hdr->seq,__ATOMIC_RELAXED) == seq) {
+      break;
+    }
+  }
+  if (!len) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"Nothing has been published in %s yet\n",shm->name);
+  }
+  ierr = summary_snapshot_view_init(view,*buf,len);
+  if (ierr) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_UNEXPECTED,"%s does not hold a snapshot of this version\n",shm->name);
+  }
+  PetscFunctionReturn(0);
+}
@@ -0,0 +1,63 @@
+#ifndef DCPROF_SUMMARY_SHM_H
+#define DCPROF_SUMMARY_SHM_H
+#include "summary_snapshot.h"
+
+/* publishes summary snapshots (see summary_snapshot.h) in a POSIX shared memory
+   segment, for readers on the same node that want the current summaries without
+   waiting for the file to be rewritten. The segment is a summary_shm_header
+   followed by one snapshot, in the same layout as the file.
+
+   Writes are guarded by a sequence lock: the driver makes seq odd, copies the
+   snapshot in, and makes seq even again. A reader reads seq, copies the snapshot
+   out and reads seq again; if it was odd or has changed, the copy may be torn and
+   the reader tries again. The driver never waits for a reader, and a reader
+   takes no lock and makes no system call unless the segment has grown (size is
+   larger than what it has mapped), in which case it maps it again. A reader
+   gives up after SUMMARY_SHM_READ_TIMEOUT_MS of retries, which is what it sees
+   of a writer that died in the middle of a copy.
+
+   Root publishes all the gathered summaries; with --shm_local every rank also
+   publishes its own, in <name>.rank<N>. */
+
+#define SUMMARY_SHM_MAGIC "DCPSHM"
+
+/* how long summary_shm_read() retries before it returns an error */
+#define SUMMARY_SHM_READ_TIMEOUT_MS 1000
+
+typedef struct {
+  char     magic[8];
+  uint64_t seq;       /* odd while a snapshot is being copied in */
+  uint64_t size;      /* of the whole segment */
+  uint64_t len;       /* of the snapshot that follows */
+} summary_shm_header;
+
+typedef struct {
+  int    fd;
+  void   *map;
+  size_t size;
+  char   name[PETSC_MAX_PATH_LEN];
+} summary_shm;
+
+/* creates (or takes over) the segment named by the second parameter, e.g.
+   "/dcprof", which the writer owns. */
+extern PetscErrorCode summary_shm_create(summary_shm *, const char *);
+
+/* unmaps and unlinks the segment */
+extern PetscErrorCode summary_shm_destroy(summary_shm *);
+
+/* copies the snapshot sealed with summary_snapshot_seal() into the segment,
+   growing it if it does not fit */
+extern PetscErrorCode summary_shm_publish(summary_shm *, summary_snapshot *);
+
+/* maps an existing segment, named by the second parameter, for reading */
+extern PetscErrorCode summary_shm_open(summary_shm *, const char *);
+
+extern PetscErrorCode summary_shm_close(summary_shm *);
+
+/* copies a consistent snapshot out of a segment opened with summary_shm_open()
+   into the buffer in the second parameter, of the capacity in the third (both
+   grown with PetscRealloc() if needed), and views it in the fourth. Returns
+   PETSC_ERR_FILE_UNEXPECTED if there is none within SUMMARY_SHM_READ_TIMEOUT_MS */
+extern PetscErrorCode summary_shm_read(summary_shm *, char **, size_t *, summary_snapshot_view *);
+
+#endif
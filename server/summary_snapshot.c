@@ -0,0 +1,252 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "summary_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* appends the string in the second parameter to the string table and stores its
+   offset in the third */
+static PetscErrorCode summary_snapshot_intern(summary_snapshot *snap, const char *s, uint32_t *offset)
+{
+  PetscErrorCode ierr;
+  size_t         len;
+  PetscFunctionBeginUser;
+  if (!s[0]) {
+    *offset = 0;
+    PetscFunctionReturn(0);
+  }
+  len = strlen(s) + 1;
+  if (snap->strings_len + len > snap->strings_capacity) {
+    while (snap->strings_len + len > snap->strings_capacity) {
+      snap->strings_capacity *= 2;
+    }
+    ierr = PetscRealloc(snap->strings_capacity,&snap->strings);CHKERRQ(ierr);
+  }
+  *offset = (uint32_t)snap->strings_len;
+  memcpy(snap->strings + snap->strings_len,s,len);
+  snap->strings_len += len;
+  PetscFunctionReturn(0);
+}
+
+/* the table always starts with the empty string */
+static PetscErrorCode summary_snapshot_reset(summary_snapshot *snap)
+{
+  PetscFunctionBeginUser;
+  snap->nrecords = 0;
+  snap->nnodes = 0;
+  snap->strings[0] = '\0';
+  snap->strings_len = 1;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_snapshot_create(summary_snapshot *snap, const char *filename)
+{
+  PetscErrorCode          ierr;
+  summary_snapshot_header hdr;
+  int                     fd;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(snap,sizeof(summary_snapshot));CHKERRQ(ierr);
+  snap->strings_capacity = 4096;
+  ierr = PetscMalloc1(snap->strings_capacity,&snap->strings);CHKERRQ(ierr);
+  ierr = summary_snapshot_reset(snap);CHKERRQ(ierr);
+  if (!filename) {
+    PetscFunctionReturn(0);
+  }
+  if (strlen(filename) + 5 > PETSC_MAX_PATH_LEN) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_ARG_OUTOFRANGE,"Snapshot file name %s is too long\n",filename);
+  }
+  ierr = PetscStrncpy(snap->filename,filename,PETSC_MAX_PATH_LEN);CHKERRQ(ierr);
+  sprintf(snap->tmp_filename,"%s.tmp",filename);
+  /* carry on from the epoch of a snapshot left by a previous run */
+  fd = open(filename,O_RDONLY);
+  if (fd >= 0) {
+    if (read(fd,&hdr,sizeof(hdr)) == sizeof(hdr) && !memcmp(hdr.magic,SUMMARY_SNAPSHOT_MAGIC,sizeof(hdr.magic)) && hdr.version == SUMMARY_SNAPSHOT_VERSION) {
+      snap->epoch = hdr.epoch;
+    }
+    close(fd);
+  }
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_snapshot_destroy(summary_snapshot *snap)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscFree(snap->records);CHKERRQ(ierr);
+  ierr = PetscFree(snap->nodes);CHKERRQ(ierr);
+  ierr = PetscFree(snap->strings);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_snapshot_add(summary_snapshot *snap, process_data_summary *psum)
+{
+  PetscErrorCode          ierr;
+  summary_snapshot_record *rec;
+  PetscFunctionBeginUser;
+  if (snap->nrecords == snap->capacity) {
+    snap->capacity = snap->capacity ? 2 * snap->capacity : 256;
+    ierr = PetscRealloc(snap->capacity*sizeof(summary_snapshot_record),&snap->records);CHKERRQ(ierr);
+  }
+  rec = &snap->records[snap->nrecords++];
+  ierr = PetscMemzero(rec,sizeof(*rec));CHKERRQ(ierr);
+  rec->rank = (int32_t)psum->rank;
+  rec->pid = (int32_t)psum->pid;
+  rec->app_rank = (int32_t)psum->app_rank;
+  ierr = summary_snapshot_intern(snap,psum->comm,&rec->comm);CHKERRQ(ierr);
+  ierr = summary_snapshot_intern(snap,psum->job_id,&rec->job_id);CHKERRQ(ierr);
+  rec->tx_kb = psum->tx_kb;
+  rec->rx_kb = psum->rx_kb;
+  rec->n_event = psum->n_event;
+  rec->nretrans = psum->nretrans;
+  rec->ndrop = psum->ndrop;
+  rec->rss_kb = psum->rss_kb;
+  rec->read_bytes = psum->read_bytes;
+  rec->write_bytes = psum->write_bytes;
+  rec->ctx_switches = psum->ctx_switches;
+  rec->avg_latency = psum->avg_latency;
+  rec->avg_lifetime = psum->avg_lifetime;
+  rec->fraction_ipv6 = psum->fraction_ipv6;
+  rec->avg_rtt = psum->avg_rtt;
+  rec->p99_rtt = psum->p99_rtt;
+  rec->avg_handshake = psum->avg_handshake;
+  rec->avg_established = psum->avg_established;
+  rec->cpu_seconds = psum->cpu_seconds;
+  rec->bytes_per_cpu_second = psum->bytes_per_cpu_second;
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_snapshot_add_node(summary_snapshot *snap, node_summary *nsumm)
+{
+  PetscErrorCode        ierr;
+  summary_snapshot_node *node;
+  PetscInt              c;
+  PetscFunctionBeginUser;
+  if (snap->nnodes == snap->node_capacity) {
+    snap->node_capacity = snap->node_capacity ? 2 * snap->node_capacity : 16;
+    ierr = PetscRealloc(snap->node_capacity*sizeof(summary_snapshot_node),&snap->nodes);CHKERRQ(ierr);
+  }
+  node = &snap->nodes[snap->nnodes++];
+  node->rank = (int32_t)nsumm->rank;
+  ierr = summary_snapshot_intern(snap,nsumm->host,&node->host);CHKERRQ(ierr);
+  node->interval = nsumm->interval;
+  for (c=0; c<NUM_NODE_COUNTERS; ++c) {
+    node->total[c] = nsumm->total[c];
+    node->rate[c] = nsumm->rate[c];
+    node->peak_rate[c] = nsumm->peak_rate[c];
+  }
+  PetscFunctionReturn(0);
+}
+
+static int summary_snapshot_record_cmp(const void *a, const void *b)
+{
+  const summary_snapshot_record *x = (const summary_snapshot_record*)a,*y = (const summary_snapshot_record*)b;
+  if (x->rank != y->rank) {
+    return x->rank < y->rank ? -1 : 1;
+  }
+  return x->pid < y->pid ? -1 : (x->pid > y->pid);
+}
+
+static int summary_snapshot_node_cmp(const void *a, const void *b)
+{
+  const summary_snapshot_node *x = (const summary_snapshot_node*)a,*y = (const summary_snapshot_node*)b;
+  return x->rank < y->rank ? -1 : (x->rank > y->rank);
+}
+
+PetscErrorCode summary_snapshot_seal(summary_snapshot *snap, int64_t now_ms)
+{
+  PetscErrorCode          ierr;
+  summary_snapshot_header *hdr = &snap->header;
+  PetscInt                c;
+  uint32_t                offset;
+  PetscFunctionBeginUser;
+  if (snap->nrecords) {
+    qsort(snap->records,snap->nrecords,sizeof(summary_snapshot_record),summary_snapshot_record_cmp);
+  }
+  if (snap->nnodes) {
+    qsort(snap->nodes,snap->nnodes,sizeof(summary_snapshot_node),summary_snapshot_node_cmp);
+  }
+  ierr = PetscMemzero(hdr,sizeof(*hdr));CHKERRQ(ierr);
+  memcpy(hdr->magic,SUMMARY_SNAPSHOT_MAGIC,sizeof(hdr->magic));
+  hdr->version = SUMMARY_SNAPSHOT_VERSION;
+  hdr->header_size = sizeof(*hdr);
+  hdr->record_size = sizeof(summary_snapshot_record);
+  hdr->node_record_size = sizeof(summary_snapshot_node);
+  hdr->epoch = ++snap->epoch;
+  hdr->time_ms = now_ms;
+  hdr->ncounters = NUM_NODE_COUNTERS;
+  for (c=0; c<NUM_NODE_COUNTERS; ++c) {
+    ierr = summary_snapshot_intern(snap,NodeCounters[c],&offset);CHKERRQ(ierr);
+    if (!c) {
+      hdr->counter_names = offset;
+    }
+  }
+  hdr->nrecords = snap->nrecords;
+  hdr->records_offset = sizeof(*hdr);
+  hdr->nnodes = snap->nnodes;
+  hdr->nodes_offset = hdr->records_offset + hdr->nrecords * sizeof(summary_snapshot_record);
+  hdr->strings_offset = hdr->nodes_offset + hdr->nnodes * sizeof(summary_snapshot_node);
+  hdr->strings_len = snap->strings_len;
+  PetscFunctionReturn(0);
+}
+
+size_t summary_snapshot_iov(summary_snapshot *snap, struct iovec *iov)
+{
+  iov[0].iov_base = &snap->header;
+  iov[0].iov_len = sizeof(summary_snapshot_header);
+  iov[1].iov_base = snap->records;
+  iov[1].iov_len = snap->header.nrecords * sizeof(summary_snapshot_record);
+  iov[2].iov_base = snap->nodes;
+  iov[2].iov_len = snap->header.nnodes * sizeof(summary_snapshot_node);
+  iov[3].iov_base = snap->strings;
+  iov[3].iov_len = snap->header.strings_len;
+  return snap->header.strings_offset + snap->header.strings_len;
+}
+
+PetscErrorCode summary_snapshot_write(summary_snapshot *snap)
+{
+  PetscErrorCode ierr;
+  struct iovec   iov[4];
+  ssize_t        total,n;
+  int            fd;
+  PetscFunctionBeginUser;
+  if (snap->filename[0]) {
+    total = (ssize_t)summary_snapshot_iov(snap,iov);
+    fd = open(snap->tmp_filename,O_WRONLY | O_CREAT | O_TRUNC,0644);
+    if (fd < 0) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open %s: %s\n",snap->tmp_filename,strerror(errno));
+    }
+    n = writev(fd,iov,4);
+    close(fd);
+    if (n != total) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not write %s: %s\n",snap->tmp_filename,strerror(errno));
+    }
+    if (rename(snap->tmp_filename,snap->filename)) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_FILE_WRITE,"Could not replace snapshot file %s: %s\n",snap->filename,strerror(errno));
+    }
+  }
+  ierr = summary_snapshot_reset(snap);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+PetscErrorCode summary_snapshot_view_init(summary_snapshot_view *view, void *data, size_t size)
+{
+  summary_snapshot_header *hdr = (summary_snapshot_header*)data;
+  PetscFunctionBeginUser;
+  view->size = size;
+  if (size < sizeof(summary_snapshot_header) || memcmp(hdr->magic,SUMMARY_SNAPSHOT_MAGIC,sizeof(hdr->magic)) ||
+      hdr->version != SUMMARY_SNAPSHOT_VERSION || hdr->record_size != sizeof(summary_snapshot_record) ||
+      hdr->node_record_size != sizeof(summary_snapshot_node) || hdr->strings_offset + hdr->strings_len != size) {
+    PetscFunctionReturn(PETSC_ERR_FILE_UNEXPECTED);
+  }
+  view->header = hdr;
+  view->records = (summary_snapshot_record*)((char*)data + hdr->records_offset);
+  view->nodes = (summary_snapshot_node*)((char*)data + hdr->nodes_offset);
+  view->strings = (const char*)data + hdr->strings_offset;
+  PetscFunctionReturn(0);
+}
+
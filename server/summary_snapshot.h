@@ -0,0 +1,111 @@
+#ifndef DCPROF_SUMMARY_SNAPSHOT_H
+#define DCPROF_SUMMARY_SNAPSHOT_H
+#include "petsc_webserver.h"
+#include "node_stats.h"
+#include <stdint.h>
+#include <sys/uio.h>
+
+/* the gathered summaries of one poll as a binary file, which root writes instead of
+   rewriting the text output in place. Each snapshot is written to <filename>.tmp
+   and renamed over <filename>, so a reader that opens the file always gets a whole
+   snapshot, and one that has it mapped keeps its old snapshot until it reopens.
+
+   Layout (native byte order, all offsets from the start of the file):
+     summary_snapshot_header
+     nrecords summary_snapshot_records, sorted by (rank,pid)
+     nnodes summary_snapshot_nodes, sorted by rank
+     the string table: NUL-terminated strings, starting with the empty one
+   Records refer to their strings (comm, job_id, host) by offset into the string
+   table, so they have a fixed size and a reader can find a (rank,pid) with a
+   binary search over the mapped records without parsing anything. The names of
+   the node counters are ncounters consecutive strings at counter_names.
+
+   The epoch counts the snapshots written to the file, and carries on from the
+   file's previous one when the driver restarts. */
+
+#define SUMMARY_SNAPSHOT_MAGIC   "DCPSNAP"
+#define SUMMARY_SNAPSHOT_VERSION 1
+
+typedef struct {
+  char     magic[8];
+  uint32_t version,header_size;
+  uint32_t record_size,node_record_size;
+  uint64_t epoch;
+  int64_t  time_ms;               /* when it was written, ms since the epoch */
+  uint64_t nrecords,records_offset;
+  uint64_t nnodes,nodes_offset;
+  uint64_t strings_offset,strings_len;
+  uint32_t ncounters,counter_names;
+} summary_snapshot_header;
+
+typedef struct {
+  int32_t  rank,pid,app_rank;
+  uint32_t comm,job_id;           /* string table offsets */
+  uint32_t reserved;
+  int64_t  tx_kb,rx_kb,n_event,nretrans,ndrop,rss_kb,read_bytes,write_bytes,ctx_switches;
+  double   avg_latency,avg_lifetime,fraction_ipv6,avg_rtt,p99_rtt,avg_handshake,avg_established,
+           cpu_seconds,bytes_per_cpu_second;
+} summary_snapshot_record;
+
+typedef struct {
+  int32_t  rank;
+  uint32_t host;                  /* string table offset */
+  double   interval;
+  int64_t  total[NUM_NODE_COUNTERS];
+  double   rate[NUM_NODE_COUNTERS],peak_rate[NUM_NODE_COUNTERS];
+} summary_snapshot_node;
+
+struct summary_snapshot_s {
+  summary_snapshot_record *records;
+  PetscInt                nrecords,capacity;
+  summary_snapshot_node   *nodes;
+  PetscInt                nnodes,node_capacity;
+  char                    *strings;
+  size_t                  strings_len,strings_capacity;
+  uint64_t                epoch;      /* of the last snapshot sealed */
+  summary_snapshot_header header;     /* of the last snapshot sealed */
+  char                    filename[PETSC_MAX_PATH_LEN],tmp_filename[PETSC_MAX_PATH_LEN];
+};
+typedef struct summary_snapshot_s summary_snapshot;
+
+/* a snapshot in memory, as a reader sees it */
+typedef struct {
+  size_t                  size;
+  summary_snapshot_header *header;
+  summary_snapshot_record *records;
+  summary_snapshot_node   *nodes;
+  const char              *strings;
+} summary_snapshot_view;
+
+/* prepares to write snapshots to the file named by the second parameter, or only
+   to build them (e.g. for summary_shm_publish()) if it is NULL */
+extern PetscErrorCode summary_snapshot_create(summary_snapshot *, const char *);
+
+extern PetscErrorCode summary_snapshot_destroy(summary_snapshot *);
+
+/* adds the process summary in the second parameter to the next snapshot */
+extern PetscErrorCode summary_snapshot_add(summary_snapshot *, process_data_summary *);
+
+/* adds the node summary in the second parameter to the next snapshot */
+extern PetscErrorCode summary_snapshot_add_node(summary_snapshot *, node_summary *);
+
+/* makes everything added since the last summary_snapshot_write() the next
+   snapshot, stamped with the time (ms since the epoch) in the second parameter:
+   sorts the records and fills in the header */
+extern PetscErrorCode summary_snapshot_seal(summary_snapshot *, int64_t);
+
+/* points the four entries of the second parameter at the header, records, nodes
+   and string table of the sealed snapshot, and returns its size in bytes */
+extern size_t summary_snapshot_iov(summary_snapshot *, struct iovec *);
+
+/* writes the sealed snapshot to the file, if there is one, and starts over */
+extern PetscErrorCode summary_snapshot_write(summary_snapshot *);
+
+/* views the snapshot in the memory in the second parameter, of the size in the
+   third, after checking its header; nothing is copied. Returns
+   PETSC_ERR_FILE_UNEXPECTED if it is not a whole snapshot. */
+extern PetscErrorCode summary_snapshot_view_init(summary_snapshot_view *, void *, size_t);
+
+#define summary_snapshot_string(view,offset) ((view)->strings + (offset))
+
+#endif
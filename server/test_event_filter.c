@@ -0,0 +1,177 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "event_filter.h"
+#include "event_source.h"
+#include <stdio.h>
+
+/* compiles the expression in the first parameter and checks that the life entry
+   in the second parameter passes it exactly when the third parameter is true */
+static PetscErrorCode check_life(const char *str, tcplife_entry *life, PetscBool expected)
+{
+  PetscErrorCode ierr;
+  event_filter   filter;
+  PetscBool      match;
+  PetscFunctionBeginUser;
+  ierr = event_filter_compile(str,&filter);CHKERRQ(ierr);
+  match = event_filter_match_life(&filter,life);
+  if (match != expected) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Filter %s should %s the life event",str,expected ? "accept" : "drop");
+  }
+  PetscFunctionReturn(0);
+}
+
+/* the same for the record in the second parameter */
+static PetscErrorCode check_record(const char *str, const event_record *record, PetscBool expected)
+{
+  PetscErrorCode ierr;
+  event_filter   filter;
+  PetscBool      match;
+  PetscFunctionBeginUser;
+  ierr = event_filter_compile(str,&filter);CHKERRQ(ierr);
+  match = event_filter_match_record(&filter,record);
+  if (match != expected) {
+    SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Filter %s should %s the record of type %d",str,expected ? "accept" : "drop",(int)record->type);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* checks that the expression in the first parameter does not compile */
+static PetscErrorCode check_rejected(const char *str)
+{
+  PetscErrorCode ierr;
+  event_filter   filter;
+  PetscFunctionBeginUser;
+  ierr = PetscPushErrorHandler(PetscReturnErrorHandler,NULL);CHKERRQ(ierr);
+  ierr = event_filter_compile(str,&filter);
+  PetscPopErrorHandler();
+  if (!ierr) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Filter %s should not compile",str);
+  }
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode   ierr;
+  tcplife_entry    life;
+  tcpconnect_entry connect;
+  event_record     record;
+  event_filter     filter;
+  char             longstr[2*EVENT_FILTER_MAX_LEN];
+  PetscInt         i;
+  ierr = PetscInitialize(&argc,&argv,NULL,NULL);  if (ierr) return ierr;
+
+  ierr = PetscMemzero(&life,sizeof(life));CHKERRQ(ierr);
+  life.pid = 1234;
+  life.ip = 4;
+  life.lport = 40000;
+  life.rport = 5432;
+  ierr = PetscStrncpy(life.laddr,"10.1.2.3",sizeof(life.laddr));CHKERRQ(ierr);
+  ierr = PetscStrncpy(life.raddr,"10.0.7.9",sizeof(life.raddr));CHKERRQ(ierr);
+  ierr = PetscStrncpy(life.comm,"mpirun",sizeof(life.comm));CHKERRQ(ierr);
+
+  ierr = check_life("",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm=mpirun",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm=mpi",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("comm=mpi*",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm=*run",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm=m?irun",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm!=mpi*",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("pid=1234",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("pid=1000-2000",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("pid=1235-2000",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("pid!=1234",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("lport=40000",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("rport=40000",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("rport=5000-6000",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("port=5432",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("port=40000",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("port=22",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("ip=4",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("ip=6",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("raddr=10.0.7.9",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("raddr=10.0.0.0/8",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("raddr=10.0.0.0/16",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("raddr=10.0.0.0/24",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("raddr=10.0.7.8/31",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("raddr=0.0.0.0/0",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("raddr=::/0",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("raddr!=10.0.0.0/8",&life,PETSC_FALSE);CHKERRQ(ierr);
+
+  ierr = check_life("comm=mpi* && rport=5432",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm=mpi* && rport=22",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("comm=mpi*,rport=5432",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm=ssh || rport=5432",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm=ssh or rport=22",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("!comm=ssh",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("not comm=mpirun",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("!!comm=mpirun",&life,PETSC_TRUE);CHKERRQ(ierr);
+  /* && binds tighter than ||, and parentheses override it */
+  ierr = check_life("comm=mpirun || rport=22 && ip=6",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("(comm=mpirun || rport=22) && ip=6",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("rport=22 && ip=6 || comm=mpirun",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("comm=mpi* && !(rport=22 || raddr=10.0.0.0/8)",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("comm=mpi* && !(rport=22 || raddr=192.168.0.0/16)",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("((pid=1234))",&life,PETSC_TRUE);CHKERRQ(ierr);
+
+  /* IPv6 networks */
+  life.ip = 6;
+  ierr = PetscStrncpy(life.raddr,"fd00::1:2",sizeof(life.raddr));CHKERRQ(ierr);
+  ierr = check_life("raddr=fd00::/8",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("raddr=fd00::1:0/112",&life,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_life("raddr=fd00::2:0/112",&life,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_life("raddr=10.0.0.0/8",&life,PETSC_FALSE);CHKERRQ(ierr);
+
+  /* tcpconnect does not report a local port, so no lport predicate is true of it */
+  ierr = PetscMemzero(&connect,sizeof(connect));CHKERRQ(ierr);
+  connect.pid = 77;
+  connect.ip = 4;
+  connect.dport = 443;
+  ierr = PetscStrncpy(connect.saddr,"10.1.2.3",sizeof(connect.saddr));CHKERRQ(ierr);
+  ierr = PetscStrncpy(connect.daddr,"172.16.0.1",sizeof(connect.daddr));CHKERRQ(ierr);
+  ierr = PetscStrncpy(connect.comm,"curl",sizeof(connect.comm));CHKERRQ(ierr);
+  ierr = event_record_from_connect(&record,&connect);CHKERRQ(ierr);
+  ierr = check_record("rport=443",&record,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_record("port=443",&record,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_record("lport=0",&record,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_record("lport=0-65535",&record,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_record("port=0",&record,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = check_record("comm=curl && raddr=172.16.0.0/12",&record,PETSC_TRUE);CHKERRQ(ierr);
+  ierr = check_record("pid=77 && ip=6",&record,PETSC_FALSE);CHKERRQ(ierr);
+  ierr = event_filter_compile("lport=0",&filter);CHKERRQ(ierr);
+  if (event_filter_match_connect(&filter,&connect)) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Filter lport=0 should drop the connect event");
+  }
+
+  /* the filter counts what it ran on and what it dropped */
+  ierr = event_filter_compile("pid=1-1000",&filter);CHKERRQ(ierr);
+  for (i=0; i<10; ++i) {
+    life.pid = 500*i;
+    event_filter_match_life(&filter,&life);
+  }
+  if (filter.nevents != 10 || filter.nrejected != 8) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Filter ran on %D events and dropped %D, expected 10 and 8",filter.nevents,filter.nrejected);
+  }
+
+  ierr = check_rejected("comm=");CHKERRQ(ierr);
+  ierr = check_rejected("pid=abc");CHKERRQ(ierr);
+  ierr = check_rejected("pid=20-10");CHKERRQ(ierr);
+  ierr = check_rejected("ip=5");CHKERRQ(ierr);
+  ierr = check_rejected("raddr=10.0.0.0/33");CHKERRQ(ierr);
+  ierr = check_rejected("raddr=notanaddress");CHKERRQ(ierr);
+  ierr = check_rejected("user=root");CHKERRQ(ierr);
+  ierr = check_rejected("comm");CHKERRQ(ierr);
+  ierr = check_rejected("(comm=a");CHKERRQ(ierr);
+  ierr = check_rejected("comm=a)");CHKERRQ(ierr);
+  ierr = check_rejected("comm=a &&");CHKERRQ(ierr);
+  ierr = check_rejected("|| comm=a");CHKERRQ(ierr);
+  for (i=0; i<(PetscInt)sizeof(longstr)-1; ++i) {
+    longstr[i] = i % 2 ? ',' : 'x';
+  }
+  longstr[sizeof(longstr)-1] = '\0';
+  ierr = check_rejected(longstr);CHKERRQ(ierr);
+
+  PetscPrintf(PETSC_COMM_WORLD,"All event filter tests passed\n");
+  PetscFinalize();
+  return 0;
+}
@@ -0,0 +1,129 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "event_log.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define TEST_EVENT_LOG_FILE "test_event_log.dcplog"
+#define TEST_NEVENTS        1000
+
+static const char *TestComms[] = {"mpirun","nginx","a_name_of_16chrs","curl","ssh"};
+
+/* fills in event number i. Sizes and durations are whole kB and us, which is
+   what the log keeps of them */
+static PetscErrorCode test_event(event_record *event, PetscInt i)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(event,sizeof(event_record));CHKERRQ(ierr);
+  event->ts_ns = 1600000000000000000ULL + 1000003ULL*(uint64_t)i;
+  event->type = (uint32_t)(i % 5 == 4 ? TCPRETRANS : i % 4);
+  event->pid = (uint32_t)(1000 + i % 37);
+  event->ip = i % 3 ? 4 : 6;
+  event->lport = (uint16_t)(event->type == TCPCONNECT || event->type == TCPCONNLAT ? 0 : 30000 + i);
+  event->rport = (uint16_t)(i % 2 ? 5432 : 443);
+  event->state = (uint16_t)(i % 12);
+  event->laddr[0] = 10;
+  event->laddr[3] = (uint8_t)i;
+  event->raddr[0] = event->ip == 6 ? 0xfd : 192;
+  event->raddr[15] = (uint8_t)(i >> 8);
+  event->tx_bytes = 1024ULL*(uint64_t)i;
+  event->rx_bytes = 1024ULL*(uint64_t)(2*i);
+  event->duration_ns = 1000ULL*(uint64_t)(i*i);
+  ierr = PetscStrncpy(event->comm,TestComms[i % 5],EVENT_RECORD_COMM_LEN);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+typedef struct {
+  PetscInt nseen;
+} test_ctx;
+
+/* checks that the events come back in order and exactly as they were written */
+static PetscErrorCode test_handler(const event_record *event, void *ptr)
+{
+  PetscErrorCode ierr;
+  test_ctx       *ctx = (test_ctx*)ptr;
+  event_record   expected;
+  PetscFunctionBeginUser;
+  ierr = test_event(&expected,ctx->nseen);CHKERRQ(ierr);
+  if (memcmp(event,&expected,sizeof(event_record))) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Event %D did not survive the round trip through the log",ctx->nseen);
+  }
+  ++(ctx->nseen);
+  PetscFunctionReturn(0);
+}
+
+/* reads what the reader in the first parameter has not read yet, and checks that it
+   is the number of events in the second parameter */
+static PetscErrorCode check_read(event_log_reader *reader, test_ctx *ctx, PetscInt expected)
+{
+  PetscErrorCode ierr;
+  PetscInt       nread;
+  PetscFunctionBeginUser;
+  ierr = event_log_read(reader,test_handler,ctx,&nread);CHKERRQ(ierr);
+  if (nread != expected) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read %D events from the log, expected %D",nread,expected);
+  }
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode   ierr;
+  event_log_writer writer;
+  event_log_reader reader;
+  event_record     event;
+  test_ctx         ctx;
+  PetscInt         i,nread,total;
+  ierr = PetscInitialize(&argc,&argv,NULL,NULL);  if (ierr) return ierr;
+  ctx.nseen = 0;
+
+  /* the reader may be opened before anything is written */
+  ierr = event_log_writer_open(&writer,TEST_EVENT_LOG_FILE);CHKERRQ(ierr);
+  ierr = event_log_reader_open(&reader,TEST_EVENT_LOG_FILE);CHKERRQ(ierr);
+  fflush(writer.fd);
+  ierr = check_read(&reader,&ctx,0);CHKERRQ(ierr);
+
+  for (i=0; i<TEST_NEVENTS/2; ++i) {
+    ierr = test_event(&event,i);CHKERRQ(ierr);
+    ierr = event_log_write(&writer,&event);CHKERRQ(ierr);
+  }
+  fflush(writer.fd);
+  ierr = check_read(&reader,&ctx,TEST_NEVENTS/2);CHKERRQ(ierr);
+  ierr = check_read(&reader,&ctx,0);CHKERRQ(ierr);
+  /* one name definition per process name, each written once */
+  if (writer.nnames != 5) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The writer defined %D names, expected 5",writer.nnames);
+  }
+
+  /* the log is followed as it grows, and read in pieces of at most max_bytes */
+  for (i=TEST_NEVENTS/2; i<TEST_NEVENTS; ++i) {
+    ierr = test_event(&event,i);CHKERRQ(ierr);
+    ierr = event_log_write(&writer,&event);CHKERRQ(ierr);
+  }
+  ierr = event_log_writer_close(&writer);CHKERRQ(ierr);
+  reader.max_bytes = 100*sizeof(event_log_record);
+  total = TEST_NEVENTS/2;
+  do {
+    ierr = event_log_read(&reader,test_handler,&ctx,&nread);CHKERRQ(ierr);
+    if (nread > 100) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read %D events in one call, more than max_bytes allows",nread);
+    }
+    total += nread;
+  } while (reader.behind);
+  if (total != TEST_NEVENTS || ctx.nseen != TEST_NEVENTS) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read %D events from the log, expected %D",total,(PetscInt)TEST_NEVENTS);
+  }
+  ierr = event_log_reader_close(&reader);CHKERRQ(ierr);
+
+  /* a second reader sees the whole log at once */
+  ctx.nseen = 0;
+  ierr = event_log_reader_open(&reader,TEST_EVENT_LOG_FILE);CHKERRQ(ierr);
+  ierr = check_read(&reader,&ctx,TEST_NEVENTS);CHKERRQ(ierr);
+  ierr = event_log_reader_close(&reader);CHKERRQ(ierr);
+  unlink(TEST_EVENT_LOG_FILE);
+
+  PetscPrintf(PETSC_COMM_WORLD,"All event log tests passed\n");
+  PetscFinalize();
+  return 0;
+}
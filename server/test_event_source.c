@@ -0,0 +1,216 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "event_source.h"
+#include "event_log.h"
+#include "event_store.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define TEST_REPLAY_FILE "test_event_source.dcpevt"
+#define TEST_LOG_FILE    "test_event_source.dcplog"
+#define TEST_NEVENTS     10000
+#define TEST_NMORE       2507 /* written after the backlog is read */
+
+static const char *TestComms[] = {"mpirun","nginx","curl"};
+
+/* fills in event number i; its pid and tx_bytes say which one it is */
+static PetscErrorCode test_event(event_record *event, PetscInt i)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(event,sizeof(event_record));CHKERRQ(ierr);
+  event->ts_ns = 1600000000000000000ULL + 1000ULL*(uint64_t)i;
+  event->type = TCPLIFE;
+  event->pid = (uint32_t)(1000 + i);
+  event->ip = 4;
+  event->tx_bytes = 1024ULL*(uint64_t)i;
+  ierr = PetscStrncpy(event->comm,TestComms[i % 3],EVENT_RECORD_COMM_LEN);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+typedef struct {
+  PetscInt nseen;
+} test_ctx;
+
+/* checks that the events come in order, none skipped or repeated */
+static PetscErrorCode test_handler(const event_record *event, void *ptr)
+{
+  test_ctx *ctx = (test_ctx*)ptr;
+  PetscFunctionBeginUser;
+  if (event->pid != (uint32_t)(1000 + ctx->nseen) || event->tx_bytes != 1024ULL*(uint64_t)ctx->nseen || strcmp(event->comm,TestComms[ctx->nseen % 3])) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Event %D came in place of event %D",(PetscInt)event->pid - 1000,ctx->nseen);
+  }
+  ++(ctx->nseen);
+  PetscFunctionReturn(0);
+}
+
+/* polls the source until it has read everything whole in its file, with at most
+   the number of records in the third parameter a poll, and checks every poll
+   against how far the source says it is. The size of a record is in the fourth
+   parameter. */
+static PetscErrorCode check_backfill(event_source *src, test_ctx *ctx, PetscInt chunk, size_t size)
+{
+  PetscErrorCode ierr;
+  int64_t        consumed,total,before;
+  PetscInt       nread,npolls=0,nwhole;
+  PetscFunctionBeginUser;
+  ierr = event_source_progress(src,&before,&total);CHKERRQ(ierr);
+  do {
+    ierr = event_source_poll(src,test_handler,ctx,&nread);CHKERRQ(ierr);
+    ierr = event_source_progress(src,&consumed,&total);CHKERRQ(ierr);
+    /* the header is consumed with the first records */
+    if (!before && consumed) {
+      before = consumed - (int64_t)(nread*size);
+    }
+    if (nread > chunk || consumed - before != (int64_t)(nread*size)) {
+      SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Poll %D read %D records and moved on %D bytes",npolls,nread,(PetscInt)(consumed - before));
+    }
+    nwhole = (PetscInt)((total - consumed)/(int64_t)size);
+    if (nwhole && (nread != chunk || !src->behind)) {
+      SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Poll %D read %D records and is not behind, with %D more to read",npolls,nread,nwhole);
+    }
+    before = consumed;
+    ++npolls;
+  } while (src->behind);
+  ierr = PetscInfo1(NULL,"Read the backlog in %D polls\n",npolls);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* a REPLAY source read in chunks of the number of records in the first
+   parameter, with --backfill_chunk bytes in the second */
+static PetscErrorCode test_replay(PetscInt chunk, size_t max_bytes)
+{
+  PetscErrorCode ierr;
+  event_source   src;
+  event_record   event;
+  test_ctx       ctx;
+  FILE           *fd;
+  int64_t        consumed,total;
+  PetscInt       i,nread;
+  PetscFunctionBeginUser;
+  ctx.nseen = 0;
+  unlink(TEST_REPLAY_FILE);
+  fd = fopen(TEST_REPLAY_FILE,"wb");
+  fclose(fd);
+  /* a source may be opened before the recording has written its header */
+  ierr = event_source_open(&src,EVENT_SOURCE_REPLAY,TEST_REPLAY_FILE);CHKERRQ(ierr);
+  src.max_bytes = max_bytes;
+  ierr = event_source_poll(&src,test_handler,&ctx,&nread);CHKERRQ(ierr);
+  ierr = event_source_progress(&src,&consumed,&total);CHKERRQ(ierr);
+  if (nread || consumed || total || src.behind) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An empty replay file is not empty");
+  }
+
+  /* a backlog, ending with a record half written */
+  ierr = event_record_file_open(TEST_REPLAY_FILE,&fd);CHKERRQ(ierr);
+  for (i=0; i<TEST_NEVENTS; ++i) {
+    ierr = test_event(&event,i);CHKERRQ(ierr);
+    ierr = event_record_write(fd,&event);CHKERRQ(ierr);
+  }
+  ierr = test_event(&event,TEST_NEVENTS);CHKERRQ(ierr);
+  fwrite(&event,sizeof(event)/2,1,fd);
+  fflush(fd);
+  ierr = check_backfill(&src,&ctx,chunk,sizeof(event_record));CHKERRQ(ierr);
+  ierr = event_source_progress(&src,&consumed,&total);CHKERRQ(ierr);
+  if (ctx.nseen != TEST_NEVENTS || consumed != (int64_t)(sizeof(event_record_file_header) + TEST_NEVENTS*sizeof(event_record))) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read %D records of %D, or into the one half written",ctx.nseen,(PetscInt)TEST_NEVENTS);
+  }
+  /* the rest of it comes with the next records */
+  fwrite((char*)&event + sizeof(event)/2,sizeof(event) - sizeof(event)/2,1,fd);
+  for (i=TEST_NEVENTS+1; i<TEST_NEVENTS+TEST_NMORE; ++i) {
+    ierr = test_event(&event,i);CHKERRQ(ierr);
+    ierr = event_record_write(fd,&event);CHKERRQ(ierr);
+  }
+  fclose(fd);
+  ierr = check_backfill(&src,&ctx,chunk,sizeof(event_record));CHKERRQ(ierr);
+  ierr = event_source_progress(&src,&consumed,&total);CHKERRQ(ierr);
+  if (ctx.nseen != TEST_NEVENTS+TEST_NMORE || consumed != total) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read %D records after the file grew",ctx.nseen);
+  }
+  ierr = event_source_close(&src);CHKERRQ(ierr);
+  unlink(TEST_REPLAY_FILE);
+  PetscFunctionReturn(0);
+}
+
+/* a LOG source read in chunks of the number of log records in the first
+   parameter; the names it defines count towards them */
+static PetscErrorCode test_log(PetscInt chunk)
+{
+  PetscErrorCode   ierr;
+  event_source     src;
+  event_log_writer writer;
+  event_record     event;
+  test_ctx         ctx;
+  int64_t          consumed,total;
+  PetscInt         i,nread,npolls=0;
+  PetscFunctionBeginUser;
+  ctx.nseen = 0;
+  ierr = event_log_writer_open(&writer,TEST_LOG_FILE);CHKERRQ(ierr);
+  for (i=0; i<TEST_NEVENTS; ++i) {
+    ierr = test_event(&event,i);CHKERRQ(ierr);
+    ierr = event_log_write(&writer,&event);CHKERRQ(ierr);
+  }
+  ierr = event_log_writer_close(&writer);CHKERRQ(ierr);
+  ierr = event_source_open(&src,EVENT_SOURCE_LOG,TEST_LOG_FILE);CHKERRQ(ierr);
+  src.max_bytes = chunk*sizeof(event_log_record);
+  do {
+    ierr = event_source_poll(&src,test_handler,&ctx,&nread);CHKERRQ(ierr);
+    ierr = event_source_progress(&src,&consumed,&total);CHKERRQ(ierr);
+    if (nread > chunk || (consumed < total) != src.behind) {
+      SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Poll %D of the log read %D records, and says it is%s behind",npolls,nread,src.behind ? "" : " not");
+    }
+    ++npolls;
+  } while (src.behind);
+  /* each name once, and at most chunk records a poll */
+  if (ctx.nseen != TEST_NEVENTS || consumed != (int64_t)(sizeof(event_log_header) + (TEST_NEVENTS + 3)*sizeof(event_log_record)) ||
+      npolls != (TEST_NEVENTS + 3 + chunk - 1)/chunk) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read %D events of the log in %D polls",ctx.nseen,npolls);
+  }
+  ierr = event_source_close(&src);CHKERRQ(ierr);
+  unlink(TEST_LOG_FILE);
+  PetscFunctionReturn(0);
+}
+
+/* a record is stored with its own time, and with the ingestion time only if it has none */
+static PetscErrorCode test_record_time(void)
+{
+  PetscErrorCode ierr;
+  event_store    store;
+  event_record   event;
+  PetscFunctionBeginUser;
+  ierr = event_store_create(&store,4);CHKERRQ(ierr);
+  ierr = test_event(&event,0);CHKERRQ(ierr);
+  ierr = event_store_add_record(&store,&event,1700000000.0);CHKERRQ(ierr);
+  event.ts_ns = 0;
+  ierr = event_store_add_record(&store,&event,1700000000.0);CHKERRQ(ierr);
+  if (store.count != 2 || store.timestamp[0] != 1600000000.0 || store.timestamp[1] != 1700000000.0) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Records were stored at times %g and %g",(double)store.timestamp[0],(double)store.timestamp[1]);
+  }
+  ierr = event_store_destroy(&store);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode ierr;
+  ierr = PetscInitialize(&argc,&argv,NULL,NULL);  if (ierr) return ierr;
+
+  /* --backfill_chunk is rounded down to whole records, but is at least one */
+  ierr = test_replay(1000,1000*sizeof(event_record) + 17);CHKERRQ(ierr);
+  ierr = test_replay(2500,2500*sizeof(event_record));CHKERRQ(ierr);
+  ierr = test_replay(1,1);CHKERRQ(ierr);
+  /* more than is read at a time */
+  ierr = test_replay(6000,6000*sizeof(event_record));CHKERRQ(ierr);
+  /* 0 reads to the end */
+  ierr = test_replay(PETSC_MAX_INT,0);CHKERRQ(ierr);
+
+  ierr = test_log(1000);CHKERRQ(ierr);
+  ierr = test_log(TEST_NEVENTS + 3);CHKERRQ(ierr);
+  ierr = test_log(7);CHKERRQ(ierr);
+
+  ierr = test_record_time();CHKERRQ(ierr);
+
+  PetscPrintf(PETSC_COMM_WORLD,"All event source tests passed\n");
+  PetscFinalize();
+  return 0;
+}
@@ -0,0 +1,149 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "event_store.h"
+#include <stdio.h>
+
+/* runs the query in the second parameter against the store in the first, and
+   checks that it selects the number of events in the third parameter (in all of
+   its groups together) and has the number of groups in the fourth */
+static PetscErrorCode check_query(event_store *store, const char *str, long nevents, PetscInt ngroups)
+{
+  PetscErrorCode  ierr;
+  event_query     query;
+  event_group_row *rows;
+  PetscInt        nrows,i;
+  long            count=0;
+  PetscFunctionBeginUser;
+  ierr = event_query_parse(str,&query);CHKERRQ(ierr);
+  ierr = event_store_query(store,&query,0,1.0e9,&rows,&nrows);CHKERRQ(ierr);
+  for (i=0; i<nrows; ++i) {
+    count += rows[i].count;
+  }
+  ierr = PetscFree(rows);CHKERRQ(ierr);
+  if (count != nevents || (ngroups >= 0 && nrows != ngroups)) {
+    SETERRQ5(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Query %s selected %D events in %D groups, expected %D in %D",
+	     str,(PetscInt)count,nrows,(PetscInt)nevents,ngroups);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* checks that the query in the second parameter does not parse */
+static PetscErrorCode check_rejected(const char *str)
+{
+  PetscErrorCode ierr;
+  event_query    query;
+  PetscFunctionBeginUser;
+  ierr = PetscPushErrorHandler(PetscReturnErrorHandler,NULL);CHKERRQ(ierr);
+  ierr = event_query_parse(str,&query);
+  PetscPopErrorHandler();
+  if (!ierr) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Query %s should not parse",str);
+  }
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode   ierr;
+  event_store      store;
+  tcpconnect_entry connect;
+  tcplife_entry    life;
+  PetscInt         i,pids[50];
+  /* 200 events, so that the scans cover whole 64-row words and a partial one */
+  const PetscInt   nevents=200;
+  ierr = PetscInitialize(&argc,&argv,NULL,NULL);  if (ierr) return ierr;
+  ierr = event_store_create(&store,nevents);CHKERRQ(ierr);
+  ierr = PetscMemzero(&connect,sizeof(connect));CHKERRQ(ierr);
+  ierr = PetscMemzero(&life,sizeof(life));CHKERRQ(ierr);
+  for (i=0; i<nevents/2; ++i) {
+    connect.pid = 1000 + i;
+    connect.ip = 4;
+    connect.dport = i % 2 ? 5432 : 80;
+    ierr = PetscStrncpy(connect.saddr,"10.0.0.1",sizeof(connect.saddr));CHKERRQ(ierr);
+    ierr = PetscStrncpy(connect.daddr,i % 4 ? "10.0.0.2" : "10.0.0.3",sizeof(connect.daddr));CHKERRQ(ierr);
+    ierr = PetscStrncpy(connect.comm,i % 2 ? "psql" : "curl",sizeof(connect.comm));CHKERRQ(ierr);
+    ierr = event_store_add_connect(&store,&connect,1.0e9);CHKERRQ(ierr);
+  }
+  for (i=0; i<nevents/2; ++i) {
+    life.pid = 2000 + i;
+    life.ip = 6;
+    life.lport = 40000 + i;
+    life.rport = 443;
+    life.tx_kb = i;
+    life.rx_kb = 2 * i;
+    life.ms = (PetscReal)i;
+    ierr = PetscStrncpy(life.laddr,"::1",sizeof(life.laddr));CHKERRQ(ierr);
+    ierr = PetscStrncpy(life.raddr,"::2",sizeof(life.raddr));CHKERRQ(ierr);
+    ierr = PetscStrncpy(life.comm,"nginx",sizeof(life.comm));CHKERRQ(ierr);
+    ierr = event_store_add_life(&store,&life,1.0e9);CHKERRQ(ierr);
+  }
+
+  ierr = check_query(&store,"",nevents,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport=5432",nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport!=5432",3*nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport<443",nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport<=443",3*nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport<443.5",3*nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport>443",nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport>=443.5",nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport=80.5",0,0);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport!=80.5",nevents,1);CHKERRQ(ierr);
+  /* bounds past either end of an int32 column select all of it or none */
+  ierr = check_query(&store,"rport<-2147483648",0,0);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport>2147483647",0,0);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport>-1e12",nevents,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport<=1e12",nevents,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport=1e12",0,0);CHKERRQ(ierr);
+  ierr = check_query(&store,"rport!=1e12",nevents,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"pid>=1050,pid<2050",nevents/2,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"duration>=50",nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"name=psql",nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"name!=psql",3*nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"name=absent",0,0);CHKERRQ(ierr);
+  ierr = check_query(&store,"type=life",nevents/2,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"raddr=10.0.0.3",nevents/8,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"group=name",nevents,3);CHKERRQ(ierr);
+  ierr = check_query(&store,"ip=4,group=raddr",nevents/2,2);CHKERRQ(ierr);
+  ierr = check_query(&store,"group=lport",nevents,nevents/2 + 1);CHKERRQ(ierr);
+
+  ierr = check_rejected("group=latency");CHKERRQ(ierr);
+  ierr = check_rejected("group=duration");CHKERRQ(ierr);
+  ierr = check_rejected("group=time");CHKERRQ(ierr);
+  ierr = check_rejected("group=nosuchcolumn");CHKERRQ(ierr);
+  ierr = check_rejected("rport=abc");CHKERRQ(ierr);
+  ierr = check_rejected("since=soon");CHKERRQ(ierr);
+  ierr = check_rejected("name<psql");CHKERRQ(ierr);
+  ierr = check_rejected("none=1");CHKERRQ(ierr);
+  ierr = check_rejected("rport");CHKERRQ(ierr);
+
+  /* forgetting the psql PIDs drops their events, and their name */
+  for (i=0; i<nevents/4; ++i) {
+    pids[i] = 1001 + 2*i;
+  }
+  ierr = event_store_forget(&store,nevents/4,pids);CHKERRQ(ierr);
+  ierr = check_query(&store,"",3*nevents/4,1);CHKERRQ(ierr);
+  ierr = check_query(&store,"name=psql",0,0);CHKERRQ(ierr);
+  ierr = check_query(&store,"group=name",3*nevents/4,2);CHKERRQ(ierr);
+  ierr = check_query(&store,"raddr=10.0.0.3",nevents/8,1);CHKERRQ(ierr);
+  if (store.names.nstrings != 2 || store.addrs.nstrings != 5) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"%D names and %D addresses are left, expected 2 and 5",store.names.nstrings,store.addrs.nstrings);
+  }
+  ierr = event_store_destroy(&store);CHKERRQ(ierr);
+
+  /* a store that wrapped around still overwrites its oldest events first */
+  ierr = event_store_create(&store,4);CHKERRQ(ierr);
+  for (i=1; i<=8; ++i) {
+    if (i == 7) {
+      pids[0] = 4;
+      ierr = event_store_forget(&store,1,pids);CHKERRQ(ierr);
+    }
+    life.pid = i;
+    ierr = event_store_add_life(&store,&life,1.0e9);CHKERRQ(ierr);
+  }
+  ierr = check_query(&store,"pid<=4",0,0);CHKERRQ(ierr);
+  ierr = check_query(&store,"pid>=5",4,1);CHKERRQ(ierr);
+  ierr = event_store_destroy(&store);CHKERRQ(ierr);
+  PetscPrintf(PETSC_COMM_WORLD,"All event store tests passed\n");
+  PetscFinalize();
+  return 0;
+}
@@ -0,0 +1,166 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "history_store.h"
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+
+#define TEST_HISTORY_FILE "test_history.dat"
+#define TEST_NPIDS        3
+#define TEST_NSAMPLES     3000
+#define TEST_T0           1600000000000LL
+
+/* a deterministic sequence, so that a sample can be regenerated to compare against */
+static uint64_t test_random(uint64_t *state)
+{
+  *state = *state*6364136223846793005ULL + 1442695040888963407ULL;
+  return *state >> 11;
+}
+
+/* the time sample number i of every PID is taken at: a regular interval with
+   jitter, a timestamp repeated every 11 samples, and a long gap every 1000 */
+static int64_t test_time(PetscInt i)
+{
+  if (i && i % 11 == 0) {
+    --i;
+  }
+  return TEST_T0 + 1000*i + (i % 5 ? (i*37) % 50 : 0) + (i/1000)*86400000LL;
+}
+
+/* fills in sample number i of the PID in the second parameter. The values cover
+   the cases the encoder treats differently: a repeated value, a slowly growing
+   one, NaN, and values that share no bits with the previous one. */
+static void test_sample(process_data_summary *psumm, PetscInt pid, PetscInt i)
+{
+  uint64_t state = (uint64_t)(pid*TEST_NSAMPLES + i);
+  test_random(&state);
+  psumm->pid = pid;
+  psumm->tx_kb = 10*i;
+  psumm->rx_kb = 4096;
+  psumm->n_event = (long)(test_random(&state) % 1000);
+  psumm->avg_latency = i % 7 ? (PetscReal)(test_random(&state) % 100000)/1000. : NAN;
+  psumm->avg_lifetime = (PetscReal)test_random(&state)/(PetscReal)(1ULL << 40);
+}
+
+static PetscBool test_same(PetscReal a, PetscReal b)
+{
+  return (PetscBool)(a == b || (a != a && b != b));
+}
+
+/* queries the PID in the second parameter between the samples numbered by the
+   third and fourth parameters (inclusive) and checks that every sample comes
+   back exactly as it was appended */
+static PetscErrorCode check_query(history_store *hist, PetscInt pid, PetscInt first, PetscInt last)
+{
+  PetscErrorCode       ierr;
+  process_data_summary psumm;
+  history_sample       *samples;
+  PetscInt             nsamples,i,k;
+  PetscReal            v[HISTORY_NMETRICS];
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(&psumm,sizeof(psumm));CHKERRQ(ierr);
+  ierr = history_store_query(hist,pid,test_time(first),test_time(last),&samples,&nsamples);CHKERRQ(ierr);
+  /* a repeated timestamp at the start of the range also selects the sample before it */
+  if (first && test_time(first-1) == test_time(first)) {
+    --first;
+  }
+  if (nsamples != last - first + 1) {
+    SETERRQ4(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Query of PID %D from sample %D to %D returned %D samples",pid,first,last,nsamples);
+  }
+  for (i=0; i<nsamples; ++i) {
+    test_sample(&psumm,pid,first+i);
+    v[0] = (PetscReal)psumm.tx_kb;
+    v[1] = (PetscReal)psumm.rx_kb;
+    v[2] = (PetscReal)psumm.n_event;
+    v[3] = psumm.avg_latency;
+    v[4] = psumm.avg_lifetime;
+    if (samples[i].t != test_time(first+i)) {
+      SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Sample %D of PID %D has the wrong time, off by %D ms",first+i,pid,(PetscInt)(samples[i].t - test_time(first+i)));
+    }
+    for (k=0; k<HISTORY_NMETRICS; ++k) {
+      if (!test_same(samples[i].v[k],v[k])) {
+	SETERRQ5(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Sample %D of PID %D has %s %g instead of %g",first+i,pid,HistoryMetrics[k],(double)samples[i].v[k],(double)v[k]);
+      }
+    }
+  }
+  ierr = PetscFree(samples);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode remove_files()
+{
+  char     filename[PETSC_MAX_PATH_LEN];
+  PetscInt l;
+  PetscFunctionBeginUser;
+  unlink(TEST_HISTORY_FILE);
+  for (l=0; l<HISTORY_NLEVELS; ++l) {
+    snprintf(filename,sizeof(filename),"%s.r%lld",TEST_HISTORY_FILE,(long long)(HistoryResolutions[l]/1000));
+    unlink(filename);
+  }
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode       ierr;
+  history_store        hist;
+  process_data_summary psumm;
+  PetscInt             i,p;
+  ierr = PetscInitialize(&argc,&argv,NULL,NULL);  if (ierr) return ierr;
+  ierr = remove_files();CHKERRQ(ierr);
+  ierr = PetscMemzero(&psumm,sizeof(psumm));CHKERRQ(ierr);
+  ierr = PetscStrncpy(psumm.comm,"mpirun",sizeof(psumm.comm));CHKERRQ(ierr);
+
+  /* enough samples that every PID fills several blocks, interleaved as the driver appends them */
+  ierr = history_store_open(&hist,TEST_HISTORY_FILE,0);CHKERRQ(ierr);
+  for (i=0; i<TEST_NSAMPLES; ++i) {
+    for (p=1; p<=TEST_NPIDS; ++p) {
+      test_sample(&psumm,p,i);
+      ierr = history_store_append(&hist,&psumm,test_time(i));CHKERRQ(ierr);
+    }
+    if (i % 100 == 99) {
+      ierr = history_store_sync(&hist,test_time(i));CHKERRQ(ierr);
+    }
+    if (i == TEST_NSAMPLES/2) {
+      /* PID 2 exits and comes back */
+      ierr = history_store_seal(&hist,2);CHKERRQ(ierr);
+    }
+  }
+  if (hist.nindex < 2*TEST_NPIDS) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Expected the samples to span several blocks per PID, got %D blocks in all",hist.nindex);
+  }
+
+  /* sealed blocks come from the file, the last ones from memory */
+  for (p=1; p<=TEST_NPIDS; ++p) {
+    ierr = check_query(&hist,p,0,TEST_NSAMPLES-1);CHKERRQ(ierr);
+    ierr = check_query(&hist,p,TEST_NSAMPLES-10,TEST_NSAMPLES-1);CHKERRQ(ierr);
+    ierr = check_query(&hist,p,1234,1789);CHKERRQ(ierr);
+  }
+  ierr = check_query(&hist,2,TEST_NSAMPLES/2-3,TEST_NSAMPLES/2+3);CHKERRQ(ierr);
+
+  /* a forgotten PID keeps its samples but nothing in memory */
+  ierr = history_store_forget(&hist,3);CHKERRQ(ierr);
+  if (hist.nopen != TEST_NPIDS-1 || hist.nrollups != TEST_NPIDS-1) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"%D open blocks and %D rollups are left after forgetting a PID",hist.nopen,hist.nrollups);
+  }
+  ierr = check_query(&hist,3,0,TEST_NSAMPLES-1);CHKERRQ(ierr);
+  /* and the others are dropped once every bucket of theirs has closed */
+  ierr = history_store_sync(&hist,test_time(TEST_NSAMPLES-1) + HistoryResolutions[HISTORY_NLEVELS-1]);CHKERRQ(ierr);
+  if (hist.nrollups) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"%D rollups are left after every bucket closed",hist.nrollups);
+  }
+  ierr = history_store_close(&hist);CHKERRQ(ierr);
+
+  /* everything is indexed again when the file is reopened */
+  ierr = history_store_open(&hist,TEST_HISTORY_FILE,0);CHKERRQ(ierr);
+  for (p=1; p<=TEST_NPIDS; ++p) {
+    ierr = check_query(&hist,p,0,TEST_NSAMPLES-1);CHKERRQ(ierr);
+    ierr = check_query(&hist,p,2500,2600);CHKERRQ(ierr);
+  }
+  ierr = history_store_close(&hist);CHKERRQ(ierr);
+  ierr = remove_files();CHKERRQ(ierr);
+
+  PetscPrintf(PETSC_COMM_WORLD,"All history store tests passed\n");
+  PetscFinalize();
+  return 0;
+}
@@ -0,0 +1,917 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "petsc_mongoose.h"
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* a client connection to the server under test, with what it has received and
+   not consumed yet */
+typedef struct {
+  int    fd;
+  char   *buf;
+  size_t len,capacity;
+} test_conn;
+
+/* one response, taken apart */
+typedef struct {
+  int      status;
+  char     *headers;   /* NUL-terminated, with the status line */
+  char     *body;      /* NUL-terminated after body_len bytes; decoded if it was chunked */
+  size_t   body_len;
+  PetscInt nchunks;
+  size_t   max_chunk;  /* the largest chunk of a chunked body */
+} test_response;
+
+/* starts the server on a free port of the loopback interface, which it stores
+   in the last parameter */
+static PetscErrorCode start_server(http_server *srv, PetscInt max_series, PetscInt *port)
+{
+  PetscErrorCode ierr;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  for (i=0; i<50; ++i) {
+    *port = 20000 + (getpid() + 97*i) % 40000;
+    ierr = PetscPushErrorHandler(PetscReturnErrorHandler,NULL);CHKERRQ(ierr);
+    ierr = http_server_start(srv,"127.0.0.1",*port,max_series);
+    PetscPopErrorHandler();
+    if (!ierr) {
+      PetscFunctionReturn(0);
+    }
+  }
+  SETERRQ(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not find a free port for the HTTP server");
+}
+
+/* connects to the server; reads time out after 10 s, so that a server that does
+   not answer fails the test rather than hangs it */
+static PetscErrorCode test_connect(PetscInt port, test_conn *conn)
+{
+  PetscErrorCode     ierr;
+  struct sockaddr_in addr;
+  struct timeval     tv;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(conn,sizeof(test_conn));CHKERRQ(ierr);
+  conn->fd = socket(AF_INET,SOCK_STREAM,0);
+  if (conn->fd < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not create a socket: %s",strerror(errno));
+  }
+  tv.tv_sec = 10;
+  tv.tv_usec = 0;
+  setsockopt(conn->fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+  ierr = PetscMemzero(&addr,sizeof(addr));CHKERRQ(ierr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((unsigned short)port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(conn->fd,(struct sockaddr*)&addr,sizeof(addr))) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not connect to port %D: %s",port,strerror(errno));
+  }
+  conn->capacity = 4096;
+  ierr = PetscMalloc1(conn->capacity,&conn->buf);CHKERRQ(ierr);
+  conn->buf[0] = '\0';
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode test_close(test_conn *conn)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  close(conn->fd);
+  ierr = PetscFree(conn->buf);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode test_send(test_conn *conn, const char *request)
+{
+  size_t  len = strlen(request),sent=0;
+  ssize_t n;
+  PetscFunctionBeginUser;
+  while (sent < len) {
+    n = send(conn->fd,request + sent,len - sent,MSG_NOSIGNAL);
+    if (n < 0) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not send a request: %s",strerror(errno));
+    }
+    sent += (size_t)n;
+  }
+  PetscFunctionReturn(0);
+}
+
+/* receives what the server has sent next, and stores how much in the last
+   parameter, which is 0 once the server has closed the connection */
+static PetscErrorCode test_fill(test_conn *conn, size_t *nread)
+{
+  PetscErrorCode ierr;
+  ssize_t        n;
+  PetscFunctionBeginUser;
+  if (conn->capacity - conn->len < 4096) {
+    conn->capacity *= 2;
+    ierr = PetscRealloc(conn->capacity,&conn->buf);CHKERRQ(ierr);
+  }
+  n = recv(conn->fd,conn->buf + conn->len,conn->capacity - conn->len - 1,0);
+  if (n < 0) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_SYS,"No answer from the server: %s",strerror(errno));
+  }
+  conn->len += (size_t)n;
+  conn->buf[conn->len] = '\0';
+  *nread = (size_t)n;
+  PetscFunctionReturn(0);
+}
+
+/* receives until what has been received contains the text in the second
+   parameter (e.g. the next event of a stream) */
+static PetscErrorCode test_read_until(test_conn *conn, const char *text)
+{
+  PetscErrorCode ierr;
+  size_t         n;
+  PetscFunctionBeginUser;
+  while (!strstr(conn->buf,text)) {
+    ierr = test_fill(conn,&n);CHKERRQ(ierr);
+    if (!n) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The server closed the connection before sending %s",text);
+    }
+  }
+  PetscFunctionReturn(0);
+}
+
+/* takes the bytes in the second parameter, up to the third, out of what has
+   been received, into a newly allocated NUL-terminated string */
+static PetscErrorCode test_take(test_conn *conn, size_t len, char **out)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscMalloc1(len + 1,out);CHKERRQ(ierr);
+  ierr = PetscMemcpy(*out,conn->buf,len);CHKERRQ(ierr);
+  (*out)[len] = '\0';
+  memmove(conn->buf,conn->buf + len,conn->len - len + 1);
+  conn->len -= len;
+  PetscFunctionReturn(0);
+}
+
+/* reads the next response, whose body is Content-Length bytes long, chunked, or
+   (to a HEAD request, which the third parameter says it was) left out */
+static PetscErrorCode test_read_response(test_conn *conn, PetscBool head, test_response *resp)
+{
+  PetscErrorCode ierr;
+  char           *end,*line,*chunk;
+  size_t         n,len,size;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(resp,sizeof(test_response));CHKERRQ(ierr);
+  ierr = test_read_until(conn,"\r\n\r\n");CHKERRQ(ierr);
+  end = strstr(conn->buf,"\r\n\r\n");
+  ierr = test_take(conn,end + 4 - conn->buf,&resp->headers);CHKERRQ(ierr);
+  if (sscanf(resp->headers,"HTTP/1.1 %d",&resp->status) != 1) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Not an HTTP response: %s",resp->headers);
+  }
+  line = strstr(resp->headers,"Content-Length: ");
+  if (head) {
+    ierr = PetscCalloc1(1,&resp->body);CHKERRQ(ierr);
+  } else if (line) {
+    len = (size_t)strtoul(line + 16,NULL,10);
+    while (conn->len < len) {
+      ierr = test_fill(conn,&n);CHKERRQ(ierr);
+      if (!n) {
+	SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The server closed the connection in the middle of a body");
+      }
+    }
+    ierr = test_take(conn,len,&resp->body);CHKERRQ(ierr);
+    resp->body_len = len;
+  } else if (strstr(resp->headers,"Transfer-Encoding: chunked")) {
+    ierr = PetscCalloc1(1,&resp->body);CHKERRQ(ierr);
+    do {
+      ierr = test_read_until(conn,"\r\n");CHKERRQ(ierr);
+      size = (size_t)strtoul(conn->buf,NULL,16);
+      len = strstr(conn->buf,"\r\n") + 2 - conn->buf;
+      while (conn->len < len + size + 2) {
+	ierr = test_fill(conn,&n);CHKERRQ(ierr);
+	if (!n) {
+	  SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The server closed the connection in the middle of a chunk");
+	}
+      }
+      if (strncmp(conn->buf + len + size,"\r\n",2)) {
+	SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Chunk %D is not followed by CRLF",resp->nchunks);
+      }
+      ierr = PetscRealloc(resp->body_len + size + 1,&resp->body);CHKERRQ(ierr);
+      ierr = PetscMemcpy(resp->body + resp->body_len,conn->buf + len,size);CHKERRQ(ierr);
+      resp->body_len += size;
+      resp->body[resp->body_len] = '\0';
+      ierr = test_take(conn,len + size + 2,&chunk);CHKERRQ(ierr);
+      ierr = PetscFree(chunk);CHKERRQ(ierr);
+      if (size) {
+	++resp->nchunks;
+	resp->max_chunk = PetscMax(resp->max_chunk,size);
+      }
+    } while (size);
+  } else {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A response with no length: %s",resp->headers);
+  }
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode test_response_free(test_response *resp)
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+  ierr = PetscFree(resp->headers);CHKERRQ(ierr);
+  ierr = PetscFree(resp->body);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* sends the request in the second parameter on a new connection and reads the
+   response into the third */
+static PetscErrorCode test_request(PetscInt port, const char *request, test_response *resp)
+{
+  PetscErrorCode ierr;
+  test_conn      conn;
+  PetscFunctionBeginUser;
+  ierr = test_connect(port,&conn);CHKERRQ(ierr);
+  ierr = test_send(&conn,request);CHKERRQ(ierr);
+  ierr = test_read_response(&conn,(PetscBool)!strncmp(request,"HEAD ",5),resp);CHKERRQ(ierr);
+  ierr = test_close(&conn);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* counts how often the text in the second parameter is in the first */
+static PetscInt test_count(const char *body, const char *text)
+{
+  const char *s;
+  PetscInt   n=0;
+  for (s=strstr(body,text); s; s=strstr(s + 1,text)) {
+    ++n;
+  }
+  return n;
+}
+
+/* GETs the path in the second parameter, and checks that the answer has the
+   status in the third, and that its body contains the text in the fourth, if
+   any, the number of times in the fifth (or at all if that is negative) */
+static PetscErrorCode check_get(PetscInt port, const char *path, int status, const char *text, PetscInt count)
+{
+  PetscErrorCode ierr;
+  test_response  resp;
+  char           request[1024];
+  PetscInt       n;
+  PetscFunctionBeginUser;
+  snprintf(request,sizeof(request),"GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n",path);
+  ierr = test_request(port,request,&resp);CHKERRQ(ierr);
+  if (resp.status != status) {
+    SETERRQ4(PETSC_COMM_SELF,PETSC_ERR_PLIB,"GET %s answered %d, expected %d: %s",path,resp.status,status,resp.body);
+  }
+  if (text) {
+    n = test_count(resp.body,text);
+    if (count < 0 ? !n : n != count) {
+      SETERRQ4(PETSC_COMM_SELF,PETSC_ERR_PLIB,"GET %s has %s %D times: %s",path,text,n,resp.body);
+    }
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* adds a summary to the next publish of the server */
+static PetscErrorCode add_summary(http_server *srv, PetscInt rank, PetscInt pid, const char *comm, long tx_kb)
+{
+  PetscErrorCode       ierr;
+  process_data_summary psumm;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(&psumm,sizeof(psumm));CHKERRQ(ierr);
+  psumm.rank = rank;
+  psumm.pid = pid;
+  psumm.tx_kb = tx_kb;
+  psumm.rx_kb = 2*tx_kb;
+  psumm.avg_latency = NAN;
+  psumm.avg_lifetime = NAN;
+  psumm.app_rank = -1;
+  ierr = PetscStrncpy(psumm.comm,comm,sizeof(psumm.comm));CHKERRQ(ierr);
+  ierr = http_server_add(srv,&psumm);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* the malformed and the well-formed requests the server has to tell apart */
+static PetscErrorCode test_requests(http_server *srv, PetscInt port)
+{
+  PetscErrorCode ierr;
+  test_response  resp;
+  test_conn      conn;
+  char           request[HTTP_MAX_REQUEST_LEN];
+  size_t         n;
+  PetscFunctionBeginUser;
+  ierr = check_get(port,"/api/get/all",200,"\"pid\": ",3);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/1/100",200,"\"rank\": 1, \"pid\": 100, \"name\": \"mpirun\"",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/1/200",404,"not found",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/0/99999999999999999999",404,"not found",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/mpirun",200,"\"name\": \"mpirun\"",2);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/mpi%20run",404,"Key mpi run not found",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/1/2/3",404,"Malformed",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/-1/100",404,"Malformed",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/nothing",404,"No endpoint",1);CHKERRQ(ierr);
+
+  ierr = test_request(port,"POST /api/get/all HTTP/1.1\r\nContent-Length: 0\r\n\r\n",&resp);CHKERRQ(ierr);
+  if (resp.status != 405 || !strstr(resp.headers,"Allow: GET, HEAD\r\n")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"POST answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_request(port,"GARBAGE\r\n\r\n",&resp);CHKERRQ(ierr);
+  if (resp.status != 400 || !strstr(resp.headers,"Connection: close\r\n")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A request with no path answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  /* headers that never end */
+  ierr = PetscMemzero(request,sizeof(request));CHKERRQ(ierr);
+  snprintf(request,sizeof(request),"GET /api/get/all HTTP/1.1\r\nX-Padding: ");
+  for (n=strlen(request); n<HTTP_MAX_REQUEST_LEN-1; ++n) {
+    request[n] = 'x';
+  }
+  ierr = test_request(port,request,&resp);CHKERRQ(ierr);
+  if (resp.status != 431) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An overlong request answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+
+  /* HEAD has the headers of GET and no body */
+  ierr = test_connect(port,&conn);CHKERRQ(ierr);
+  ierr = test_send(&conn,"HEAD /api/get/all HTTP/1.1\r\nConnection: close\r\n\r\n");CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_TRUE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || !strstr(resp.headers,"Content-Length: ") || strstr(resp.headers,"Content-Length: 0\r\n")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"HEAD answered %d, or without the length of the body",resp.status);
+  }
+  ierr = test_fill(&conn,&n);CHKERRQ(ierr);
+  if (n || conn.len) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"HEAD was answered with a body");
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_close(&conn);CHKERRQ(ierr);
+
+  /* HTTP/1.1 keeps the connection, and requests pipelined on it are answered in
+     order; HTTP/1.0 does not */
+  ierr = test_connect(port,&conn);CHKERRQ(ierr);
+  ierr = test_send(&conn,"GET /api/get/0/100 HTTP/1.1\r\n\r\nGET /api/get/0/200 HTTP/1.1\r\nConnection: close\r\n\r\n");CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || !strstr(resp.headers,"Connection: keep-alive\r\n") || !strstr(resp.body,"\"pid\": 100")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The first of two pipelined requests answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || !strstr(resp.headers,"Connection: close\r\n") || !strstr(resp.body,"\"pid\": 200")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The second of two pipelined requests answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_fill(&conn,&n);CHKERRQ(ierr);
+  if (n) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The connection was kept after Connection: close");
+  }
+  ierr = test_close(&conn);CHKERRQ(ierr);
+  ierr = test_request(port,"GET /api/get/all HTTP/1.0\r\n\r\n",&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || !strstr(resp.headers,"Connection: close\r\n")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An HTTP/1.0 request answered %d, or kept the connection",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* the deltas after the epoch in the second parameter, as a long poll and as a
+   stream. The server has published the epochs e1 (in the second parameter) and
+   e2, which changed pid 100 and added pid 300 on rank 0 and removed pid 200. */
+static PetscErrorCode test_deltas(http_server *srv, PetscInt port, uint64_t e1)
+{
+  PetscErrorCode ierr;
+  test_conn      conn,stream;
+  test_response  resp;
+  char           path[256],text[256];
+  uint64_t       e2 = srv->epoch,e3,e4;
+  time_t         start;
+  PetscFunctionBeginUser;
+  /* a watcher with no epoch, or one from before a restart or after this
+     server's last, gets a snapshot */
+  snprintf(text,sizeof(text),"{\"epoch\": %llu, \"full\": true",(unsigned long long)e2);
+  ierr = check_get(port,"/api/deltas?timeout=0",200,text,1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/deltas?since=1&timeout=0",200,text,1);CHKERRQ(ierr);
+  snprintf(path,sizeof(path),"/api/deltas?since=%llu&timeout=0",(unsigned long long)(e2 + 5));
+  ierr = check_get(port,path,200,text,1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/deltas?timeout=0",200,"\"pid\": ",3);CHKERRQ(ierr);
+
+  /* one that has e1 gets the delta to e2 */
+  snprintf(path,sizeof(path),"/api/deltas?since=%llu&timeout=0",(unsigned long long)e1);
+  snprintf(text,sizeof(text),"{\"epoch\": %llu, \"full\": false",(unsigned long long)e2);
+  ierr = check_get(port,path,200,text,1);CHKERRQ(ierr);
+  ierr = check_get(port,path,200,"\"removed\": [[0, 200]]",1);CHKERRQ(ierr);
+  ierr = check_get(port,path,200,"\"pid\": ",2);CHKERRQ(ierr);
+  ierr = check_get(port,path,200,"\"rank\": 1",0);CHKERRQ(ierr);
+  /* and one that is up to date, nothing */
+  snprintf(path,sizeof(path),"/api/deltas?since=%llu&timeout=0",(unsigned long long)e2);
+  ierr = check_get(port,path,200,"{\"response\": []}",1);CHKERRQ(ierr);
+
+  /* a long poll that is up to date waits for its timeout ... */
+  start = time(NULL);
+  snprintf(path,sizeof(path),"/api/deltas?since=%llu&timeout=1",(unsigned long long)e2);
+  ierr = check_get(port,path,200,"{\"response\": []}",1);CHKERRQ(ierr);
+  if (time(NULL) - start < 1) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A long poll did not wait");
+  }
+  /* ... or for the next publish; so does a stream */
+  ierr = test_connect(port,&conn);CHKERRQ(ierr);
+  snprintf(text,sizeof(text),"GET /api/deltas?since=%llu&timeout=10 HTTP/1.1\r\nConnection: close\r\n\r\n",(unsigned long long)e2);
+  ierr = test_send(&conn,text);CHKERRQ(ierr);
+  ierr = test_connect(port,&stream);CHKERRQ(ierr);
+  snprintf(text,sizeof(text),"GET /api/stream?since=%llu HTTP/1.1\r\n\r\n",(unsigned long long)e1);
+  ierr = test_send(&stream,text);CHKERRQ(ierr);
+  snprintf(text,sizeof(text),"id: %llu\nevent: delta\ndata: {\"epoch\": %llu, \"full\": false",(unsigned long long)e2,(unsigned long long)e2);
+  ierr = test_read_until(&stream,text);CHKERRQ(ierr);
+  if (!strstr(stream.buf,"Content-Type: text/event-stream\r\n")) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A stream is not text/event-stream");
+  }
+  ierr = PetscSleep(0.2);CHKERRQ(ierr);
+  ierr = add_summary(srv,0,100,"mpirun",12);CHKERRQ(ierr);
+  ierr = add_summary(srv,0,300,"ssh",5);CHKERRQ(ierr);
+  ierr = add_summary(srv,1,100,"mpirun",30);CHKERRQ(ierr);
+  ierr = http_server_publish(srv);CHKERRQ(ierr);
+  e3 = srv->epoch;
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  snprintf(text,sizeof(text),"{\"response\": [{\"epoch\": %llu, \"full\": false",(unsigned long long)e3);
+  if (resp.status != 200 || !strstr(resp.body,text) || !strstr(resp.body,"\"tx_kb\": 12")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A parked long poll was answered with %s",resp.body);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_close(&conn);CHKERRQ(ierr);
+  snprintf(text,sizeof(text),"id: %llu\nevent: delta\n",(unsigned long long)e3);
+  ierr = test_read_until(&stream,text);CHKERRQ(ierr);
+  ierr = test_close(&stream);CHKERRQ(ierr);
+
+  /* a watcher two epochs behind gets both deltas */
+  snprintf(path,sizeof(path),"/api/deltas?since=%llu&timeout=0",(unsigned long long)e1);
+  ierr = check_get(port,path,200,"\"full\": false",2);CHKERRQ(ierr);
+
+  /* a stream resumes after its Last-Event-ID */
+  ierr = test_connect(port,&stream);CHKERRQ(ierr);
+  snprintf(text,sizeof(text),"GET /api/stream HTTP/1.1\r\nLast-Event-ID: %llu\r\n\r\n",(unsigned long long)e3);
+  ierr = test_send(&stream,text);CHKERRQ(ierr);
+  ierr = PetscSleep(0.2);CHKERRQ(ierr);
+  ierr = add_summary(srv,0,100,"mpirun",13);CHKERRQ(ierr);
+  ierr = add_summary(srv,0,300,"ssh",5);CHKERRQ(ierr);
+  ierr = add_summary(srv,1,100,"mpirun",30);CHKERRQ(ierr);
+  ierr = http_server_publish(srv);CHKERRQ(ierr);
+  e4 = srv->epoch;
+  snprintf(text,sizeof(text),"id: %llu\nevent: delta\n",(unsigned long long)e4);
+  ierr = test_read_until(&stream,text);CHKERRQ(ierr);
+  snprintf(text,sizeof(text),"id: %llu\n",(unsigned long long)e3);
+  if (strstr(stream.buf,text) || strstr(stream.buf,"event: snapshot")) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A resumed stream got what it had already");
+  }
+  ierr = test_close(&stream);CHKERRQ(ierr);
+
+  /* and a new one starts from a snapshot */
+  ierr = test_connect(port,&stream);CHKERRQ(ierr);
+  ierr = test_send(&stream,"GET /api/stream HTTP/1.1\r\n\r\n");CHKERRQ(ierr);
+  snprintf(text,sizeof(text),"id: %llu\nevent: snapshot\n",(unsigned long long)e4);
+  ierr = test_read_until(&stream,text);CHKERRQ(ierr);
+  ierr = test_close(&stream);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* an export, as answered by /api/export */
+typedef struct {
+  test_response      resp;
+  http_export_header hdr;
+  const char         *names;
+  const char         *columns[23];
+  const int32_t      *removed_rank,*removed_pid;
+} test_export;
+
+#define TEST_PAD8(n) (((n) + 7) & ~(size_t)7)
+
+/* GETs the export since the epoch in the third parameter (or with no since if
+   that is 0) and finds its parts, checking that they add up to its length */
+static PetscErrorCode get_export(PetscInt port, uint64_t since, test_export *exp)
+{
+  PetscErrorCode ierr;
+  char           request[256];
+  size_t         offset,size;
+  PetscInt       c;
+  PetscFunctionBeginUser;
+  if (since) {
+    snprintf(request,sizeof(request),"GET /api/export?since=%llu HTTP/1.1\r\nConnection: close\r\n\r\n",(unsigned long long)since);
+  } else {
+    snprintf(request,sizeof(request),"GET /api/export HTTP/1.1\r\nConnection: close\r\n\r\n");
+  }
+  ierr = test_request(port,request,&exp->resp);CHKERRQ(ierr);
+  if (exp->resp.status != 200 || !strstr(exp->resp.headers,"Content-Type: application/octet-stream\r\n") || exp->resp.body_len < sizeof(http_export_header)) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"/api/export answered %d",exp->resp.status);
+  }
+  ierr = PetscMemcpy(&exp->hdr,exp->resp.body,sizeof(http_export_header));CHKERRQ(ierr);
+  if (memcmp(exp->hdr.magic,HTTP_EXPORT_MAGIC,sizeof(HTTP_EXPORT_MAGIC)) || exp->hdr.version != HTTP_EXPORT_VERSION) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An export with the wrong magic or version");
+  }
+  exp->names = exp->resp.body + sizeof(http_export_header);
+  offset = sizeof(http_export_header) + TEST_PAD8(exp->hdr.names_len);
+  for (c=0; c<23; ++c) {
+    size = c < 5 ? 4 : 8;
+    exp->columns[c] = exp->resp.body + offset;
+    offset += TEST_PAD8(exp->hdr.nrows*size);
+  }
+  exp->removed_rank = (const int32_t*)(exp->resp.body + offset);
+  offset += TEST_PAD8(exp->hdr.nremoved*sizeof(int32_t));
+  exp->removed_pid = (const int32_t*)(exp->resp.body + offset);
+  offset += TEST_PAD8(exp->hdr.nremoved*sizeof(int32_t));
+  if (offset != exp->resp.body_len) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An export of %D bytes, whose parts add up to %D",(PetscInt)exp->resp.body_len,(PetscInt)offset);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* checks that row k of an export is the process in the third and fourth
+   parameters, with the comm and tx_kb in the fifth and sixth */
+static PetscErrorCode check_export_row(test_export *exp, PetscInt k, PetscInt rank, PetscInt pid, const char *comm, long tx_kb)
+{
+  const char *name;
+  uint32_t   i,n;
+  PetscFunctionBeginUser;
+  n = ((const uint32_t*)exp->columns[3])[k];
+  if (n >= exp->hdr.nnames) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Row %D refers to name %D, past the names",k,(PetscInt)n);
+  }
+  for (i=0,name=exp->names; i<n; ++i) {
+    name += strlen(name) + 1;
+  }
+  if (((const int32_t*)exp->columns[0])[k] != rank || ((const int32_t*)exp->columns[1])[k] != pid ||
+      ((const int32_t*)exp->columns[2])[k] != -1 || strcmp(name,comm) ||
+      ((const int64_t*)exp->columns[5])[k] != tx_kb || ((const int64_t*)exp->columns[6])[k] != 2*tx_kb ||
+      ((const double*)exp->columns[14])[k] == ((const double*)exp->columns[14])[k]) {
+    SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Row %D of the export is not %D/%D, or has the wrong fields",k,rank,pid);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* the columnar export, in full and since an earlier epoch. The server has
+   published e1 (the third parameter) and then the epochs test_deltas() did. */
+static PetscErrorCode test_exports(http_server *srv, PetscInt port, uint64_t e1)
+{
+  PetscErrorCode ierr;
+  test_export    exp,again;
+  uint64_t       e4 = srv->epoch,e5;
+  PetscInt       i;
+  PetscFunctionBeginUser;
+  /* a full export has every summary, sorted, and each name once */
+  ierr = get_export(port,0,&exp);CHKERRQ(ierr);
+  if (!exp.hdr.full || exp.hdr.epoch != e4 || exp.hdr.since || exp.hdr.nrows != 3 || exp.hdr.nremoved || exp.hdr.nnames != 3) {
+    SETERRQ3(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A full export of %D rows, %D removed and %D names",(PetscInt)exp.hdr.nrows,(PetscInt)exp.hdr.nremoved,(PetscInt)exp.hdr.nnames);
+  }
+  ierr = check_export_row(&exp,0,0,100,"mpirun",13);CHKERRQ(ierr);
+  ierr = check_export_row(&exp,1,0,300,"ssh",5);CHKERRQ(ierr);
+  ierr = check_export_row(&exp,2,1,100,"mpirun",30);CHKERRQ(ierr);
+  /* the second time it is the one encoded the first time */
+  ierr = get_export(port,e4 + 5,&again);CHKERRQ(ierr);
+  if (again.resp.body_len != exp.resp.body_len || memcmp(again.resp.body,exp.resp.body,exp.resp.body_len)) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Two full exports of the same epoch differ");
+  }
+  ierr = test_response_free(&again.resp);CHKERRQ(ierr);
+  ierr = test_response_free(&exp.resp);CHKERRQ(ierr);
+
+  /* since e1, pid 100 on rank 0 changed, pid 300 was added and pid 200 removed */
+  ierr = get_export(port,e1,&exp);CHKERRQ(ierr);
+  if (exp.hdr.full || exp.hdr.epoch != e4 || exp.hdr.since != e1 || exp.hdr.nrows != 2 || exp.hdr.nremoved != 1 ||
+      exp.removed_rank[0] != 0 || exp.removed_pid[0] != 200) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An export since e1 of %D rows and %D removed",(PetscInt)exp.hdr.nrows,(PetscInt)exp.hdr.nremoved);
+  }
+  ierr = check_export_row(&exp,0,0,100,"mpirun",13);CHKERRQ(ierr);
+  ierr = check_export_row(&exp,1,0,300,"ssh",5);CHKERRQ(ierr);
+  ierr = test_response_free(&exp.resp);CHKERRQ(ierr);
+  /* since the one before, only pid 100 on rank 0 */
+  ierr = get_export(port,e4 - 1,&exp);CHKERRQ(ierr);
+  if (exp.hdr.full || exp.hdr.nrows != 1 || exp.hdr.nremoved || exp.hdr.nnames != 2) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An export since the last epoch of %D rows",(PetscInt)exp.hdr.nrows);
+  }
+  ierr = check_export_row(&exp,0,0,100,"mpirun",13);CHKERRQ(ierr);
+  ierr = test_response_free(&exp.resp);CHKERRQ(ierr);
+  /* and since the current one, nothing */
+  ierr = get_export(port,e4,&exp);CHKERRQ(ierr);
+  if (exp.hdr.full || exp.hdr.nrows || exp.hdr.nremoved || exp.hdr.nnames) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An export since the current epoch of %D rows",(PetscInt)exp.hdr.nrows);
+  }
+  ierr = test_response_free(&exp.resp);CHKERRQ(ierr);
+
+  /* a publish replaces the full export that was encoded */
+  ierr = add_summary(srv,0,100,"mpirun",13);CHKERRQ(ierr);
+  ierr = add_summary(srv,1,100,"mpirun",30);CHKERRQ(ierr);
+  ierr = http_server_publish(srv);CHKERRQ(ierr);
+  e5 = srv->epoch;
+  ierr = get_export(port,0,&exp);CHKERRQ(ierr);
+  if (!exp.hdr.full || exp.hdr.epoch != e5 || exp.hdr.nrows != 2) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A full export after a publish of %D rows",(PetscInt)exp.hdr.nrows);
+  }
+  ierr = test_response_free(&exp.resp);CHKERRQ(ierr);
+  ierr = get_export(port,e4,&exp);CHKERRQ(ierr);
+  if (exp.hdr.full || exp.hdr.nrows || exp.hdr.nremoved != 1 || exp.removed_rank[0] != 0 || exp.removed_pid[0] != 300) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An export of a removal of %D rows",(PetscInt)exp.hdr.nrows);
+  }
+  ierr = test_response_free(&exp.resp);CHKERRQ(ierr);
+
+  /* an epoch further back than the deltas kept gets a full export */
+  for (i=0; i<=HTTP_DELTA_HISTORY; ++i) {
+    ierr = add_summary(srv,0,100,"mpirun",13);CHKERRQ(ierr);
+    ierr = add_summary(srv,1,100,"mpirun",30);CHKERRQ(ierr);
+    ierr = http_server_publish(srv);CHKERRQ(ierr);
+  }
+  ierr = get_export(port,e5,&exp);CHKERRQ(ierr);
+  if (!exp.hdr.full || exp.hdr.since || exp.hdr.nrows != 2) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"An export since an epoch no longer kept of %D rows",(PetscInt)exp.hdr.nrows);
+  }
+  ierr = test_response_free(&exp.resp);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* /metrics, on a server that labels only the max_series processes in the third
+   parameter of the ones it has: TEST_METRICS_NRANKS ranks of TEST_METRICS_NPIDS
+   each, whose tx_kb grows with rank and pid, and every third of which has no
+   latency */
+#define TEST_METRICS_NRANKS 4
+#define TEST_METRICS_NPIDS  750
+
+static PetscErrorCode test_metrics(http_server *srv, PetscInt port, PetscInt max_series)
+{
+  PetscErrorCode       ierr;
+  process_data_summary psumm;
+  test_response        resp;
+  test_conn            conn;
+  char                 text[256];
+  PetscInt             r,p,n;
+  PetscFunctionBeginUser;
+  ierr = check_get(port,"/metrics",200,"\ndcprof_processes 0\n",1);CHKERRQ(ierr);
+  ierr = PetscMemzero(&psumm,sizeof(psumm));CHKERRQ(ierr);
+  ierr = PetscStrncpy(psumm.comm,"a \"quoted\\\" comm",sizeof(psumm.comm));CHKERRQ(ierr);
+  psumm.avg_lifetime = NAN;
+  for (r=0; r<TEST_METRICS_NRANKS; ++r) {
+    for (p=1; p<=TEST_METRICS_NPIDS; ++p) {
+      psumm.rank = r;
+      psumm.pid = p;
+      psumm.tx_kb = 1000*r + p;
+      psumm.avg_latency = p % 3 ? 0.1*p : NAN;
+      ierr = http_server_add(srv,&psumm);CHKERRQ(ierr);
+    }
+  }
+  ierr = http_server_publish(srv);CHKERRQ(ierr);
+
+  ierr = test_request(port,"GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n",&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || !strstr(resp.headers,"Content-Type: text/plain; version=0.0.4") || strstr(resp.headers,"Content-Length")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"/metrics answered %d, or not chunked",resp.status);
+  }
+  /* written a chunk at a time, none much more than HTTP_METRICS_CHUNK */
+  if (resp.nchunks < 2 || resp.max_chunk > HTTP_METRICS_CHUNK + 1024) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"/metrics came in %D chunks of up to %D bytes",resp.nchunks,(PetscInt)resp.max_chunk);
+  }
+  snprintf(text,sizeof(text),"\ndcprof_processes %d\n",TEST_METRICS_NRANKS*TEST_METRICS_NPIDS);
+  n = test_count(resp.body,text);
+  snprintf(text,sizeof(text),"\ndcprof_processes_unlabelled %d\n",(int)(TEST_METRICS_NRANKS*TEST_METRICS_NPIDS - max_series));
+  if (n != 1 || test_count(resp.body,text) != 1) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"/metrics has the wrong number of processes, or of unlabelled ones");
+  }
+  /* only the processes with the most tx_kb are labelled, and families with no
+     value are left out */
+  if (test_count(resp.body,"\ndcprof_tx_kilobytes_total{") != max_series || test_count(resp.body,"\ndcprof_connection_lifetime_milliseconds{")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"/metrics labels %D processes",test_count(resp.body,"\ndcprof_tx_kilobytes_total{"));
+  }
+  snprintf(text,sizeof(text),"\ndcprof_tx_kilobytes_total{rank=\"%d\",pid=\"%d\",comm=\"a \\\"quoted\\\\\\\" comm\"} %d\n",
+	   TEST_METRICS_NRANKS-1,(int)(TEST_METRICS_NPIDS - max_series + 1),(int)(1000*(TEST_METRICS_NRANKS-1) + TEST_METRICS_NPIDS - max_series + 1));
+  n = test_count(resp.body,text);
+  snprintf(text,sizeof(text),"pid=\"%d\"",(int)(TEST_METRICS_NPIDS - max_series));
+  if (n != 1 || test_count(resp.body,text)) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"/metrics labels the wrong processes, or does not escape their comm");
+  }
+  /* the histograms count every process with a latency */
+  for (r=0; r<TEST_METRICS_NRANKS; ++r) {
+    snprintf(text,sizeof(text),"\ndcprof_process_connection_latency_milliseconds_bucket{rank=\"%d\",le=\"0.25\"} 2\n",(int)r);
+    n = test_count(resp.body,text);
+    snprintf(text,sizeof(text),"\ndcprof_process_connection_latency_milliseconds_bucket{rank=\"%d\",le=\"+Inf\"} %d\n",(int)r,TEST_METRICS_NPIDS - TEST_METRICS_NPIDS/3);
+    n += test_count(resp.body,text);
+    snprintf(text,sizeof(text),"\ndcprof_process_connection_latency_milliseconds_count{rank=\"%d\"} %d\n",(int)r,TEST_METRICS_NPIDS - TEST_METRICS_NPIDS/3);
+    n += test_count(resp.body,text);
+    snprintf(text,sizeof(text),"\ndcprof_process_connection_latency_milliseconds_sum{rank=\"%d\"} 18750\n",(int)r);
+    n += test_count(resp.body,text);
+    if (n != 4) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The latency histogram of rank %D is wrong",r);
+    }
+  }
+  if (resp.body[resp.body_len-1] != '\n') {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"/metrics does not end with a newline");
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+
+  /* HEAD has no chunks, and the connection serves requests after a scrape */
+  ierr = test_connect(port,&conn);CHKERRQ(ierr);
+  ierr = test_send(&conn,"HEAD /metrics HTTP/1.1\r\n\r\nGET /metrics HTTP/1.1\r\n\r\nGET /api/get/0/1 HTTP/1.1\r\nConnection: close\r\n\r\n");CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_TRUE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || !strstr(resp.headers,"Transfer-Encoding: chunked\r\n")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"HEAD /metrics answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || resp.nchunks < 2) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"/metrics after HEAD answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || !strstr(resp.body,"\"rank\": 0, \"pid\": 1,")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A request after a scrape answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_close(&conn);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* hands the server the summaries of a rank, with --fanout: the pids in the third
+   parameter, each with the comm in the fourth, and the tx_kb in the sixth */
+static PetscErrorCode deliver_rank(http_server *srv, PetscInt rank, const PetscInt *pids, const char **comms, PetscInt n, long tx_kb)
+{
+  PetscErrorCode       ierr;
+  process_data_summary *summaries;
+  PetscInt             i;
+  PetscFunctionBeginUser;
+  /* the server frees them */
+  summaries = (process_data_summary*)calloc(n ? n : 1,sizeof(process_data_summary));
+  if (!summaries) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_MEM,"Could not allocate the summaries of a rank");
+  }
+  for (i=0; i<n; ++i) {
+    summaries[i].rank = rank;
+    summaries[i].pid = pids[i];
+    summaries[i].tx_kb = tx_kb;
+    summaries[i].avg_latency = NAN;
+    summaries[i].avg_lifetime = NAN;
+    ierr = PetscStrncpy(summaries[i].comm,comms[i],sizeof(summaries[i].comm));CHKERRQ(ierr);
+  }
+  ierr = http_server_fanout_deliver(srv,rank,summaries,n);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* checks that the server wants the rank in the second parameter next, or that
+   it wants none if that is -1 */
+static PetscErrorCode check_wanted(http_server *srv, PetscInt expected)
+{
+  PetscErrorCode ierr;
+  PetscInt       rank;
+  PetscFunctionBeginUser;
+  ierr = http_server_fanout_wait(srv,expected < 0 ? 0.2 : 10.0,&rank);CHKERRQ(ierr);
+  if (rank != expected) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The server wants rank %D, expected %D",rank,expected);
+  }
+  PetscFunctionReturn(0);
+}
+
+static int test_hash_cmp(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a,y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+/* starts a poll of --fanout, in which rank 0 has mpirun and nginx, rank 1 has
+   mpirun, and rank 2 has nothing */
+static PetscErrorCode fanout_publish(http_server *srv)
+{
+  PetscErrorCode ierr;
+  PetscMPIInt    nnames[3] = {2,1,0};
+  uint64_t       names[3];
+  PetscFunctionBeginUser;
+  names[0] = http_name_hash("mpirun");
+  names[1] = http_name_hash("nginx");
+  names[2] = http_name_hash("mpirun");
+  qsort(names,2,sizeof(uint64_t),test_hash_cmp);
+  ierr = http_server_fanout_publish(srv,3,nnames,names);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* /api/get with --fanout, from the ranks the requests are about. This thread
+   plays the driver, which waits for the ranks the server wants and delivers them. */
+static PetscErrorCode test_fanout(http_server *srv, PetscInt port)
+{
+  PetscErrorCode ierr;
+  test_conn      conn;
+  test_response  resp;
+  PetscInt       pids0[2] = {100,200},pids1[1] = {100};
+  const char     *comms0[2] = {"mpirun","nginx"},*comms1[1] = {"mpirun"};
+  PetscFunctionBeginUser;
+  ierr = fanout_publish(srv);CHKERRQ(ierr);
+
+  /* ranks the index does not have are not found, and not asked for */
+  ierr = check_get(port,"/api/get/3/100",404,"Key 3/100 not found",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/2147483648/100",404,"not found",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/99999999999999999999/100",404,"not found",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/-1/100",404,"Malformed",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/0/1/2",404,"Malformed",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/get/ssh",404,"Key ssh not found in dictionary entries_by_name!",1);CHKERRQ(ierr);
+  ierr = check_wanted(srv,-1);CHKERRQ(ierr);
+
+  /* a key waits for its rank ... */
+  ierr = test_connect(port,&conn);CHKERRQ(ierr);
+  ierr = test_send(&conn,"GET /api/get/1/100 HTTP/1.1\r\n\r\n");CHKERRQ(ierr);
+  ierr = check_wanted(srv,1);CHKERRQ(ierr);
+  ierr = check_wanted(srv,-1);CHKERRQ(ierr);
+  ierr = deliver_rank(srv,1,pids1,comms1,1,30);CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || !strstr(resp.body,"\"rank\": 1, \"pid\": 100, \"name\": \"mpirun\", \"tx_kb\": 30")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A key answered %s",resp.body);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  /* ... which is kept for the rest of the poll */
+  ierr = test_send(&conn,"GET /api/get/1/200 HTTP/1.1\r\n\r\n");CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 404) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A key not on a rank that was fetched answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = check_wanted(srv,-1);CHKERRQ(ierr);
+
+  /* a name waits for the ranks that have it, and only those */
+  ierr = test_send(&conn,"GET /api/get/nginx HTTP/1.1\r\n\r\n");CHKERRQ(ierr);
+  ierr = check_wanted(srv,0);CHKERRQ(ierr);
+  ierr = check_wanted(srv,-1);CHKERRQ(ierr);
+  ierr = deliver_rank(srv,0,pids0,comms0,2,10);CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || test_count(resp.body,"\"pid\": ") != 1 || !strstr(resp.body,"\"rank\": 0, \"pid\": 200, \"name\": \"nginx\"")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A name answered %s",resp.body);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  /* all is every rank with a name, which both are now */
+  ierr = test_send(&conn,"GET /api/get/all HTTP/1.1\r\nConnection: close\r\n\r\n");CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || test_count(resp.body,"\"pid\": ") != 3) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"All answered %s",resp.body);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_close(&conn);CHKERRQ(ierr);
+  ierr = check_wanted(srv,-1);CHKERRQ(ierr);
+  /* a rank that was not asked for is dropped */
+  ierr = deliver_rank(srv,2,pids1,comms1,1,0);CHKERRQ(ierr);
+
+  /* the next poll forgets the ranks fetched, and a request that waits for one
+     across it asks again */
+  ierr = fanout_publish(srv);CHKERRQ(ierr);
+  ierr = test_connect(port,&conn);CHKERRQ(ierr);
+  ierr = test_send(&conn,"GET /api/get/mpirun HTTP/1.1\r\nConnection: close\r\n\r\n");CHKERRQ(ierr);
+  ierr = check_wanted(srv,0);CHKERRQ(ierr);
+  ierr = check_wanted(srv,1);CHKERRQ(ierr);
+  ierr = fanout_publish(srv);CHKERRQ(ierr);
+  ierr = check_wanted(srv,0);CHKERRQ(ierr);
+  ierr = check_wanted(srv,1);CHKERRQ(ierr);
+  ierr = deliver_rank(srv,1,pids1,comms1,1,31);CHKERRQ(ierr);
+  ierr = deliver_rank(srv,0,pids0,comms0,2,11);CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 200 || test_count(resp.body,"\"pid\": ") != 2 || !strstr(resp.body,"\"tx_kb\": 31") || !strstr(resp.body,"\"tx_kb\": 11")) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A name across polls answered %s",resp.body);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_close(&conn);CHKERRQ(ierr);
+  /* the rank delivered unasked was not kept: a key on it waits for it */
+  ierr = test_connect(port,&conn);CHKERRQ(ierr);
+  ierr = test_send(&conn,"GET /api/get/2/100 HTTP/1.1\r\nConnection: close\r\n\r\n");CHKERRQ(ierr);
+  ierr = check_wanted(srv,2);CHKERRQ(ierr);
+  ierr = deliver_rank(srv,2,NULL,NULL,0,0);CHKERRQ(ierr);
+  ierr = test_read_response(&conn,PETSC_FALSE,&resp);CHKERRQ(ierr);
+  if (resp.status != 404) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A key on a rank with no summaries answered %d",resp.status);
+  }
+  ierr = test_response_free(&resp);CHKERRQ(ierr);
+  ierr = test_close(&conn);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode ierr;
+  http_server    srv;
+  PetscInt       port;
+  uint64_t       e1;
+  ierr = PetscInitialize(&argc,&argv,NULL,NULL);  if (ierr) return ierr;
+
+  ierr = start_server(&srv,HTTP_METRICS_MAX_SERIES,&port);CHKERRQ(ierr);
+  /* nothing has been published yet */
+  ierr = check_get(port,"/api/get/all",200,"{\"response\": []}",1);CHKERRQ(ierr);
+  ierr = check_get(port,"/api/deltas?timeout=0",200,"{\"response\": []}",1);CHKERRQ(ierr);
+
+  ierr = add_summary(&srv,1,100,"mpirun",30);CHKERRQ(ierr);
+  ierr = add_summary(&srv,0,200,"nginx",20);CHKERRQ(ierr);
+  ierr = add_summary(&srv,0,100,"mpirun",10);CHKERRQ(ierr);
+  ierr = http_server_publish(&srv);CHKERRQ(ierr);
+  e1 = srv.epoch;
+  ierr = test_requests(&srv,port);CHKERRQ(ierr);
+
+  ierr = add_summary(&srv,0,100,"mpirun",11);CHKERRQ(ierr);
+  ierr = add_summary(&srv,0,300,"ssh",5);CHKERRQ(ierr);
+  ierr = add_summary(&srv,1,100,"mpirun",30);CHKERRQ(ierr);
+  ierr = http_server_publish(&srv);CHKERRQ(ierr);
+  ierr = test_deltas(&srv,port,e1);CHKERRQ(ierr);
+  ierr = test_exports(&srv,port,e1);CHKERRQ(ierr);
+  ierr = http_server_stop(&srv);CHKERRQ(ierr);
+
+  ierr = start_server(&srv,100,&port);CHKERRQ(ierr);
+  ierr = test_metrics(&srv,port,100);CHKERRQ(ierr);
+  ierr = http_server_stop(&srv);CHKERRQ(ierr);
+
+  ierr = start_server(&srv,HTTP_METRICS_MAX_SERIES,&port);CHKERRQ(ierr);
+  ierr = test_fanout(&srv,port);CHKERRQ(ierr);
+  ierr = http_server_stop(&srv);CHKERRQ(ierr);
+
+  PetscPrintf(PETSC_COMM_WORLD,"All HTTP server tests passed\n");
+  PetscFinalize();
+  return 0;
+}
@@ -17,7 +17,7 @@ int main(int argc, char **argv)
     SETERRQ(PETSC_COMM_WORLD,1,"Must provide a filename (-file)");
   }
 
-  ierr = create_tcplife_entry_bag(&entry,&bag);CHKERRQ(ierr);
+  ierr = create_tcplife_entry_bag(&entry,&bag,1);CHKERRQ(ierr);
   input = fopen(filename,"r");
   getline(&line,&linesize,input);/* first line */
   getline(&line,&linesize,input);
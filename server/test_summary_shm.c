@@ -0,0 +1,161 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "summary_shm.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* the writer publishes these two snapshots in turn. Every record of a snapshot
+   has tx_kb equal to the number of records, so a reader can tell a torn copy.
+   The large one does not fit in the segment as it is first created. */
+#define TEST_SMALL_NRECORDS 100
+#define TEST_LARGE_NRECORDS 8000
+#define TEST_NPUBLISH       2000
+
+static PetscErrorCode build_snapshot(summary_snapshot *snap, PetscInt nrecords)
+{
+  PetscErrorCode       ierr;
+  process_data_summary psumm;
+  PetscInt             i;
+  PetscFunctionBeginUser;
+  ierr = summary_snapshot_create(snap,NULL);CHKERRQ(ierr);
+  ierr = PetscMemzero(&psumm,sizeof(psumm));CHKERRQ(ierr);
+  ierr = PetscStrncpy(psumm.comm,"mpirun",sizeof(psumm.comm));CHKERRQ(ierr);
+  for (i=0; i<nrecords; ++i) {
+    psumm.pid = i;
+    psumm.tx_kb = nrecords;
+    ierr = summary_snapshot_add(snap,&psumm);CHKERRQ(ierr);
+  }
+  ierr = summary_snapshot_seal(snap,1000);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+/* reads a snapshot out of the segment and checks that it is one of the two the
+   writer publishes, whole; the number of records is stored in the last parameter */
+static PetscErrorCode check_read(summary_shm *shm, char **buf, size_t *capacity, PetscInt *nrecords)
+{
+  PetscErrorCode        ierr;
+  summary_snapshot_view view;
+  PetscInt              i,n;
+  PetscFunctionBeginUser;
+  ierr = summary_shm_read(shm,buf,capacity,&view);CHKERRQ(ierr);
+  n = (PetscInt)view.header->nrecords;
+  if (n != TEST_SMALL_NRECORDS && n != TEST_LARGE_NRECORDS) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read a snapshot of %D records",n);
+  }
+  for (i=0; i<n; ++i) {
+    if (view.records[i].tx_kb != n || view.records[i].pid != i || strcmp(summary_snapshot_string(&view,view.records[i].comm),"mpirun")) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Record %D of a snapshot of %D records is torn",i,n);
+    }
+  }
+  if (nrecords) {
+    *nrecords = n;
+  }
+  PetscFunctionReturn(0);
+}
+
+/* checks that reading the segment fails, and stores how long it took in ms in the
+   last parameter */
+static PetscErrorCode check_read_fails(summary_shm *shm, char **buf, size_t *capacity, PetscInt *ms)
+{
+  PetscErrorCode        ierr;
+  summary_snapshot_view view;
+  struct timespec       start,end;
+  PetscFunctionBeginUser;
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  ierr = PetscPushErrorHandler(PetscReturnErrorHandler,NULL);CHKERRQ(ierr);
+  ierr = summary_shm_read(shm,buf,capacity,&view);
+  PetscPopErrorHandler();
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  if (ierr != PETSC_ERR_FILE_UNEXPECTED) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Reading %s should have failed",shm->name);
+  }
+  *ms = (PetscInt)((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000);
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode   ierr;
+  summary_snapshot small,large;
+  summary_shm      writer,reader;
+  char             name[64],*buf=NULL;
+  size_t           capacity=0;
+  pid_t            child;
+  PetscInt         i,n,ms,nsmall=0,nlarge=0;
+  int              status;
+  ierr = PetscInitialize(&argc,&argv,NULL,NULL);  if (ierr) return ierr;
+  snprintf(name,sizeof(name),"/dcprof_test_%d",(int)getpid());
+  ierr = build_snapshot(&small,TEST_SMALL_NRECORDS);CHKERRQ(ierr);
+  ierr = build_snapshot(&large,TEST_LARGE_NRECORDS);CHKERRQ(ierr);
+
+  ierr = summary_shm_create(&writer,name);CHKERRQ(ierr);
+  ierr = summary_shm_open(&reader,name);CHKERRQ(ierr);
+  ierr = check_read_fails(&reader,&buf,&capacity,&ms);CHKERRQ(ierr);
+
+  ierr = summary_shm_publish(&writer,&small);CHKERRQ(ierr);
+  ierr = check_read(&reader,&buf,&capacity,&n);CHKERRQ(ierr);
+  if (n != TEST_SMALL_NRECORDS) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read a snapshot of %D records after publishing the small one",n);
+  }
+  /* the segment grows, and the reader maps it again */
+  ierr = summary_shm_publish(&writer,&large);CHKERRQ(ierr);
+  ierr = check_read(&reader,&buf,&capacity,&n);CHKERRQ(ierr);
+  if (n != TEST_LARGE_NRECORDS || reader.size != writer.size) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Read a snapshot of %D records after publishing the large one",n);
+  }
+
+  /* a writer in another process publishes while this one reads; no copy may be torn */
+  child = fork();
+  if (child < 0) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_SYS,"Could not fork the writer");
+  }
+  if (!child) {
+    for (i=0; i<TEST_NPUBLISH; ++i) {
+      if (summary_shm_publish(&writer,i % 2 ? &large : &small)) {
+	_exit(1);
+      }
+    }
+    _exit(0);
+  }
+  while (waitpid(child,&status,WNOHANG) == 0) {
+    ierr = check_read(&reader,&buf,&capacity,&n);CHKERRQ(ierr);
+    if (n == TEST_SMALL_NRECORDS) {
+      ++nsmall;
+    } else {
+      ++nlarge;
+    }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The writer failed");
+  }
+  ierr = PetscInfo2(NULL,"Read %D small and %D large snapshots\n",nsmall,nlarge);CHKERRQ(ierr);
+
+  /* a writer that dies in the middle of a copy leaves seq odd: readers give up
+     after SUMMARY_SHM_READ_TIMEOUT_MS rather than spin forever */
+  ++(((summary_shm_header*)writer.map)->seq);
+  ierr = check_read_fails(&reader,&buf,&capacity,&ms);CHKERRQ(ierr);
+  if (ms < SUMMARY_SHM_READ_TIMEOUT_MS || ms > 10*SUMMARY_SHM_READ_TIMEOUT_MS) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The reader gave up after %D ms, expected about %D",ms,(PetscInt)SUMMARY_SHM_READ_TIMEOUT_MS);
+  }
+  /* and the next writer takes the segment over, without the torn snapshot */
+  ierr = summary_shm_close(&writer);CHKERRQ(ierr);
+  ierr = summary_shm_create(&writer,name);CHKERRQ(ierr);
+  ierr = check_read_fails(&reader,&buf,&capacity,&ms);CHKERRQ(ierr);
+  if (ms >= SUMMARY_SHM_READ_TIMEOUT_MS) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The reader waited %D ms on a segment that was taken over",ms);
+  }
+  ierr = summary_shm_publish(&writer,&small);CHKERRQ(ierr);
+  ierr = check_read(&reader,&buf,&capacity,&n);CHKERRQ(ierr);
+
+  ierr = summary_shm_close(&reader);CHKERRQ(ierr);
+  ierr = summary_shm_destroy(&writer);CHKERRQ(ierr);
+  ierr = summary_snapshot_destroy(&small);CHKERRQ(ierr);
+  ierr = summary_snapshot_destroy(&large);CHKERRQ(ierr);
+  ierr = PetscFree(buf);CHKERRQ(ierr);
+  PetscPrintf(PETSC_COMM_WORLD,"All summary shared memory tests passed\n");
+  PetscFinalize();
+  return 0;
+}
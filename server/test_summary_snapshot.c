@@ -0,0 +1,166 @@
+#define  _POSIX_C_SOURCE 200809L
+#include "petsc_webserver.h"
+#include "summary_snapshot.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define TEST_SNAPSHOT_FILE "test_summary_snapshot.dcpsnap"
+#define TEST_NRANKS        4
+#define TEST_NPIDS         50
+
+/* reads the whole snapshot file into a buffer stored in the first parameter
+   (free with PetscFree()), and its size into the second */
+static PetscErrorCode read_snapshot_file(char **data, size_t *size)
+{
+  PetscErrorCode ierr;
+  FILE           *fd;
+  long           len;
+  PetscFunctionBeginUser;
+  fd = fopen(TEST_SNAPSHOT_FILE,"rb");
+  if (!fd) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_OPEN,"Could not open %s",TEST_SNAPSHOT_FILE);
+  }
+  fseek(fd,0,SEEK_END);
+  len = ftell(fd);
+  rewind(fd);
+  ierr = PetscMalloc1(len,data);CHKERRQ(ierr);
+  if (fread(*data,1,len,fd) != (size_t)len) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_FILE_READ,"Could not read %s",TEST_SNAPSHOT_FILE);
+  }
+  fclose(fd);
+  *size = (size_t)len;
+  PetscFunctionReturn(0);
+}
+
+/* adds the records of every rank, in an order the snapshot has to sort */
+static PetscErrorCode add_records(summary_snapshot *snap)
+{
+  PetscErrorCode       ierr;
+  process_data_summary psumm;
+  node_summary         nsumm;
+  PetscInt             r,p,c;
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(&psumm,sizeof(psumm));CHKERRQ(ierr);
+  for (r=TEST_NRANKS-1; r>=0; --r) {
+    for (p=TEST_NPIDS-1; p>=0; --p) {
+      psumm.rank = r;
+      psumm.pid = 100*(p + 1);
+      psumm.app_rank = p % 2 ? -1 : p;
+      psumm.tx_kb = r*1000 + p;
+      psumm.rx_kb = 2*psumm.tx_kb;
+      psumm.n_event = p;
+      psumm.avg_latency = 0.5*p;
+      psumm.fraction_ipv6 = p % 2 ? 1.0 : 0.0;
+      ierr = PetscStrncpy(psumm.comm,p % 3 ? "mpirun" : "nginx",sizeof(psumm.comm));CHKERRQ(ierr);
+      ierr = PetscStrncpy(psumm.job_id,p % 2 ? "" : "job42",sizeof(psumm.job_id));CHKERRQ(ierr);
+      ierr = summary_snapshot_add(snap,&psumm);CHKERRQ(ierr);
+    }
+    ierr = PetscMemzero(&nsumm,sizeof(nsumm));CHKERRQ(ierr);
+    nsumm.rank = r;
+    nsumm.interval = 1.0;
+    for (c=0; c<NUM_NODE_COUNTERS; ++c) {
+      nsumm.total[c] = r*100 + c;
+    }
+    snprintf(nsumm.host,sizeof(nsumm.host),"node%d",(int)r);
+    ierr = summary_snapshot_add_node(snap,&nsumm);CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+/* checks the snapshot in the file against what add_records() added, and that it
+   carries the epoch in the second parameter */
+static PetscErrorCode check_snapshot(uint64_t epoch)
+{
+  PetscErrorCode          ierr;
+  summary_snapshot_view   view;
+  summary_snapshot_record *rec;
+  char                    *data,host[16];
+  size_t                  size;
+  PetscInt                r,p,i,c;
+  const char              *name;
+  PetscFunctionBeginUser;
+  ierr = read_snapshot_file(&data,&size);CHKERRQ(ierr);
+  ierr = summary_snapshot_view_init(&view,data,size);CHKERRQ(ierr);
+  if (view.header->epoch != epoch || view.header->time_ms != 1000*(int64_t)epoch) {
+    SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Snapshot has epoch %D",(PetscInt)view.header->epoch);
+  }
+  if (view.header->nrecords != TEST_NRANKS*TEST_NPIDS || view.header->nnodes != TEST_NRANKS) {
+    SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Snapshot has %D records and %D nodes",(PetscInt)view.header->nrecords,(PetscInt)view.header->nnodes);
+  }
+  /* records are sorted by (rank,pid) */
+  for (r=0,i=0; r<TEST_NRANKS; ++r) {
+    for (p=0; p<TEST_NPIDS; ++p,++i) {
+      rec = &view.records[i];
+      if (rec->rank != r || rec->pid != 100*(p + 1) || rec->tx_kb != r*1000 + p || rec->rx_kb != 2*rec->tx_kb ||
+	  rec->app_rank != (p % 2 ? -1 : p) || rec->avg_latency != 0.5*p || rec->fraction_ipv6 != (p % 2 ? 1.0 : 0.0)) {
+	SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Record %D is wrong or out of order: rank %D",i,(PetscInt)rec->rank);
+      }
+      if (strcmp(summary_snapshot_string(&view,rec->comm),p % 3 ? "mpirun" : "nginx") ||
+	  strcmp(summary_snapshot_string(&view,rec->job_id),p % 2 ? "" : "job42")) {
+	SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Record %D has the wrong strings",i);
+      }
+    }
+  }
+  /* every empty string is the one at the start of the table */
+  if (view.records[1].job_id != 0 || view.strings[0]) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"The string table does not start with the empty string");
+  }
+  for (r=0; r<TEST_NRANKS; ++r) {
+    snprintf(host,sizeof(host),"node%d",(int)r);
+    if (view.nodes[r].rank != r || strcmp(summary_snapshot_string(&view,view.nodes[r].host),host) ||
+	view.nodes[r].total[NUM_NODE_COUNTERS-1] != r*100 + NUM_NODE_COUNTERS-1) {
+      SETERRQ1(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Node record %D is wrong or out of order",r);
+    }
+  }
+  name = summary_snapshot_string(&view,view.header->counter_names);
+  for (c=0; c<NUM_NODE_COUNTERS; ++c) {
+    if (strcmp(name,NodeCounters[c])) {
+      SETERRQ2(PETSC_COMM_SELF,PETSC_ERR_PLIB,"Counter name %D is %s",c,name);
+    }
+    name += strlen(name) + 1;
+  }
+  /* anything but a whole snapshot is refused */
+  if (summary_snapshot_view_init(&view,data,size-1) != PETSC_ERR_FILE_UNEXPECTED) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A truncated snapshot was accepted");
+  }
+  data[0] = 'X';
+  if (summary_snapshot_view_init(&view,data,size) != PETSC_ERR_FILE_UNEXPECTED) {
+    SETERRQ(PETSC_COMM_SELF,PETSC_ERR_PLIB,"A snapshot with a bad magic was accepted");
+  }
+  ierr = PetscFree(data);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+  PetscErrorCode   ierr;
+  summary_snapshot snap;
+  ierr = PetscInitialize(&argc,&argv,NULL,NULL);  if (ierr) return ierr;
+  unlink(TEST_SNAPSHOT_FILE);
+
+  ierr = summary_snapshot_create(&snap,TEST_SNAPSHOT_FILE);CHKERRQ(ierr);
+  ierr = add_records(&snap);CHKERRQ(ierr);
+  ierr = summary_snapshot_seal(&snap,1000);CHKERRQ(ierr);
+  ierr = summary_snapshot_write(&snap);CHKERRQ(ierr);
+  ierr = check_snapshot(1);CHKERRQ(ierr);
+
+  /* the next snapshot starts over rather than adding to the last one */
+  ierr = add_records(&snap);CHKERRQ(ierr);
+  ierr = summary_snapshot_seal(&snap,2000);CHKERRQ(ierr);
+  ierr = summary_snapshot_write(&snap);CHKERRQ(ierr);
+  ierr = check_snapshot(2);CHKERRQ(ierr);
+  ierr = summary_snapshot_destroy(&snap);CHKERRQ(ierr);
+
+  /* a restarted writer carries on from the epoch in the file */
+  ierr = summary_snapshot_create(&snap,TEST_SNAPSHOT_FILE);CHKERRQ(ierr);
+  ierr = add_records(&snap);CHKERRQ(ierr);
+  ierr = summary_snapshot_seal(&snap,3000);CHKERRQ(ierr);
+  ierr = summary_snapshot_write(&snap);CHKERRQ(ierr);
+  ierr = check_snapshot(3);CHKERRQ(ierr);
+  ierr = summary_snapshot_destroy(&snap);CHKERRQ(ierr);
+  unlink(TEST_SNAPSHOT_FILE);
+
+  PetscPrintf(PETSC_COMM_WORLD,"All summary snapshot tests passed\n");
+  PetscFinalize();
+  return 0;
+}